@@ -11,10 +11,22 @@ public:
     using invalid_argument::invalid_argument;
 };
 
+struct MeshConversionParams
+{
+    std::string input_filename;
+    std::string output_filename;
+
+    bool quantize_normal = false;
+    bool quantize_uv     = false;
+};
+
 struct Params
 {
     std::string scene_description;
     std::string scene_filename;
+
+    // convert a mesh to .bm v2 instead of rendering
+    std::optional<MeshConversionParams> mesh_conversion;
 };
 
 /*
@@ -23,5 +35,9 @@ struct Params
         -d only: load scene desc from SceneDescriptionFilename
         -s only: use SceneDescription as scene desc and assume that it's loaded from './scene.txt'
         -d and -s: use SceneDescription as scene desc and assume that it's loaded from SceneDescriptionFilename
+
+    --convert-mesh InputMeshFilename -o,--output OutputFilename [--quantize-normal] [--quantize-uv]
+
+        convert a mesh (.bm v1/v2, .obj, etc) to .bm v2 file and exit
 */
 std::optional<Params> parse_opts(int argc, char *argv[]);
@@ -17,6 +17,22 @@ void run(int argc, char *argv[])
     if(!params)
         return;
 
+    if(params->mesh_conversion)
+    {
+        const auto &conversion = *params->mesh_conversion;
+
+        agz::tracer::factory::BinMeshV2Params bin_mesh_params;
+        bin_mesh_params.quantize_normal = conversion.quantize_normal;
+        bin_mesh_params.quantize_uv     = conversion.quantize_uv;
+
+        AGZ_INFO("convert {} to {}",
+                 conversion.input_filename, conversion.output_filename);
+        agz::tracer::factory::convert_to_bin_mesh_v2(
+            conversion.input_filename, conversion.output_filename,
+            bin_mesh_params);
+        return;
+    }
+
 #ifdef USE_EMBREE
         AGZ_INFO("initializing embree device");
         agz::tracer::init_embree_device();
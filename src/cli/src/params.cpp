@@ -9,6 +9,10 @@ std::optional<Params> parse_opts(int argc, char *argv[])
     opts.add_options("")
         ("s,scene", "scene description", cxxopts::value<std::string>())
         ("d,scene-filename", "scene description filename", cxxopts::value<std::string>())
+        ("convert-mesh", "convert mesh file to .bm v2 file", cxxopts::value<std::string>())
+        ("o,output", "output filename of mesh conversion", cxxopts::value<std::string>())
+        ("quantize-normal", "store octahedral-encoded normals in converted mesh")
+        ("quantize-uv", "store 16-bit uvs in converted mesh")
         ("h,help", "help information");
     auto parse_result = opts.parse(argc, argv);
 
@@ -20,6 +24,21 @@ std::optional<Params> parse_opts(int argc, char *argv[])
 
     Params ret;
 
+    if(parse_result.count("convert-mesh"))
+    {
+        if(!parse_result.count("output"))
+            throw ParamParsingException("output filename of mesh conversion is unspecified");
+
+        MeshConversionParams conversion;
+        conversion.input_filename  = parse_result["convert-mesh"].as<std::string>();
+        conversion.output_filename = parse_result["output"].as<std::string>();
+        conversion.quantize_normal = parse_result.count("quantize-normal") != 0;
+        conversion.quantize_uv     = parse_result.count("quantize-uv") != 0;
+
+        ret.mesh_conversion = conversion;
+        return ret;
+    }
+
     const bool has_scene_content  = parse_result.count("scene") != 0;
     const bool has_scene_filename = parse_result.count("scene-filename") != 0;
 
@@ -86,8 +86,11 @@ RC<tracer::ConfigNode> TriangleBVHWidget::to_config(JSONExportContext &ctx) cons
 
     const auto [ref_filename, filename] = ctx.gen_filename(".bm");
 
-    tracer::factory::save_bin_mesh(
-        filename, vertices_->data(), vertices_->size() / 3);
+    // v2 meshes are indexed and memory-mapped by the tracer
+    static_assert(sizeof(mesh::triangle_t) == 3 * sizeof(Vertex));
+    tracer::factory::save_bin_mesh_v2(
+        filename, reinterpret_cast<const mesh::triangle_t*>(vertices_->data()),
+        vertices_->size() / 3);
 
     grp->insert_str("filename", ref_filename);
 
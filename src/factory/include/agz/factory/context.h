@@ -1,9 +1,11 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <unordered_map>
 
 #include <agz/tracer/utility/config.h>
@@ -110,6 +112,8 @@ class CreatingContext
         Texture2D,
         Texture3D> factory_tuple_;
 
+    std::map<std::string, std::shared_ptr<void>> shared_objects_;
+
 public:
 
     CreatingContext();
@@ -125,6 +129,15 @@ public:
 
     template<typename T, typename...Args>
     RC<T> create(const ConfigGroup &params, Args&&...args);
+
+    /**
+     * @brief get object shared by multiple created objects
+     *
+     * create_func is called to create the object when no object has been
+     * stored with given key
+     */
+    template<typename T, typename F>
+    RC<T> get_or_create_shared(const std::string &key, F &&create_func);
 };
 
 template<typename T>
@@ -299,4 +312,16 @@ RC<T> CreatingContext::create(const ConfigGroup &params, Args&&...args)
         "in creating object with factory: " + this->factory<T>().name())
 }
 
+template<typename T, typename F>
+RC<T> CreatingContext::get_or_create_shared(
+    const std::string &key, F &&create_func)
+{
+    if(auto it = shared_objects_.find(key); it != shared_objects_.end())
+        return std::static_pointer_cast<T>(it->second);
+
+    RC<T> ret = create_func();
+    shared_objects_[key] = std::const_pointer_cast<std::remove_const_t<T>>(ret);
+    return ret;
+}
+
 AGZ_TRACER_FACTORY_END
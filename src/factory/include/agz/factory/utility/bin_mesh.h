@@ -1,14 +1,180 @@
 #pragma once
 
+#include <cstddef>
+
 #include <agz/tracer/common.h>
+#include <agz/tracer/create/geometry.h>
+#include <agz/tracer/utility/mapped_file.h>
 #include <agz-utils/mesh.h>
+#include <agz-utils/misc.h>
 
 AGZ_TRACER_FACTORY_BEGIN
 
-std::vector<mesh::triangle_t> load_bin_mesh(const std::string &filename);
+/*
+    .bm v1: size_t triangle_count + mesh::triangle_t[triangle_count]
+
+    .bm v2: indexed mesh which can be memory-mapped and decoded in parallel
+
+        BinMeshHeader
+        BinMeshChunk[chunk_count]
+        float    position[vertex_count][3]
+        float    normal[vertex_count][3]    | int16_t  normal[vertex_count][2]
+        float    tex_coord[vertex_count][2] | uint16_t tex_coord[vertex_count][2]
+        uint32_t index[triangle_count][3]
+
+    each section starts at a 64-byte aligned offset recorded in the header.
+    quantized normals are octahedral-encoded. quantized uvs are 16-bit
+    fixed-point numbers in [uv_low, uv_low + 65535 * uv_scale].
+    vertices are stored in the order of their first use, so each chunk of
+    triangles references a narrow range of vertices
+*/
+
+constexpr uint32_t BIN_MESH_V2_QUANTIZED_NORMAL = 1u << 0;
+constexpr uint32_t BIN_MESH_V2_QUANTIZED_UV     = 1u << 1;
+
+struct BinMeshHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+
+    uint32_t chunk_count;
+    uint32_t chunk_triangle_count;
+
+    float uv_low[2];
+    float uv_scale[2];
+
+    uint64_t chunk_offset;
+    uint64_t position_offset;
+    uint64_t normal_offset;
+    uint64_t tex_coord_offset;
+    uint64_t index_offset;
+};
+
+static_assert(sizeof(BinMeshHeader) == 96);
+static_assert(offsetof(BinMeshHeader, vertex_count)    == 16);
+static_assert(offsetof(BinMeshHeader, chunk_count)     == 32);
+static_assert(offsetof(BinMeshHeader, uv_low)          == 40);
+static_assert(offsetof(BinMeshHeader, chunk_offset)    == 56);
+static_assert(offsetof(BinMeshHeader, index_offset)    == 88);
+
+struct BinMeshChunk
+{
+    uint64_t first_triangle;
+    uint32_t triangle_count;
+
+    // range of referenced vertices: [vertex_beg, vertex_end)
+    uint32_t vertex_beg;
+    uint32_t vertex_end;
+
+    float bound_low[3];
+    float bound_high[3];
+
+    uint32_t pad;
+};
+
+static_assert(sizeof(BinMeshChunk) == 48);
+static_assert(offsetof(BinMeshChunk, vertex_beg) == 12);
+static_assert(offsetof(BinMeshChunk, bound_low)  == 20);
+static_assert(offsetof(BinMeshChunk, pad)        == 44);
+
+struct BinMeshV2Params
+{
+    bool quantize_normal = false;
+    bool quantize_uv     = false;
+
+    uint32_t chunk_triangle_count = 1u << 16;
+};
 
+/**
+ * @brief read-only view of a memory-mapped .bm v2 file
+ */
+class BinMeshView : public misc::uncopyable_t
+{
+public:
+
+    /**
+     * @brief map and validate a .bm v2 file
+     *
+     * throw std::runtime_error when the file is not a valid .bm v2 file
+     */
+    explicit BinMeshView(const std::string &filename);
+
+    size_t vertex_count() const noexcept;
+
+    size_t triangle_count() const noexcept;
+
+    uint32_t chunk_count() const noexcept;
+
+    const BinMeshChunk &chunk(uint32_t idx) const noexcept;
+
+    /**
+     * @brief decode triangles [beg, end) into output
+     */
+    void decode(size_t beg, size_t end, mesh::triangle_t *output) const noexcept;
+
+    /**
+     * @brief indexed mesh referencing the mapped positions and indices
+     *
+     * normals and uvs are decoded on demand. the view is valid only during
+     * the lifetime of this object.
+     * throw std::runtime_error when there are more than 2^32 - 1 triangles
+     */
+    IndexedTriangleMeshView indexed_view() const;
+
+private:
+
+    mesh::vertex_t vertex(uint32_t idx) const noexcept;
+
+    MappedFile file_;
+    BinMeshHeader header_;
+
+    const BinMeshChunk *chunks_;
+    const float        *positions_;
+    const void         *normals_;
+    const void         *tex_coords_;
+    const uint32_t     *indices_;
+};
+
+/**
+ * @brief check whether the given file starts with .bm v2 header
+ */
+bool is_bin_mesh_v2(const std::string &filename);
+
+/**
+ * @brief load triangles from .bm v1/v2 file
+ *
+ * chunks of v2 files are decoded by worker_count threads.
+ * non-positive worker_count means (hardware thread count + worker_count)
+ */
+std::vector<mesh::triangle_t> load_bin_mesh(
+    const std::string &filename, int worker_count = 0);
+
+/**
+ * @brief save triangles to .bm v1 file
+ */
 void save_bin_mesh(
     const std::string &filename,
     const void *triangles, size_t triangle_count);
 
+/**
+ * @brief save triangles to .bm v2 file. identical vertices are merged
+ */
+void save_bin_mesh_v2(
+    const std::string &filename,
+    const mesh::triangle_t *triangles, size_t triangle_count,
+    const BinMeshV2Params &params = {});
+
+/**
+ * @brief convert a mesh file (.bm v1/v2 or any format supported by
+ *  mesh::load_from_file) to .bm v2 file
+ */
+void convert_to_bin_mesh_v2(
+    const std::string &input_filename,
+    const std::string &output_filename,
+    const BinMeshV2Params &params = {});
+
 AGZ_TRACER_FACTORY_END
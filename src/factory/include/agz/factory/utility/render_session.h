@@ -5,6 +5,7 @@
 #include <agz/tracer/core/renderer.h>
 #include <agz/factory/factory.h>
 #include <agz/tracer/utility/config.h>
+#include <agz/tracer/utility/task_scheduler.h>
 
 AGZ_TRACER_BEGIN
 
@@ -25,6 +26,16 @@ public:
 
         real eps = real(3e-4);
 
+        // memory budget of texture tile cache
+        size_t texture_cache_bytes = size_t(2048) << 20;
+
+        // cpu affinity of worker threads
+        TaskScheduler::Affinity thread_affinity = TaskScheduler::Affinity::None;
+
+        // where to write the json statistics report. only used when the
+        // tracer is built with ENABLE_STATS
+        std::string stats_filename;
+
         RC<Camera>                     camera;
         RC<FilmFilter>                 film_filter;
         RC<Renderer>                   renderer;
@@ -23,8 +23,17 @@ namespace envir_light
             const bool no_importance_sampling = params.child_int_or(
                 "no_importance_sampling", 0) != 0;
             const real power = params.child_real_or("power", -1);
+            const int sampling_resolution = params.child_int_or(
+                "sampling_resolution", 4096);
+            if(sampling_resolution <= 0)
+            {
+                throw ObjectConstructionException(
+                    "invalid sampling resolution: " +
+                    std::to_string(sampling_resolution));
+            }
             return create_ibl_light(
-                std::move(tex), no_importance_sampling, power);
+                std::move(tex), no_importance_sampling, power,
+                sampling_resolution);
         }
     };
 
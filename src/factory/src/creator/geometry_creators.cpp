@@ -1,7 +1,13 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
 #include <agz/factory/creator/geometry_creators.h>
 #include <agz/factory/utility/bin_mesh.h>
 #include <agz/tracer/create/geometry.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/mapped_file.h>
 
 AGZ_TRACER_FACTORY_BEGIN
 
@@ -15,6 +21,233 @@ namespace geometry
         return mesh::load_from_file(filename);
     }
     
+    TriangleBVHNoEmbreeParams parse_triangle_bvh_params(
+        const ConfigGroup &params)
+    {
+        TriangleBVHNoEmbreeParams bvh_params;
+        bvh_params.max_leaf_size      =
+            params.child_int_or("max_leaf_size", 5);
+        bvh_params.build_worker_count =
+            params.child_int_or("build_worker_count", 0);
+
+        const std::string builder = params.child_str_or("builder", "midpoint");
+        if(builder == "sah")
+            bvh_params.use_sah = true;
+        else if(builder != "midpoint")
+            throw CreatingObjectException("unknown bvh builder: " + builder);
+
+        bvh_params.sah_bin_count      =
+            params.child_int_or("sah_bin_count", 16);
+        bvh_params.sah_leaf_cost      =
+            params.child_real_or("sah_leaf_cost", 1);
+        bvh_params.sah_traversal_cost =
+            params.child_real_or("sah_traversal_cost", 1);
+
+        const std::string layout = params.child_str_or("layout", "binary");
+        if(layout == "bvh4")
+            bvh_params.layout = TriangleBVHNoEmbreeParams::Layout::Wide4;
+        else if(layout == "compact")
+            bvh_params.layout = TriangleBVHNoEmbreeParams::Layout::Compact;
+        else if(layout != "binary")
+            throw CreatingObjectException("unknown bvh layout: " + layout);
+
+        return bvh_params;
+    }
+
+    // key of shared triangle bvh mesh in creating context
+    std::string triangle_bvh_mesh_key(
+        const std::string &filename, const TriangleBVHNoEmbreeParams &params)
+    {
+        return "triangle_bvh_mesh:" + filename
+             + ":" + std::to_string(params.max_leaf_size)
+             + ":" + std::to_string(params.use_sah)
+             + ":" + std::to_string(params.sah_bin_count)
+             + ":" + std::to_string(params.sah_leaf_cost)
+             + ":" + std::to_string(params.sah_traversal_cost)
+             + ":" + std::to_string(static_cast<int>(params.layout));
+    }
+
+    constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+    // 64-bit fnv-1a over bytes. not finalized, so that data can be fed
+    // in pieces
+    uint64_t hash_bytes(const void *data, size_t bytes, uint64_t seed)
+    {
+        constexpr uint64_t PRIME = 1099511628211ull;
+
+        auto src = static_cast<const unsigned char*>(data);
+        uint64_t ret = seed;
+        for(size_t i = 0; i < bytes; ++i)
+            ret = (ret ^ src[i]) * PRIME;
+
+        return ret;
+    }
+
+    // murmur3 fmix64, spreading every input bit over the whole hash value
+    uint64_t finalize_hash(uint64_t h) noexcept
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    std::string hash_to_str(uint64_t hash)
+    {
+        char ret[17];
+        std::snprintf(
+            ret, sizeof(ret), "%016llx",
+            static_cast<unsigned long long>(hash));
+        return ret;
+    }
+
+    /*
+     * hash of mesh file content
+     *
+     * hashing a huge mesh costs seconds, so the result is recorded in
+     * cache_dir by a stamp file keyed on path, size and modification time of
+     * the mesh file. the content is hashed again only when the stamp is
+     * missing or any of these changes
+     */
+    uint64_t mesh_content_hash(
+        const std::filesystem::path &cache_dir, const std::string &mesh_filename)
+    {
+        const auto abs_path  = std::filesystem::absolute(mesh_filename).string();
+        const auto file_size = std::filesystem::file_size(mesh_filename);
+        const auto mtime     = std::filesystem::last_write_time(mesh_filename)
+                                .time_since_epoch().count();
+
+        uint64_t stamp_hash = hash_bytes(abs_path.data(), abs_path.size(), HASH_SEED);
+        stamp_hash = hash_bytes(&file_size, sizeof(file_size), stamp_hash);
+        stamp_hash = hash_bytes(&mtime, sizeof(mtime), stamp_hash);
+
+        const std::filesystem::path stamp_path =
+            cache_dir / (hash_to_str(finalize_hash(stamp_hash)) + ".bvhk");
+
+        // stamp file contains exactly 16 hex digits
+        {
+            std::ifstream fin(stamp_path, std::ios::binary);
+            char stamp[17] = {};
+            if(fin.read(stamp, 16) && fin.get() == EOF)
+            {
+                char *end;
+                const auto ret = std::strtoull(stamp, &end, 16);
+                if(end == stamp + 16)
+                    return ret;
+            }
+        }
+
+        AGZ_INFO("hash mesh content: {}", mesh_filename);
+
+        uint64_t ret;
+        {
+            const MappedFile mesh_file(mesh_filename);
+            ret = finalize_hash(
+                hash_bytes(mesh_file.data(), mesh_file.size(), HASH_SEED));
+        }
+
+        // a failed stamp write only costs rehashing next time
+        std::error_code err;
+        std::filesystem::create_directories(cache_dir, err);
+        std::ofstream fout(stamp_path, std::ios::binary | std::ios::trunc);
+        fout << hash_to_str(ret);
+
+        return ret;
+    }
+
+    /*
+     * path of bvh cache file, which is determined by content of mesh file,
+     * bvh params and the transform baked into the cache
+     *
+     * returns empty string when bvh_cache_dir is not specified
+     */
+    std::string triangle_bvh_cache_filename(
+        const ConfigGroup &params, CreatingContext &context,
+        const std::string &mesh_filename,
+        const TriangleBVHNoEmbreeParams &bvh_params,
+        const FTransform3 *baked_local_to_world)
+    {
+        const std::string cache_dir = params.child_str_or("bvh_cache_dir", "");
+        if(cache_dir.empty())
+            return {};
+
+        const std::filesystem::path dir = context.path_mapper->map(cache_dir);
+
+        // filename is excluded so that moved or copied meshes share the cache
+        const uint64_t content_hash = mesh_content_hash(dir, mesh_filename);
+        uint64_t hash = hash_bytes(&content_hash, sizeof(content_hash), HASH_SEED);
+
+        const std::string params_key = triangle_bvh_mesh_key({}, bvh_params);
+        hash = hash_bytes(params_key.data(), params_key.size(), hash);
+
+        if(baked_local_to_world)
+        {
+            const FVec3 transformed[4] = {
+                baked_local_to_world->apply_to_point({ 0, 0, 0 }),
+                baked_local_to_world->apply_to_vector({ 1, 0, 0 }),
+                baked_local_to_world->apply_to_vector({ 0, 1, 0 }),
+                baked_local_to_world->apply_to_vector({ 0, 0, 1 })
+            };
+            hash = hash_bytes(transformed, sizeof(transformed), hash);
+        }
+
+        return (dir / (hash_to_str(finalize_hash(hash)) + ".bvhc")).string();
+    }
+
+    /*
+     * whether to build the bvh from a memory-mapped .bm v2 mesh, which is
+     * read in place instead of being expanded into triangles
+     *
+     * building a binary bvh cache still needs the expanded triangles
+     */
+    bool build_from_indexed_mesh(
+        const std::string &filename, const std::string &cache_filename,
+        const TriangleBVHNoEmbreeParams &bvh_params)
+    {
+        if(!cache_filename.empty() &&
+           bvh_params.layout == TriangleBVHNoEmbreeParams::Layout::Binary)
+            return false;
+        return stdstr::ends_with(filename, ".bm") && is_bin_mesh_v2(filename);
+    }
+
+    // triangle bvh with vertices transformed into world space
+    RC<Geometry> create_world_triangle_bvh(
+        const ConfigGroup &params, CreatingContext &context,
+        const std::string &filename, const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &bvh_params)
+    {
+        auto load_triangles = [&]
+        {
+            AGZ_INFO("load mesh from {}", filename);
+            auto build_triangles = load_triangle_mesh_from_file(filename);
+            AGZ_INFO("triangle count: {}", build_triangles.size());
+            return build_triangles;
+        };
+
+        const auto cache_filename = triangle_bvh_cache_filename(
+            params, context, filename, bvh_params, &local_to_world);
+
+        if(build_from_indexed_mesh(filename, cache_filename, bvh_params))
+        {
+            AGZ_INFO("map indexed mesh from {}", filename);
+            const BinMeshView view(filename);
+            AGZ_INFO("triangle count: {}", view.triangle_count());
+            return create_triangle_bvh_noembree(
+                view.indexed_view(), local_to_world, bvh_params);
+        }
+
+        if(!cache_filename.empty())
+        {
+            return create_cached_triangle_bvh_noembree(
+                cache_filename, load_triangles, local_to_world, bvh_params);
+        }
+
+        return create_triangle_bvh_noembree(
+            load_triangles(), local_to_world, bvh_params);
+    }
+
     class DiskCreator : public Creator<Geometry>
     {
     public:
@@ -157,12 +390,74 @@ namespace geometry
             const auto local_to_world = params.child_transform3("transform");
             const auto filename = context.path_mapper->map(params.child_str("filename"));
 
-            AGZ_INFO("load mesh from {}", filename);
-            auto build_triangles = load_triangle_mesh_from_file(filename);
-            AGZ_INFO("triangle count: {}", build_triangles.size());
+            const auto bvh_params = parse_triangle_bvh_params(params);
 
-            return create_triangle_bvh_noembree(
-                std::move(build_triangles), local_to_world);
+            return create_world_triangle_bvh(
+                params, context, filename, local_to_world, bvh_params);
+        }
+    };
+
+    class TriangleBVHInstanceCreator : public Creator<Geometry>
+    {
+    public:
+
+        std::string name() const override
+        {
+            return "triangle_bvh_instance";
+        }
+
+        RC<Geometry> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            const auto local_to_world = params.child_transform3("transform");
+            const auto filename = context.path_mapper->map(params.child_str("filename"));
+
+            const auto bvh_params = parse_triangle_bvh_params(params);
+
+            // the shared mesh can't represent non-uniform scaling or shearing,
+            // so this instance gets its own bvh in world space instead
+            if(!is_similarity_transform(local_to_world))
+            {
+                AGZ_INFO(
+                    "transform of triangle_bvh_instance {} is not a similarity "
+                    "transform. build a separate bvh for it", filename);
+                return create_world_triangle_bvh(
+                    params, context, filename, local_to_world, bvh_params);
+            }
+
+            auto mesh = context.get_or_create_shared<const TriangleBVHMesh>(
+                triangle_bvh_mesh_key(filename, bvh_params), [&]
+            {
+                auto load_triangles = [&]
+                {
+                    AGZ_INFO("load mesh from {}", filename);
+                    auto build_triangles = load_triangle_mesh_from_file(filename);
+                    AGZ_INFO("triangle count: {}", build_triangles.size());
+                    return build_triangles;
+                };
+
+                const auto cache_filename = triangle_bvh_cache_filename(
+                    params, context, filename, bvh_params, nullptr);
+
+                if(build_from_indexed_mesh(filename, cache_filename, bvh_params))
+                {
+                    AGZ_INFO("map indexed mesh from {}", filename);
+                    const BinMeshView view(filename);
+                    AGZ_INFO("triangle count: {}", view.triangle_count());
+                    return create_triangle_bvh_mesh(
+                        view.indexed_view(), bvh_params);
+                }
+
+                if(!cache_filename.empty())
+                {
+                    return create_cached_triangle_bvh_mesh(
+                        cache_filename, load_triangles, bvh_params);
+                }
+
+                return create_triangle_bvh_mesh(load_triangles(), bvh_params);
+            });
+
+            return create_triangle_bvh_instance(std::move(mesh), local_to_world);
         }
     };
 
@@ -226,6 +521,7 @@ void initialize_geometry_factory(Factory<Geometry> &factory)
     factory.add_creator(newBox<geometry::TriangleCreator>());
     factory.add_creator(newBox<geometry::TriangleBVHCreator>());
     factory.add_creator(newBox<geometry::TriangleBVHNoEmbreeCreator>());
+    factory.add_creator(newBox<geometry::TriangleBVHInstanceCreator>());
 #ifdef USE_EMBREE
     factory.add_creator(newBox<geometry::TriangleBVHEmbreeCreator>());
 #endif
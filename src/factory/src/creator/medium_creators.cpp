@@ -31,10 +31,29 @@ namespace medium
             const bool white_for_indirect =
                 params.child_int_or("white_for_indirect", 0) != 0;
 
+            TransmittanceEstimatorParams tr_params;
+
+            const std::string tr_estimator =
+                params.child_str_or("tr_estimator", "ratio");
+            if(tr_estimator == "ratio")
+                tr_params.type = TransmittanceEstimator::Ratio;
+            else if(tr_estimator == "residual_ratio")
+                tr_params.type = TransmittanceEstimator::ResidualRatio;
+            else
+            {
+                throw CreatingObjectException(
+                    "unknown transmittance estimator: " + tr_estimator);
+            }
+
+            tr_params.control_density_ratio = params.child_real_or(
+                "control_density_ratio", tr_params.control_density_ratio);
+            tr_params.rr_threshold = params.child_real_or(
+                "tr_rr_threshold", tr_params.rr_threshold);
+
             return create_heterogeneous_medium(
                 local_to_world, std::move(density),
                 std::move(albedo), std::move(g),
-                max_scat_count, white_for_indirect);
+                max_scat_count, white_for_indirect, tr_params);
         }
     };
 
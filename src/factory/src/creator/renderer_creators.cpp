@@ -6,6 +6,20 @@ AGZ_TRACER_FACTORY_BEGIN
 namespace renderer
 {
 
+    PixelSamplerType parse_pixel_sampler_type(const ConfigGroup &params)
+    {
+        const std::string type = params.child_str_or("sampler", "native");
+        if(type == "native")
+            return PixelSamplerType::Native;
+        if(type == "sobol")
+            return PixelSamplerType::Sobol;
+        if(type == "halton")
+            return PixelSamplerType::Halton;
+        if(type == "blue_noise")
+            return PixelSamplerType::BlueNoise;
+        throw CreatingObjectException("unknown sampler type: " + type);
+    }
+
     class AORendererCreator : public Creator<Renderer>
     {
     public:
@@ -39,6 +53,8 @@ namespace renderer
 
             ao_params.spp = params.child_int("spp");
 
+            ao_params.sampler = parse_pixel_sampler_type(params);
+
             return create_ao_renderer(ao_params);
         }
     };
@@ -136,6 +152,10 @@ namespace renderer
 
             const int specular_depth = params.child_int_or("specular_depth", 20);
 
+            const bool adaptive     = params.child_int_or("adaptive", 0) != 0;
+            const real target_error = params.child_real_or("target_error", real(0.01));
+            const int  max_spp      = params.child_int_or("max_spp", 4 * spp);
+
             PTRendererParams pt_params;
             pt_params.worker_count      = worker_count;
             pt_params.task_grid_size    = task_grid_size;
@@ -145,11 +165,55 @@ namespace renderer
             pt_params.cont_prob         = cont_prob;
             pt_params.use_mis           = use_mis;
             pt_params.specular_depth    = specular_depth;
+            pt_params.sampler           = parse_pixel_sampler_type(params);
+            pt_params.adaptive          = adaptive;
+            pt_params.target_error      = target_error;
+            pt_params.max_spp           = max_spp;
 
             return create_pt_renderer(pt_params);
         }
     };
 
+    class PathTracingWavefrontRendererCreator : public Creator<Renderer>
+    {
+    public:
+
+        std::string name() const override
+        {
+            return "pt_wavefront";
+        }
+
+        RC<Renderer> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            PTWavefrontRendererParams p;
+
+            p.worker_count   =
+                params.child_int_or("worker_count", p.worker_count);
+            p.task_grid_size =
+                params.child_int_or("task_grid_size", p.task_grid_size);
+            p.spp            =
+                params.child_int("spp");
+            p.min_depth      =
+                params.child_int_or("min_depth", p.min_depth);
+            p.max_depth      =
+                params.child_int_or("max_depth", p.max_depth);
+            p.cont_prob      =
+                params.child_real_or("cont_prob", p.cont_prob);
+            p.specular_depth =
+                params.child_int_or("specular_depth", p.specular_depth);
+            p.queue_size     =
+                params.child_int_or("queue_size", p.queue_size);
+            p.sampler        = parse_pixel_sampler_type(params);
+
+            if(p.queue_size <= 0)
+                throw CreatingObjectException(
+                    "invalid queue size: " + std::to_string(p.queue_size));
+
+            return create_pt_wavefront_renderer(p);
+        }
+    };
+
     class PSSMLTPTCreator : public Creator<Renderer>
     {
     public:
@@ -288,6 +352,7 @@ void initialize_renderer_factory(Factory<Renderer> &factory)
     factory.add_creator(newBox<renderer::AORendererCreator>());
     factory.add_creator(newBox<renderer::ParticleTracingRendererCreator>());
     factory.add_creator(newBox<renderer::PathTracingRendererCreator>());
+    factory.add_creator(newBox<renderer::PathTracingWavefrontRendererCreator>());
     factory.add_creator(newBox<renderer::PSSMLTPTCreator>());
     factory.add_creator(newBox<renderer::ReSTIRRendererCreator>());
     factory.add_creator(newBox<renderer::ReSTIRGIRendererCreator>());
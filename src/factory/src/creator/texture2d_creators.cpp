@@ -1,6 +1,12 @@
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <thread>
+
 #include <agz/factory/creator/texture2d_creators.h>
 #include <agz/tracer/create/texture2d.h>
 #include <agz/tracer/create/texture3d.h>
+#include <agz/tracer/utility/logger.h>
 #include <agz-utils/image.h>
 
 AGZ_TRACER_FACTORY_BEGIN
@@ -145,6 +151,115 @@ namespace texture
         }
     };
 
+    /*
+     * convert source image to a tiled texture file when the file is missing
+     * or older than the source. hdr images are stored as float texels
+     */
+    void update_tiled_texture(
+        const std::string &filename, const std::string &source, int tile_size)
+    {
+        namespace fs = std::filesystem;
+
+        if(fs::exists(filename) &&
+           fs::last_write_time(filename) >= fs::last_write_time(source))
+            return;
+
+        AGZ_INFO("convert {} to tiled texture {}", source, filename);
+
+        // written to a unique temporary file and then renamed, so that
+        // concurrent renders never open a partial file
+        std::random_device rd;
+        char suffix[64];
+        std::snprintf(
+            suffix, sizeof(suffix), ".%016zx.%08x%08x.tmp",
+            std::hash<std::thread::id>()(std::this_thread::get_id()),
+            static_cast<unsigned>(rd()), static_cast<unsigned>(rd()));
+        const std::string tmp_filename = filename + suffix;
+
+        try
+        {
+            const fs::path path(filename);
+            if(path.has_parent_path())
+                fs::create_directories(path.parent_path());
+
+            if(stdstr::ends_with(source, ".hdr"))
+            {
+                const auto data = img::load_rgb_from_hdr_file(source);
+                if(!data.is_available())
+                    throw ObjectConstructionException(
+                        "failed to load texture from " + source);
+                save_tiled_texture(tmp_filename, data, tile_size);
+            }
+            else
+            {
+                const auto data = img::load_rgb_from_file(source);
+                if(!data.is_available())
+                    throw ObjectConstructionException(
+                        "failed to load texture from " + source);
+                save_tiled_texture(tmp_filename, data, tile_size);
+            }
+
+            fs::rename(tmp_filename, filename);
+        }
+        catch(const std::exception &err)
+        {
+            std::error_code ec;
+            fs::remove(tmp_filename, ec);
+            throw ObjectConstructionException(err.what());
+        }
+    }
+
+    class TiledImageCreator : public Creator<Texture2D>
+    {
+        mutable std::map<std::string, RC<const TiledTextureFile>>
+            filename2file_;
+
+    public:
+
+        std::string name() const override
+        {
+            return "tiled_image";
+        }
+
+        RC<Texture2D> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            const auto common_params = init_common_params(params);
+            const auto filename =
+                context.path_mapper->map(params.child_str("filename"));
+            const auto sample =
+                params.child_str_or("sample", "linear");
+
+            RC<const TiledTextureFile> file;
+            if(auto it = filename2file_.find(filename);
+               it != filename2file_.end())
+                file = it->second;
+            else
+            {
+                if(params.find_child("source"))
+                {
+                    const auto source =
+                        context.path_mapper->map(params.child_str("source"));
+                    const int tile_size = params.child_int_or("tile_size", 64);
+                    update_tiled_texture(filename, source, tile_size);
+                }
+
+                try
+                {
+                    file = newRC<TiledTextureFile>(filename);
+                }
+                catch(const std::exception &err)
+                {
+                    throw ObjectConstructionException(err.what());
+                }
+                filename2file_[filename] = file;
+            }
+
+            return create_tiled_image_texture(
+                common_params, std::move(file), sample);
+        }
+    };
+
     class SolidImageCreator : public Creator<Texture2D>
     {
     public:
@@ -171,6 +286,7 @@ void initialize_texture2d_factory(Factory<Texture2D> &factory)
     factory.add_creator(newBox<texture::HDRCreator>());
     factory.add_creator(newBox<texture::ImageCreator>());
     factory.add_creator(newBox<texture::SolidImageCreator>());
+    factory.add_creator(newBox<texture::TiledImageCreator>());
 }
 
 AGZ_TRACER_FACTORY_END
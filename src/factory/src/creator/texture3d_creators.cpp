@@ -206,12 +206,48 @@ namespace
         }
     };
 
+    class SparseBrickTexture3DCreator : public Creator<Texture3D>
+    {
+    public:
+
+        std::string name() const override
+        {
+            return "sparse_brick3d";
+        }
+
+        RC<Texture3D> create(
+            const ConfigGroup &params, CreatingContext &context) const override
+        {
+            const Texture3DCommonParams common_params = parse_common_params(params);
+            const std::string sampling_strategy = params.child_str_or(
+                "sampler", "linear");
+            const bool use_linear_sampler = sampling_strategy == "linear";
+
+            const std::string filename = context.path_mapper->map(
+                params.child_str("filename"));
+
+            RC<const SparseBrickVolume> volume;
+            try
+            {
+                volume = newRC<SparseBrickVolume>(filename);
+            }
+            catch(const std::exception &err)
+            {
+                throw ObjectConstructionException(err.what());
+            }
+
+            return create_sparse_brick3d(
+                common_params, std::move(volume), use_linear_sampler);
+        }
+    };
+
 }
 
 void initialize_texture3d_factory(Factory<Texture3D> &factory)
 {
     factory.add_creator(newBox<Constant3DCreator>());
     factory.add_creator(newBox<ImageTexture3DCreator>());
+    factory.add_creator(newBox<SparseBrickTexture3DCreator>());
 }
 
 AGZ_TRACER_FACTORY_END
@@ -1,27 +1,330 @@
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <unordered_map>
 
 #include <agz/factory/utility/bin_mesh.h>
+#include <agz/tracer/utility/parallel_grid.h>
+#include <agz-utils/thread.h>
 
 AGZ_TRACER_FACTORY_BEGIN
 
-std::vector<mesh::triangle_t> load_bin_mesh(const std::string &filename)
+namespace
 {
-    std::ifstream fin(filename, std::ios::binary | std::ios::in);
-    if(!fin)
-        throw std::runtime_error("failed to open file: " + filename);
 
-    size_t triangle_count;
-    fin.read(reinterpret_cast<char*>(&triangle_count), sizeof(triangle_count));
-    if(!fin)
-        throw std::runtime_error(
-            "failed to load triangle count from " + filename);
+    constexpr char     BIN_MESH_V2_MAGIC[8] = { 'A', 'G', 'Z', 'B', 'M', '2', 0, 0 };
+    constexpr uint32_t BIN_MESH_V2_VERSION  = 2;
+    constexpr uint64_t BIN_MESH_V2_ALIGNMENT = 64;
 
-    const size_t byte_size = sizeof(mesh::triangle_t) * triangle_count;
-    std::vector<mesh::triangle_t> ret(triangle_count);
-    fin.read(reinterpret_cast<char*>(ret.data()), byte_size);
-    if(!fin)
+    uint64_t align_section(uint64_t offset) noexcept
+    {
+        return (offset + BIN_MESH_V2_ALIGNMENT - 1)
+             / BIN_MESH_V2_ALIGNMENT * BIN_MESH_V2_ALIGNMENT;
+    }
+
+    // octahedral normal encoding
+
+    float sign_not_zero(float x) noexcept
+    {
+        return x >= 0 ? 1.0f : -1.0f;
+    }
+
+    void encode_normal(const FVec3 &n, int16_t *output) noexcept
+    {
+        const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if(l1 <= 0)
+        {
+            output[0] = output[1] = 0;
+            return;
+        }
+
+        float x = n.x / l1, y = n.y / l1;
+        if(n.z < 0)
+        {
+            const float ox = (1 - std::abs(y)) * sign_not_zero(x);
+            const float oy = (1 - std::abs(x)) * sign_not_zero(y);
+            x = ox;
+            y = oy;
+        }
+
+        output[0] = static_cast<int16_t>(
+            std::round(math::clamp(x, -1.0f, 1.0f) * 32767));
+        output[1] = static_cast<int16_t>(
+            std::round(math::clamp(y, -1.0f, 1.0f) * 32767));
+    }
+
+    FVec3 decode_normal(const int16_t *input) noexcept
+    {
+        float x = float(input[0]) / 32767;
+        float y = float(input[1]) / 32767;
+        const float z = 1 - std::abs(x) - std::abs(y);
+        if(z < 0)
+        {
+            const float ox = (1 - std::abs(y)) * sign_not_zero(x);
+            const float oy = (1 - std::abs(x)) * sign_not_zero(y);
+            x = ox;
+            y = oy;
+        }
+        return FVec3(x, y, z).normalize();
+    }
+
+    uint16_t quantize_uv(float v, float low, float scale) noexcept
+    {
+        if(scale <= 0)
+            return 0;
+        const float q = std::round((v - low) / scale);
+        return static_cast<uint16_t>(math::clamp(q, 0.0f, 65535.0f));
+    }
+
+    struct VertexKey
+    {
+        float data[8];
+
+        bool operator==(const VertexKey &rhs) const noexcept
+        {
+            return std::memcmp(data, rhs.data, sizeof(data)) == 0;
+        }
+    };
+
+    struct VertexKeyHasher
+    {
+        size_t operator()(const VertexKey &key) const noexcept
+        {
+            size_t ret = 0;
+            for(float d : key.data)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &d, sizeof(bits));
+                ret ^= bits + 0x9e3779b9 + (ret << 6) + (ret >> 2);
+            }
+            return ret;
+        }
+    };
+
+    VertexKey to_key(const mesh::vertex_t &v) noexcept
+    {
+        // +0 and -0 are merged
+        return { {
+            v.position.x + 0.0f,  v.position.y + 0.0f, v.position.z + 0.0f,
+            v.normal.x + 0.0f,    v.normal.y + 0.0f,   v.normal.z + 0.0f,
+            v.tex_coord.x + 0.0f, v.tex_coord.y + 0.0f
+        } };
+    }
+
+    std::vector<mesh::triangle_t> load_bin_mesh_v1(const std::string &filename)
+    {
+        std::ifstream fin(filename, std::ios::binary | std::ios::in);
+        if(!fin)
+            throw std::runtime_error("failed to open file: " + filename);
+
+        size_t triangle_count;
+        fin.read(reinterpret_cast<char*>(&triangle_count), sizeof(triangle_count));
+        if(!fin)
+            throw std::runtime_error(
+                "failed to load triangle count from " + filename);
+
+        const size_t byte_size = sizeof(mesh::triangle_t) * triangle_count;
+        std::vector<mesh::triangle_t> ret(triangle_count);
+        fin.read(reinterpret_cast<char*>(ret.data()), byte_size);
+        if(!fin)
+            throw std::runtime_error(
+                "failed to load triangle data from " + filename);
+
+        return ret;
+    }
+
+} // namespace anonymous
+
+BinMeshView::BinMeshView(const std::string &filename)
+    : file_(filename)
+{
+    const unsigned char *data = file_.data();
+    const size_t size = file_.size();
+
+    if(size < sizeof(BinMeshHeader))
+        throw std::runtime_error("invalid .bm v2 file: " + filename);
+    std::memcpy(&header_, data, sizeof(header_));
+
+    if(std::memcmp(header_.magic, BIN_MESH_V2_MAGIC, sizeof(header_.magic)) != 0)
+        throw std::runtime_error("invalid .bm v2 file: " + filename);
+    if(header_.version != BIN_MESH_V2_VERSION)
+    {
         throw std::runtime_error(
-            "failed to load triangle data from " + filename);
+            "unsupported .bm version " + std::to_string(header_.version) +
+            " in " + filename);
+    }
+    if(header_.vertex_count > (std::numeric_limits<uint32_t>::max)())
+        throw std::runtime_error("too many vertices in " + filename);
+
+    const uint64_t vertex_count = header_.vertex_count;
+    const bool q_nor = (header_.flags & BIN_MESH_V2_QUANTIZED_NORMAL) != 0;
+    const bool q_uv  = (header_.flags & BIN_MESH_V2_QUANTIZED_UV) != 0;
+
+    // count is compared with the remaining size before multiplying, so that
+    // huge counts in a corrupted header can't overflow
+    auto check_section = [&](uint64_t offset, uint64_t count, uint64_t stride)
+    {
+        if(offset % BIN_MESH_V2_ALIGNMENT != 0 ||
+           offset > size || count > (size - offset) / stride)
+            throw std::runtime_error("truncated .bm v2 file: " + filename);
+        return data + offset;
+    };
+
+    chunks_ = reinterpret_cast<const BinMeshChunk*>(check_section(
+        header_.chunk_offset, header_.chunk_count, sizeof(BinMeshChunk)));
+    positions_ = reinterpret_cast<const float*>(check_section(
+        header_.position_offset, vertex_count, 3 * sizeof(float)));
+    normals_ = check_section(
+        header_.normal_offset, vertex_count,
+        q_nor ? 2 * sizeof(int16_t) : 3 * sizeof(float));
+    tex_coords_ = check_section(
+        header_.tex_coord_offset, vertex_count,
+        2 * (q_uv ? sizeof(uint16_t) : sizeof(float)));
+    indices_ = reinterpret_cast<const uint32_t*>(check_section(
+        header_.index_offset, header_.triangle_count, 3 * sizeof(uint32_t)));
+
+    // indices are validated once so that decoding never reads out of range
+
+    for(uint64_t i = 0; i < 3 * header_.triangle_count; ++i)
+    {
+        if(indices_[i] >= vertex_count)
+            throw std::runtime_error("invalid vertex index in " + filename);
+    }
+
+    // chunks must cover all triangles in order
+
+    uint64_t next_triangle = 0;
+    for(uint32_t i = 0; i < header_.chunk_count; ++i)
+    {
+        const BinMeshChunk &c = chunks_[i];
+        if(c.first_triangle != next_triangle ||
+           c.triangle_count > header_.triangle_count - c.first_triangle)
+            throw std::runtime_error("invalid chunk in " + filename);
+        next_triangle += c.triangle_count;
+    }
+    if(next_triangle != header_.triangle_count)
+        throw std::runtime_error("invalid chunk in " + filename);
+}
+
+size_t BinMeshView::vertex_count() const noexcept
+{
+    return static_cast<size_t>(header_.vertex_count);
+}
+
+size_t BinMeshView::triangle_count() const noexcept
+{
+    return static_cast<size_t>(header_.triangle_count);
+}
+
+uint32_t BinMeshView::chunk_count() const noexcept
+{
+    return header_.chunk_count;
+}
+
+const BinMeshChunk &BinMeshView::chunk(uint32_t idx) const noexcept
+{
+    assert(idx < header_.chunk_count);
+    return chunks_[idx];
+}
+
+void BinMeshView::decode(
+    size_t beg, size_t end, mesh::triangle_t *output) const noexcept
+{
+    assert(beg <= end && end <= triangle_count());
+    for(size_t i = beg; i < end; ++i)
+    {
+        for(int j = 0; j < 3; ++j)
+            output[i - beg].vertices[j] = vertex(indices_[3 * i + j]);
+    }
+}
+
+IndexedTriangleMeshView BinMeshView::indexed_view() const
+{
+    if(header_.triangle_count > (std::numeric_limits<uint32_t>::max)())
+        throw std::runtime_error("too many triangles in .bm v2 file");
+
+    IndexedTriangleMeshView ret;
+    ret.vertex_count   = static_cast<uint32_t>(header_.vertex_count);
+    ret.triangle_count = static_cast<uint32_t>(header_.triangle_count);
+    ret.positions      = positions_;
+    ret.indices        = indices_;
+    ret.vertex_attrib  = [this](uint32_t idx, FVec3 *normal, Vec2 *uv)
+    {
+        const mesh::vertex_t v = vertex(idx);
+        *normal = v.normal;
+        *uv     = v.tex_coord;
+    };
+
+    return ret;
+}
+
+mesh::vertex_t BinMeshView::vertex(uint32_t idx) const noexcept
+{
+    mesh::vertex_t ret;
+
+    const float *p = positions_ + 3 * size_t(idx);
+    ret.position = FVec3(p[0], p[1], p[2]);
+
+    if(header_.flags & BIN_MESH_V2_QUANTIZED_NORMAL)
+    {
+        ret.normal = decode_normal(
+            static_cast<const int16_t*>(normals_) + 2 * size_t(idx));
+    }
+    else
+    {
+        const float *n = static_cast<const float*>(normals_) + 3 * size_t(idx);
+        ret.normal = FVec3(n[0], n[1], n[2]);
+    }
+
+    if(header_.flags & BIN_MESH_V2_QUANTIZED_UV)
+    {
+        const uint16_t *t =
+            static_cast<const uint16_t*>(tex_coords_) + 2 * size_t(idx);
+        ret.tex_coord = Vec2(
+            header_.uv_low[0] + t[0] * header_.uv_scale[0],
+            header_.uv_low[1] + t[1] * header_.uv_scale[1]);
+    }
+    else
+    {
+        const float *t = static_cast<const float*>(tex_coords_) + 2 * size_t(idx);
+        ret.tex_coord = Vec2(t[0], t[1]);
+    }
+
+    return ret;
+}
+
+bool is_bin_mesh_v2(const std::string &filename)
+{
+    std::ifstream fin(filename, std::ios::binary | std::ios::in);
+    char magic[sizeof(BIN_MESH_V2_MAGIC)];
+    fin.read(magic, sizeof(magic));
+    return fin && std::memcmp(magic, BIN_MESH_V2_MAGIC, sizeof(magic)) == 0;
+}
+
+std::vector<mesh::triangle_t> load_bin_mesh(
+    const std::string &filename, int worker_count)
+{
+    if(!is_bin_mesh_v2(filename))
+        return load_bin_mesh_v1(filename);
+
+    const BinMeshView view(filename);
+    std::vector<mesh::triangle_t> ret(view.triangle_count());
+
+    parallel_for_1d_grid(
+        thread::actual_worker_count(worker_count),
+        static_cast<int>(view.chunk_count()), 1,
+        [&](int, int beg, int end)
+    {
+        for(int i = beg; i < end; ++i)
+        {
+            const BinMeshChunk &c = view.chunk(static_cast<uint32_t>(i));
+            view.decode(
+                c.first_triangle, c.first_triangle + c.triangle_count,
+                ret.data() + c.first_triangle);
+        }
+    });
 
     return ret;
 }
@@ -46,4 +349,202 @@ void save_bin_mesh(
             "failed to write triangle data to " + filename);
 }
 
+void save_bin_mesh_v2(
+    const std::string &filename,
+    const mesh::triangle_t *triangles, size_t triangle_count,
+    const BinMeshV2Params &params)
+{
+    if(!params.chunk_triangle_count)
+        throw std::runtime_error("chunk_triangle_count must be positive");
+
+    // merge identical vertices in the order of first use
+
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHasher> key2index;
+    std::vector<const mesh::vertex_t*> vertices;
+    std::vector<uint32_t> indices(3 * triangle_count);
+
+    for(size_t i = 0; i < triangle_count; ++i)
+    {
+        for(int j = 0; j < 3; ++j)
+        {
+            const mesh::vertex_t &v = triangles[i].vertices[j];
+            const auto [it, inserted] = key2index.try_emplace(
+                to_key(v), static_cast<uint32_t>(vertices.size()));
+            if(inserted)
+            {
+                if(vertices.size() > (std::numeric_limits<uint32_t>::max)())
+                    throw std::runtime_error("too many vertices in mesh");
+                vertices.push_back(&v);
+            }
+            indices[3 * i + j] = it->second;
+        }
+    }
+
+    key2index.clear();
+
+    BinMeshHeader header = {};
+    std::memcpy(header.magic, BIN_MESH_V2_MAGIC, sizeof(header.magic));
+    header.version = BIN_MESH_V2_VERSION;
+    header.flags   = (params.quantize_normal ? BIN_MESH_V2_QUANTIZED_NORMAL : 0)
+                   | (params.quantize_uv     ? BIN_MESH_V2_QUANTIZED_UV     : 0);
+
+    header.vertex_count         = vertices.size();
+    header.triangle_count       = triangle_count;
+    header.chunk_triangle_count = params.chunk_triangle_count;
+    header.chunk_count          = static_cast<uint32_t>(
+        (triangle_count + params.chunk_triangle_count - 1)
+        / params.chunk_triangle_count);
+
+    // chunks
+
+    std::vector<BinMeshChunk> chunks(header.chunk_count);
+    for(uint32_t c = 0; c < header.chunk_count; ++c)
+    {
+        BinMeshChunk &chunk = chunks[c];
+        chunk.first_triangle = uint64_t(c) * params.chunk_triangle_count;
+        chunk.triangle_count = static_cast<uint32_t>((std::min<uint64_t>)(
+            params.chunk_triangle_count, triangle_count - chunk.first_triangle));
+
+        AABB bound;
+        chunk.vertex_beg = (std::numeric_limits<uint32_t>::max)();
+        chunk.vertex_end = 0;
+
+        const uint64_t idx_end =
+            3 * (chunk.first_triangle + chunk.triangle_count);
+        for(uint64_t i = 3 * chunk.first_triangle; i < idx_end; ++i)
+        {
+            chunk.vertex_beg = (std::min)(chunk.vertex_beg, indices[i]);
+            chunk.vertex_end = (std::max)(chunk.vertex_end, indices[i] + 1);
+            bound |= vertices[indices[i]]->position;
+        }
+
+        for(int i = 0; i < 3; ++i)
+        {
+            chunk.bound_low[i]  = bound.low[i];
+            chunk.bound_high[i] = bound.high[i];
+        }
+    }
+
+    // vertex attributes
+
+    std::vector<float> positions(3 * vertices.size());
+    for(size_t i = 0; i < vertices.size(); ++i)
+    {
+        positions[3 * i + 0] = vertices[i]->position.x;
+        positions[3 * i + 1] = vertices[i]->position.y;
+        positions[3 * i + 2] = vertices[i]->position.z;
+    }
+
+    std::vector<unsigned char> normals;
+    if(params.quantize_normal)
+    {
+        normals.resize(vertices.size() * 2 * sizeof(int16_t));
+        auto output = reinterpret_cast<int16_t*>(normals.data());
+        for(size_t i = 0; i < vertices.size(); ++i)
+            encode_normal(vertices[i]->normal, output + 2 * i);
+    }
+    else
+    {
+        normals.resize(vertices.size() * 3 * sizeof(float));
+        auto output = reinterpret_cast<float*>(normals.data());
+        for(size_t i = 0; i < vertices.size(); ++i)
+        {
+            output[3 * i + 0] = vertices[i]->normal.x;
+            output[3 * i + 1] = vertices[i]->normal.y;
+            output[3 * i + 2] = vertices[i]->normal.z;
+        }
+    }
+
+    std::vector<unsigned char> tex_coords;
+    if(params.quantize_uv)
+    {
+        Vec2 uv_low(REAL_MAX), uv_high(REAL_MIN);
+        for(auto v : vertices)
+        {
+            uv_low.x  = (std::min)(uv_low.x,  v->tex_coord.x);
+            uv_low.y  = (std::min)(uv_low.y,  v->tex_coord.y);
+            uv_high.x = (std::max)(uv_high.x, v->tex_coord.x);
+            uv_high.y = (std::max)(uv_high.y, v->tex_coord.y);
+        }
+
+        if(vertices.empty())
+            uv_low = uv_high = Vec2(0);
+
+        header.uv_low[0]   = uv_low.x;
+        header.uv_low[1]   = uv_low.y;
+        header.uv_scale[0] = (uv_high.x - uv_low.x) / 65535;
+        header.uv_scale[1] = (uv_high.y - uv_low.y) / 65535;
+
+        tex_coords.resize(vertices.size() * 2 * sizeof(uint16_t));
+        auto output = reinterpret_cast<uint16_t*>(tex_coords.data());
+        for(size_t i = 0; i < vertices.size(); ++i)
+        {
+            output[2 * i + 0] = quantize_uv(
+                vertices[i]->tex_coord.x, header.uv_low[0], header.uv_scale[0]);
+            output[2 * i + 1] = quantize_uv(
+                vertices[i]->tex_coord.y, header.uv_low[1], header.uv_scale[1]);
+        }
+    }
+    else
+    {
+        tex_coords.resize(vertices.size() * 2 * sizeof(float));
+        auto output = reinterpret_cast<float*>(tex_coords.data());
+        for(size_t i = 0; i < vertices.size(); ++i)
+        {
+            output[2 * i + 0] = vertices[i]->tex_coord.x;
+            output[2 * i + 1] = vertices[i]->tex_coord.y;
+        }
+    }
+
+    // layout
+
+    const uint64_t chunk_bytes    = chunks.size() * sizeof(BinMeshChunk);
+    const uint64_t position_bytes = positions.size() * sizeof(float);
+    const uint64_t index_bytes    = indices.size() * sizeof(uint32_t);
+
+    header.chunk_offset     = align_section(sizeof(header));
+    header.position_offset  = align_section(header.chunk_offset + chunk_bytes);
+    header.normal_offset    = align_section(
+        header.position_offset + position_bytes);
+    header.tex_coord_offset = align_section(
+        header.normal_offset + normals.size());
+    header.index_offset     = align_section(
+        header.tex_coord_offset + tex_coords.size());
+
+    std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+    if(!fout)
+        throw std::runtime_error("failed to open file: " + filename);
+
+    auto write_section = [&](uint64_t offset, const void *data, uint64_t bytes)
+    {
+        static const char zeros[BIN_MESH_V2_ALIGNMENT] = {};
+        const auto pos = static_cast<uint64_t>(fout.tellp());
+        fout.write(zeros, static_cast<std::streamsize>(offset - pos));
+        fout.write(static_cast<const char*>(data),
+                   static_cast<std::streamsize>(bytes));
+    };
+
+    write_section(0, &header, sizeof(header));
+    write_section(header.chunk_offset, chunks.data(), chunk_bytes);
+    write_section(header.position_offset, positions.data(), position_bytes);
+    write_section(header.normal_offset, normals.data(), normals.size());
+    write_section(header.tex_coord_offset, tex_coords.data(), tex_coords.size());
+    write_section(header.index_offset, indices.data(), index_bytes);
+
+    if(!fout)
+        throw std::runtime_error("failed to write mesh data to " + filename);
+}
+
+void convert_to_bin_mesh_v2(
+    const std::string &input_filename,
+    const std::string &output_filename,
+    const BinMeshV2Params &params)
+{
+    const auto ext = std::filesystem::path(input_filename).extension().string();
+    const auto triangles = ext == ".bm" ?
+        load_bin_mesh(input_filename) : mesh::load_from_file(input_filename);
+    save_bin_mesh_v2(
+        output_filename, triangles.data(), triangles.size(), params);
+}
+
 AGZ_TRACER_FACTORY_END
@@ -1,9 +1,13 @@
+#include <fstream>
+
 #include <agz/factory/utility/render_session.h>
 #include <agz/tracer/core/post_processor.h>
 #include <agz/tracer/core/scene.h>
 #include <agz/factory/factory.h>
 #include <agz/tracer/create/film_filter.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/stats.h>
+#include <agz/tracer/utility/texture_tile_cache.h>
 
 #include <agz-utils/string.h>
 
@@ -62,6 +66,41 @@ namespace
         if(auto node = rendering_config.find_child_value("eps"))
             settings->eps = node->as_real();
 
+        if(auto node = rendering_config.find_child_value("texture_cache_mb"))
+        {
+            const int mb = node->as_int();
+            if(mb <= 0)
+            {
+                throw ObjectConstructionException(
+                    "invalid texture cache size: " + std::to_string(mb));
+            }
+            settings->texture_cache_bytes = size_t(mb) << 20;
+        }
+
+        if(auto node = rendering_config.find_child_value("thread_affinity"))
+        {
+            const std::string &affinity = node->as_str();
+            if(affinity == "none")
+                settings->thread_affinity = TaskScheduler::Affinity::None;
+            else if(affinity == "numa")
+                settings->thread_affinity = TaskScheduler::Affinity::NumaNode;
+            else if(affinity == "core")
+                settings->thread_affinity = TaskScheduler::Affinity::Core;
+            else
+            {
+                throw ObjectConstructionException(
+                    "invalid thread affinity: " + affinity);
+            }
+        }
+
+        if(auto node = rendering_config.find_child_value("stats_filename"))
+        {
+            settings->stats_filename = context.path_mapper->map(node->as_str());
+#ifndef AGZ_TRACER_STATS
+            AGZ_INFO("statistics are not collected. stats_filename is ignored");
+#endif
+        }
+
         return settings;
     }
 }
@@ -77,22 +116,74 @@ void RenderSession::execute()
 {
     AGZ_INFO("start rendering");
 
+#ifdef AGZ_TRACER_STATS
+    stats::reset();
+#endif
+
     set_eps(render_settings->eps);
 
+    auto &tile_cache = TextureTileCache::instance();
+    tile_cache.set_memory_budget(render_settings->texture_cache_bytes);
+    tile_cache.reset_statistics();
+
+    TaskScheduler::instance().set_affinity(render_settings->thread_affinity);
+
     scene->set_camera(render_settings->camera);
-    scene->start_rendering();
+    {
+        AGZ_STATS_SCOPED_TIMER("start_rendering");
+        scene->start_rendering();
+    }
 
     FilmFilterApplier filter_applier(
         render_settings->width, render_settings->height,
         render_settings->film_filter);
 
-    RenderTarget render_target = render_settings->renderer->render(
-        filter_applier, *scene, *render_settings->reporter);
+    RenderTarget render_target;
+    {
+        AGZ_STATS_SCOPED_TIMER("render");
+        render_target = render_settings->renderer->render(
+            filter_applier, *scene, *render_settings->reporter);
+    }
+
+    const auto tile_stats = tile_cache.statistics();
+    if(const uint64_t lookups = tile_stats.front_hit_count + tile_stats.hit_count
+                              + tile_stats.miss_count)
+    {
+        const double hit_rate = 100.0 * (lookups - tile_stats.miss_count) / lookups;
+        AGZ_INFO("texture tile cache: {} lookups, {:.2f}% hit "
+                 "({} front hits, {} global hits, {} misses), {} evictions",
+                 lookups, hit_rate,
+                 tile_stats.front_hit_count, tile_stats.hit_count,
+                 tile_stats.miss_count, tile_stats.evict_count);
+        AGZ_INFO("texture tile cache: {:.1f} MB resident, {:.1f} MB peak",
+                 tile_stats.resident_bytes / 1048576.0,
+                 tile_stats.peak_resident_bytes / 1048576.0);
+    }
 
     AGZ_INFO("running post processors");
 
-    for(auto &p : render_settings->post_processors)
-        p->process(render_target);
+    {
+        AGZ_STATS_SCOPED_TIMER("post_process");
+        for(auto &p : render_settings->post_processors)
+            p->process(render_target);
+    }
+
+#ifdef AGZ_TRACER_STATS
+    const std::string stats_report = stats::report_json();
+    AGZ_INFO("statistics:\n{}", stats_report);
+
+    if(!render_settings->stats_filename.empty())
+    {
+        std::ofstream fout(render_settings->stats_filename, std::ios::trunc);
+        if(!fout)
+        {
+            AGZ_ERROR("failed to open statistics file: {}",
+                      render_settings->stats_filename);
+        }
+        else
+            fout << stats_report << std::endl;
+    }
+#endif
 }
 
 RenderSession create_render_session(
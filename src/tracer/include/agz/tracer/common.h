@@ -29,6 +29,7 @@ class FilmFilter;
 class Geometry;
 class Material;
 class Medium;
+struct PixelSampleIndex;
 class PostProcessor;
 class Renderer;
 class RendererInteractor;
@@ -271,6 +272,30 @@ public:
     bool between(real t) const noexcept;
 };
 
+/**
+ * @brief first-order change of a camera ray w.r.t. its film coordinate
+ *
+ * (dodx, dddx) is the change of ray origin/direction per unit offset of
+ * film x coordinate, and (dody, dddy) is that of film y coordinate.
+ * all zero when the camera doesn't provide differentials
+ */
+struct RayDifferential
+{
+    FVec3 dodx, dddx;
+    FVec3 dody, dddy;
+
+    bool is_zero() const noexcept
+    {
+        return dodx.length_square() == 0 && dddx.length_square() == 0 &&
+               dody.length_square() == 0 && dddy.length_square() == 0;
+    }
+
+    RayDifferential scaled(real sx, real sy) const noexcept
+    {
+        return { dodx * sx, dddx * sx, dody * sy, dddy * sy };
+    }
+};
+
 class AABB
 {
 public:
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include <agz/tracer/core/intersection.h>
+#include <agz-utils/misc.h>
 
 AGZ_TRACER_BEGIN
 
@@ -36,6 +37,30 @@ public:
      */
     virtual bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept = 0;
+
+    /**
+     * @brief test intersections with a stream of rays
+     *
+     * coherent rays (e.g. primary rays of a tile or shadow rays from the
+     * same point) can share traversal steps
+     */
+    virtual void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = has_intersection(rays[i]);
+    }
+
+    /**
+     * @brief find closest intersections with a stream of rays
+     */
+    virtual void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = closest_intersection(rays[i], &incts[i]);
+    }
 };
 
 AGZ_TRACER_END
@@ -28,6 +28,9 @@ struct CameraSampleWeResult
     FVec3 pos_to_out;
     FVec3 nor_on_cam;
     FSpectrum throughput;
+
+    // w.r.t. film_coord passed to sample_we. optional
+    RayDifferential differential;
 };
 
 /**
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <agz/tracer/core/intersection.h>
+#include <agz-utils/misc.h>
 
 AGZ_TRACER_BEGIN
 
@@ -39,6 +40,29 @@ public:
     virtual bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept = 0;
 
+    /**
+     * @brief test intersections with a stream of rays
+     */
+    virtual void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = has_intersection(rays[i]);
+    }
+
+    /**
+     * @brief find closest intersections with a stream of rays
+     *
+     * incts[i] is only modified when results[i] is true
+     */
+    virtual void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = closest_intersection(rays[i], &incts[i]);
+    }
+
     /**
      * @brief aabb in world space
      */
@@ -3,6 +3,7 @@
 #include <any>
 
 #include <agz/tracer/core/intersection.h>
+#include <agz-utils/misc.h>
 
 AGZ_TRACER_BEGIN
 
@@ -31,6 +32,31 @@ public:
     virtual bool closest_intersection(
         const Ray &r, GeometryIntersection *inct) const noexcept = 0;
 
+    /**
+     * @brief test intersections with a stream of rays
+     *
+     * results[i] is set to has_intersection(rays[i])
+     */
+    virtual void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = has_intersection(rays[i]);
+    }
+
+    /**
+     * @brief find closest intersections with a stream of rays
+     *
+     * results[i] is set to closest_intersection(rays[i], &incts[i])
+     */
+    virtual void closest_intersection_n(
+        misc::span<const Ray> rays,
+        GeometryIntersection *incts, bool *results) const noexcept
+    {
+        for(size_t i = 0; i < rays.size(); ++i)
+            results[i] = closest_intersection(rays[i], &incts[i]);
+    }
+
     /**
      * @brief aabb in world space
      */
@@ -70,6 +96,18 @@ public:
      * @brief pdf of sample with ref
      */
     virtual real pdf(const FVec3 &ref, const FVec3 &pos) const noexcept = 0;
+
+    /**
+     * @brief bounding cone of geometry normals in world space
+     *
+     * all normals n satisfy dot(n, *axis) >= *cos_theta
+     *
+     * @return false when the normals are not bounded
+     */
+    virtual bool normal_bound(FVec3 *axis, real *cos_theta) const noexcept
+    {
+        return false;
+    }
 };
 
 AGZ_TRACER_END
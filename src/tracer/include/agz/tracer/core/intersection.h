@@ -37,6 +37,10 @@ struct GeometryIntersection : SurfacePoint
 {
     real t = -1;
     FVec3 wr;
+
+    // partial derivatives of pos w.r.t. uv. zero when unavailable
+    FVec3 dpdu;
+    FVec3 dpdv;
 };
 
 /**
@@ -63,6 +67,66 @@ struct EntityIntersection : GeometryIntersection
     {
         return dot(d, geometry_coord.z) >= 0 ? medium_out : medium_in;
     }
+
+    // uv footprint used for texture filtering. zero means a point lookup
+    Vec2 duvdx;
+    Vec2 duvdy;
+
+    bool has_uv_footprint() const noexcept
+    {
+        return duvdx.x != 0 || duvdx.y != 0 || duvdy.x != 0 || duvdy.y != 0;
+    }
+
+    /**
+     * @brief compute duvdx/duvdy from ray differential of r
+     *
+     * offset rays are intersected with the tangent plane, and the offsets
+     * on the plane are projected onto dpdu/dpdv in least-square sense
+     */
+    void compute_uv_differentials(
+        const Ray &r, const RayDifferential &diff) noexcept
+    {
+        duvdx = duvdy = Vec2();
+        if(diff.is_zero())
+            return;
+
+        const real ata00 = dot(dpdu, dpdu);
+        const real ata01 = dot(dpdu, dpdv);
+        const real ata11 = dot(dpdv, dpdv);
+        const real det = ata00 * ata11 - ata01 * ata01;
+        if(!(det > 0))
+            return;
+        const real inv_det = 1 / det;
+
+        const FVec3 &nor = geometry_coord.z;
+        auto offset_to_uv = [&](const FVec3 &dodx, const FVec3 &dddx)
+        {
+            const FVec3 o = r.o + dodx;
+            const FVec3 d = r.d + dddx;
+            const real cos_d = dot(nor, d);
+            if(std::abs(cos_d) < EPS())
+                return Vec2();
+
+            const real t_plane = dot(nor, pos - o) / cos_d;
+            const FVec3 dpdx = o + t_plane * d - pos;
+
+            const real atb0 = dot(dpdu, dpdx);
+            const real atb1 = dot(dpdv, dpdx);
+            const Vec2 ret(
+                (ata11 * atb0 - ata01 * atb1) * inv_det,
+                (ata00 * atb1 - ata01 * atb0) * inv_det);
+
+            // discard footprints from grazing rays and degenerate uvs
+            constexpr real MAX_DUV = real(1e4);
+            if(!std::isfinite(ret.x) || !std::isfinite(ret.y) ||
+               std::abs(ret.x) > MAX_DUV || std::abs(ret.y) > MAX_DUV)
+                return Vec2();
+            return ret;
+        };
+
+        duvdx = offset_to_uv(diff.dodx, diff.dddx);
+        duvdy = offset_to_uv(diff.dody, diff.dddy);
+    }
 };
 
 /**
@@ -182,6 +182,21 @@ public:
         const FVec3 &ref,
         const FVec3 &pos,
         const FVec3 &nor) const noexcept = 0;
+
+    /**
+     * @brief bound of emitting directions
+     *
+     * normals of the light source are in the cone (axis, cos_theta_o), and
+     * light is emitted within angle acos(cos_theta_e) around each normal.
+     * default value means no bound
+     */
+    virtual void emission_bound(
+        FVec3 *axis, real *cos_theta_o, real *cos_theta_e) const noexcept
+    {
+        *axis        = FVec3(0, 0, 1);
+        *cos_theta_o = -1;
+        *cos_theta_e = -1;
+    }
 };
 
 /**
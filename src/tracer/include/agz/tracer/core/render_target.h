@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include <agz/tracer/core/framebuffer.h>
 #include <agz/tracer/core/film_filter.h>
 #include <agz-utils/texture.h>
@@ -148,6 +151,11 @@ public:
          */
         const Rect2i &sample_pixels() const noexcept;
 
+        /**
+         * @brief get pixel range represented by this grid
+         */
+        const Rect2i &pixel_range() const noexcept;
+
         /**
          * @brief add grid data to full image buffer
          */
@@ -245,6 +253,93 @@ private:
     RC<const FilmFilter> film_filter_;
 };
 
+/**
+ * @brief film accumulating samples splatted to arbitrary pixels by multiple
+ *  threads, e.g. particles hitting the camera in light tracing
+ *
+ * each thread writes its own buffer without synchronization. buffers are
+ * divided into tiles, which are allocated when first written, so that
+ * threads only pay for pixels they actually touch. get_image sums up all
+ * buffers in parallel, and can be called while other threads are splatting.
+ */
+class SplatFilm : public misc::uncopyable_t
+{
+public:
+
+    static constexpr int TILE_SIZE = 32;
+
+    /**
+     * @brief splatting buffer owned by a single thread
+     */
+    class ThreadBuffer : public misc::uncopyable_t
+    {
+    public:
+
+        ThreadBuffer() = default;
+
+        ~ThreadBuffer();
+
+        /**
+         * @brief add a sample at given pixel coordinate, weighted by the film filter
+         */
+        void splat(real px, real py, const FSpectrum &value) noexcept;
+
+        /**
+         * @brief add a value to pixel (x, y) directly
+         */
+        void add(int x, int y, const FSpectrum &value) noexcept;
+
+    private:
+
+        friend class SplatFilm;
+
+        struct Tile;
+
+        Tile *allocate_tile(int tile_index);
+
+        const SplatFilm *film_ = nullptr;
+
+        // written by the owner thread and read by get_image
+        std::unique_ptr<std::atomic<Tile*>[]> tiles_;
+    };
+
+    SplatFilm(const FilmFilterApplier &filter, int thread_count);
+
+    int width() const noexcept;
+
+    int height() const noexcept;
+
+    int thread_count() const noexcept;
+
+    /**
+     * @brief get buffer of given thread. thread_index is in [0, thread_count)
+     */
+    ThreadBuffer &thread_buffer(int thread_index) noexcept;
+
+    /**
+     * @brief sum up buffers of all threads, multiplied by scale
+     */
+    Image2D<Spectrum> get_image(real scale = 1) const;
+
+    /**
+     * @brief write sum of buffers in an inclusive pixel range to output,
+     *  multiplied by scale
+     */
+    void resolve(
+        const Rect2i &pixels, real scale, Image2D<Spectrum> &output) const;
+
+private:
+
+    FilmFilterApplier filter_;
+    Rect2i pixel_range_;
+
+    int tile_count_x_;
+    int tile_count_y_;
+
+    int thread_count_;
+    std::unique_ptr<ThreadBuffer[]> buffers_;
+};
+
 template<bool WITH_VALUE,
          bool WITH_WEIGHT,
          bool WITH_ALBEDO,
@@ -416,6 +511,13 @@ const Rect2i &FilmFilterApplier::FilmGrid<TexelTypes...>
     return sample_pixels_;
 }
 
+template<typename...TexelTypes>
+const Rect2i &FilmFilterApplier::FilmGrid<TexelTypes...>
+    ::pixel_range() const noexcept
+{
+    return pixel_range_;
+}
+
 template<typename...TexelTypes>
 void FilmFilterApplier::FilmGrid<TexelTypes...>::clear(const TexelTypes&...texels)
 {
@@ -543,4 +645,73 @@ FilmFilterApplier::FilmGrid<TexelTypes...> FilmFilterApplier::create_subgrid(
     return FilmGrid<TexelTypes...>(pixel_bound, film_filter_);
 }
 
+struct SplatFilm::ThreadBuffer::Tile
+{
+    // each texel is written by only one thread. atomics make concurrent
+    // reads in get_image well-defined
+    std::atomic<real> values[TILE_SIZE * TILE_SIZE * SPECTRUM_COMPONENT_COUNT];
+
+    Tile() noexcept
+    {
+        for(auto &v : values)
+            v.store(0, std::memory_order_relaxed);
+    }
+};
+
+inline void SplatFilm::ThreadBuffer::splat(
+    real px, real py, const FSpectrum &value) noexcept
+{
+    const FilmFilterApplier &filter = film_->filter_;
+    apply_image_filter(
+        film_->pixel_range_, filter.radius(), { px, py },
+        [&](int pix, int piy, real rel_x, real rel_y)
+    {
+        add(pix, piy, filter.eval_filter(rel_x, rel_y) * value);
+    });
+}
+
+inline void SplatFilm::ThreadBuffer::add(
+    int x, int y, const FSpectrum &value) noexcept
+{
+    const int tile_index = (y / TILE_SIZE) * film_->tile_count_x_ + x / TILE_SIZE;
+
+    Tile *tile = tiles_[tile_index].load(std::memory_order_relaxed);
+    if(!tile)
+        tile = allocate_tile(tile_index);
+
+    const int local_x = x % TILE_SIZE, local_y = y % TILE_SIZE;
+    std::atomic<real> *texel = &tile->values[
+        (local_y * TILE_SIZE + local_x) * SPECTRUM_COMPONENT_COUNT];
+
+    // single writer, so no atomic read-modify-write is needed
+    for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+    {
+        texel[i].store(
+            texel[i].load(std::memory_order_relaxed) + value[i],
+            std::memory_order_relaxed);
+    }
+}
+
+inline int SplatFilm::width() const noexcept
+{
+    return filter_.width();
+}
+
+inline int SplatFilm::height() const noexcept
+{
+    return filter_.height();
+}
+
+inline int SplatFilm::thread_count() const noexcept
+{
+    return thread_count_;
+}
+
+inline SplatFilm::ThreadBuffer &SplatFilm::thread_buffer(
+    int thread_index) noexcept
+{
+    assert(0 <= thread_index && thread_index < thread_count_);
+    return buffers_[thread_index];
+}
+
 AGZ_TRACER_END
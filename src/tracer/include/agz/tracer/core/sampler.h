@@ -9,6 +9,30 @@
 
 AGZ_TRACER_BEGIN
 
+/**
+ * @brief identifies the next values generated by a dimension-aware sampler
+ *
+ * index is the sample index in the pixel. dimension is the position of the
+ * next values in the sample, whose meaning is defined by the sampler
+ */
+struct PixelSampleIndex
+{
+    Vec2i pixel;
+    int index     = 0;
+    int dimension = 0;
+};
+
+/**
+ * @brief sampler types which can be used for generating pixel samples
+ */
+enum class PixelSamplerType
+{
+    Native,   // independent uniform random numbers
+    Sobol,    // owen-scrambled sobol sequence
+    Halton,   // randomized halton sequence
+    BlueNoise // sobol sequence dithered by a blue noise mask over pixels
+};
+
 class Sampler
 {
 public:
@@ -20,6 +44,18 @@ public:
     virtual Sample3 sample3() = 0;
     virtual Sample4 sample4() = 0;
     virtual Sample5 sample5() = 0;
+
+    /**
+     * @brief start generating values of given pixel sample
+     *
+     * ignored by samplers which are not dimension-aware
+     */
+    virtual void start_pixel_sample(const PixelSampleIndex &index) { }
+
+    /**
+     * @brief index of the next values to be generated
+     */
+    virtual PixelSampleIndex pixel_sample_index() const { return {}; }
 };
 
 class NativeSampler : public Sampler
@@ -71,6 +71,22 @@ public:
      */
     virtual real light_pdf(const Light *light) const noexcept = 0;
 
+    /**
+     * @brief sample a light source according to its estimated contribution
+     *  to given shading point
+     *
+     * @param pos shading point
+     * @param nor normal at pos. zero when pos is in medium
+     */
+    virtual SceneSampleLightResult sample_light(
+        const FVec3 &pos, const FVec3 &nor, const Sample1 &sam) const noexcept = 0;
+
+    /**
+     * @brief pdf of sample_light(pos, nor, sam)
+     */
+    virtual real light_pdf(
+        const FVec3 &pos, const FVec3 &nor, const Light *light) const noexcept = 0;
+
     /** @brief is there an intersection with given ray */
     virtual bool has_intersection(const Ray &r) const noexcept = 0;
 
@@ -89,6 +105,15 @@ public:
     virtual bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept = 0;
 
+    /** @brief test intersections with a stream of rays */
+    virtual void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept = 0;
+
+    /** @brief find closest intersections with a stream of rays */
+    virtual void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept = 0;
+
     virtual AABB world_bound() const noexcept = 0;;
 
     /**
@@ -123,6 +123,56 @@ protected:
         return sample_spectrum_impl(uv).r;
     }
 
+    /**
+     * @brief sample with the uv footprint (inct.duvdx, inct.duvdy)
+     *
+     * the footprint is ignored by default, which falls back to the unfiltered
+     * sample_spectrum(inct.uv). overriders are responsible for mapping the
+     * footprint (see map_footprint) and applying inv_gamma
+     */
+    virtual FSpectrum filtered_sample_spectrum_impl(
+        const EntityIntersection &inct) const noexcept
+    {
+        return sample_spectrum(inct.uv);
+    }
+
+    /**
+     * @brief sample real value with the uv footprint (inct.duvdx, inct.duvdy)
+     *
+     * falls back to the unfiltered sample_real(inct.uv) by default
+     */
+    virtual real filtered_sample_real_impl(
+        const EntityIntersection &inct) const noexcept
+    {
+        return sample_real(inct.uv);
+    }
+
+    FSpectrum apply_inv_gamma(FSpectrum s) const noexcept
+    {
+        if(inv_gamma_ != 1)
+        {
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                s[i] = std::pow(s[i], inv_gamma_);
+        }
+        return s;
+    }
+
+    real apply_inv_gamma(real r) const noexcept
+    {
+        return inv_gamma_ != 1 ? std::pow(r, inv_gamma_) : r;
+    }
+
+    // transform uv and its footprint to texture space
+    void map_footprint(
+        const EntityIntersection &inct,
+        Vec2 *uv, Vec2 *duvdx, Vec2 *duvdy) const noexcept
+    {
+        const Vec2 uv1 = transform_.apply_to_point(inct.uv);
+        *uv    = Vec2(wrapper_u_(uv1.x), wrapper_v_(uv1.y));
+        *duvdx = transform_.apply_to_vector(inct.duvdx);
+        *duvdy = transform_.apply_to_vector(inct.duvdy);
+    }
+
 public:
 
     virtual ~Texture2D() = default;
@@ -135,13 +185,7 @@ public:
         const Vec2 uv1 = transform_.apply_to_point(uv);
         const real u = wrapper_u_(uv1.x);
         const real v = wrapper_v_(uv1.y);
-        FSpectrum ret = sample_spectrum_impl({ u, v });
-        if(inv_gamma_ != 1)
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                ret[i] = std::pow(ret[i], inv_gamma_);
-        }
-        return ret;
+        return apply_inv_gamma(sample_spectrum_impl({ u, v }));
     }
 
     /**
@@ -152,20 +196,29 @@ public:
         const Vec2 uv1 = transform_.apply_to_point(uv);
         const real u = wrapper_u_(uv1.x);
         const real v = wrapper_v_(uv1.y);
-        real ret = sample_real_impl({ u, v });
-        if(inv_gamma_ != 1)
-            ret = std::pow(ret, inv_gamma_);
-        return ret;
+        return apply_inv_gamma(sample_real_impl({ u, v }));
     }
 
+    /**
+     * @brief sample spectrum value at inct.uv, filtered over the uv footprint
+     *  (inct.duvdx, inct.duvdy)
+     */
     virtual FSpectrum sample_spectrum(const EntityIntersection &inct) const noexcept
     {
-        return sample_spectrum(inct.uv);
+        if(!inct.has_uv_footprint())
+            return sample_spectrum(inct.uv);
+        return filtered_sample_spectrum_impl(inct);
     }
 
+    /**
+     * @brief sample real value at inct.uv, filtered over the uv footprint
+     *  (inct.duvdx, inct.duvdy)
+     */
     virtual real sample_real(const EntityIntersection &inct) const noexcept
     {
-        return sample_real(inct.uv);
+        if(!inct.has_uv_footprint())
+            return sample_real(inct.uv);
+        return filtered_sample_real_impl(inct);
     }
 
     virtual int width() const noexcept = 0;
@@ -51,6 +51,17 @@ protected:
 
     void init_common_params(const Texture3DCommonParams &params);
 
+    /**
+     * @brief range [beg, end] of texels which may be accessed when sampling
+     *  in [uvw_low, uvw_high]
+     *
+     * includes one more texel on each side for interpolation.
+     * return false when the range cannot be bounded due to wrapping
+     */
+    bool uvw_to_texel_range(
+        const FVec3 &uvw_low, const FVec3 &uvw_high, const Vec3i &size,
+        Vec3i &beg, Vec3i &end) const noexcept;
+
     virtual FSpectrum sample_spectrum_impl(const FVec3 &uvw) const noexcept;
 
     virtual real sample_real_impl(const FVec3 &uvw) const noexcept;
@@ -84,6 +95,14 @@ public:
      * @brief maximal real value
      */
     virtual real max_real() const noexcept = 0;
+
+    /**
+     * @brief upper bound of real values sampled in [uvw_low, uvw_high]
+     *
+     * default implementation returns max_real()
+     */
+    virtual real max_real_in(
+        const FVec3 &uvw_low, const FVec3 &uvw_high) const noexcept;
 };
 
 inline FTransform3 Texture3DCommonParams::full_transform() const
@@ -193,6 +212,52 @@ inline real Texture3D::sample_real_impl(const FVec3 &uvw) const noexcept
     return sample_spectrum_impl(uvw).r;
 }
 
+inline bool Texture3D::uvw_to_texel_range(
+    const FVec3 &uvw_low, const FVec3 &uvw_high, const Vec3i &size,
+    Vec3i &beg, Vec3i &end) const noexcept
+{
+    // bound of the transformed uvw box
+
+    AABB tbound;
+    for(int i = 0; i < 8; ++i)
+    {
+        tbound |= transform_.apply_to_point({
+            (i & 1) ? uvw_high.x : uvw_low.x,
+            (i & 2) ? uvw_high.y : uvw_low.y,
+            (i & 4) ? uvw_high.z : uvw_low.z
+        });
+    }
+
+    const WrapFuncPtr wrappers[3] = { wrapper_u_, wrapper_v_, wrapper_w_ };
+
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        real low  = tbound.low[axis];
+        real high = tbound.high[axis];
+
+        if(wrappers[axis] == &wrap_clamp)
+        {
+            low  = math::clamp<real>(low,  0, 1);
+            high = math::clamp<real>(high, 0, 1);
+        }
+        else if(low < 0 || high > 1)
+            return false;
+
+        beg[axis] = math::clamp(
+            static_cast<int>(low  * size[axis]) - 1, 0, size[axis] - 1);
+        end[axis] = math::clamp(
+            static_cast<int>(high * size[axis]) + 1, 0, size[axis] - 1);
+    }
+
+    return true;
+}
+
+inline real Texture3D::max_real_in(
+    const FVec3 &uvw_low, const FVec3 &uvw_high) const noexcept
+{
+    return max_real();
+}
+
 inline FSpectrum Texture3D::sample_spectrum(const FVec3 &uvw) const noexcept
 {
     auto tuvw = transform_.apply_to_point(uvw);
@@ -5,10 +5,17 @@
 
 AGZ_TRACER_BEGIN
 
+/**
+ * @brief image based lighting
+ *
+ * sampling_resolution is the max resolution of the importance sampling
+ * distribution. the texture resolution is used when it is smaller
+ */
 RC<EnvirLight> create_ibl_light(
     RC<const Texture2D> tex,
     bool no_importance_sampling = false,
-    real user_specified_power = -1);
+    real user_specified_power = -1,
+    int sampling_resolution = 4096);
 
 RC<EnvirLight> create_native_sky(
     const FSpectrum &top,
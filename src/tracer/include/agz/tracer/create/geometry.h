@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include <agz/tracer/core/geometry.h>
 #include <agz-utils/mesh.h>
 
@@ -39,8 +41,118 @@ RC<Geometry> create_triangle_bvh_embree(
 
 #endif
 
+struct TriangleBVHNoEmbreeParams
+{
+    int max_leaf_size = 5;
+
+    // <= 0: hardware thread count + build_worker_count
+    int build_worker_count = 0;
+
+    // use binned SAH builder instead of centroid-midpoint splitting
+    bool use_sah = false;
+
+    int  sah_bin_count      = 16;
+    real sah_leaf_cost      = 1; // cost of testing one triangle
+    real sah_traversal_cost = 1; // cost of visiting one interior node
+
+    enum class Layout
+    {
+        Binary,  // binary tree with full-precision nodes and triangles
+        Wide4,   // 4-wide nodes with 4-triangle leaf packets
+        Compact  // quantized nodes with indexed, compressed vertices
+    };
+
+    Layout layout = Layout::Binary;
+};
+
+/**
+ * @brief indexed triangle mesh which is read in place by the triangle bvh
+ *  builders
+ *
+ * positions and indices are accessed directly. normals and uvs can be stored
+ * in any form (e.g. quantized), and are fetched vertex by vertex with
+ * vertex_attrib. the referenced data must outlive the building process only
+ */
+struct IndexedTriangleMeshView
+{
+    uint32_t vertex_count   = 0;
+    uint32_t triangle_count = 0;
+
+    const float    *positions = nullptr; // [vertex_count][3]
+    const uint32_t *indices   = nullptr; // [triangle_count][3]
+
+    std::function<void(uint32_t vertex_idx, FVec3 *normal, Vec2 *uv)>
+        vertex_attrib;
+};
+
 RC<Geometry> create_triangle_bvh_noembree(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world);
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params = {});
+
+/**
+ * @brief create triangle bvh from an indexed mesh without expanding it into
+ *  triangles
+ *
+ * only positions are copied when transformed by local_to_world
+ */
+RC<Geometry> create_triangle_bvh_noembree(
+    const IndexedTriangleMeshView &mesh,
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params = {});
+
+/**
+ * @brief triangle bvh in local space, which can be shared by instances
+ */
+class TriangleBVHMesh;
+
+RC<const TriangleBVHMesh> create_triangle_bvh_mesh(
+    const std::vector<mesh::triangle_t> &build_triangles,
+    const TriangleBVHNoEmbreeParams &params = {});
+
+RC<const TriangleBVHMesh> create_triangle_bvh_mesh(
+    const IndexedTriangleMeshView &mesh,
+    const TriangleBVHNoEmbreeParams &params = {});
+
+/**
+ * @brief whether transform only contains rotation, reflection, translation
+ *  and uniform scaling
+ */
+bool is_similarity_transform(const FTransform3 &transform) noexcept;
+
+/**
+ * @brief instance of a shared triangle bvh mesh
+ *
+ * surface area and sampling pdf of the mesh are scaled by a single ratio, so
+ * local_to_world must be a similarity transform. throw
+ * ObjectConstructionException otherwise
+ */
+RC<Geometry> create_triangle_bvh_instance(
+    RC<const TriangleBVHMesh> mesh, const FTransform3 &local_to_world);
+
+/**
+ * @brief create triangle bvh from a binary cache file
+ *
+ * nodes and triangles are memory-mapped from the cache file when it is
+ * valid. otherwise load_triangles is called, and the built bvh is written
+ * to the cache file. only Layout::Binary is cached
+ *
+ * the cache contains triangles transformed by local_to_world
+ */
+RC<Geometry> create_cached_triangle_bvh_noembree(
+    const std::string &cache_filename,
+    const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params = {});
+
+/**
+ * @brief create shared triangle bvh mesh from a binary cache file
+ *
+ * see create_cached_triangle_bvh_noembree
+ */
+RC<const TriangleBVHMesh> create_cached_triangle_bvh_mesh(
+    const std::string &cache_filename,
+    const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+    const TriangleBVHNoEmbreeParams &params = {});
 
 AGZ_TRACER_END
@@ -7,13 +7,35 @@
 
 AGZ_TRACER_BEGIN
 
+// transmittance estimator of heterogeneous medium
+
+enum class TransmittanceEstimator
+{
+    Ratio,        // ratio tracking against local majorants
+    ResidualRatio // residual ratio tracking with a control density
+};
+
+struct TransmittanceEstimatorParams
+{
+    TransmittanceEstimator type = TransmittanceEstimator::Ratio;
+
+    // control density of residual ratio tracking, relative to the local
+    // majorant of each segment
+    real control_density_ratio = real(0.5);
+
+    // russian roulette is applied when the estimate drops below this.
+    // <= 0 disables it
+    real rr_threshold = 0;
+};
+
 RC<Medium> create_heterogeneous_medium(
     const FTransform3 &local_to_world,
     RC<const Texture3D> density,
     RC<const Texture3D> albedo,
     RC<const Texture3D> g,
     int max_scattering_count,
-    bool white_for_indirect);
+    bool white_for_indirect,
+    const TransmittanceEstimatorParams &tr_params = {});
 
 RC<Medium> create_homogeneous_medium(
     const FSpectrum &sigma_a,
@@ -21,11 +21,43 @@ struct PTRendererParams
     int spp = 1;
 
     int specular_depth = 20;
+
+    PixelSamplerType sampler = PixelSamplerType::Native;
+
+    // adaptive sampling: after spp samples, pixels with relative error
+    // above target_error are sampled further, up to max_spp samples
+    bool adaptive     = false;
+    real target_error = real(0.01);
+    int  max_spp      = 0; // <= 0: 4 * spp
 };
 
 RC<Renderer> create_pt_renderer(
     const PTRendererParams &params);
 
+// wavefront path tracing
+
+struct PTWavefrontRendererParams
+{
+    int min_depth  = 5;
+    int max_depth  = 10;
+    real cont_prob = real(0.9);
+
+    int worker_count   = 0;
+    int task_grid_size = 32;
+
+    int spp = 1;
+
+    int specular_depth = 20;
+
+    PixelSamplerType sampler = PixelSamplerType::Native;
+
+    // max number of paths traced together by a worker thread
+    int queue_size = 4096;
+};
+
+RC<Renderer> create_pt_wavefront_renderer(
+    const PTWavefrontRendererParams &params);
+
 // particle tracing
 
 struct AdjointPTRendererParams
@@ -65,6 +97,8 @@ struct AORendererParams
     FSpectrum background_color = FSpectrum(0);
 
     int spp = 1;
+
+    PixelSamplerType sampler = PixelSamplerType::Native;
 };
 
 RC<Renderer> create_ao_renderer(const AORendererParams &params);
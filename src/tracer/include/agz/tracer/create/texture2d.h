@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/tiled_texture.h>
 
 AGZ_TRACER_BEGIN
 
@@ -24,6 +25,13 @@ RC<Texture2D> create_image_texture(
     const Texture2DCommonParams &common_params,
     RC<const Image2D<math::color3b>> data, const std::string &sampler);
 
+/**
+ * @brief texture whose tiles are loaded on demand via TextureTileCache
+ */
+RC<Texture2D> create_tiled_image_texture(
+    const Texture2DCommonParams &common_params,
+    RC<const TiledTextureFile> file, const std::string &sampler);
+
 RC<Texture2D> create_solid_image_texture(RC<const Texture3D> tex3d);
 
 AGZ_TRACER_END
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/utility/sparse_volume.h>
 #include <agz-utils/texture/texture3d.h>
 
 AGZ_TRACER_BEGIN
@@ -29,4 +30,9 @@ RC<Texture3D> create_image3d(
     RC<const Image3D<math::color3b>> data,
     bool use_linear_sampler);
 
+RC<Texture3D> create_sparse_brick3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseBrickVolume> volume,
+    bool use_linear_sampler);
+
 AGZ_TRACER_END
@@ -7,52 +7,68 @@
 
 AGZ_TRACER_BEGIN
 
+/*
+ * select_light_pdf: probability of choosing the light. it is folded into the
+ * pdf of the light sample, so the returned estimate already accounts for
+ * light selection and must not be divided by it again
+ */
+
 FSpectrum mis_sample_area_light(
     const Scene &scene,
     const AreaLight *light,
     const EntityIntersection &inct,
     const ShadingPoint &shd,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 FSpectrum mis_sample_area_light(
     const Scene &scene,
     const AreaLight *light,
     const MediumScattering &scattering,
     const BSDF *phase_function,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 FSpectrum mis_sample_envir_light(
     const Scene &scene,
     const EnvirLight *light,
     const EntityIntersection &inct,
     const ShadingPoint &shd,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 FSpectrum mis_sample_envir_light(
     const Scene &scene,
     const EnvirLight *light,
     const MediumScattering &scattering,
     const BSDF *phase_function,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 FSpectrum mis_sample_light(
     const Scene &scene,
     const Light *lht,
     const EntityIntersection &inct,
     const ShadingPoint &shd,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 FSpectrum mis_sample_light(
     const Scene &scene,
     const Light *lht,
     const MediumScattering &scattering,
     const BSDF *phase_function,
-    Sampler &sampler);
+    Sampler &sampler,
+    real select_light_pdf = 1);
 
 /**
  * @brief compute BSDF sampling part in MIS direct illumination
  *
- * the last 3 parameters are used for receiving the BSDF sampling result
+ * bsdf_sample, has_ent_inct and ent_inct are used for receiving the BSDF
+ * sampling result.
+ *
+ * when one_light is true, light pdf in MIS weight is multiplied by
+ * scene.light_pdf(pos, nor, light), matching mis_sample_one_light
  */
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
@@ -61,18 +77,21 @@ FSpectrum mis_sample_bsdf(
     Sampler &sampler,
     BSDFSampleResult &bsdf_sample,
     bool &has_ent_inct,
-    EntityIntersection &ent_inct);
+    EntityIntersection &ent_inct,
+    bool one_light = false);
 
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
     const EntityIntersection &inct,
     const ShadingPoint &shd,
-    Sampler &sampler);
+    Sampler &sampler,
+    bool one_light = false);
 
 /**
  * @brief compute phase function sampling part in MIS direct illumination
  *
- * the last 3 parameters are receiver of the phase function sampling result
+ * bsdf_sample, has_ent_inct and ent_inct are receiver of the phase function
+ * sampling result
  */
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
@@ -80,9 +99,27 @@ FSpectrum mis_sample_bsdf(
     const BSDF *phase_function,
     Sampler &sampler,
     BSDFSampleResult &bsdf_sample,
-    bool &has_ent_inct, EntityIntersection &ent_inct);
+    bool &has_ent_inct, EntityIntersection &ent_inct,
+    bool one_light = false);
 
 FSpectrum mis_sample_bsdf(
+    const Scene &scene,
+    const MediumScattering &scattering,
+    const BSDF *phase_function,
+    Sampler &sampler,
+    bool one_light = false);
+
+/**
+ * @brief MIS direct illumination from one light chosen by
+ *  scene.sample_light(pos, nor, sam), including the BSDF sampling part
+ */
+FSpectrum mis_sample_one_light(
+    const Scene &scene,
+    const EntityIntersection &inct,
+    const ShadingPoint &shd,
+    Sampler &sampler);
+
+FSpectrum mis_sample_one_light(
     const Scene &scene,
     const MediumScattering &scattering,
     const BSDF *phase_function,
@@ -17,13 +17,13 @@ struct ParticleTraceParams
 void trace_particle(
     const ParticleTraceParams &params,
     const Scene &scene, Sampler &sampler,
-    FilmFilterApplier::FilmGridView<Spectrum> &film,
+    SplatFilm::ThreadBuffer &film,
     Arena &arena);
 
 void trace_vol_particle(
     const ParticleTraceParams &params,
     const Scene &scene, Sampler &sampler,
-    FilmFilterApplier::FilmGridView<Spectrum> &film,
+    SplatFilm::ThreadBuffer &film,
     Arena &arena);
 
 AGZ_TRACER_RENDER_END
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/render/common.h>
+#include <agz-utils/misc.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
@@ -32,21 +33,41 @@ struct AlbedoAOParams
     real max_occlusion_distance = 1;
 };
 
+/**
+ * @brief trace a camera ray
+ *
+ * diff is used for texture filtering at the first intersection
+ */
 Pixel trace_std(
     const TraceParams &params,
     const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena);
+    Sampler &sampler, Arena &arena,
+    const RayDifferential &diff = {});
 
 Pixel trace_nomis(
     const TraceParams &params,
     const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena);
+    Sampler &sampler, Arena &arena,
+    const RayDifferential &diff = {});
 
 Pixel trace_ao(
     const AOParams &params,
     const Scene &scene, const Ray &ray,
     Sampler &sampler);
 
+/**
+ * @brief batched version of trace_ao
+ *
+ * camera rays and ao shadow rays are traced as streams.
+ * sampler.start_pixel_sample(sample_indices[i]) is called before generating
+ * shadow rays of rays[i]. stream buffers are kept per thread and reused by
+ * later calls
+ */
+void trace_ao_n(
+    const AOParams &params, const Scene &scene,
+    misc::span<const Ray> rays, const PixelSampleIndex *sample_indices,
+    Pixel *pixels, Sampler &sampler);
+
 Pixel trace_albedo_ao(
     const AlbedoAOParams &params,
     const Scene &scene, const Ray &ray,
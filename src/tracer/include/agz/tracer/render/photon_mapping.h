@@ -1,7 +1,9 @@
 #pragma once
 
+#include <vector>
+
 #include <agz/tracer/render/common.h>
-#include <agz/tracer/utility/hashed_grid_aux.h>
+#include <agz-utils/thread.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
@@ -71,46 +73,130 @@ struct Pixel
     FSpectrum direct_illum;
 };
 
-class VisiblePointSearcher
+/**
+ * @brief per-thread buffer of photon flux deposits
+ *
+ * records (pixel, flux) pairs instead of accumulating them to pixels with
+ * atomic operations. deposits are sorted by pixel and reduced once per
+ * iteration, so photon tracing threads never write to shared pixels
+ *
+ * pixels are identified by their addresses, which are assumed to be ordered
+ * in the same way as pixels in the film
+ */
+class PhotonDepositBuffer
 {
 public:
 
-    explicit VisiblePointSearcher(
-        const AABB &world_bound,
-        real grid_sidelen,
-        size_t entry_count);
+    /**
+     * @brief record flux deposited at a pixel
+     */
+    void add(Pixel *pixel, const FSpectrum &phi);
+
+    /**
+     * @brief sort deposits by pixel and merge deposits of the same pixel
+     */
+    void sort_and_reduce();
+
+    /**
+     * @brief accumulate deposits of pixels in [beg, end) to these pixels
+     *
+     * 'sort_and_reduce' must be called before. parallel 'apply' is safe if
+     * the pixel ranges do not overlap
+     */
+    void apply(const Pixel *beg, const Pixel *end) const;
 
     /**
-     * @brief clear all vp records
+     * @brief remove all deposits
      */
     void clear();
 
+private:
+
+    struct Deposit
+    {
+        Pixel    *pixel;
+        FSpectrum phi;
+        int       count;
+    };
+
+    // when the buffer grows beyond this, it is reduced in place
+    size_t reduce_threshold_ = 1 << 20;
+
+    std::vector<Deposit> deposits_;
+};
+
+/**
+ * @brief uniform grid of visible points for photon lookups
+ *
+ * rebuilt for each iteration with a parallel counting sort. each visible
+ * point is copied to all hashed cells overlapped by its search sphere, and
+ * records of a cell are stored contiguously
+ */
+class VisiblePointSearcher
+{
+public:
+
     /**
-     * @brief add a vp record
+     * @brief rebuild the grid from valid visible points of pixels
      *
-     * parallel 'add_vp' is safe
+     * cell size and cell count are chosen from the number of visible points
+     * and the distribution of their radii
      */
-    void add_vp(Pixel &pixel, Arena &vp_node_arena);
+    void build(
+        Pixel *pixels, size_t pixel_count,
+        int thread_count);
 
     /**
      * @brief accumulate photon flux to recorded visible points
      *
      * parallel 'add_photon' is safe
      */
-    void add_photon(const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr);
+    void add_photon(
+        const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr) const;
+
+    /**
+     * @brief record photon flux at visible points in a deposit buffer
+     *
+     * parallel 'add_photon' is safe if each thread uses its own buffer
+     */
+    void add_photon(
+        const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr,
+        PhotonDepositBuffer &deposits) const;
 
 private:
 
-    struct VPNode
+    // call func(pixel, delta_phi) for each visible point around photon_pos
+    template<typename Func>
+    void for_each_contribution(
+        const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr,
+        Func &&func) const;
+
+    Vec3i pos_to_cell(const FVec3 &pos) const noexcept;
+
+    size_t cell_to_entry(const Vec3i &cell) const noexcept;
+
+    static uint64_t cell_to_key(const Vec3i &cell) noexcept;
+
+    struct VPRecord
     {
-        Pixel *pixel = nullptr;
-        VPNode *next = nullptr;
+        FVec3    pos;
+        real     radius2;
+        Pixel   *pixel;
+        uint64_t cell_key; // different cells may share the same entry
     };
 
-    HashedGridAux hashed_grid_aux_;
+    FVec3 world_low_;
+    real  cell_sidelen_     = 1;
+    real  inv_cell_sidelen_ = 1;
+
+    size_t entry_mask_ = 0;
 
-    Box<std::atomic<VPNode*>[]> node_entries_;
-    size_t node_entry_count_;
+    // records of entry i are records_[entry_beg_[i], entry_beg_[i + 1])
+    std::vector<uint32_t> entry_beg_;
+    std::vector<VPRecord> records_;
+
+    Box<std::atomic<uint32_t>[]> entry_cursors_;
+    size_t entry_cursor_count_ = 0;
 };
 
 /**
@@ -135,7 +221,16 @@ Pixel::VisiblePoint tracer_vp(
  */
 void trace_photon(
     int min_depth, int max_depth, real cont_prob,
-    VisiblePointSearcher &vp_searcher,
+    const VisiblePointSearcher &vp_searcher,
+    const Scene &scene, Arena &arena, Sampler &sampler);
+
+/**
+ * trace a photon from light source and
+ * record flux at visible points in deposits
+ */
+void trace_photon(
+    int min_depth, int max_depth, real cont_prob,
+    const VisiblePointSearcher &vp_searcher, PhotonDepositBuffer &deposits,
     const Scene &scene, Arena &arena, Sampler &sampler);
 
 void update_pixel_params(real alpha, Pixel &pixel);
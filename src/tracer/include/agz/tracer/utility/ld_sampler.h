@@ -0,0 +1,108 @@
+#pragma once
+
+#include <agz/tracer/core/sampler.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief owen-scrambled sobol sampler
+ *
+ * each sampleN() call consumes one dimension of a padded sequence. values of
+ * a dimension come from the first N dims of the sobol sequence, with the
+ * sample index shuffled and the values scrambled by per-pixel-dimension seeds
+ * (Burley 2020, "Practical Hash-based Owen Scrambling")
+ */
+class SobolSampler : public Sampler
+{
+public:
+
+    explicit SobolSampler(uint32_t seed) noexcept;
+
+    Sample1 sample1() override;
+    Sample2 sample2() override;
+    Sample3 sample3() override;
+    Sample4 sample4() override;
+    Sample5 sample5() override;
+
+    void start_pixel_sample(const PixelSampleIndex &index) override;
+
+    PixelSampleIndex pixel_sample_index() const override;
+
+protected:
+
+    // seed shared by all dimensions of current pixel
+    virtual uint32_t pixel_seed(const Vec2i &pixel) const noexcept;
+
+    // called on each generated value
+    virtual real dither(real u, int dim) const noexcept { return u; }
+
+    template<int N>
+    void sample_dims(real *output) noexcept;
+
+    uint32_t seed_;
+
+    PixelSampleIndex index_;
+    uint32_t pixel_seed_;
+};
+
+/**
+ * @brief sobol sampler with values of each pixel shifted by a blue noise mask
+ *
+ * all pixels share the same scrambled sequence, and the toroidal shifts of
+ * neighbouring pixels come from a tiled blue noise mask, which distributes
+ * the error as blue noise over the image
+ * (Georgiev & Fajardo 2016, "Blue-noise Dithered Sampling")
+ */
+class BlueNoiseSampler : public SobolSampler
+{
+public:
+
+    explicit BlueNoiseSampler(uint32_t seed) noexcept;
+
+protected:
+
+    uint32_t pixel_seed(const Vec2i &pixel) const noexcept override;
+
+    real dither(real u, int dim) const noexcept override;
+};
+
+/**
+ * @brief halton sampler with per-pixel random toroidal shifts
+ *
+ * dimensions beyond the prime table fall back to hashed random values
+ */
+class HaltonSampler : public Sampler
+{
+public:
+
+    explicit HaltonSampler(uint32_t seed) noexcept;
+
+    Sample1 sample1() override;
+    Sample2 sample2() override;
+    Sample3 sample3() override;
+    Sample4 sample4() override;
+    Sample5 sample5() override;
+
+    void start_pixel_sample(const PixelSampleIndex &index) override;
+
+    PixelSampleIndex pixel_sample_index() const override;
+
+private:
+
+    real next() noexcept;
+
+    uint32_t seed_;
+
+    // index_.dimension is the number of generated values
+    PixelSampleIndex index_;
+    uint32_t pixel_seed_;
+};
+
+/**
+ * @brief create a sampler of given type
+ *
+ * returns nullptr for PixelSamplerType::Native
+ */
+Box<Sampler> create_pixel_sampler(PixelSamplerType type, uint32_t seed);
+
+AGZ_TRACER_END
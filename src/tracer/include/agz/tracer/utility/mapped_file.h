@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+#include <agz/tracer/common.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief read-only memory-mapped file
+ *
+ * pages are loaded by the os on first access, so opening a file takes
+ * almost no time regardless of its size
+ */
+class MappedFile : public misc::uncopyable_t
+{
+public:
+
+    MappedFile() noexcept = default;
+
+    /**
+     * @brief map the whole file. throw std::runtime_error on failure
+     */
+    explicit MappedFile(const std::string &filename);
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    ~MappedFile();
+
+    void swap(MappedFile &other) noexcept;
+
+    bool is_open() const noexcept;
+
+    const unsigned char *data() const noexcept;
+
+    size_t size() const noexcept;
+
+private:
+
+    void close() noexcept;
+
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+
+#ifdef _WIN32
+    void *file_handle_    = nullptr;
+    void *mapping_handle_ = nullptr;
+#endif
+};
+
+AGZ_TRACER_END
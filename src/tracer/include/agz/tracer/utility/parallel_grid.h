@@ -1,6 +1,7 @@
 #pragma once
 
 #include <agz/tracer/common.h>
+#include <agz/tracer/utility/task_scheduler.h>
 #include <agz-utils/thread.h>
 
 AGZ_TRACER_BEGIN
@@ -12,24 +13,24 @@ AGZ_TRACER_BEGIN
  * func interface: bool func(int thread_index, int beg, int end)
  *
  * if any one func call returns false, that worker thread is stopped immediately
+ *
+ * ranges are distributed by TaskScheduler with work stealing, and each thread
+ * mostly processes adjacent ranges
  */
 template<typename Func>
 void parallel_for_1d_grid(
-    int thread_count, int total_width, int grid_size,
-    thread::thread_group_t &threads, Func &&func)
+    int thread_count, int total_width, int grid_size, Func &&func)
 {
     const int task_count = (total_width + grid_size - 1) / grid_size;
+    thread_count = (std::max)(1, (std::min)(thread_count, task_count));
 
-    std::atomic<int> next_task = 0;
+    WorkStealingRanges tasks(thread_count, task_count);
 
     auto worker_func = [&](int thread_index)
     {
-        for(;;)
+        int task_idx;
+        while(tasks.pop(thread_index, &task_idx))
         {
-            const int task_idx = next_task++;
-            if(task_idx >= task_count)
-                return;
-
             const int beg = task_idx * grid_size;
             const int end = (std::min)(beg + grid_size, total_width);
 
@@ -45,7 +46,7 @@ void parallel_for_1d_grid(
         }
     };
 
-    threads.run(thread_count, worker_func);
+    TaskScheduler::instance().run(thread_count, worker_func);
 }
 
 /**
@@ -55,29 +56,32 @@ void parallel_for_1d_grid(
  * func interface: bool func(int thread_index, Rect2i grid)
  *
  * if any one func call returns false, that worker thread is stopped immediately
+ *
+ * grids are ordered along a hilbert curve and distributed by TaskScheduler
+ * with work stealing, so that each thread mostly processes neighboring grids
  */
 template<typename Func>
 void parallel_for_2d_grid(
     int thread_count, int width, int height,
-    int grid_size_x, int grid_size_y,
-    thread::thread_group_t &threads, Func &&func)
+    int grid_size_x, int grid_size_y, Func &&func)
 {
     const int x_task_count = (width  + grid_size_x - 1) / grid_size_x;
     const int y_task_count = (height + grid_size_y - 1) / grid_size_y;
     const int total_task_count = x_task_count * y_task_count;
+    thread_count = (std::max)(1, (std::min)(thread_count, total_task_count));
+
+    const std::vector<Vec2i> task_order =
+        hilbert_tile_order(x_task_count, y_task_count);
 
-    std::atomic<int> next_task = 0;
+    WorkStealingRanges tasks(thread_count, total_task_count);
 
     auto worker_func = [&](int thread_index)
     {
-        for(;;)
+        int task_idx;
+        while(tasks.pop(thread_index, &task_idx))
         {
-            const int task_idx = next_task++;
-            if(task_idx >= total_task_count)
-                return;
-
-            const int y_idx = task_idx / x_task_count;
-            const int x_idx = task_idx % x_task_count;
+            const int x_idx = task_order[task_idx].x;
+            const int y_idx = task_order[task_idx].y;
 
             const int x_beg = x_idx * grid_size_x;
             const int y_beg = y_idx * grid_size_y;
@@ -98,34 +102,7 @@ void parallel_for_2d_grid(
         }
     };
 
-    threads.run(thread_count, worker_func);
-}
-
-/**
- * @brief parallal_for_1d_grid without thread_group
- */
-template<typename Func>
-void parallel_for_1d_grid(
-    int thread_count, int total_width, int grid_size, Func &&func)
-{
-    thread::thread_group_t threads;
-    parallel_for_1d_grid(
-        thread_count, total_width, grid_size,
-        threads, std::forward<Func>(func));
-}
-
-/**
- * @brief parallal_for_2d_grid without thread_group
- */
-template<typename Func>
-void parallel_for_2d_grid(
-    int thread_count, int width, int height,
-    int grid_size_x, int grid_size_y, Func &&func)
-{
-    thread::thread_group_t threads;
-    parallel_for_2d_grid(
-        thread_count, width, height, grid_size_x, grid_size_y,
-        threads, std::forward<Func>(func));
+    TaskScheduler::instance().run(thread_count, worker_func);
 }
 
 AGZ_TRACER_END
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <vector>
+
 #include <agz/tracer/core/sampler.h>
+#include <agz/tracer/utility/ld_sampler.h>
 
 AGZ_TRACER_BEGIN
 
@@ -12,6 +15,14 @@ public:
 
     PerThreadNativeSamplers(size_t threadCount, const NativeSampler &parent);
 
+    /**
+     * @brief also create per-thread samplers of given type for generating
+     *  pixel samples
+     */
+    PerThreadNativeSamplers(
+        size_t threadCount, const NativeSampler &parent,
+        PixelSamplerType pixelSamplerType);
+
     PerThreadNativeSamplers(PerThreadNativeSamplers &&other) noexcept;
 
     PerThreadNativeSamplers &operator=(PerThreadNativeSamplers &&other) noexcept;
@@ -24,6 +35,13 @@ public:
 
     NativeSampler *operator[](size_t threadIdx) noexcept;
 
+    /**
+     * @brief sampler for generating pixel samples
+     *
+     * the native sampler is returned when pixel sampler type is Native
+     */
+    Sampler *get_pixel_sampler(size_t threadIdx) noexcept;
+
 private:
 
     static constexpr size_t STORAGE_ALIGN = 64;
@@ -41,6 +59,8 @@ private:
 
     size_t count_;
     SamplerStorage *samplers_;
+
+    std::vector<Box<Sampler>> pixel_samplers_;
 };
 
 inline PerThreadNativeSamplers::PerThreadNativeSamplers()
@@ -74,6 +94,24 @@ inline PerThreadNativeSamplers::PerThreadNativeSamplers(
     }
 }
 
+inline PerThreadNativeSamplers::PerThreadNativeSamplers(
+    size_t threadCount, const NativeSampler &parent,
+    PixelSamplerType pixelSamplerType)
+    : PerThreadNativeSamplers(threadCount, parent)
+{
+    if(pixelSamplerType == PixelSamplerType::Native)
+        return;
+
+    // dimension-aware samplers are deterministic in pixel sample indices,
+    // so all threads share the same seed
+    pixel_samplers_.reserve(threadCount);
+    for(size_t i = 0; i < threadCount; ++i)
+    {
+        pixel_samplers_.push_back(create_pixel_sampler(
+            pixelSamplerType, static_cast<uint32_t>(parent.get_seed())));
+    }
+}
+
 inline PerThreadNativeSamplers::PerThreadNativeSamplers(
     PerThreadNativeSamplers &&other) noexcept
     : PerThreadNativeSamplers()
@@ -100,6 +138,7 @@ inline void PerThreadNativeSamplers::swap(PerThreadNativeSamplers &other) noexce
 {
     std::swap(count_, other.count_);
     std::swap(samplers_, other.samplers_);
+    std::swap(pixel_samplers_, other.pixel_samplers_);
 }
 
 inline NativeSampler *PerThreadNativeSamplers::get_sampler(
@@ -114,6 +153,14 @@ inline NativeSampler *PerThreadNativeSamplers::operator[](
     return get_sampler(threadIdx);
 }
 
+inline Sampler *PerThreadNativeSamplers::get_pixel_sampler(
+    size_t threadIdx) noexcept
+{
+    if(pixel_samplers_.empty())
+        return get_sampler(threadIdx);
+    return pixel_samplers_[threadIdx].get();
+}
+
 inline PerThreadNativeSamplers::SamplerStorage::SamplerStorage(
     int seed, bool use_time_seed)
     : sampler(seed, use_time_seed)
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <agz/tracer/common.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief double-buffered preview image refreshed incrementally by tiles
+ *
+ * renderers write their accumulation buffers through write(), or call
+ * mark_dirty() for buffers which are safe to read concurrently. dirty tiles
+ * are resolved into the back image by try_refresh(), which returns
+ * immediately when another thread is refreshing or the last refresh is too
+ * recent, so that at most one worker pays for previewing at a time.
+ * get_image() copies the front image and never waits for resolving.
+ */
+class ProgressivePreview : public misc::uncopyable_t
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief compute preview pixels in an inclusive pixel range
+     */
+    using ResolveFunc = std::function<
+        void(const Rect2i &pixels, Image2D<Spectrum> &output)>;
+
+    static constexpr int DEFAULT_TILE_SIZE = 32;
+
+    ProgressivePreview(
+        int width, int height, ResolveFunc resolve,
+        Clock::duration min_refresh_interval = std::chrono::milliseconds(200),
+        int tile_size = DEFAULT_TILE_SIZE);
+
+    /**
+     * @brief call func with tiles overlapping the given inclusive pixel
+     *  range locked, then mark them as dirty
+     *
+     * func can modify the data read by the resolve function in the range
+     */
+    template<typename Func>
+    void write(const Rect2i &pixels, Func &&func);
+
+    /**
+     * @brief mark tiles overlapping the given inclusive pixel range as dirty
+     */
+    void mark_dirty(const Rect2i &pixels) noexcept;
+
+    void mark_all_dirty() noexcept;
+
+    /**
+     * @brief refresh the front image if no other thread is refreshing and
+     *  the min refresh interval has elapsed
+     *
+     * @return whether the front image is refreshed
+     */
+    bool try_refresh();
+
+    /**
+     * @brief refresh the front image unconditionally
+     */
+    void refresh();
+
+    /**
+     * @brief copy of the front image
+     */
+    Image2D<Spectrum> get_image() const;
+
+private:
+
+    Rect2i tile_range(const Rect2i &pixels) const noexcept;
+
+    // requires refresh_mutex_ to be locked
+    void refresh_impl();
+
+    int width_;
+    int height_;
+    int tile_size_;
+    int tile_count_x_;
+    int tile_count_y_;
+
+    ResolveFunc resolve_;
+
+    Box<std::mutex[]> tile_mutexes_;
+
+    // increased when a tile is written
+    Box<std::atomic<uint32_t>[]> tile_versions_;
+
+    // tile versions resolved into each image
+    std::vector<uint32_t> image_versions_[2];
+
+    Image2D<Spectrum> images_[2];
+    int front_ = 0;
+    mutable std::mutex front_mutex_;
+
+    std::mutex refresh_mutex_;
+    Clock::duration min_refresh_interval_;
+    Clock::time_point last_refresh_time_;
+};
+
+template<typename Func>
+void ProgressivePreview::write(const Rect2i &pixels, Func &&func)
+{
+    // tiles are always locked in the same order to avoid deadlocks
+
+    const Rect2i tiles = tile_range(pixels);
+    for(int y = tiles.low.y; y <= tiles.high.y; ++y)
+    {
+        for(int x = tiles.low.x; x <= tiles.high.x; ++x)
+            tile_mutexes_[y * tile_count_x_ + x].lock();
+    }
+
+    AGZ_SCOPE_EXIT
+    {
+        for(int y = tiles.low.y; y <= tiles.high.y; ++y)
+        {
+            for(int x = tiles.low.x; x <= tiles.high.x; ++x)
+                tile_mutexes_[y * tile_count_x_ + x].unlock();
+        }
+        mark_dirty(pixels);
+    };
+
+    func();
+}
+
+AGZ_TRACER_END
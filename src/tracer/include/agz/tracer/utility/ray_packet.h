@@ -0,0 +1,91 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+
+#include <agz/tracer/common.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief soa ray packet used for traversing bvh with a stream of rays
+ *
+ * each bit of a mask indicates whether the corresponding ray is active
+ */
+struct RayPacket
+{
+    static constexpr int MAX_SIZE = 64;
+
+    using Mask = uint64_t;
+
+    int size = 0;
+
+    real ori    [3][MAX_SIZE];
+    real inv_dir[3][MAX_SIZE];
+    real t_min     [MAX_SIZE];
+    real t_max     [MAX_SIZE];
+
+    // sum of ray directions, used for ordering children
+    FVec3 dir_sum;
+
+    void load(const Ray *rays, int count) noexcept
+    {
+        assert(0 < count && count <= MAX_SIZE);
+        size = count;
+        dir_sum = FVec3(0);
+        for(int i = 0; i < count; ++i)
+        {
+            const Ray &r = rays[i];
+            for(int k = 0; k < 3; ++k)
+            {
+                ori[k][i]     = r.o[k];
+                inv_dir[k][i] = 1 / r.d[k];
+            }
+            t_min[i] = r.t_min;
+            t_max[i] = r.t_max;
+            dir_sum += r.d;
+        }
+    }
+
+    Mask full_mask() const noexcept
+    {
+        return size == MAX_SIZE ? ~Mask(0) : (Mask(1) << size) - 1;
+    }
+
+    /**
+     * @brief slab test between active rays and an aabb
+     *
+     * @return mask of rays intersecting the aabb
+     */
+    Mask intersect(const real *low, const real *high, Mask mask) const noexcept
+    {
+        Mask ret = 0;
+        for_each(mask, [&](int i)
+        {
+            real t0 = t_min[i], t1 = t_max[i];
+            for(int k = 0; k < 3; ++k)
+            {
+                const real n = inv_dir[k][i] * (low[k]  - ori[k][i]);
+                const real f = inv_dir[k][i] * (high[k] - ori[k][i]);
+                t0 = (std::max)(t0, (std::min)(n, f));
+                t1 = (std::min)(t1, (std::max)(n, f));
+            }
+            if(t0 <= t1)
+                ret |= Mask(1) << i;
+        });
+        return ret;
+    }
+
+    template<typename F>
+    static void for_each(Mask mask, F &&func)
+    {
+        while(mask)
+        {
+            func(std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+};
+
+AGZ_TRACER_END
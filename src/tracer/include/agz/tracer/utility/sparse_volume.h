@@ -0,0 +1,214 @@
+#pragma once
+
+#include <agz/tracer/utility/mapped_file.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * sparse brick volume file layout (little endian):
+ *
+ *  SparseVolumeHeader
+ *  brick table    : uint32_t per brick. index of occupied brick or EMPTY_BRICK
+ *  brick infos    : SparseVolumeBrickInfo per occupied brick
+ *  brick data     : brick_size^3 * channel_count elements per occupied brick.
+ *                   x is the fastest axis and channels are interleaved
+ *
+ * all texels of an empty brick are zero. sections are 64-byte aligned, so
+ * the file can be sampled in place after being memory-mapped
+ */
+
+enum class SparseVolumeEncoding : uint32_t
+{
+    Float32 = 0,
+    UNorm8  = 1, // per-brick-channel linear quantization
+    UNorm16 = 2  // per-brick-channel linear quantization
+};
+
+struct SparseVolumeHeader
+{
+    char     magic[8];
+    uint32_t version;
+    SparseVolumeEncoding encoding;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t channel_count; // 1 or 3
+
+    uint32_t brick_size;    // power of 2
+    uint32_t brick_count_x;
+    uint32_t brick_count_y;
+    uint32_t brick_count_z;
+
+    uint32_t occupied_brick_count;
+    float    max_value[3];  // max value of each channel
+
+    uint64_t brick_table_offset;
+    uint64_t brick_info_offset;
+    uint64_t brick_data_offset;
+};
+
+static_assert(sizeof(SparseVolumeHeader) == 88);
+
+struct SparseVolumeBrickInfo
+{
+    // value = base + scale * quantized, or stored value for Float32
+    float base[3];
+    float scale[3];
+
+    float max_value; // max value of channel 0
+    float pad;
+};
+
+static_assert(sizeof(SparseVolumeBrickInfo) == 32);
+
+/**
+ * @brief read-only sparse brick volume sampled directly from a mapped file
+ *
+ * memory usage scales with the number of occupied bricks
+ */
+class SparseBrickVolume : public misc::uncopyable_t
+{
+public:
+
+    static constexpr uint32_t EMPTY_BRICK = 0xffffffff;
+
+    static constexpr char MAGIC[8] = { 'A', 'G', 'Z', 'S', 'B', 'V', 0, 0 };
+
+    static constexpr uint32_t VERSION = 1;
+
+    /**
+     * @brief map and validate a volume file
+     *
+     * throw std::runtime_error on failure
+     */
+    explicit SparseBrickVolume(const std::string &filename);
+
+    int width() const noexcept;
+
+    int height() const noexcept;
+
+    int depth() const noexcept;
+
+    int channel_count() const noexcept;
+
+    size_t occupied_brick_count() const noexcept;
+
+    /**
+     * @brief value of a channel of texel (x, y, z)
+     */
+    real texel(int x, int y, int z, int channel) const noexcept;
+
+    FSpectrum texel_spectrum(int x, int y, int z) const noexcept;
+
+    FSpectrum max_spectrum() const noexcept;
+
+    /**
+     * @brief upper bound of channel 0 in texel box [beg, end]
+     *
+     * computed from per-brick max values without touching brick data
+     */
+    real max_real_in(const Vec3i &beg, const Vec3i &end) const noexcept;
+
+private:
+
+    uint32_t brick_index(int bx, int by, int bz) const noexcept;
+
+    MappedFile file_;
+
+    const SparseVolumeHeader    *header_      = nullptr;
+    const uint32_t              *brick_table_ = nullptr;
+    const SparseVolumeBrickInfo *brick_infos_ = nullptr;
+    const unsigned char         *brick_data_  = nullptr;
+
+    int    brick_shift_ = 0;
+    int    brick_mask_  = 0;
+    size_t brick_bytes_ = 0;
+};
+
+/**
+ * @brief write a dense volume as a sparse brick volume file
+ *
+ * bricks whose texels are all not greater than empty_threshold are
+ * eliminated. throw std::runtime_error on failure
+ */
+void save_sparse_brick_volume(
+    const std::string &filename, const Image3D<real> &data,
+    SparseVolumeEncoding encoding,
+    int brick_size = 8, real empty_threshold = 0);
+
+void save_sparse_brick_volume(
+    const std::string &filename, const Image3D<Spectrum> &data,
+    SparseVolumeEncoding encoding,
+    int brick_size = 8, real empty_threshold = 0);
+
+inline int SparseBrickVolume::width() const noexcept
+{
+    return static_cast<int>(header_->width);
+}
+
+inline int SparseBrickVolume::height() const noexcept
+{
+    return static_cast<int>(header_->height);
+}
+
+inline int SparseBrickVolume::depth() const noexcept
+{
+    return static_cast<int>(header_->depth);
+}
+
+inline int SparseBrickVolume::channel_count() const noexcept
+{
+    return static_cast<int>(header_->channel_count);
+}
+
+inline size_t SparseBrickVolume::occupied_brick_count() const noexcept
+{
+    return header_->occupied_brick_count;
+}
+
+inline uint32_t SparseBrickVolume::brick_index(
+    int bx, int by, int bz) const noexcept
+{
+    return brick_table_[
+        (size_t(bz) * header_->brick_count_y + by) * header_->brick_count_x + bx];
+}
+
+inline real SparseBrickVolume::texel(
+    int x, int y, int z, int channel) const noexcept
+{
+    const uint32_t brick = brick_index(
+        x >> brick_shift_, y >> brick_shift_, z >> brick_shift_);
+    if(brick == EMPTY_BRICK)
+        return 0;
+
+    const size_t local_idx =
+        ((((size_t(z & brick_mask_) << brick_shift_) | size_t(y & brick_mask_))
+            << brick_shift_) | size_t(x & brick_mask_));
+    const size_t elem_idx = local_idx * header_->channel_count + channel;
+
+    const unsigned char *data = brick_data_ + brick * brick_bytes_;
+    const SparseVolumeBrickInfo &info = brick_infos_[brick];
+
+    switch(header_->encoding)
+    {
+    case SparseVolumeEncoding::UNorm8:
+        return info.base[channel] + info.scale[channel] * data[elem_idx];
+    case SparseVolumeEncoding::UNorm16:
+        return info.base[channel] + info.scale[channel] *
+               reinterpret_cast<const uint16_t*>(data)[elem_idx];
+    default:
+        return reinterpret_cast<const float*>(data)[elem_idx];
+    }
+}
+
+inline FSpectrum SparseBrickVolume::texel_spectrum(
+    int x, int y, int z) const noexcept
+{
+    if(header_->channel_count == 1)
+        return FSpectrum(texel(x, y, z, 0));
+    return FSpectrum(
+        texel(x, y, z, 0), texel(x, y, z, 1), texel(x, y, z, 2));
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <agz/tracer/common.h>
+
+/**
+ * @brief hot-path statistics of the tracer
+ *
+ * counters are compiled in only when AGZ_TRACER_STATS is defined (cmake
+ * option ENABLE_STATS). otherwise AGZ_STATS_* macros expand to nothing.
+ *
+ * AGZ_STATS_ADD(COUNTER, N):       add N to builtin counter stats::Counter::COUNTER
+ * AGZ_STATS_ADD_NAMED(NAME, N):    add N to counter with literal name NAME
+ * AGZ_STATS_SCOPED_TIMER(NAME):    add wall time of current scope in
+ *                                  microseconds to counter "stage_time_us.NAME"
+ *
+ * counter names are formatted as "group.item", and counters are grouped in
+ * the json report by the part before the first dot
+ */
+
+#ifdef AGZ_TRACER_STATS
+
+AGZ_TRACER_BEGIN
+
+namespace stats
+{
+
+    enum class Counter : int
+    {
+        PrimaryRay,
+        ClosestRay,
+        ShadowRay,
+        BSSRDFProbeRay,
+        TriangleBVHNode,
+        TriangleBVHTriangle,
+        EntityBVHNode,
+        EntityBVHEntity,
+        HeterogeneousMediumStep,
+
+        BuiltinCount
+    };
+
+    // counters registered after this are merged into "stats.dropped"
+    constexpr int MAX_COUNTER_COUNT = 256;
+
+    /**
+     * @brief get id of a named counter. the counter is created on first call
+     */
+    int register_counter(const std::string &name);
+
+    /**
+     * @brief set values of all counters to zero
+     *
+     * counters increased meanwhile by other threads may be partially reset
+     */
+    void reset();
+
+    /**
+     * @brief sum up counters of all threads into a json object
+     */
+    std::string report_json();
+
+    namespace detail
+    {
+
+        // counters of one thread. only written by the owner thread, so they
+        // are updated with relaxed load and store instead of atomic rmw, and
+        // can be read by other threads on reporting
+        struct ThreadCounters
+        {
+            ThreadCounters();
+
+            ~ThreadCounters();
+
+            std::atomic<uint64_t> values[MAX_COUNTER_COUNT];
+        };
+
+        inline thread_local ThreadCounters thread_counters;
+
+    } // namespace detail
+
+    inline void add(int counter, uint64_t n) noexcept
+    {
+        std::atomic<uint64_t> &v = detail::thread_counters.values[counter];
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void add(Counter counter, uint64_t n) noexcept
+    {
+        add(static_cast<int>(counter), n);
+    }
+
+    class ScopedTimer : public misc::uncopyable_t
+    {
+        int counter_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+
+        explicit ScopedTimer(int counter) noexcept
+            : counter_(counter), start_(std::chrono::steady_clock::now())
+        {
+
+        }
+
+        ~ScopedTimer()
+        {
+            const auto end = std::chrono::steady_clock::now();
+            add(counter_, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    end - start_).count()));
+        }
+    };
+
+} // namespace stats
+
+AGZ_TRACER_END
+
+#define AGZ_STATS_CONCAT_IMPL(A, B) A##B
+#define AGZ_STATS_CONCAT(A, B) AGZ_STATS_CONCAT_IMPL(A, B)
+
+#define AGZ_STATS_ADD(COUNTER, N)                                               \
+    (::agz::tracer::stats::add(::agz::tracer::stats::Counter::COUNTER, (N)))
+
+#define AGZ_STATS_ADD_NAMED(NAME, N)                                            \
+    do                                                                          \
+    {                                                                           \
+        static const int agz_stats_counter_id =                                 \
+            ::agz::tracer::stats::register_counter(NAME);                       \
+        ::agz::tracer::stats::add(agz_stats_counter_id, (N));                   \
+    } while(false)
+
+#define AGZ_STATS_SCOPED_TIMER(NAME)                                            \
+    ::agz::tracer::stats::ScopedTimer AGZ_STATS_CONCAT(                         \
+        agz_stats_timer_, __LINE__)(                                            \
+            ::agz::tracer::stats::register_counter(                             \
+                std::string("stage_time_us.") + (NAME)))
+
+#else
+
+#define AGZ_STATS_ADD(COUNTER, N)       do { } while(false)
+#define AGZ_STATS_ADD_NAMED(NAME, N)    do { } while(false)
+#define AGZ_STATS_SCOPED_TIMER(NAME)    do { } while(false)
+
+#endif
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <agz/tracer/common.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief process-wide pool of persistent worker threads
+ *
+ * run(n, func) calls func(thread_index) for each thread_index in [0, n) in
+ * parallel, where index 0 is run by the calling thread and others are run
+ * by pool workers. workers are created on demand and reused by later calls.
+ *
+ * only one job can use the pool at a time. nested calls and calls made while
+ * the pool is busy are run by temporary threads instead.
+ *
+ * workers can be bound to cpus. cpus are ordered by numa nodes and assigned
+ * to workers by thread index, so that workers with adjacent indices are
+ * placed on the same node.
+ */
+class TaskScheduler : public misc::uncopyable_t
+{
+public:
+
+    enum class Affinity
+    {
+        None,     // let the os schedule workers
+        NumaNode, // bind each worker to cpus of one numa node
+        Core      // bind each worker to one cpu
+    };
+
+    static TaskScheduler &instance();
+
+    ~TaskScheduler();
+
+    /**
+     * @brief set cpu affinity of workers. waits for the running job
+     *
+     * only supported on linux. ignored on other platforms
+     */
+    void set_affinity(Affinity affinity);
+
+    Affinity affinity() const;
+
+    /**
+     * @brief run func(thread_index) with thread_index in [0, thread_count)
+     *  in parallel and wait for all of them
+     *
+     * the first exception thrown by func is rethrown after all threads finish
+     */
+    void run(int thread_count, const std::function<void(int)> &func);
+
+private:
+
+    TaskScheduler();
+
+    void spawn_workers(int worker_count);
+
+    void worker_func(int worker_index, uint64_t last_job_id);
+
+    void apply_affinity(std::thread &thread, int thread_index) const;
+
+    static void run_with_temporary_threads(
+        int thread_count, const std::function<void(int)> &func);
+
+    // serialize jobs using the pool
+    std::mutex job_mutex_;
+
+    std::mutex mutex_;
+    std::condition_variable job_cond_;
+    std::condition_variable done_cond_;
+
+    uint64_t job_id_ = 0;
+    const std::function<void(int)> *job_func_ = nullptr;
+    int job_thread_count_ = 0;
+    int job_remaining_    = 0;
+    std::exception_ptr job_exception_;
+    bool exit_ = false;
+
+    std::vector<std::thread> workers_;
+
+    std::atomic<Affinity> affinity_ = Affinity::None;
+
+    // logical cpus usable by this process, ordered by numa nodes
+    std::vector<int> cpus_;
+    std::vector<int> cpu_nodes_;
+};
+
+/**
+ * @brief per-thread ranges of task indices with work stealing
+ *
+ * [0, task_count) is divided into contiguous ranges, one for each thread.
+ * a thread takes tasks from the front of its own range. when the range is
+ * empty, the back half of a remaining range of a nearby thread is stolen,
+ * so that tasks taken by a thread stay mostly contiguous.
+ */
+class WorkStealingRanges : public misc::uncopyable_t
+{
+public:
+
+    WorkStealingRanges(int thread_count, int task_count);
+
+    /**
+     * @brief get next task of given thread
+     *
+     * @return false when there is no task left
+     */
+    bool pop(int thread_index, int *task) noexcept;
+
+private:
+
+    static uint64_t pack(uint32_t beg, uint32_t end) noexcept
+    {
+        return (uint64_t(beg) << 32) | end;
+    }
+
+    static uint32_t range_beg(uint64_t range) noexcept
+    {
+        return uint32_t(range >> 32);
+    }
+
+    static uint32_t range_end(uint64_t range) noexcept
+    {
+        return uint32_t(range);
+    }
+
+    bool steal(int thread_index) noexcept;
+
+    // [beg, end) packed as (beg << 32) | end
+    struct alignas(64) Range
+    {
+        std::atomic<uint64_t> value;
+    };
+
+    int thread_count_;
+    Box<Range[]> ranges_;
+};
+
+/**
+ * @brief order tiles of a x_count * y_count grid along a hilbert curve
+ *
+ * a generalized hilbert curve is used for arbitrary grid sizes. consecutive
+ * tiles are adjacent, except for at most one diagonal step when the grid
+ * has odd sides. the cost is linear in x_count * y_count
+ */
+std::vector<Vec2i> hilbert_tile_order(int x_count, int y_count);
+
+inline WorkStealingRanges::WorkStealingRanges(int thread_count, int task_count)
+    : thread_count_((std::max)(thread_count, 1))
+{
+    ranges_ = newBox<Range[]>(thread_count_);
+    for(int i = 0; i < thread_count_; ++i)
+    {
+        const auto beg = uint32_t(int64_t(task_count) * i       / thread_count_);
+        const auto end = uint32_t(int64_t(task_count) * (i + 1) / thread_count_);
+        ranges_[i].value.store(pack(beg, end), std::memory_order_relaxed);
+    }
+}
+
+inline bool WorkStealingRanges::pop(int thread_index, int *task) noexcept
+{
+    std::atomic<uint64_t> &own = ranges_[thread_index].value;
+    for(;;)
+    {
+        uint64_t range = own.load(std::memory_order_acquire);
+        while(range_beg(range) < range_end(range))
+        {
+            const uint32_t beg = range_beg(range);
+            if(own.compare_exchange_weak(
+                range, pack(beg + 1, range_end(range)),
+                std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                *task = static_cast<int>(beg);
+                return true;
+            }
+        }
+
+        if(!steal(thread_index))
+            return false;
+    }
+}
+
+inline bool WorkStealingRanges::steal(int thread_index) noexcept
+{
+    // try nearby threads first, whose tasks are close to ours in task order
+
+    for(int d = 1; d < thread_count_; ++d)
+    {
+        for(int victim : { thread_index + d, thread_index - d })
+        {
+            if(victim < 0 || victim >= thread_count_)
+                continue;
+
+            std::atomic<uint64_t> &range = ranges_[victim].value;
+            uint64_t old_range = range.load(std::memory_order_acquire);
+            while(range_beg(old_range) < range_end(old_range))
+            {
+                const uint32_t beg = range_beg(old_range);
+                const uint32_t end = range_end(old_range);
+                const uint32_t mid = end - (end - beg + 1) / 2;
+
+                if(range.compare_exchange_weak(
+                    old_range, pack(beg, mid),
+                    std::memory_order_acq_rel, std::memory_order_acquire))
+                {
+                    // own range is empty, so no thief can modify it meanwhile
+                    ranges_[thread_index].value.store(
+                        pack(mid, end), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <agz/tracer/utility/tiled_texture.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief process-wide cache of tiles of TiledTextureFile
+ *
+ * each thread has a small direct-mapped front cache which is accessed
+ * without locking. front cache misses go to a global lru cache guarded by
+ * a mutex, and tiles are read from files on global misses. the least
+ * recently used tiles are evicted when the global cache exceeds its
+ * memory budget. evicted tiles are freed after being dropped by all front
+ * caches, which hold at most FRONT_CACHE_SIZE tiles per thread.
+ */
+class TextureTileCache : public misc::uncopyable_t
+{
+public:
+
+    static constexpr int FRONT_CACHE_SIZE = 64;
+
+    struct Statistics
+    {
+        uint64_t front_hit_count = 0;
+        uint64_t hit_count       = 0; // hits in global cache
+        uint64_t miss_count      = 0;
+        uint64_t evict_count     = 0;
+
+        size_t resident_bytes      = 0;
+        size_t peak_resident_bytes = 0;
+    };
+
+    static TextureTileCache &instance();
+
+    /**
+     * @brief set max bytes of tiles in the global cache
+     *
+     * tiles are evicted immediately when the budget is decreased
+     */
+    void set_memory_budget(size_t bytes);
+
+    size_t memory_budget() const;
+
+    /**
+     * @brief get data of a tile. the tile is read from file when absent
+     *
+     * the returned pointer is valid until the next call of get_tile on the
+     * same thread. tiles failing to be read are filled with zeros
+     */
+    const unsigned char *get_tile(
+        const TiledTextureFile &file, uint32_t tile) noexcept;
+
+    /**
+     * @brief drop all cached tiles
+     */
+    void clear();
+
+    Statistics statistics() const;
+
+    void reset_statistics();
+
+private:
+
+    using TileData = std::vector<unsigned char>;
+
+    struct FrontCache;
+
+    TextureTileCache() = default;
+
+    RC<const TileData> get_shared_tile(
+        const TiledTextureFile &file, uint32_t tile, uint64_t key) noexcept;
+
+    // requires mutex_ to be locked
+    void evict();
+
+    struct LRUEntry
+    {
+        uint64_t key;
+        RC<const TileData> data;
+    };
+
+    mutable std::mutex mutex_;
+
+    std::list<LRUEntry> lru_; // most recently used tile comes first
+    std::unordered_map<uint64_t, std::list<LRUEntry>::iterator> key2entry_;
+
+    size_t budget_         = size_t(2048) << 20;
+    size_t resident_bytes_ = 0;
+    size_t peak_bytes_     = 0;
+
+    uint64_t hit_count_   = 0;
+    uint64_t miss_count_  = 0;
+    uint64_t evict_count_ = 0;
+
+    std::atomic<bool> read_error_reported_ = false;
+
+    // front caches are flushed when generation_ changes
+    std::atomic<uint64_t> generation_ = 0;
+
+    // front hits of alive threads are summed up on query
+    mutable std::mutex fronts_mutex_;
+    std::vector<const FrontCache*> fronts_;
+    uint64_t retired_front_hit_count_ = 0;
+    uint64_t front_hit_count_base_    = 0;
+};
+
+AGZ_TRACER_END
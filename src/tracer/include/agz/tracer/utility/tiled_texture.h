@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vector>
+
+#include <agz/tracer/common.h>
+#include <agz/tracer/utility/mapped_file.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * tiled texture file layout (little endian):
+ *
+ *  TiledTextureHeader
+ *  level table : TiledTextureLevel per mip level
+ *  tile data   : tile_size^2 texels per tile. tiles of level 0 come first,
+ *                and tiles of a level are stored row by row
+ *
+ * texels are rgb triples of uint8 (raw values of 8-bit images) or float.
+ * each level is downsampled from the previous one with a box filter, until
+ * 1x1. texels of edge tiles outside the level repeat the border ones.
+ * sections are 64-byte aligned
+ */
+
+enum class TiledTextureFormat : uint32_t
+{
+    RGB8   = 0,
+    RGB32F = 1
+};
+
+struct TiledTextureHeader
+{
+    char     magic[8];
+    uint32_t version;
+    TiledTextureFormat format;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;   // power of 2
+    uint32_t level_count;
+
+    uint64_t level_offset;
+    uint64_t tile_data_offset;
+    uint64_t tile_count;
+};
+
+static_assert(sizeof(TiledTextureHeader) == 56);
+
+struct TiledTextureLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_count_x;
+    uint32_t tile_count_y;
+    uint64_t first_tile;
+};
+
+static_assert(sizeof(TiledTextureLevel) == 24);
+
+/**
+ * @brief tiled texture file whose tiles are read on demand
+ *
+ * the file is memory-mapped, so only the header, level table and touched
+ * pages are loaded. see TextureTileCache
+ */
+class TiledTextureFile : public misc::uncopyable_t
+{
+public:
+
+    static constexpr char MAGIC[8] = { 'A', 'G', 'Z', 'T', 'T', 'X', 0, 0 };
+
+    static constexpr uint32_t VERSION = 1;
+
+    /**
+     * @brief open and validate a tiled texture file
+     *
+     * throw std::runtime_error on failure
+     */
+    explicit TiledTextureFile(const std::string &filename);
+
+    const std::string &filename() const noexcept;
+
+    /**
+     * @brief process-wide unique id of this file
+     */
+    uint32_t id() const noexcept;
+
+    TiledTextureFormat format() const noexcept;
+
+    int level_count() const noexcept;
+
+    int level_width(int level) const noexcept;
+
+    int level_height(int level) const noexcept;
+
+    size_t tile_bytes() const noexcept;
+
+    /**
+     * @brief index of the tile containing texel (x, y) of given level
+     */
+    uint32_t tile_index(int level, int x, int y) const noexcept;
+
+    /**
+     * @brief byte offset of texel (x, y) in its tile
+     */
+    size_t texel_offset(int x, int y) const noexcept;
+
+    /**
+     * @brief copy tile data into output, which holds tile_bytes() bytes
+     *
+     * thread-safe without locking. concurrent misses only wait for their
+     * own page faults
+     */
+    void read_tile(uint32_t tile, unsigned char *output) const;
+
+private:
+
+    std::string filename_;
+    uint32_t id_;
+
+    TiledTextureHeader             header_;
+    std::vector<TiledTextureLevel> levels_;
+
+    int    tile_shift_ = 0;
+    int    tile_mask_  = 0;
+    size_t texel_bytes_ = 0;
+    size_t tile_bytes_  = 0;
+
+    MappedFile file_;
+};
+
+/**
+ * @brief write an image as a tiled texture file with its mip levels
+ *
+ * throw std::runtime_error on failure
+ */
+void save_tiled_texture(
+    const std::string &filename, const Image2D<math::color3b> &data,
+    int tile_size = 64);
+
+void save_tiled_texture(
+    const std::string &filename, const Image2D<math::color3f> &data,
+    int tile_size = 64);
+
+inline const std::string &TiledTextureFile::filename() const noexcept
+{
+    return filename_;
+}
+
+inline uint32_t TiledTextureFile::id() const noexcept
+{
+    return id_;
+}
+
+inline TiledTextureFormat TiledTextureFile::format() const noexcept
+{
+    return header_.format;
+}
+
+inline int TiledTextureFile::level_count() const noexcept
+{
+    return static_cast<int>(levels_.size());
+}
+
+inline int TiledTextureFile::level_width(int level) const noexcept
+{
+    return static_cast<int>(levels_[level].width);
+}
+
+inline int TiledTextureFile::level_height(int level) const noexcept
+{
+    return static_cast<int>(levels_[level].height);
+}
+
+inline size_t TiledTextureFile::tile_bytes() const noexcept
+{
+    return tile_bytes_;
+}
+
+inline uint32_t TiledTextureFile::tile_index(
+    int level, int x, int y) const noexcept
+{
+    const TiledTextureLevel &lv = levels_[level];
+    return static_cast<uint32_t>(
+        lv.first_tile + uint64_t(y >> tile_shift_) * lv.tile_count_x
+                      + uint64_t(x >> tile_shift_));
+}
+
+inline size_t TiledTextureFile::texel_offset(int x, int y) const noexcept
+{
+    return ((size_t(y & tile_mask_) << tile_shift_) | size_t(x & tile_mask_))
+         * texel_bytes_;
+}
+
+AGZ_TRACER_END
@@ -87,4 +87,25 @@ inline FVec3 dpdu_as_ex(
     return (m11 * inv_det * B_A - m01 * inv_det * C_A).normalize();
 }
 
+/**
+ * @brief partial derivatives of position w.r.t. uv
+ *
+ * both are zero when uvs of the triangle are degenerate
+ */
+inline void triangle_dpduv(
+    const FVec3 &B_A, const FVec3 &C_A,
+    const Vec2 &b_a, const Vec2 &c_a,
+    FVec3 *dpdu, FVec3 *dpdv) noexcept
+{
+    const real det = b_a.x * c_a.y - b_a.y * c_a.x;
+    if(!det)
+    {
+        *dpdu = *dpdv = FVec3();
+        return;
+    }
+    const real inv_det = 1 / det;
+    *dpdu = inv_det * (c_a.y * B_A - b_a.y * C_A);
+    *dpdv = inv_det * (b_a.x * C_A - c_a.x * B_A);
+}
+
 AGZ_TRACER_END
@@ -1,33 +1,181 @@
+#include <algorithm>
+#include <bit>
+#include <limits>
+
 #include <agz/tracer/core/aggregate.h>
 #include <agz/tracer/core/entity.h>
+#include <agz/tracer/utility/ray_packet.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
 AGZ_TRACER_BEGIN
 
 namespace
 {
-    
-    struct Leaf;
-    struct Interior;
 
-    using Node = misc::variant_t<Leaf, Interior>;
+    // stack size for traversal the bvh tree
+    constexpr int TRAVERSAL_STACK_SIZE = 128;
 
-    struct Leaf
-    {
-        AABB bound;
-        size_t start = 0, end = 0;
-    };
+    // after this depth, nodes are split at the median so that the tree depth
+    // is bounded by MEDIAN_SPLIT_DEPTH + log2(entity count)
+    constexpr int MEDIAN_SPLIT_DEPTH = 64;
+
+    constexpr int SAH_BIN_COUNT = 16;
+
+    // entities are usually bvhs themselves, so testing an entity is much more
+    // expensive than visiting an interior node
+    constexpr real SAH_LEAF_COST      = 1;
+    constexpr real SAH_TRAVERSAL_COST = real(0.125);
 
-    struct Interior
+    // node in linear bvh
+    //
+    // nodes are stored in depth-first order. the left child of an interior
+    // node is right after it and end_or_right_offset is its right child
+    struct Node
     {
-        AABB bound;
-        size_t left  = 0, right = 0;
+        real low[3], high[3];
+        uint32_t start;               // uint32_t max for interior node
+        uint32_t end_or_right_offset;
+
+        bool is_leaf() const noexcept
+        {
+            return start < std::numeric_limits<uint32_t>::max();
+        }
+
+        bool has_intersection(
+            const real *ori, const real *inv_dir,
+            real t_min, real t_max, real *inct_t) const noexcept
+        {
+            const real nx = inv_dir[0] * (low[0] - ori[0]);
+            const real ny = inv_dir[1] * (low[1] - ori[1]);
+            const real nz = inv_dir[2] * (low[2] - ori[2]);
+
+            const real fx = inv_dir[0] * (high[0] - ori[0]);
+            const real fy = inv_dir[1] * (high[1] - ori[1]);
+            const real fz = inv_dir[2] * (high[2] - ori[2]);
+
+            t_min = (std::max)(t_min, (std::min)(nx, fx));
+            t_min = (std::max)(t_min, (std::min)(ny, fy));
+            t_min = (std::max)(t_min, (std::min)(nz, fz));
+
+            t_max = (std::min)(t_max, (std::max)(nx, fx));
+            t_max = (std::min)(t_max, (std::max)(ny, fy));
+            t_max = (std::min)(t_max, (std::max)(nz, fz));
+
+            *inct_t = t_min;
+            return t_min <= t_max;
+        }
     };
 
     struct EntityRecord
     {
         const Entity *entity = nullptr;
         AABB bound;
+        FVec3 centroid;
+    };
+
+    real surface_area_of(const AABB &bound) noexcept
+    {
+        const FVec3 d = bound.high - bound.low;
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // binned sah on entity centroids
+    class SAHSplitFinder
+    {
+        struct Bin
+        {
+            AABB bound;
+            uint32_t count = 0;
+        };
+
+        Bin bins_[SAH_BIN_COUNT];
+        real right_costs_[SAH_BIN_COUNT] = {};
+
+        static int bin_index(
+            const AABB &centroid_bound, int axis, const FVec3 &centroid) noexcept
+        {
+            const real low    = centroid_bound.low[axis];
+            const real extent = centroid_bound.high[axis] - low;
+            const int idx = static_cast<int>(
+                SAH_BIN_COUNT * (centroid[axis] - low) / extent);
+            return math::clamp(idx, 0, SAH_BIN_COUNT - 1);
+        }
+
+    public:
+
+        // returns false when splitting is not better than creating a leaf
+        bool find(
+            const EntityRecord *records, uint32_t count,
+            const AABB &all_bound, const AABB &centroid_bound,
+            bool force_split, int *split_axis, real *split_pos)
+        {
+            const real parent_area = surface_area_of(all_bound);
+            if(parent_area <= 0)
+                return false;
+
+            real best_area_count = REAL_MAX;
+
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                if(centroid_bound.high[axis] <= centroid_bound.low[axis])
+                    continue;
+
+                for(auto &bin : bins_)
+                    bin = Bin();
+
+                for(uint32_t i = 0; i < count; ++i)
+                {
+                    auto &bin = bins_[bin_index(
+                        centroid_bound, axis, records[i].centroid)];
+                    bin.bound |= records[i].bound;
+                    ++bin.count;
+                }
+
+                // right_costs_[i]: area * count of bins [i, SAH_BIN_COUNT)
+
+                AABB acc_bound;
+                uint32_t acc_count = 0;
+                for(int i = SAH_BIN_COUNT - 1; i > 0; --i)
+                {
+                    acc_bound |= bins_[i].bound;
+                    acc_count += bins_[i].count;
+                    right_costs_[i] = acc_count ?
+                        surface_area_of(acc_bound) * acc_count : real(0);
+                }
+
+                acc_bound = AABB();
+                acc_count = 0;
+                for(int i = 0; i < SAH_BIN_COUNT - 1; ++i)
+                {
+                    acc_bound |= bins_[i].bound;
+                    acc_count += bins_[i].count;
+
+                    if(!acc_count || acc_count == count)
+                        continue;
+
+                    const real area_count =
+                        surface_area_of(acc_bound) * acc_count
+                      + right_costs_[i + 1];
+
+                    if(area_count < best_area_count)
+                    {
+                        best_area_count = area_count;
+                        *split_axis = axis;
+                        *split_pos  = centroid_bound.low[axis] +
+                            (centroid_bound.high[axis] - centroid_bound.low[axis])
+                          * (i + 1) / SAH_BIN_COUNT;
+                    }
+                }
+            }
+
+            if(best_area_count == REAL_MAX)
+                return false;
+
+            const real split_cost = SAH_TRAVERSAL_COST +
+                SAH_LEAF_COST * best_area_count / parent_area;
+            return force_split || split_cost < SAH_LEAF_COST * count;
+        }
     };
 
 } // namespace anonymous
@@ -40,135 +188,267 @@ class EntityBVH : public Aggregate
     std::vector<EntityPtr> prims_;
 
     std::vector<RC<const Entity>> entities_;
-    
+
     int max_leaf_size_ = 5;
 
-    size_t build_aux(EntityRecord *entities, size_t count)
+    SAHSplitFinder sah_;
+
+    uint32_t add_leaf(const EntityRecord *records, uint32_t count, const AABB &bound)
+    {
+        const auto start = static_cast<uint32_t>(prims_.size());
+        for(uint32_t i = 0; i < count; ++i)
+            prims_.push_back(records[i].entity);
+
+        const auto ret = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({
+            { bound.low.x,  bound.low.y,  bound.low.z  },
+            { bound.high.x, bound.high.y, bound.high.z },
+            start, start + count });
+        return ret;
+    }
+
+    uint32_t build_aux(EntityRecord *records, uint32_t count, int depth)
     {
         assert(count);
 
-        if(count <= static_cast<size_t>(max_leaf_size_) || count < 2)
+        AABB all_bound, centroid_bound;
+        for(uint32_t i = 0; i < count; ++i)
         {
-            const size_t start = prims_.size();
-            const size_t end   = start + count;
-            
-            AABB bound;
-            for(size_t i = 0; i < count; ++i)
-            {
-                prims_.push_back(entities[i].entity);
-                bound |= entities[i].bound;
-            }
-
-            const size_t ret = nodes_.size();
-            nodes_.emplace_back(Leaf{ bound, start, end });
-            return ret;
+            all_bound      |= records[i].bound;
+            centroid_bound |= records[i].centroid;
         }
 
-        // find splitting axis
+        if(count < 2)
+            return add_leaf(records, count, all_bound);
+
+        // find splitting position
+
+        const bool force_split = count > static_cast<uint32_t>(max_leaf_size_);
+
+        uint32_t split_idx = 0;
 
-        AABB all_bound;
-        for(size_t i = 0; i < count; ++i)
-            all_bound |= entities[i].bound;
-        real split_axis_len = -1;
         int split_axis = 0;
-        for(int i = 0; i < 3; ++i)
+        real split_pos = 0;
+        if(depth < MEDIAN_SPLIT_DEPTH &&
+           sah_.find(records, count, all_bound, centroid_bound,
+                     force_split, &split_axis, &split_pos))
         {
-            const real axis_len = all_bound.high[i] - all_bound.low[i];
-            if(axis_len > split_axis_len)
+            split_idx = static_cast<uint32_t>(std::partition(
+                records, records + count,
+                [=](const EntityRecord &rcd)
             {
-                split_axis_len = axis_len;
-                split_axis = i;
-            }
+                return rcd.centroid[split_axis] < split_pos;
+            }) - records);
         }
 
-        // sort entities according to centre[split_axis]
-
-        std::sort(entities, entities + count,
-            [split_axis](const EntityRecord &lhs, const EntityRecord &rhs)
+        if(!split_idx || split_idx == count)
         {
-            const real L = lhs.bound.low[split_axis] +
-                           lhs.bound.high[split_axis];
-            const real R = rhs.bound.low[split_axis] +
-                           rhs.bound.high[split_axis];
-            return L < R;
-        });
+            if(!force_split)
+                return add_leaf(records, count, all_bound);
+
+            // split at the median of the widest centroid axis
 
-        // push back new interior node
+            split_axis = 0;
+            const FVec3 extent = centroid_bound.high - centroid_bound.low;
+            if(extent.y > extent[split_axis]) split_axis = 1;
+            if(extent.z > extent[split_axis]) split_axis = 2;
 
-        const size_t interior_idx = nodes_.size();
-        nodes_.emplace_back(Interior());
+            split_idx = count / 2;
+            std::nth_element(
+                records, records + split_idx, records + count,
+                [split_axis](const EntityRecord &lhs, const EntityRecord &rhs)
+            {
+                return lhs.centroid[split_axis] < rhs.centroid[split_axis];
+            });
+        }
 
-        // build left & right children
+        // push back new interior node. left child follows it immediately
 
-        const size_t split_idx = count / 2;
-        const size_t left_idx  = build_aux(entities, split_idx);
-        const size_t right_idx = build_aux(
-            entities + split_idx, count - split_idx);
+        const auto interior_idx = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({
+            { all_bound.low.x,  all_bound.low.y,  all_bound.low.z  },
+            { all_bound.high.x, all_bound.high.y, all_bound.high.z },
+            std::numeric_limits<uint32_t>::max(), 0 });
 
-        // fill interior node
+        build_aux(records, split_idx, depth + 1);
+        const uint32_t right_idx = build_aux(
+            records + split_idx, count - split_idx, depth + 1);
 
-        auto &interior = nodes_[interior_idx].as<Interior>();
-        interior.bound = all_bound;
-        interior.left  = left_idx;
-        interior.right = right_idx;
+        nodes_[interior_idx].end_or_right_offset = right_idx;
 
         return interior_idx;
     }
 
-    bool has_intersection_aux(
-        const FVec3 &inv_dir, const Ray &r, const Node &node) const noexcept
+    struct PacketStackEntry
     {
-        if(const Leaf *leaf = node.as_if<Leaf>())
+        uint32_t node;
+        RayPacket::Mask mask;
+    };
+
+    // push children of an interior node. the child whose center is nearer
+    // along the mean ray direction is visited first
+    void push_children_of(
+        const RayPacket &packet, uint32_t node_idx, RayPacket::Mask mask,
+        PacketStackEntry *stack, int &top) const noexcept
+    {
+        const uint32_t left_idx  = node_idx + 1;
+        const uint32_t right_idx = nodes_[node_idx].end_or_right_offset;
+
+        const Node &left = nodes_[left_idx], &right = nodes_[right_idx];
+        real proj = 0;
+        for(int k = 0; k < 3; ++k)
         {
-            if(!leaf->bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-                return false;
-            for(size_t i = leaf->start; i < leaf->end; ++i)
-            {
-                if(prims_[i]->has_intersection(r))
-                    return true;
-            }
-            return false;
+            proj += packet.dir_sum[k] *
+                ((left.low[k] + left.high[k]) - (right.low[k] + right.high[k]));
         }
 
-        const Interior &interior = node.as<Interior>();
-        if(!interior.bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-            return false;
-
-        return has_intersection_aux(inv_dir, r, nodes_[interior.left]) ||
-               has_intersection_aux(inv_dir, r, nodes_[interior.right]);
+        assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+        if(proj < 0)
+        {
+            stack[top++] = { right_idx, mask };
+            stack[top++] = { left_idx,  mask };
+        }
+        else
+        {
+            stack[top++] = { left_idx,  mask };
+            stack[top++] = { right_idx, mask };
+        }
     }
 
-    bool closest_intersection_aux(
-        const FVec3 &inv_dir, Ray &r, const Node &node,
-        EntityIntersection *inct) const noexcept
+    void has_intersection_packet(
+        const Ray *rays, int count, bool *results) const noexcept
     {
-        if(const Leaf *leaf = node.as_if<Leaf>())
+        RayPacket packet;
+        packet.load(rays, count);
+
+        for(int i = 0; i < count; ++i)
+            results[i] = false;
+
+        // rays that have not found an intersection
+        RayPacket::Mask active = packet.full_mask();
+
+        Ray leaf_rays[RayPacket::MAX_SIZE];
+        int leaf_ray_idx[RayPacket::MAX_SIZE];
+        bool leaf_results[RayPacket::MAX_SIZE];
+
+        PacketStackEntry stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, active };
+
+        while(top && active)
         {
-            if(!leaf->bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-                return false;
-            bool ret = false;
-            for(size_t i = leaf->start; i < leaf->end; ++i)
+            const PacketStackEntry entry = stack[--top];
+            const Node &node = nodes_[entry.node];
+            AGZ_STATS_ADD(EntityBVHNode, std::popcount(entry.mask & active));
+
+            const RayPacket::Mask mask = packet.intersect(
+                node.low, node.high, entry.mask & active);
+            if(!mask)
+                continue;
+
+            if(!node.is_leaf())
             {
-                const EntityPtr ent = prims_[i];
-                if(ent->closest_intersection(r, inct))
+                push_children_of(packet, entry.node, mask, stack, top);
+                continue;
+            }
+
+            for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+            {
+                int leaf_ray_count = 0;
+                RayPacket::for_each(mask & active, [&](int ray_idx)
                 {
-                    r.t_max = inct->t;
-                    ret = true;
+                    leaf_rays[leaf_ray_count]    = rays[ray_idx];
+                    leaf_ray_idx[leaf_ray_count] = ray_idx;
+                    ++leaf_ray_count;
+                });
+                if(!leaf_ray_count)
+                    break;
+                AGZ_STATS_ADD(EntityBVHEntity, leaf_ray_count);
+
+                prims_[i]->has_intersection_n(
+                    misc::span<const Ray>(leaf_rays, leaf_ray_count),
+                    leaf_results);
+
+                for(int j = 0; j < leaf_ray_count; ++j)
+                {
+                    if(leaf_results[j])
+                    {
+                        results[leaf_ray_idx[j]] = true;
+                        active &= ~(RayPacket::Mask(1) << leaf_ray_idx[j]);
+                    }
                 }
             }
-            return ret;
         }
+    }
 
-        const Interior &interior = node.as<Interior>();
-        if(!interior.bound.intersect(r.o, inv_dir, r.t_min, r.t_max))
-            return false;
+    void closest_intersection_packet(
+        const Ray *rays, int count,
+        EntityIntersection *incts, bool *results) const noexcept
+    {
+        RayPacket packet;
+        packet.load(rays, count);
+
+        for(int i = 0; i < count; ++i)
+            results[i] = false;
+
+        Ray leaf_rays[RayPacket::MAX_SIZE];
+        int leaf_ray_idx[RayPacket::MAX_SIZE];
+        bool leaf_results[RayPacket::MAX_SIZE];
+        EntityIntersection leaf_incts[RayPacket::MAX_SIZE];
+
+        PacketStackEntry stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, packet.full_mask() };
+
+        while(top)
+        {
+            const PacketStackEntry entry = stack[--top];
+            const Node &node = nodes_[entry.node];
+            AGZ_STATS_ADD(EntityBVHNode, std::popcount(entry.mask));
+
+            // t_max of the packet is shrunk by found intersections,
+            // so farther nodes are culled here
+
+            const RayPacket::Mask mask = packet.intersect(
+                node.low, node.high, entry.mask);
+            if(!mask)
+                continue;
+
+            if(!node.is_leaf())
+            {
+                push_children_of(packet, entry.node, mask, stack, top);
+                continue;
+            }
 
-        const bool left  = closest_intersection_aux(
-            inv_dir, r, nodes_[interior.left], inct);
-        const bool right = closest_intersection_aux(
-            inv_dir, r, nodes_[interior.right], inct);
+            for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+            {
+                int leaf_ray_count = 0;
+                RayPacket::for_each(mask, [&](int ray_idx)
+                {
+                    Ray &r = leaf_rays[leaf_ray_count];
+                    r = rays[ray_idx];
+                    r.t_max = packet.t_max[ray_idx];
+                    leaf_ray_idx[leaf_ray_count] = ray_idx;
+                    ++leaf_ray_count;
+                });
+
+                AGZ_STATS_ADD(EntityBVHEntity, leaf_ray_count);
+                prims_[i]->closest_intersection_n(
+                    misc::span<const Ray>(leaf_rays, leaf_ray_count),
+                    leaf_incts, leaf_results);
+
+                for(int j = 0; j < leaf_ray_count; ++j)
+                {
+                    if(!leaf_results[j])
+                        continue;
 
-        return left || right;
+                    const int ray_idx = leaf_ray_idx[j];
+                    incts[ray_idx] = leaf_incts[j];
+                    packet.t_max[ray_idx] = leaf_incts[j].t;
+                    results[ray_idx] = true;
+                }
+            }
+        }
     }
 
 public:
@@ -187,31 +467,177 @@ public:
 
         if(entities.empty())
         {
-            nodes_.emplace_back(Leaf{ AABB{ FVec3(0), FVec3(1) }, 0, 0 });
+            nodes_.push_back({ { 0, 0, 0 }, { 1, 1, 1 }, 0, 0 });
             return;
         }
 
         std::vector<EntityRecord> records(entities.size());
         prims_.reserve(entities.size());
         for(size_t i = 0; i < entities.size(); ++i)
-            records[i] = { entities[i].get(), entities[i]->world_bound() };
+        {
+            const AABB bound = entities[i]->world_bound();
+            records[i] = {
+                entities[i].get(), bound, real(0.5) * (bound.low + bound.high) };
+        }
 
         entities_ = entities;
-        build_aux(records.data(), records.size());
+
+        nodes_.reserve(2 * entities.size());
+        build_aux(records.data(), static_cast<uint32_t>(records.size()), 0);
+        nodes_.shrink_to_fit();
     }
 
     bool has_intersection(const Ray &r) const noexcept override
     {
-        const FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
-        return has_intersection_aux(inv_dir, r, nodes_[0]);
+        const real ori[3]     = { r.o.x,     r.o.y,     r.o.z };
+        const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+        real t;
+
+        if(!nodes_[0].has_intersection(ori, inv_dir, r.t_min, r.t_max, &t))
+            return false;
+
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top)
+        {
+            const uint32_t node_idx = stack[--top];
+            const Node &node = nodes_[node_idx];
+            AGZ_STATS_ADD(EntityBVHNode, 1);
+
+            if(node.is_leaf())
+            {
+                for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                {
+                    AGZ_STATS_ADD(EntityBVHEntity, 1);
+                    if(prims_[i]->has_intersection(r))
+                        return true;
+                }
+            }
+            else
+            {
+                assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+                if(nodes_[node.end_or_right_offset].has_intersection(
+                    ori, inv_dir, r.t_min, r.t_max, &t))
+                    stack[top++] = node.end_or_right_offset;
+                if(nodes_[node_idx + 1].has_intersection(
+                    ori, inv_dir, r.t_min, r.t_max, &t))
+                    stack[top++] = node_idx + 1;
+            }
+        }
+
+        return false;
     }
 
     bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept override
     {
-        FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+        const real ori[3]     = { r.o.x,     r.o.y,     r.o.z };
+        const real inv_dir[3] = { 1 / r.d.x, 1 / r.d.y, 1 / r.d.z };
+
+        real t_min, t_max = r.t_max;
+        if(!nodes_[0].has_intersection(ori, inv_dir, r.t_min, t_max, &t_min))
+            return false;
+
+        // stack entries are kept with their entry distance so that nodes
+        // behind the current closest intersection can be skipped
+
+        struct StackEntry
+        {
+            uint32_t node;
+            real t;
+        };
+
+        StackEntry stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, t_min };
+
         Ray ray = r;
-        return closest_intersection_aux(inv_dir, ray, nodes_[0], inct);
+        bool ret = false;
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+            if(entry.t > ray.t_max)
+                continue;
+
+            const Node &node = nodes_[entry.node];
+            AGZ_STATS_ADD(EntityBVHNode, 1);
+
+            if(node.is_leaf())
+            {
+                AGZ_STATS_ADD(
+                    EntityBVHEntity, node.end_or_right_offset - node.start);
+                for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                {
+                    if(prims_[i]->closest_intersection(ray, inct))
+                    {
+                        ray.t_max = inct->t;
+                        ret = true;
+                    }
+                }
+                continue;
+            }
+
+            const uint32_t left_idx  = entry.node + 1;
+            const uint32_t right_idx = node.end_or_right_offset;
+
+            real t_left, t_right;
+            const bool add_left = nodes_[left_idx].has_intersection(
+                ori, inv_dir, ray.t_min, ray.t_max, &t_left);
+            const bool add_right = nodes_[right_idx].has_intersection(
+                ori, inv_dir, ray.t_min, ray.t_max, &t_right);
+
+            assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+
+            // push the farther child first so that the nearer one is visited first
+
+            if(add_left && add_right)
+            {
+                if(t_left < t_right)
+                {
+                    stack[top++] = { right_idx, t_right };
+                    stack[top++] = { left_idx,  t_left  };
+                }
+                else
+                {
+                    stack[top++] = { left_idx,  t_left  };
+                    stack[top++] = { right_idx, t_right };
+                }
+            }
+            else if(add_left)
+                stack[top++] = { left_idx, t_left };
+            else if(add_right)
+                stack[top++] = { right_idx, t_right };
+        }
+
+        return ret;
+    }
+
+    void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept override
+    {
+        for(size_t beg = 0; beg < rays.size(); beg += RayPacket::MAX_SIZE)
+        {
+            const size_t count = (std::min)(
+                rays.size() - beg, size_t(RayPacket::MAX_SIZE));
+            has_intersection_packet(
+                &rays[beg], static_cast<int>(count), results + beg);
+        }
+    }
+
+    void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept override
+    {
+        for(size_t beg = 0; beg < rays.size(); beg += RayPacket::MAX_SIZE)
+        {
+            const size_t count = (std::min)(
+                rays.size() - beg, size_t(RayPacket::MAX_SIZE));
+            closest_intersection_packet(
+                &rays[beg], static_cast<int>(count), incts + beg, results + beg);
+        }
     }
 };
 
@@ -1,4 +1,5 @@
 #include <agz/tracer/core/camera.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
 AGZ_TRACER_BEGIN
@@ -75,6 +76,8 @@ public:
         const Vec2 &film_coord,
         const Sample2 &aperture_sample) const noexcept override
     {
+        AGZ_STATS_ADD(PrimaryRay, 1);
+
         const FVec3 focal_film_pos = {
             (real(0.5) - film_coord.x) * focal_film_width_,
             (film_coord.y - real(0.5)) * focal_film_height_,
@@ -86,11 +89,29 @@ public:
             lens_radius_ * disk_sam.x, lens_radius_ * disk_sam.y, 0);
 
         const FVec3 pos_on_cam = camera_to_world_.apply_to_point(lens_pos);;
-        const FVec3 pos_to_out = camera_to_world_.apply_to_vector(
-            focal_film_pos - lens_pos).normalize();
-        
-        return CameraSampleWeResult(
+        const FVec3 unnormalized_dir = camera_to_world_.apply_to_vector(
+            focal_film_pos - lens_pos);
+        const FVec3 pos_to_out = unnormalized_dir.normalize();
+
+        CameraSampleWeResult ret(
             pos_on_cam, pos_to_out, dir_, FSpectrum(1));
+
+        // lens position is fixed, and only the direction changes with
+        // film coordinate
+
+        const real inv_len = 1 / unnormalized_dir.length();
+        auto normalized_derivative = [&](const FVec3 &local_dv)
+        {
+            const FVec3 dv = camera_to_world_.apply_to_vector(local_dv);
+            return inv_len * (dv - pos_to_out * dot(pos_to_out, dv));
+        };
+
+        ret.differential.dddx = normalized_derivative(
+            { -focal_film_width_, 0, 0 });
+        ret.differential.dddy = normalized_derivative(
+            { 0, focal_film_height_, 0 });
+
+        return ret;
     }
 
     CameraEvalWeResult eval_we(
@@ -0,0 +1,118 @@
+#include <agz/tracer/core/render_target.h>
+#include <agz/tracer/utility/parallel_grid.h>
+#include <agz-utils/thread.h>
+
+AGZ_TRACER_BEGIN
+
+SplatFilm::ThreadBuffer::~ThreadBuffer()
+{
+    if(!film_)
+        return;
+    const int tile_count = film_->tile_count_x_ * film_->tile_count_y_;
+    for(int i = 0; i < tile_count; ++i)
+        delete tiles_[i].load(std::memory_order_relaxed);
+}
+
+SplatFilm::ThreadBuffer::Tile *SplatFilm::ThreadBuffer::allocate_tile(
+    int tile_index)
+{
+    Tile *tile = new Tile;
+    tiles_[tile_index].store(tile, std::memory_order_release);
+    return tile;
+}
+
+SplatFilm::SplatFilm(const FilmFilterApplier &filter, int thread_count)
+    : filter_(filter)
+{
+    pixel_range_ = { { 0, 0 }, { filter.width() - 1, filter.height() - 1 } };
+
+    tile_count_x_ = (filter.width()  + TILE_SIZE - 1) / TILE_SIZE;
+    tile_count_y_ = (filter.height() + TILE_SIZE - 1) / TILE_SIZE;
+
+    thread_count_ = (std::max)(thread_count, 1);
+    buffers_ = std::make_unique<ThreadBuffer[]>(thread_count_);
+
+    const int tile_count = tile_count_x_ * tile_count_y_;
+    for(int i = 0; i < thread_count_; ++i)
+    {
+        ThreadBuffer &buf = buffers_[i];
+        buf.film_  = this;
+        buf.tiles_ = std::make_unique<std::atomic<ThreadBuffer::Tile*>[]>(
+                                                                tile_count);
+        for(int j = 0; j < tile_count; ++j)
+            buf.tiles_[j].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Image2D<Spectrum> SplatFilm::get_image(real scale) const
+{
+    const int w = width(), h = height();
+    Image2D<Spectrum> ret(h, w);
+
+    // tiles are disjoint, so each of them is resolved by one worker
+
+    parallel_for_2d_grid(
+        thread::actual_worker_count(0), w, h, TILE_SIZE, TILE_SIZE,
+        [&](int, const Rect2i &grid)
+    {
+        resolve({ grid.low, grid.high - Vec2i(1) }, scale, ret);
+    });
+
+    return ret;
+}
+
+void SplatFilm::resolve(
+    const Rect2i &pixels, real scale, Image2D<Spectrum> &output) const
+{
+    for(int y = pixels.low.y; y <= pixels.high.y; ++y)
+    {
+        for(int x = pixels.low.x; x <= pixels.high.x; ++x)
+            output(y, x) = Spectrum();
+    }
+
+    const int tx_beg = pixels.low.x / TILE_SIZE, tx_end = pixels.high.x / TILE_SIZE;
+    const int ty_beg = pixels.low.y / TILE_SIZE, ty_end = pixels.high.y / TILE_SIZE;
+
+    for(int ty = ty_beg; ty <= ty_end; ++ty)
+    {
+        for(int tx = tx_beg; tx <= tx_end; ++tx)
+        {
+            const int tile_index = ty * tile_count_x_ + tx;
+
+            const int x_beg = (std::max)(pixels.low.x,  tx * TILE_SIZE);
+            const int y_beg = (std::max)(pixels.low.y,  ty * TILE_SIZE);
+            const int x_end = (std::min)(pixels.high.x, tx * TILE_SIZE + TILE_SIZE - 1);
+            const int y_end = (std::min)(pixels.high.y, ty * TILE_SIZE + TILE_SIZE - 1);
+
+            for(int i = 0; i < thread_count_; ++i)
+            {
+                const ThreadBuffer::Tile *tile = buffers_[i].tiles_[tile_index]
+                                                .load(std::memory_order_acquire);
+                if(!tile)
+                    continue;
+
+                for(int y = y_beg; y <= y_end; ++y)
+                {
+                    for(int x = x_beg; x <= x_end; ++x)
+                    {
+                        const std::atomic<real> *texel = &tile->values[
+                            ((y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE)
+                           * SPECTRUM_COMPONENT_COUNT];
+
+                        Spectrum &pixel = output(y, x);
+                        for(int c = 0; c < SPECTRUM_COMPONENT_COUNT; ++c)
+                            pixel[c] += texel[c].load(std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+    }
+
+    for(int y = pixels.low.y; y <= pixels.high.y; ++y)
+    {
+        for(int x = pixels.low.x; x <= pixels.high.x; ++x)
+            output(y, x) *= scale;
+    }
+}
+
+AGZ_TRACER_END
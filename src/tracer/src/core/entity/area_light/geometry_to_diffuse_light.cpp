@@ -89,4 +89,16 @@ real GeometryToDiffuseLight::pdf(
     return area_pdf * area_to_solid_angle_factor;
 }
 
+void GeometryToDiffuseLight::emission_bound(
+    FVec3 *axis, real *cos_theta_o, real *cos_theta_e) const noexcept
+{
+    // diffuse emission covers the hemisphere around each normal
+    *cos_theta_e = 0;
+    if(!geometry_->normal_bound(axis, cos_theta_o))
+    {
+        *axis        = FVec3(0, 0, 1);
+        *cos_theta_o = -1;
+    }
+}
+
 AGZ_TRACER_END
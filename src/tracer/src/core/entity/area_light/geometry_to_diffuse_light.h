@@ -37,6 +37,9 @@ public:
     real pdf(
         const FVec3 &ref,
         const FVec3 &pos, const FVec3 &nor) const noexcept override;
+
+    void emission_bound(
+        FVec3 *axis, real *cos_theta_o, real *cos_theta_e) const noexcept override;
 };
 
 AGZ_TRACER_END
@@ -57,6 +57,44 @@ public:
         return true;
     }
 
+    void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept override
+    {
+        geometry_->has_intersection_n(rays, results);
+    }
+
+    void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept override
+    {
+        // geometry intersections are stored contiguously, so rays are
+        // processed in chunks and copied into entity intersections
+
+        constexpr size_t CHUNK_SIZE = 64;
+        GeometryIntersection geo_incts[CHUNK_SIZE];
+
+        for(size_t beg = 0; beg < rays.size(); beg += CHUNK_SIZE)
+        {
+            const size_t end = (std::min)(beg + CHUNK_SIZE, rays.size());
+            geometry_->closest_intersection_n(
+                misc::span<const Ray>(&rays[beg], end - beg),
+                geo_incts, results + beg);
+
+            for(size_t i = beg; i < end; ++i)
+            {
+                if(!results[i])
+                    continue;
+
+                EntityIntersection &inct = incts[i];
+                static_cast<GeometryIntersection &>(inct) = geo_incts[i - beg];
+                inct.entity     = this;
+                inct.material   = material_.get();
+                inct.medium_in  = medium_interface_.in.get();
+                inct.medium_out = medium_interface_.out.get();
+            }
+        }
+    }
+
     AABB world_bound() const noexcept override
     {
         return geometry_->world_bound();
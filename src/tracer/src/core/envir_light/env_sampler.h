@@ -1,9 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/parallel_grid.h>
 #include <agz-utils/texture.h>
 #include <agz-utils/thread.h>
 
@@ -11,120 +13,246 @@ AGZ_TRACER_BEGIN
 
 /**
  * @brief helper class for importance sampling of environment light
+ *
+ * the sphere is divided into cells by a lat-long grid, whose resolution is
+ * the texture resolution clamped to max_resolution. the probability of
+ * a cell is proportional to the integral of radiance luminance over it,
+ * where radiance is bilinearly interpolated from texels. cells are sampled
+ * by a marginal cdf over rows and a conditional cdf in each row.
+ *
+ * texels are fetched in a single parallel pass, which also computes the
+ * integral of radiance over the sphere.
  */
 class EnvironmentLightSampler : public misc::uncopyable_t
 {
-    texture::texture2d_t<real> probs_;
-    math::distribution::alias_sampler_t<real> sampler_;
+    int width_  = 1;
+    int height_ = 1;
+
+    // probability of each cell
+    std::vector<real> probs_;
+
+    // cdf over rows, with height_ + 1 entries
+    std::vector<real> marginal_cdf_;
+
+    // cdf in each row, with width_ + 1 entries per row
+    std::vector<real> conditional_cdfs_;
+
+    // cos(theta) of each row boundary
+    std::vector<real> row_cos_;
+
+    FSpectrum radiance_integral_;
+
+    // returns i where cdf[i] <= u < cdf[i + 1], and the relative position
+    // of u in the entry
+    static int sample_cdf(const real *cdf, int n, real u, real *offset) noexcept
+    {
+        const int i = (std::min)(
+            n - 1, int(std::upper_bound(cdf + 1, cdf + n + 1, u) - (cdf + 1)));
+        const real width = cdf[i + 1] - cdf[i];
+        *offset = width > 0 ? (std::min)(
+            (u - cdf[i]) / width, real(1) - std::numeric_limits<real>::epsilon())
+            : real(0.5);
+        return i;
+    }
+
+    // solid angle of cells in row y
+    real cell_area(int y) const noexcept
+    {
+        return 2 * PI_r * (row_cos_[y] - row_cos_[y + 1]) / width_;
+    }
 
 public:
 
-    explicit EnvironmentLightSampler(RC<const Texture2D> tex)
+    static constexpr int DEFAULT_MAX_RESOLUTION = 4096;
+
+    explicit EnvironmentLightSampler(
+        RC<const Texture2D> tex, int max_resolution = DEFAULT_MAX_RESOLUTION)
     {
-        const int width = tex->width(), height = tex->height();
-        const int new_width  = (std::min)(width, 200);
-        const int new_height = (std::min)(height, 200);
+        const int tex_w = tex->width(), tex_h = tex->height();
+        max_resolution = (std::max)(max_resolution, 1);
+        width_  = (std::min)(tex_w, max_resolution);
+        height_ = (std::min)(tex_h, max_resolution);
+
+        row_cos_.resize(height_ + 1);
+        for(int y = 0; y <= height_; ++y)
+            row_cos_[y] = std::cos(PI_r * y / height_);
+        row_cos_.back() = -1;
+
+        // source texels overlapped by cells: [beg, end)
 
-        // compute energy distribution
+        auto src_beg = [](int i, int src, int dst)
+            { return int(int64_t(i) * src / dst); };
+        auto src_end = [](int i, int src, int dst)
+            { return int((int64_t(i + 1) * src + dst - 1) / dst); };
 
-        std::atomic<real> lum_sum = 0;
-        probs_.initialize(new_height, new_width);
+        // texels are fetched by rows of cells. each row reads its source
+        // rows plus one neighboring row on each side for bilinear filtering.
+        // radiance integrals are accumulated over owned source rows, which
+        // partition the texture
 
-        thread::parallel_forrange(0, new_height, [&](int, int y)
+        probs_.resize(size_t(width_) * height_);
+        std::vector<FSpectrum> row_radiance_integrals(height_);
+
+        parallel_for_1d_grid(
+            thread::actual_worker_count(0), height_, 1, [&](int, int y, int)
         {
-            const real y0 = real(y)     / real(new_height);
-            const real y1 = real(y + 1) / real(new_height);
+            const int sy_beg = src_beg(y, tex_h, height_);
+            const int sy_end = src_end(y, tex_h, height_);
+            const int sy_own_end = src_beg(y + 1, tex_h, height_);
+
+            const int fetch_beg = (std::max)(sy_beg - 1, 0);
+            const int fetch_end = (std::min)(sy_end + 1, tex_h);
 
-            const real y0_src = y0 * height;
-            const real y1_src = y1 * height;
+            // horizontally filtered luminance of fetched rows.
+            // the bilinear integral over a texel is [1/8, 3/4, 1/8] * texels
 
-            const int y_src_beg = (std::max)(0, int(std::floor(y0_src) - 1));
-            const int y_src_lst = (std::min)(height - 1, int(std::floor(y1_src) + 1));
+            std::vector<real> lum(tex_w);
+            std::vector<real> filtered(size_t(fetch_end - fetch_beg) * tex_w);
 
-            for(int x = 0; x < new_width; ++x)
+            FSpectrum radiance_integral;
+            for(int sy = fetch_beg; sy < fetch_end; ++sy)
             {
-                const real x0 = real(x)     / new_width;
-                const real x1 = real(x + 1) / new_width;
+                const real v = (sy + real(0.5)) / tex_h;
+                const bool owned = sy_beg <= sy && sy < sy_own_end;
+                const real texel_area = 2 * PI_r / tex_w * (
+                    std::cos(PI_r * sy / tex_h) - std::cos(PI_r * (sy + 1) / tex_h));
+
+                for(int sx = 0; sx < tex_w; ++sx)
+                {
+                    const real u = (sx + real(0.5)) / tex_w;
+                    const FSpectrum texel = tex->sample_spectrum({ u, v });
+                    lum[sx] = (std::max)(texel.lum(), real(0));
+                    if(owned)
+                        radiance_integral += texel_area * texel;
+                }
+
+                real *row = &filtered[size_t(sy - fetch_beg) * tex_w];
+                for(int sx = 0; sx < tex_w; ++sx)
+                {
+                    const real l = lum[(std::max)(sx - 1, 0)];
+                    const real r = lum[(std::min)(sx + 1, tex_w - 1)];
+                    row[sx] = real(0.125) * (l + r) + real(0.75) * lum[sx];
+                }
+            }
+            row_radiance_integrals[y] = radiance_integral;
 
-                const real x0_src = x0 * width;
-                const real x1_src = x1 * width;
+            // vertically filter and sum up source rows of this cell row,
+            // then use prefix sums to sum up source columns of each cell
 
-                const int x_src_beg = (std::max)(0, int(std::floor(x0_src) - 1));
-                const int x_src_lst = (std::min)(width - 1, int(std::floor(x1_src) + 1));
+            auto filtered_row = [&](int sy)
+            {
+                sy = math::clamp(sy, fetch_beg, fetch_end - 1);
+                return &filtered[size_t(sy - fetch_beg) * tex_w];
+            };
 
-                real pixel_lum = 0;
-                for(int y_src = y_src_beg; y_src <= y_src_lst; ++y_src)
+            std::vector<double> column_prefix_sum(tex_w + 1);
+            for(int sy = sy_beg; sy < sy_end; ++sy)
+            {
+                const real *t = filtered_row(sy - 1);
+                const real *m = filtered_row(sy);
+                const real *b = filtered_row(sy + 1);
+                for(int sx = 0; sx < tex_w; ++sx)
                 {
-                    for(int x_src = x_src_beg; x_src <= x_src_lst; ++x_src)
-                    {
-                        const real src_u = (real(x_src) + real(0.5)) / real(width);
-                        const real src_v = (real(y_src) + real(0.5)) / real(height);
-                        pixel_lum += tex->sample_spectrum({ src_u, src_v }).lum();
-                    }
+                    column_prefix_sum[sx + 1] +=
+                        real(0.125) * (t[sx] + b[sx]) + real(0.75) * m[sx];
                 }
+            }
+            for(int sx = 0; sx < tex_w; ++sx)
+                column_prefix_sum[sx + 1] += column_prefix_sum[sx];
 
-                const real delta_area = std::abs(
-                    2 * PI_r * (x1 - x0) * (std::cos(PI_r * y1)
-                  - std::cos(PI_r * y0)));
-                  
-                const real area_lum = pixel_lum * delta_area;
-                probs_(y, x) = area_lum;
-                math::atomic_add(lum_sum, area_lum);
+            for(int x = 0; x < width_; ++x)
+            {
+                const int sx_beg = src_beg(x, tex_w, width_);
+                const int sx_end = src_end(x, tex_w, width_);
+                const double sum = column_prefix_sum[sx_end]
+                                 - column_prefix_sum[sx_beg];
+                const double texel_count =
+                    double(sx_end - sx_beg) * (sy_end - sy_beg);
+                probs_[size_t(y) * width_ + x] =
+                    real(sum / texel_count) * cell_area(y);
             }
         });
 
-        // normalize the energy distribution
+        for(auto &r : row_radiance_integrals)
+            radiance_integral_ += r;
+
+        // fall back to uniform sampling when there is no energy
 
-        if(lum_sum > EPS())
+        double prob_sum = 0;
+        for(real p : probs_)
+            prob_sum += p;
+
+        if(!(prob_sum > 0))
         {
-            const real ratio = 1 / lum_sum;
-            for(int y = 0; y < new_height; ++y)
+            prob_sum = 0;
+            for(int y = 0; y < height_; ++y)
             {
-                for(int x = 0; x < new_width; ++x)
-                    probs_(y, x) *= ratio;
+                for(int x = 0; x < width_; ++x)
+                {
+                    probs_[size_t(y) * width_ + x] = cell_area(y);
+                    prob_sum += cell_area(y);
+                }
             }
         }
 
-        // linearize the energy distribution
+        // construct cdfs
+
+        const double inv_prob_sum = 1 / prob_sum;
+        for(auto &p : probs_)
+            p = real(p * inv_prob_sum);
+
+        marginal_cdf_.resize(height_ + 1);
+        conditional_cdfs_.resize(size_t(width_ + 1) * height_);
 
-        std::vector<real> linear_probs(probs_.size().product());
-        for(int y = 0; y < new_height; ++y)
+        double marginal_sum = 0;
+        for(int y = 0; y < height_; ++y)
         {
-            const int y_base = y * new_width;
-            for(int x = 0; x < new_width; ++x)
+            const real *row_probs = &probs_[size_t(y) * width_];
+            real *cdf = &conditional_cdfs_[size_t(y) * (width_ + 1)];
+
+            double row_sum = 0;
+            for(int x = 0; x < width_; ++x)
+                row_sum += row_probs[x];
+
+            cdf[0] = 0;
+            double acc = 0;
+            for(int x = 0; x < width_; ++x)
             {
-                const int idx = y_base + x;
-                linear_probs[idx] = probs_(y, x);
+                acc += row_sum > 0 ? row_probs[x] / row_sum : 1.0 / width_;
+                cdf[x + 1] = real(acc);
             }
-        }
+            cdf[width_] = 1;
 
-        // construct sampler
+            marginal_cdf_[y] = real(marginal_sum);
+            marginal_sum += row_sum;
+        }
+        marginal_cdf_[height_] = 1;
+    }
 
-        sampler_.initialize(linear_probs.data(), int(linear_probs.size()));
+    /**
+     * @brief integral of radiance over the sphere
+     */
+    const FSpectrum &radiance_integral() const noexcept
+    {
+        return radiance_integral_;
     }
 
     // return (ref_to_light, pdf)
     std::pair<FVec3, real> sample(const Sample3 &sam) const
     {
-        const int patch_idx = sampler_.sample(sam.u);
-        const int patch_y = patch_idx / probs_.width();
-        const int patch_x = patch_idx % probs_.width();
-        assert(patch_y < probs_.height());
-        assert(patch_x < probs_.width());
+        real offset_y, offset_x;
+        const int patch_y = sample_cdf(
+            marginal_cdf_.data(), height_, sam.u, &offset_y);
+        const int patch_x = sample_cdf(
+            &conditional_cdfs_[size_t(patch_y) * (width_ + 1)],
+            width_, sam.v, &offset_x);
 
-        const real patch_pdf = probs_(patch_y, patch_x);
+        const real patch_pdf = probs_[size_t(patch_y) * width_ + patch_x];
 
-        const real u0 = real(patch_x)     / real(probs_.width());
-        const real u1 = real(patch_x + 1) / real(probs_.width());
-        const real v0 = real(patch_y)     / real(probs_.height());
-        const real v1 = real(patch_y + 1) / real(probs_.height());
-
-        const auto [cvmin, cvmax] = math::minmax(
-            std::cos(PI_r * v1), std::cos(PI_r * v0));
-
-        const real cos_theta = cvmin + sam.w * (cvmax - cvmin);
+        const real cos_theta = math::mix(
+            row_cos_[patch_y], row_cos_[patch_y + 1], offset_y);
         const real sin_theta = local_angle::cos_2_sin(cos_theta);
-        const real u         = math::mix(u0, u1, sam.v);
+        const real u         = (patch_x + offset_x) / width_;
         const real phi       = 2 * PI_r * u;
 
         const FVec3 dir = {
@@ -132,39 +260,27 @@ public:
             sin_theta * std::sin(phi),
             cos_theta
         };
-        const real in_patch_pdf = 1 / (2 * PI_r * ((u1 - u0) * (cvmax - cvmin)));
 
-        return { dir, patch_pdf * in_patch_pdf };
+        return { dir, patch_pdf / cell_area(patch_y) };
     }
 
     real pdf(const FVec3 &ref_to_light) const
     {
         const FVec3 dir = ref_to_light.normalize();
         const real cos_theta = local_angle::cos_theta(dir);
-        const real theta = std::acos(cos_theta);
+        const real theta = std::acos(math::clamp<real>(cos_theta, -1, 1));
         const real phi = local_angle::phi(dir);
 
         const real u = phi / (2 * PI_r);
         const real v = theta / PI_r;
 
         const int patch_x = math::clamp(
-            int(std::floor(u * probs_.width())), 0, probs_.width() - 1);
+            int(std::floor(u * width_)), 0, width_ - 1);
         const int patch_y = math::clamp(
-            int(std::floor(v * probs_.height())), 0, probs_.height() - 1);
-
-        const real patch_pdf = probs_(patch_y, patch_x);
-
-        const real u0 = real(patch_x)     / real(probs_.width());
-        const real u1 = real(patch_x + 1) / real(probs_.width());
-        const real v0 = real(patch_y)     / real(probs_.height());
-        const real v1 = real(patch_y + 1) / real(probs_.height());
-
-        const auto [cvmin, cvmax] = math::minmax(
-            std::cos(PI_r * v1), std::cos(PI_r * v0));
-        
-        const real in_patch_pdf = 1 / (2 * PI_r * ((u1 - u0) * (cvmax - cvmin)));
+            int(std::floor(v * height_)), 0, height_ - 1);
 
-        return patch_pdf * in_patch_pdf;
+        const real patch_pdf = probs_[size_t(patch_y) * width_ + patch_x];
+        return patch_pdf / cell_area(patch_y);
     }
 };
 
@@ -23,41 +23,23 @@ public:
     IBL(
         RC<const Texture2D> tex,
         bool no_importance_sampling,
-        real user_specified_power = -1)
+        real user_specified_power,
+        int sampling_resolution)
     {
         tex_ = tex;
         user_specified_power_ = user_specified_power;
 
         if(no_importance_sampling)
+        {
             sampler_ = newBox<EnvironmentLightSampler>(
                 create_constant2d_texture({}, FSpectrum(1)));
-        else
-            sampler_ = newBox<EnvironmentLightSampler>(tex_);
-
-        if(no_importance_sampling)
-        {
             avg_rad_ = FSpectrum(1);
         }
         else
         {
-            const int tex_width = tex_->width(), tex_height = tex_->height();
-            for(int y = 0; y < tex_height; ++y)
-            {
-                const real v0 = real(y) / tex_height;
-                const real v1 = real(y + 1) / tex_height;
-
-                for(int x = 0; x < tex_width; ++x)
-                {
-                    const real u0 = real(x) / tex_width;
-                    const real u1 = real(x + 1) / tex_width;
-
-                    const real delta_area = std::abs(2 * PI_r * (u1 - u0) *
-                                            (std::cos(PI_r * v1) - std::cos(PI_r * v0)));
-
-                    const real u = (u0 + u1) / 2, v = (v0 + v1) / 2;
-                    avg_rad_ += PI_r * delta_area * tex_->sample_spectrum({ u, v });
-                }
-            }
+            sampler_ = newBox<EnvironmentLightSampler>(
+                tex_, sampling_resolution);
+            avg_rad_ = PI_r * sampler_->radiance_integral();
         }
     }
 
@@ -158,9 +140,11 @@ public:
 RC<EnvirLight> create_ibl_light(
     RC<const Texture2D> tex,
     bool no_importance_sampling,
-    real user_specified_power)
+    real user_specified_power,
+    int sampling_resolution)
 {
-    return newRC<IBL>(tex, no_importance_sampling, user_specified_power);
+    return newRC<IBL>(
+        tex, no_importance_sampling, user_specified_power, sampling_resolution);
 }
 
 AGZ_TRACER_END
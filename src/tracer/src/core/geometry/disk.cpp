@@ -76,6 +76,13 @@ public:
         inct->wr = -local_r.d;
         inct->t = t_val;
 
+        inct->dpdu = inct->dpdv = FVec3();
+        if(radius > 0)
+        {
+            inct->dpdu = 2 * PI_r * FVec3(-pos.y, pos.x, 0);
+            inct->dpdv = radius_ / radius * FVec3(pos.x, pos.y, 0);
+        }
+
         to_world(inct);
         return true;
     }
@@ -123,6 +130,14 @@ public:
     {
         return pdf(sample);
     }
+
+    bool normal_bound(FVec3 *axis, real *cos_theta) const noexcept override
+    {
+        *axis = local_to_world_.apply_to_coord(
+            FCoord(FVec3(1, 0, 0), FVec3(0, 1, 0), FVec3(0, 0, 1))).z;
+        *cos_theta = 1;
+        return true;
+    }
 };
 
 RC<Geometry> create_disk(
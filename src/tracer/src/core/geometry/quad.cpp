@@ -40,6 +40,8 @@ public:
             inct->user_coord     = inct->geometry_coord;
             inct->wr             = -r.d;
             inct->t              = inct_rcd.t_ray;
+            triangle_dpduv(
+                b_a_, c_a_, t_b_a_, t_c_a_, &inct->dpdu, &inct->dpdv);
             return true;
         }
         
@@ -51,6 +53,8 @@ public:
             inct->user_coord     = inct->geometry_coord;
             inct->wr             = -r.d;
             inct->t              = inct_rcd.t_ray;
+            triangle_dpduv(
+                c_a_, d_a_, t_c_a_, t_d_a_, &inct->dpdu, &inct->dpdv);
             return true;
         }
 
@@ -120,6 +124,13 @@ public:
         return pdf(sample);
     }
 
+    bool normal_bound(FVec3 *axis, real *cos_theta) const noexcept override
+    {
+        *axis = z_;
+        *cos_theta = 1;
+        return true;
+    }
+
 private:
     
     FVec3 a_;
@@ -55,6 +55,16 @@ public:
         inct->wr = -local_r.d;
         inct->t = t;
 
+        // zero at poles, where u is undefined
+        const real rho = std::sqrt(pos.x * pos.x + pos.y * pos.y);
+        inct->dpdu = inct->dpdv = FVec3();
+        if(rho > 0)
+        {
+            inct->dpdu = 2 * PI_r * FVec3(-pos.y, pos.x, 0);
+            inct->dpdv = PI_r * FVec3(
+                -pos.z * pos.x / rho, -pos.z * pos.y / rho, rho);
+        }
+
         to_world(inct);
 
         return true;
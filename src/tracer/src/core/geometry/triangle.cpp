@@ -45,6 +45,9 @@ public:
         inct->wr             = -local_r.d;
         inct->t              = inct_rcd.t_ray;
 
+        triangle_dpduv(
+            b_a_, c_a_, t_b_a_, t_c_a_, &inct->dpdu, &inct->dpdv);
+
         to_world(inct);
 
         return true;
@@ -102,6 +105,13 @@ public:
         return pdf(sample);
     }
 
+    bool normal_bound(FVec3 *axis, real *cos_theta) const noexcept override
+    {
+        *axis = local_to_world_.apply_to_coord(FCoord(x_, cross(z_, x_), z_)).z;
+        *cos_theta = 1;
+        return true;
+    }
+
 private:
 
     void init_from_params(const Params &params)
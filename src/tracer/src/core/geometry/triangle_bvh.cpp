@@ -1,38 +1,39 @@
-﻿#include <limits>
-#include <queue>
+﻿#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
 #include <stack>
+#include <thread>
 #include <vector>
 
+#include <agz/tracer/create/geometry.h>
 #include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/ray_packet.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz/tracer/utility/triangle_aux.h>
 
 #include <agz-utils/mesh.h>
 #include <agz-utils/misc.h>
 
 #include "./transformed_geometry.h"
+#include "./triangle_bvh_compact.h"
+#include "./triangle_bvh_wide.h"
 
 AGZ_TRACER_BEGIN
 
 namespace
 {
 
+    using namespace tri_bvh_ws;
+
     // stack for traversal the bvh tree
-    constexpr int TRAVERSAL_STACK_SIZE = 128;
     thread_local uint32_t traversal_stack[TRAVERSAL_STACK_SIZE];
 
-    // triangle in bvh
-    struct Primitive
-    {
-        Vec3 a_, b_a_, c_a_;
-    };
-
-    // triangle info in bvh
-    struct PrimitiveInfo
-    {
-        Vec3 n_a_, n_b_a_, n_c_a_;
-        Vec2 t_a_, t_b_a_, t_c_a_;
-        Vec3 x_, z_;
-    };
+    constexpr double BYTES_PER_MB = 1024.0 * 1024.0;
 
     // node in triangle bvh
     struct Node
@@ -97,134 +98,9 @@ namespace
         }
     };
 
-    // linking node used in building bvh
-    // leaf node when left == nullptr. otherwise, internal node
-    struct BuildingNode
-    {
-        AABB bounding;
-        BuildingNode *left = nullptr, *right = nullptr;
-        uint32_t start = 0, end = 0;
-    };
-
-    // triangle used in building bvh
-    struct BuildingTriangle
-    {
-        const mesh::vertex_t *vtx = nullptr;
-        Vec3 centroid;
-    };
-
-    struct BuildingResult
-    {
-        BuildingNode *root;
-        uint32_t node_count;
-    };
-
-    BuildingResult build_bvh(
-        BuildingTriangle *triangles, uint32_t triangle_count,
-        uint32_t leaf_size_threshold, uint32_t depth_threshold, Arena &arena)
-    {
-        struct BuildingTask
-        {
-            BuildingNode **fillback_ptr;
-            uint32_t start, end;
-            uint32_t depth;
-        };
-
-        BuildingResult ret = { nullptr, 0 };
-
-        std::queue<BuildingTask> tasks;
-        tasks.push({ &ret.root, 0, triangle_count, 0 });
-
-        while(!tasks.empty())
-        {
-            const BuildingTask task = tasks.front();
-            tasks.pop();
-
-            assert(task.start < task.end);
-
-            AABB all_bound, centroid_bound;
-            for(uint32_t i = task.start; i < task.end; ++i)
-            {
-                auto &tri = triangles[i];
-                all_bound |= tri.vtx[0].position;
-                all_bound |= tri.vtx[1].position;
-                all_bound |= tri.vtx[2].position;
-                centroid_bound |= tri.centroid;
-            }
-
-            // construct leaf node when triangle count is sufficiently low
-            const uint32_t n = task.end - task.start;
-            if(n <= leaf_size_threshold)
-            {
-                ++ret.node_count;
-
-                auto leaf = arena.create<BuildingNode>();
-                leaf->bounding = all_bound;
-                leaf->left     = nullptr;
-                leaf->right    = nullptr;
-                leaf->start    = task.start;
-                leaf->end      = task.end;
-
-                *task.fillback_ptr = leaf;
-
-                continue;
-            }
-
-            // select the split axis with max extent
-            const FVec3 centroid_delta = centroid_bound.high - centroid_bound.low;
-            const int split_axis = centroid_delta[0] > centroid_delta[1] ?
-                (centroid_delta[0] > centroid_delta[2] ? 0 : 2) :
-                (centroid_delta[1] > centroid_delta[2] ? 1 : 2);
-
-            // divide the axis with centroid position when recursive depth is
-            // small. otherwise, divide with triangle count
-            uint32_t split_middle;
-            if(task.depth < depth_threshold)
-            {
-                const real split_pos = real(0.5) * (
-                    centroid_bound.high[split_axis] + centroid_bound.low[split_axis]);
-                split_middle = task.start;
-                for(uint32_t i = task.start; i < task.end; ++i)
-                {
-                    if(triangles[i].centroid[split_axis] < split_pos)
-                        std::swap(triangles[i], triangles[split_middle++]);
-                }
-
-                if(split_middle == task.start || split_middle == task.end)
-                    split_middle = task.start + n / 2;
-            }
-            else
-            {
-                std::sort(
-                    triangles + task.start, triangles + task.end,
-                    [axis = split_axis]
-                    (const BuildingTriangle &L, const BuildingTriangle &R)
-                {
-                    return L.centroid[axis] < R.centroid[axis];
-                });
-                split_middle = task.start + n / 2;
-            }
-
-            auto interior = arena.create<BuildingNode>();
-            interior->bounding = all_bound;
-            interior->left     = nullptr;
-            interior->right    = nullptr;
-            interior->start    = 0;
-            interior->end      = 0;
-
-            *task.fillback_ptr = interior;
-            ++ret.node_count;
-
-            tasks.push({ &interior->left, task.start, split_middle, task.depth + 1 });
-            tasks.push({ &interior->right, split_middle, task.end, task.depth + 1 });
-        }
-
-        return ret;
-    }
-
-    void compact_bvh(
-        const BuildingNode *building_node, const BuildingTriangle *triangles,
-        Node *node_arr, Primitive *prim_arr, PrimitiveInfo *prim_info_arr)
+    // fill nodes in depth-first order
+    // leaf nodes refer to the same triangle range as in building triangles
+    void compact_bvh(const BuildingNode *building_node, Node *node_arr)
     {
         struct CompactingTask
         {
@@ -232,7 +108,7 @@ namespace
             uint32_t *fillback_ptr;
         };
 
-        uint32_t next_node_idx = 0, next_prim_idx = 0;
+        uint32_t next_node_idx = 0;
 
         std::stack<CompactingTask> tasks;
         tasks.push({ building_node, nullptr });
@@ -257,107 +133,322 @@ namespace
             }
             else
             {
-                const uint32_t start = next_prim_idx;
-                const uint32_t end = next_prim_idx + (tree->end - tree->start);
-
                 auto &node = node_arr[next_node_idx++];
                 node = Node::new_leaf(
-                    &tree->bounding.low[0], &tree->bounding.high[0], start, end);
+                    &tree->bounding.low[0], &tree->bounding.high[0],
+                    tree->start, tree->end);
+            }
+        }
+    }
 
-                for(uint32_t i = start, j = tree->start; i < end; ++i, ++j)
-                {
-                    assert(j < tree->end);
+    // header of triangle bvh cache file
+    //
+    // node, primitive and primitive info arrays follow the header in
+    // 64-byte aligned sections, so that they can be used in place after the
+    // file is memory-mapped
+    struct TriangleBVHCacheHeader
+    {
+        char     magic[8];
+        uint32_t version;
 
-                    const auto &tri = triangles[j];
-                    auto &prim      = prim_arr[i];
-                    auto &prim_info = prim_info_arr[i];
+        // sizes of stored structures, which must match the current build
+        uint32_t node_size;
+        uint32_t prim_size;
+        uint32_t prim_info_size;
 
-                    prim.a_   = tri.vtx[0].position;
-                    prim.b_a_ = tri.vtx[1].position - tri.vtx[0].position;
-                    prim.c_a_ = tri.vtx[2].position - tri.vtx[0].position;
+        uint32_t node_count;
+        uint32_t prim_count;
 
-                    const FVec3 n_a = tri.vtx[0].normal.normalize();
-                    const FVec3 n_b = tri.vtx[1].normal.normalize();
-                    const FVec3 n_c = tri.vtx[2].normal.normalize();
+        real surface_area;
+        real bound_low[3];
+        real bound_high[3];
 
-                    prim_info.n_a_   = n_a;
-                    prim_info.n_b_a_ = n_b - n_a;
-                    prim_info.n_c_a_ = n_c - n_a;
+        uint64_t node_offset;
+        uint64_t prim_offset;
+        uint64_t prim_info_offset;
+    };
 
-                    prim_info.t_a_   = tri.vtx[0].tex_coord;
-                    prim_info.t_b_a_ = tri.vtx[1].tex_coord - tri.vtx[0].tex_coord;
-                    prim_info.t_c_a_ = tri.vtx[2].tex_coord - tri.vtx[0].tex_coord;
+    constexpr char     TRIANGLE_BVH_CACHE_MAGIC[8] = { 'A', 'G', 'Z', 'B', 'V', 'H', 'C', 0 };
+    constexpr uint32_t TRIANGLE_BVH_CACHE_VERSION = 1;
+    constexpr uint64_t TRIANGLE_BVH_CACHE_ALIGNMENT = 64;
 
-                    prim_info.z_ = cross(prim.b_a_, prim.c_a_).normalize();
-                    const FVec3 mean_nor = n_a + n_b + n_c;
-                    if(dot(mean_nor, prim_info.z_) < 0)
-                        prim_info.z_ = -prim_info.z_;
+    uint64_t align_cache_section(uint64_t offset) noexcept
+    {
+        return (offset + TRIANGLE_BVH_CACHE_ALIGNMENT - 1)
+             / TRIANGLE_BVH_CACHE_ALIGNMENT * TRIANGLE_BVH_CACHE_ALIGNMENT;
+    }
 
-                    prim_info.x_ = dpdu_as_ex(
-                        prim.b_a_, prim.c_a_,
-                        prim_info.t_b_a_, prim_info.t_c_a_, prim_info.z_);
-                }
+    /*
+     * check that mapped nodes form a tree which can be traversed safely
+     *
+     * nodes are stored in depth-first order, so the left child of node i is
+     * i + 1 and the right child must be after it. leaf ranges must be in
+     * [0, prim_count), and the depth must fit in the traversal stack
+     */
+    bool valid_cached_nodes(
+        const Node *nodes, uint32_t node_count, uint32_t prim_count)
+    {
+        // traversal keeps at most one pending sibling per level
+        constexpr uint32_t MAX_DEPTH = TRAVERSAL_STACK_SIZE - 2;
 
-                next_prim_idx = end;
+        // children are after their parent, so depths are final when visited
+        std::vector<uint32_t> depth(node_count, 0);
+
+        for(uint32_t i = 0; i < node_count; ++i)
+        {
+            const Node &node = nodes[i];
+
+            if(node.is_leaf())
+            {
+                if(node.start >= node.end_or_right_offset ||
+                   node.end_or_right_offset > prim_count)
+                    return false;
+                continue;
             }
+
+            const uint32_t right = node.end_or_right_offset;
+            if(i + 1 >= node_count || right <= i + 1 || right >= node_count)
+                return false;
+
+            if(depth[i] + 1 > MAX_DEPTH)
+                return false;
+            depth[i + 1] = (std::max)(depth[i + 1], depth[i] + 1);
+            depth[right] = (std::max)(depth[right], depth[i] + 1);
         }
+
+        return true;
     }
 
     // local triangle bvh
-    class UntransformedTriangleBVH
+    class UntransformedTriangleBVH : public misc::uncopyable_t
     {
-        std::vector<Primitive> prims_;
-        std::vector<PrimitiveInfo> prim_info_;
-        std::vector<Node> nodes_;
+        // point to owned_nodes_ or data in a mapped cache file
+        const Node *nodes_ = nullptr;
+        uint32_t node_count_ = 0;
 
-        math::distribution::alias_sampler_t<real> prim_sampler_;
+        std::vector<Node> owned_nodes_;
 
-        real surface_area_ = 0;
-        AABB local_bound_;
+        TrianglePrimitives prims_;
+
+        MemoryUsage memory_usage_;
 
     public:
 
-        void initialize(const mesh::triangle_t *triangles, uint32_t triangle_count)
+        void initialize(
+            const BuildingMesh &mesh, const TriangleBVHNoEmbreeParams &params)
+        {
+            assert(mesh.triangle_count());
+
+            const int worker_count = thread::actual_worker_count(
+                params.build_worker_count);
+
+            const auto bvh = build_bvh(
+                mesh, TRAVERSAL_STACK_SIZE / 2, params, worker_count);
+
+            owned_nodes_.resize(bvh->node_count);
+            compact_bvh(bvh->root, owned_nodes_.data());
+
+            nodes_      = owned_nodes_.data();
+            node_count_ = bvh->node_count;
+
+            prims_.initialize(*bvh, worker_count);
+
+            memory_usage_.node_bytes          = node_count_ * sizeof(Node);
+            memory_usage_.primitive_bytes     = prims_.memory_bytes();
+            memory_usage_.binary_layout_bytes = binary_layout_bytes(*bvh);
+            memory_usage_.peak_build_bytes    = building_bvh_bytes(*bvh)
+                                              + memory_usage_.total_bytes();
+        }
+
+        /**
+         * @brief map nodes and primitives from a cache file
+         *
+         * return false when the file is missing or invalid
+         */
+        bool initialize_from_cache(
+            const std::string &filename, int build_worker_count)
         {
-            assert(triangles && triangle_count);
+            if(!std::filesystem::exists(filename))
+                return false;
+
+            RC<MappedFile> file;
+            try
+            {
+                file = newRC<MappedFile>(filename);
+            }
+            catch(const std::exception &err)
+            {
+                AGZ_INFO("failed to map triangle bvh cache: {}", err.what());
+                return false;
+            }
 
-            surface_area_ = 0;
-            local_bound_ = AABB();
+            const unsigned char *data = file->data();
+            const size_t size = file->size();
+
+            if(size < sizeof(TriangleBVHCacheHeader))
+                return false;
+
+            TriangleBVHCacheHeader header;
+            std::memcpy(&header, data, sizeof(header));
+
+            if(std::memcmp(header.magic, TRIANGLE_BVH_CACHE_MAGIC,
+                           sizeof(header.magic)) != 0 ||
+               header.version        != TRIANGLE_BVH_CACHE_VERSION ||
+               header.node_size      != sizeof(Node) ||
+               header.prim_size      != sizeof(Primitive) ||
+               header.prim_info_size != sizeof(PrimitiveInfo) ||
+               !header.node_count || !header.prim_count)
+            {
+                AGZ_INFO("incompatible triangle bvh cache: {}", filename);
+                return false;
+            }
+
+            auto valid_section = [&](uint64_t offset, uint64_t bytes)
+            {
+                return offset % TRIANGLE_BVH_CACHE_ALIGNMENT == 0 &&
+                       offset <= size && bytes <= size - offset;
+            };
+
+            if(!valid_section(header.node_offset,
+                              uint64_t(header.node_count) * sizeof(Node)) ||
+               !valid_section(header.prim_offset,
+                              uint64_t(header.prim_count) * sizeof(Primitive)) ||
+               !valid_section(header.prim_info_offset,
+                              uint64_t(header.prim_count) * sizeof(PrimitiveInfo)))
+            {
+                AGZ_INFO("truncated triangle bvh cache: {}", filename);
+                return false;
+            }
 
-            std::vector<BuildingTriangle> build_triangles(triangle_count);
-            for(uint32_t i = 0; i < triangle_count; ++i)
+            const auto cached_nodes =
+                reinterpret_cast<const Node*>(data + header.node_offset);
+            if(!valid_cached_nodes(
+                cached_nodes, header.node_count, header.prim_count))
             {
-                build_triangles[i].vtx = triangles[i].vertices;
-                build_triangles[i].centroid = (
-                    triangles[i].vertices[0].position +
-                    triangles[i].vertices[1].position +
-                    triangles[i].vertices[2].position) / real(3);
-                surface_area_ += triangle_area(
-                    triangles[i].vertices[1].position - triangles[i].vertices[0].position,
-                    triangles[i].vertices[2].position - triangles[i].vertices[0].position);
-                local_bound_ |= triangles[i].vertices[0].position;
-                local_bound_ |= triangles[i].vertices[1].position;
-                local_bound_ |= triangles[i].vertices[2].position;
+                AGZ_INFO("corrupted triangle bvh cache: {}", filename);
+                return false;
             }
 
-            Arena arena;
-            auto [root, node_count] = build_bvh(
-                build_triangles.data(), triangle_count, 5, TRAVERSAL_STACK_SIZE / 2, arena);
+            const int worker_count = thread::actual_worker_count(
+                build_worker_count);
 
-            nodes_.resize(node_count);
-            prims_.resize(triangle_count);
-            prim_info_.resize(triangle_count);
+            nodes_ = cached_nodes;
+            node_count_ = header.node_count;
+            owned_nodes_.clear();
 
-            compact_bvh(
-                root, build_triangles.data(),
-                nodes_.data(), prims_.data(), prim_info_.data());
+            const AABB bound(
+                { header.bound_low[0],  header.bound_low[1],  header.bound_low[2]  },
+                { header.bound_high[0], header.bound_high[1], header.bound_high[2] });
 
-            std::vector<real> area_arr(triangle_count);
-            for(uint32_t i = 0; i < triangle_count; ++i)
-                area_arr[i] = triangle_area(prims_[i].b_a_, prims_[i].c_a_);
+            prims_.initialize_mapped(
+                file,
+                reinterpret_cast<const Primitive*>(data + header.prim_offset),
+                reinterpret_cast<const PrimitiveInfo*>(data + header.prim_info_offset),
+                header.prim_count, header.surface_area, bound,
+                worker_count);
 
-            prim_sampler_.initialize(
-                area_arr.data(), static_cast<int>(triangle_count));
+            memory_usage_.node_bytes          = node_count_ * sizeof(Node);
+            memory_usage_.primitive_bytes     = prims_.memory_bytes();
+            memory_usage_.binary_layout_bytes = memory_usage_.total_bytes();
+            memory_usage_.peak_build_bytes    = memory_usage_.total_bytes();
+
+            return true;
+        }
+
+        /**
+         * @brief write nodes and primitives to a cache file
+         *
+         * the file is written to a temporary path unique to this writer and
+         * then renamed, so that concurrent renders never see a partial cache
+         */
+        void save_cache(const std::string &filename) const
+        {
+            TriangleBVHCacheHeader header = {};
+            std::memcpy(header.magic, TRIANGLE_BVH_CACHE_MAGIC, sizeof(header.magic));
+            header.version        = TRIANGLE_BVH_CACHE_VERSION;
+            header.node_size      = sizeof(Node);
+            header.prim_size      = sizeof(Primitive);
+            header.prim_info_size = sizeof(PrimitiveInfo);
+            header.node_count     = node_count_;
+            header.prim_count     = prims_.prim_count();
+            header.surface_area   = prims_.surface_area();
+
+            for(int i = 0; i < 3; ++i)
+            {
+                header.bound_low[i]  = prims_.local_bound().low[i];
+                header.bound_high[i] = prims_.local_bound().high[i];
+            }
+
+            const uint64_t node_bytes =
+                uint64_t(node_count_) * sizeof(Node);
+            const uint64_t prim_bytes =
+                uint64_t(header.prim_count) * sizeof(Primitive);
+            const uint64_t prim_info_bytes =
+                uint64_t(header.prim_count) * sizeof(PrimitiveInfo);
+
+            header.node_offset      = align_cache_section(sizeof(header));
+            header.prim_offset      = align_cache_section(
+                header.node_offset + node_bytes);
+            header.prim_info_offset = align_cache_section(
+                header.prim_offset + prim_bytes);
+
+            const std::filesystem::path path(filename);
+            if(path.has_parent_path())
+                std::filesystem::create_directories(path.parent_path());
+
+            // random suffix and thread id avoid collisions between threads
+            // and processes writing the same cache
+            std::random_device rd;
+            char suffix[64];
+            std::snprintf(
+                suffix, sizeof(suffix), ".%016zx.%08x%08x.tmp",
+                std::hash<std::thread::id>()(std::this_thread::get_id()),
+                static_cast<unsigned>(rd()), static_cast<unsigned>(rd()));
+            const std::string tmp_filename = filename + suffix;
+
+            try
+            {
+                std::ofstream fout(
+                    tmp_filename, std::ios::binary | std::ios::trunc);
+                if(!fout)
+                {
+                    throw ObjectConstructionException(
+                        "failed to open file: " + tmp_filename);
+                }
+
+                auto write_section = [&](
+                    uint64_t offset, const void *section_data, uint64_t bytes)
+                {
+                    static const char zeros[TRIANGLE_BVH_CACHE_ALIGNMENT] = {};
+                    const auto pos = static_cast<uint64_t>(fout.tellp());
+                    fout.write(zeros, static_cast<std::streamsize>(offset - pos));
+                    fout.write(static_cast<const char*>(section_data),
+                               static_cast<std::streamsize>(bytes));
+                };
+
+                write_section(0, &header, sizeof(header));
+                write_section(header.node_offset, nodes_, node_bytes);
+                write_section(
+                    header.prim_offset, prims_.prims_data(), prim_bytes);
+                write_section(
+                    header.prim_info_offset, prims_.prim_info_data(),
+                    prim_info_bytes);
+
+                fout.close();
+                if(!fout)
+                {
+                    throw ObjectConstructionException(
+                        "failed to write file: " + tmp_filename);
+                }
+
+                std::filesystem::rename(tmp_filename, filename);
+            }
+            catch(...)
+            {
+                std::error_code err;
+                std::filesystem::remove(tmp_filename, err);
+                throw;
+            }
         }
 
         bool has_intersection(const Ray &r) const noexcept
@@ -375,12 +466,14 @@ namespace
             {
                 const uint32_t task_node_idx = traversal_stack[--top];
                 const Node &node = nodes_[task_node_idx];
+                AGZ_STATS_ADD(TriangleBVHNode, 1);
 
                 if(node.is_leaf())
                 {
                     for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
                     {
-                        const Primitive &prim = prims_[i];
+                        const Primitive &prim = prims_.prim(i);
+                        AGZ_STATS_ADD(TriangleBVHTriangle, 1);
                         if(has_intersection_with_triangle(r, prim.a_, prim.b_a_, prim.c_a_))
                             return true;
                     }
@@ -420,12 +513,14 @@ namespace
             {
                 const uint32_t task_node_idx = traversal_stack[--top];
                 const Node &node = nodes_[task_node_idx];
+                AGZ_STATS_ADD(TriangleBVHNode, 1);
 
                 if(node.is_leaf())
                 {
                     for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
                     {
-                        const Primitive &prim = prims_[i];
+                        const Primitive &prim = prims_.prim(i);
+                        AGZ_STATS_ADD(TriangleBVHTriangle, 1);
                         if(closest_intersection_with_triangle(
                             r, prim.a_, prim.b_a_, prim.c_a_, &tmp_rcd))
                         {
@@ -469,69 +564,256 @@ namespace
             if(std::isinf(rcd.t_ray))
                 return false;
 
-            const PrimitiveInfo &prim_info = prim_info_[final_prim_idx];
+            prims_.fill_intersection(final_prim_idx, r, rcd, inct);
+            return true;
+        }
 
-            inct->pos            = r.at(rcd.t_ray);
-            inct->geometry_coord = FCoord(prim_info.x_, cross(
-                prim_info.z_, prim_info.x_), prim_info.z_);
-            inct->uv             = prim_info.t_a_ + rcd.uv.x * prim_info.t_b_a_
-                                                  + rcd.uv.y * prim_info.t_c_a_;
-            inct->t              = rcd.t_ray;
+        // packet traversal. rays sharing a node are tested against its bound
+        // together, and the node is fetched once for all of them
 
-            const FVec3 user_z = prim_info.n_a_ + rcd.uv.x * FVec3(prim_info.n_b_a_)
-                                               + rcd.uv.y * FVec3(prim_info.n_c_a_);
-            inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
+        void has_intersection_packet(
+            const Ray *rays, int count, bool *results) const noexcept
+        {
+            RayPacket packet;
+            packet.load(rays, count);
 
-            inct->wr = -r.d;
+            for(int i = 0; i < count; ++i)
+                results[i] = false;
+            RayPacket::Mask active = packet.full_mask();
 
-            return true;
+            PacketStackEntry stack[TRAVERSAL_STACK_SIZE];
+            int top = 0;
+            stack[top++] = { 0, active };
+
+            while(top && active)
+            {
+                const PacketStackEntry entry = stack[--top];
+                const Node &node = nodes_[entry.node];
+                AGZ_STATS_ADD(TriangleBVHNode, std::popcount(entry.mask & active));
+
+                const RayPacket::Mask mask = packet.intersect(
+                    node.low, node.high, entry.mask & active);
+                if(!mask)
+                    continue;
+
+                if(!node.is_leaf())
+                {
+                    push_children_of(packet, entry.node, mask, stack, top);
+                    continue;
+                }
+
+                RayPacket::for_each(mask, [&](int ray_idx)
+                {
+                    for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                    {
+                        const Primitive &prim = prims_.prim(i);
+                        AGZ_STATS_ADD(TriangleBVHTriangle, 1);
+                        if(has_intersection_with_triangle(
+                            rays[ray_idx], prim.a_, prim.b_a_, prim.c_a_))
+                        {
+                            results[ray_idx] = true;
+                            active &= ~(RayPacket::Mask(1) << ray_idx);
+                            break;
+                        }
+                    }
+                });
+            }
+        }
+
+        void closest_intersection_packet(
+            const Ray *rays, int count,
+            GeometryIntersection *incts, bool *results) const noexcept
+        {
+            RayPacket packet;
+            packet.load(rays, count);
+
+            TriangleIntersectionRecord rcds[RayPacket::MAX_SIZE];
+            uint32_t prim_indices[RayPacket::MAX_SIZE];
+            for(int i = 0; i < count; ++i)
+                results[i] = false;
+
+            PacketStackEntry stack[TRAVERSAL_STACK_SIZE];
+            int top = 0;
+            stack[top++] = { 0, packet.full_mask() };
+
+            while(top)
+            {
+                const PacketStackEntry entry = stack[--top];
+                const Node &node = nodes_[entry.node];
+                AGZ_STATS_ADD(TriangleBVHNode, std::popcount(entry.mask));
+
+                const RayPacket::Mask mask = packet.intersect(
+                    node.low, node.high, entry.mask);
+                if(!mask)
+                    continue;
+
+                if(!node.is_leaf())
+                {
+                    push_children_of(packet, entry.node, mask, stack, top);
+                    continue;
+                }
+
+                RayPacket::for_each(mask, [&](int ray_idx)
+                {
+                    Ray r = rays[ray_idx];
+                    r.t_max = packet.t_max[ray_idx];
+
+                    TriangleIntersectionRecord tmp_rcd;
+                    for(uint32_t i = node.start; i < node.end_or_right_offset; ++i)
+                    {
+                        const Primitive &prim = prims_.prim(i);
+                        AGZ_STATS_ADD(TriangleBVHTriangle, 1);
+                        if(closest_intersection_with_triangle(
+                            r, prim.a_, prim.b_a_, prim.c_a_, &tmp_rcd))
+                        {
+                            r.t_max = tmp_rcd.t_ray;
+                            rcds[ray_idx] = tmp_rcd;
+                            prim_indices[ray_idx] = i;
+                            results[ray_idx] = true;
+                        }
+                    }
+
+                    packet.t_max[ray_idx] = r.t_max;
+                });
+            }
+
+            for(int i = 0; i < count; ++i)
+            {
+                if(results[i])
+                    prims_.fill_intersection(prim_indices[i], rays[i], rcds[i], &incts[i]);
+            }
         }
 
         real surface_area() const noexcept
         {
-            return surface_area_;
+            return prims_.surface_area();
+        }
+
+        const AABB &local_bound() const noexcept
+        {
+            return prims_.local_bound();
         }
 
         SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept
         {
-            const int prim_idx = prim_sampler_.sample(sam.u);
-            assert(0 <= prim_idx && static_cast<size_t>(prim_idx) < prims_.size());
-            const Primitive &prim = prims_[prim_idx];
-            const PrimitiveInfo &prim_info = prim_info_[prim_idx];
+            return prims_.sample(pdf, sam);
+        }
+
+        const MemoryUsage &memory_usage() const noexcept
+        {
+            return memory_usage_;
+        }
+
+    private:
+
+        struct PacketStackEntry
+        {
+            uint32_t node;
+            RayPacket::Mask mask;
+        };
 
-            const Vec2 uv = math::distribution::uniform_on_triangle(sam.v, sam.w);
+        // the child whose center is nearer along the packet direction is
+        // pushed last, so that it is visited first
+        void push_children_of(
+            const RayPacket &packet, uint32_t node_idx, RayPacket::Mask mask,
+            PacketStackEntry *stack, int &top) const noexcept
+        {
+            const uint32_t left_idx  = node_idx + 1;
+            const uint32_t right_idx = nodes_[node_idx].end_or_right_offset;
 
-            SurfacePoint spt;
-            spt.pos            = prim.a_ + uv.x * prim.b_a_ + uv.y * prim.c_a_;
-            spt.geometry_coord = FCoord(
-                prim_info.x_, cross(prim_info.z_, prim_info.x_), prim_info.z_);
-            spt.uv             = prim_info.t_a_ + uv.x * prim_info.t_b_a_
-                                                + uv.y * prim_info.t_c_a_;
+            const Node &left = nodes_[left_idx], &right = nodes_[right_idx];
+            real proj = 0;
+            for(int k = 0; k < 3; ++k)
+            {
+                proj += packet.dir_sum[k] *
+                    ((left.low[k] + left.high[k]) - (right.low[k] + right.high[k]));
+            }
 
-            const FVec3 user_z = prim_info.n_a_ + uv.x * FVec3(prim_info.n_b_a_)
-                                               + uv.y * FVec3(prim_info.n_c_a_);
-            spt.user_coord = spt.geometry_coord.rotate_to_new_z(user_z);
+            assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+            if(proj < 0)
+            {
+                stack[top++] = { right_idx, mask };
+                stack[top++] = { left_idx,  mask };
+            }
+            else
+            {
+                stack[top++] = { left_idx,  mask };
+                stack[top++] = { right_idx, mask };
+            }
+        }
+    };
 
-            *pdf = 1 / surface_area_;
+    static_assert(sizeof(Node) == BINARY_NODE_SIZE);
 
-            return spt;
+    void check_params(const TriangleBVHNoEmbreeParams &params)
+    {
+        if(params.max_leaf_size < 1)
+            throw ObjectConstructionException("invalid max_leaf_size value");
+        if(params.use_sah && params.sah_bin_count < 2)
+            throw ObjectConstructionException("invalid sah_bin_count value");
+    }
+
+    void log_memory_usage(const MemoryUsage &mem)
+    {
+        AGZ_INFO(
+            "triangle bvh memory: nodes {:.2f} MB, primitives {:.2f} MB, "
+            "total {:.2f} MB ({:.1f}% of binary layout), "
+            "peak while building {:.2f} MB, uvs: {}",
+            mem.node_bytes / BYTES_PER_MB,
+            mem.primitive_bytes / BYTES_PER_MB,
+            mem.total_bytes() / BYTES_PER_MB,
+            100.0 * mem.total_bytes() / mem.binary_layout_bytes,
+            mem.peak_build_bytes / BYTES_PER_MB,
+            mem.uv_precision);
+    }
+
+    AABB non_degenerate(AABB bound) noexcept
+    {
+        for(int i = 0; i != 3; ++i)
+        {
+            if(bound.low[i] >= bound.high[i])
+                bound.low[i] = bound.high[i] - real(0.1) * std::abs(bound.high[i]);
         }
+        return bound;
+    }
 
-        const std::vector<Primitive> &get_prims() const noexcept
+    // load a binary bvh from cache file, or build it and write the cache
+    template<typename Build>
+    void load_or_build_cached(
+        UntransformedTriangleBVH &bvh, const std::string &cache_filename,
+        const TriangleBVHNoEmbreeParams &params, const Build &build)
+    {
+        if(bvh.initialize_from_cache(cache_filename, params.build_worker_count))
         {
-            return prims_;
+            AGZ_INFO("load triangle bvh from cache: {}", cache_filename);
+            return;
         }
-    };
+
+        build();
+
+        try
+        {
+            bvh.save_cache(cache_filename);
+            AGZ_INFO("save triangle bvh cache: {}", cache_filename);
+        }
+        catch(const std::exception &err)
+        {
+            // a failed cache write should never fail the render
+            AGZ_INFO("failed to save triangle bvh cache: {}", err.what());
+        }
+    }
 
 } // namespace anonymous
 
+template<typename Untransformed>
 class TriangleBVH : public Geometry
 {
-    Box<const UntransformedTriangleBVH> untransformed_;
+    Box<const Untransformed> untransformed_;
     AABB world_bound_;
 
-    static Box<const UntransformedTriangleBVH> load(
-        std::vector<mesh::triangle_t> build_triangles, const FTransform3 &local_to_world)
+    static void transform_triangles(
+        std::vector<mesh::triangle_t> &build_triangles,
+        const FTransform3 &local_to_world)
     {
         for(auto &tri : build_triangles)
         {
@@ -548,39 +830,132 @@ class TriangleBVH : public Geometry
             tri.vertices[2].normal   = local_to_world.apply_to_vector(
                 tri.vertices[2].normal);
         }
+    }
 
-        auto ret = newBox<UntransformedTriangleBVH>();
+    static Box<const Untransformed> load(
+        std::vector<mesh::triangle_t> build_triangles,
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
+    {
+        transform_triangles(build_triangles, local_to_world);
+
+        auto ret = newBox<Untransformed>();
         ret->initialize(
-            build_triangles.data(),
-            static_cast<uint32_t>(build_triangles.size()));
+            BuildingMesh(
+                build_triangles.data(),
+                static_cast<uint32_t>(build_triangles.size())),
+            params);
 
         return ret;
     }
 
+    // positions are copied and transformed. normals are transformed when
+    // they are fetched by the builder
+    static Box<const Untransformed> load(
+        const IndexedTriangleMeshView &mesh,
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
+    {
+        std::vector<float> positions(3 * size_t(mesh.vertex_count));
+        for(size_t i = 0; i < mesh.vertex_count; ++i)
+        {
+            const float *p = mesh.positions + 3 * i;
+            const FVec3 world = local_to_world.apply_to_point({ p[0], p[1], p[2] });
+            positions[3 * i + 0] = world.x;
+            positions[3 * i + 1] = world.y;
+            positions[3 * i + 2] = world.z;
+        }
+
+        IndexedTriangleMeshView world_mesh = mesh;
+        world_mesh.positions     = positions.data();
+        world_mesh.vertex_attrib = [&](uint32_t idx, FVec3 *normal, Vec2 *uv)
+        {
+            mesh.vertex_attrib(idx, normal, uv);
+            *normal = local_to_world.apply_to_vector(*normal);
+        };
+
+        auto ret = newBox<Untransformed>();
+        ret->initialize(BuildingMesh(world_mesh), params);
+
+        return ret;
+    }
+
+    // cached data contains triangles transformed by local_to_world
+    static Box<const Untransformed> load_cached(
+        const std::string &cache_filename,
+        const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
+    {
+        auto ret = newBox<Untransformed>();
+        load_or_build_cached(*ret, cache_filename, params, [&]
+        {
+            auto build_triangles = load_triangles();
+            transform_triangles(build_triangles, local_to_world);
+            ret->initialize(
+                BuildingMesh(
+                    build_triangles.data(),
+                    static_cast<uint32_t>(build_triangles.size())),
+                params);
+        });
+        return ret;
+    }
+
+    void init_from_untransformed()
+    {
+        world_bound_ = non_degenerate(untransformed_->local_bound());
+        log_memory_usage(untransformed_->memory_usage());
+    }
+
 public:
 
     TriangleBVH(
         std::vector<mesh::triangle_t> build_triangles,
-        const FTransform3 &local_to_world)
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
     {
         AGZ_HIERARCHY_TRY
 
-        untransformed_ = load(std::move(build_triangles), local_to_world);
+        check_params(params);
 
-        world_bound_ = AABB();
-        for(auto &prim : untransformed_->get_prims())
-        {
-            world_bound_ |= prim.a_;
-            world_bound_ |= prim.a_ + prim.b_a_;
-            world_bound_ |= prim.a_ + prim.c_a_;
-        }
+        untransformed_ = load(
+            std::move(build_triangles), local_to_world, params);
 
-        for(int i = 0; i != 3; ++i)
-        {
-            if(world_bound_.low[i] >= world_bound_.high[i])
-                world_bound_.low[i] = world_bound_.high[i] -
-                                      real(0.1) * std::abs(world_bound_.high[i]);
-        }
+        init_from_untransformed();
+
+        AGZ_HIERARCHY_WRAP("in initializing triangle_bvh geometry object")
+    }
+
+    TriangleBVH(
+        const IndexedTriangleMeshView &mesh,
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
+    {
+        AGZ_HIERARCHY_TRY
+
+        check_params(params);
+
+        untransformed_ = load(mesh, local_to_world, params);
+
+        init_from_untransformed();
+
+        AGZ_HIERARCHY_WRAP("in initializing triangle_bvh geometry object")
+    }
+
+    TriangleBVH(
+        const std::string &cache_filename,
+        const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+        const FTransform3 &local_to_world,
+        const TriangleBVHNoEmbreeParams &params)
+    {
+        AGZ_HIERARCHY_TRY
+
+        check_params(params);
+
+        untransformed_ = load_cached(
+            cache_filename, load_triangles, local_to_world, params);
+
+        init_from_untransformed();
 
         AGZ_HIERARCHY_WRAP("in initializing triangle_bvh geometry object")
     }
@@ -596,6 +971,42 @@ public:
         return untransformed_->closest_intersection(r, inct);
     }
 
+    void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept override
+    {
+        if constexpr(std::is_same_v<Untransformed, UntransformedTriangleBVH>)
+        {
+            for(size_t beg = 0; beg < rays.size(); beg += RayPacket::MAX_SIZE)
+            {
+                const size_t count = (std::min)(
+                    rays.size() - beg, size_t(RayPacket::MAX_SIZE));
+                untransformed_->has_intersection_packet(
+                    &rays[beg], static_cast<int>(count), results + beg);
+            }
+        }
+        else
+            Geometry::has_intersection_n(rays, results);
+    }
+
+    void closest_intersection_n(
+        misc::span<const Ray> rays,
+        GeometryIntersection *incts, bool *results) const noexcept override
+    {
+        if constexpr(std::is_same_v<Untransformed, UntransformedTriangleBVH>)
+        {
+            for(size_t beg = 0; beg < rays.size(); beg += RayPacket::MAX_SIZE)
+            {
+                const size_t count = (std::min)(
+                    rays.size() - beg, size_t(RayPacket::MAX_SIZE));
+                untransformed_->closest_intersection_packet(
+                    &rays[beg], static_cast<int>(count),
+                    incts + beg, results + beg);
+            }
+        }
+        else
+            Geometry::closest_intersection_n(rays, incts, results);
+    }
+
     AABB world_bound() const noexcept override
     {
         return world_bound_;
@@ -628,11 +1039,329 @@ public:
     }
 };
 
+class TriangleBVHMesh : public misc::uncopyable_t
+{
+public:
+
+    virtual ~TriangleBVHMesh() = default;
+
+    virtual bool has_intersection(const Ray &r) const noexcept = 0;
+
+    virtual bool closest_intersection(
+        const Ray &r, GeometryIntersection *inct) const noexcept = 0;
+
+    virtual real surface_area() const noexcept = 0;
+
+    virtual const AABB &local_bound() const noexcept = 0;
+
+    virtual SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept = 0;
+};
+
+namespace
+{
+
+    template<typename Untransformed>
+    class TriangleBVHMeshImpl : public TriangleBVHMesh
+    {
+        Untransformed untransformed_;
+
+    public:
+
+        TriangleBVHMeshImpl(
+            const std::vector<mesh::triangle_t> &build_triangles,
+            const TriangleBVHNoEmbreeParams &params)
+        {
+            untransformed_.initialize(
+                BuildingMesh(
+                    build_triangles.data(),
+                    static_cast<uint32_t>(build_triangles.size())),
+                params);
+            log_memory_usage(untransformed_.memory_usage());
+        }
+
+        TriangleBVHMeshImpl(
+            const IndexedTriangleMeshView &mesh,
+            const TriangleBVHNoEmbreeParams &params)
+        {
+            untransformed_.initialize(BuildingMesh(mesh), params);
+            log_memory_usage(untransformed_.memory_usage());
+        }
+
+        TriangleBVHMeshImpl(
+            const std::string &cache_filename,
+            const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+            const TriangleBVHNoEmbreeParams &params)
+        {
+            load_or_build_cached(untransformed_, cache_filename, params, [&]
+            {
+                const auto build_triangles = load_triangles();
+                untransformed_.initialize(
+                    BuildingMesh(
+                        build_triangles.data(),
+                        static_cast<uint32_t>(build_triangles.size())),
+                    params);
+            });
+            log_memory_usage(untransformed_.memory_usage());
+        }
+
+        bool has_intersection(const Ray &r) const noexcept override
+        {
+            return untransformed_.has_intersection(r);
+        }
+
+        bool closest_intersection(
+            const Ray &r, GeometryIntersection *inct) const noexcept override
+        {
+            return untransformed_.closest_intersection(r, inct);
+        }
+
+        real surface_area() const noexcept override
+        {
+            return untransformed_.surface_area();
+        }
+
+        const AABB &local_bound() const noexcept override
+        {
+            return untransformed_.local_bound();
+        }
+
+        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept override
+        {
+            return untransformed_.sample(pdf, sam);
+        }
+    };
+
+    // instance of a shared local triangle bvh
+    class TriangleBVHInstance : public TransformedGeometry
+    {
+        RC<const TriangleBVHMesh> mesh_;
+        AABB world_bound_;
+
+    public:
+
+        TriangleBVHInstance(
+            RC<const TriangleBVHMesh> mesh, const FTransform3 &local_to_world)
+            : mesh_(std::move(mesh))
+        {
+            init_transform(local_to_world);
+            world_bound_ = non_degenerate(to_world(mesh_->local_bound()));
+        }
+
+        bool has_intersection(const Ray &r) const noexcept override
+        {
+            return mesh_->has_intersection(to_local(r));
+        }
+
+        bool closest_intersection(
+            const Ray &r, GeometryIntersection *inct) const noexcept override
+        {
+            if(!mesh_->closest_intersection(to_local(r), inct))
+                return false;
+            to_world(inct);
+            inct->wr = -r.d;
+            return true;
+        }
+
+        AABB world_bound() const noexcept override
+        {
+            return world_bound_;
+        }
+
+        real surface_area() const noexcept override
+        {
+            return mesh_->surface_area()
+                 * local_to_world_ratio_ * local_to_world_ratio_;
+        }
+
+        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept override
+        {
+            SurfacePoint spt = mesh_->sample(pdf, sam);
+            to_world(&spt);
+            *pdf /= local_to_world_ratio_ * local_to_world_ratio_;
+            return spt;
+        }
+
+        SurfacePoint sample(
+            const FVec3 &, real *pdf, const Sample3 &sam) const noexcept override
+        {
+            return sample(pdf, sam);
+        }
+
+        real pdf(const FVec3 &) const noexcept override
+        {
+            return 1 / surface_area();
+        }
+
+        real pdf(const FVec3 &, const FVec3 &sample) const noexcept override
+        {
+            return pdf(sample);
+        }
+    };
+
+} // namespace anonymous
+
+RC<const TriangleBVHMesh> create_triangle_bvh_mesh(
+    const std::vector<mesh::triangle_t> &build_triangles,
+    const TriangleBVHNoEmbreeParams &params)
+{
+    AGZ_HIERARCHY_TRY
+
+    check_params(params);
+
+    using Layout = TriangleBVHNoEmbreeParams::Layout;
+
+    if(params.layout == Layout::Wide4)
+    {
+        return newRC<TriangleBVHMeshImpl<UntransformedWideTriangleBVH>>(
+            build_triangles, params);
+    }
+
+    if(params.layout == Layout::Compact)
+    {
+        return newRC<TriangleBVHMeshImpl<UntransformedCompactTriangleBVH>>(
+            build_triangles, params);
+    }
+
+    return newRC<TriangleBVHMeshImpl<UntransformedTriangleBVH>>(
+        build_triangles, params);
+
+    AGZ_HIERARCHY_WRAP("in initializing shared triangle bvh mesh")
+}
+
+RC<const TriangleBVHMesh> create_triangle_bvh_mesh(
+    const IndexedTriangleMeshView &mesh,
+    const TriangleBVHNoEmbreeParams &params)
+{
+    AGZ_HIERARCHY_TRY
+
+    check_params(params);
+
+    using Layout = TriangleBVHNoEmbreeParams::Layout;
+
+    if(params.layout == Layout::Wide4)
+    {
+        return newRC<TriangleBVHMeshImpl<UntransformedWideTriangleBVH>>(
+            mesh, params);
+    }
+
+    if(params.layout == Layout::Compact)
+    {
+        return newRC<TriangleBVHMeshImpl<UntransformedCompactTriangleBVH>>(
+            mesh, params);
+    }
+
+    return newRC<TriangleBVHMeshImpl<UntransformedTriangleBVH>>(mesh, params);
+
+    AGZ_HIERARCHY_WRAP("in initializing shared triangle bvh mesh")
+}
+
+RC<const TriangleBVHMesh> create_cached_triangle_bvh_mesh(
+    const std::string &cache_filename,
+    const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+    const TriangleBVHNoEmbreeParams &params)
+{
+    AGZ_HIERARCHY_TRY
+
+    check_params(params);
+
+    if(params.layout != TriangleBVHNoEmbreeParams::Layout::Binary)
+        return create_triangle_bvh_mesh(load_triangles(), params);
+
+    return newRC<TriangleBVHMeshImpl<UntransformedTriangleBVH>>(
+        cache_filename, load_triangles, params);
+
+    AGZ_HIERARCHY_WRAP("in initializing shared triangle bvh mesh")
+}
+
+bool is_similarity_transform(const FTransform3 &transform) noexcept
+{
+    // images of the axes must be orthogonal and have the same length
+    const FVec3 x = transform.apply_to_vector({ 1, 0, 0 });
+    const FVec3 y = transform.apply_to_vector({ 0, 1, 0 });
+    const FVec3 z = transform.apply_to_vector({ 0, 0, 1 });
+
+    const real xx = x.length_square(), yy = y.length_square(), zz = z.length_square();
+    const real max_len2 = (std::max)({ xx, yy, zz });
+    if(!(max_len2 > 0))
+        return false;
+
+    const real tol = real(1e-4) * max_len2;
+    return std::abs(xx - yy) <= tol && std::abs(xx - zz) <= tol &&
+           std::abs(dot(x, y)) <= tol && std::abs(dot(y, z)) <= tol &&
+           std::abs(dot(z, x)) <= tol;
+}
+
+RC<Geometry> create_triangle_bvh_instance(
+    RC<const TriangleBVHMesh> mesh, const FTransform3 &local_to_world)
+{
+    if(!is_similarity_transform(local_to_world))
+    {
+        throw ObjectConstructionException(
+            "transform of triangle bvh instance must be a similarity transform");
+    }
+    return newRC<TriangleBVHInstance>(std::move(mesh), local_to_world);
+}
+
 RC<Geometry> create_triangle_bvh_noembree(
     std::vector<mesh::triangle_t> build_triangles,
-    const FTransform3 &local_to_world)
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params)
+{
+    using Layout = TriangleBVHNoEmbreeParams::Layout;
+
+    if(params.layout == Layout::Wide4)
+    {
+        return newRC<TriangleBVH<UntransformedWideTriangleBVH>>(
+            std::move(build_triangles), local_to_world, params);
+    }
+
+    if(params.layout == Layout::Compact)
+    {
+        return newRC<TriangleBVH<UntransformedCompactTriangleBVH>>(
+            std::move(build_triangles), local_to_world, params);
+    }
+
+    return newRC<TriangleBVH<UntransformedTriangleBVH>>(
+        std::move(build_triangles), local_to_world, params);
+}
+
+RC<Geometry> create_triangle_bvh_noembree(
+    const IndexedTriangleMeshView &mesh,
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params)
 {
-    return newRC<TriangleBVH>(std::move(build_triangles), local_to_world);
+    using Layout = TriangleBVHNoEmbreeParams::Layout;
+
+    if(params.layout == Layout::Wide4)
+    {
+        return newRC<TriangleBVH<UntransformedWideTriangleBVH>>(
+            mesh, local_to_world, params);
+    }
+
+    if(params.layout == Layout::Compact)
+    {
+        return newRC<TriangleBVH<UntransformedCompactTriangleBVH>>(
+            mesh, local_to_world, params);
+    }
+
+    return newRC<TriangleBVH<UntransformedTriangleBVH>>(
+        mesh, local_to_world, params);
+}
+
+RC<Geometry> create_cached_triangle_bvh_noembree(
+    const std::string &cache_filename,
+    const std::function<std::vector<mesh::triangle_t>()> &load_triangles,
+    const FTransform3 &local_to_world,
+    const TriangleBVHNoEmbreeParams &params)
+{
+    if(params.layout != TriangleBVHNoEmbreeParams::Layout::Binary)
+    {
+        return create_triangle_bvh_noembree(
+            load_triangles(), local_to_world, params);
+    }
+
+    return newRC<TriangleBVH<UntransformedTriangleBVH>>(
+        cache_filename, load_triangles, local_to_world, params);
 }
 
 #ifndef USE_EMBREE
@@ -0,0 +1,701 @@
+#include <algorithm>
+#include <atomic>
+#include <queue>
+
+#include <agz/tracer/utility/parallel_grid.h>
+
+#include "./triangle_bvh_builder.h"
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    struct BuildingResult
+    {
+        BuildingNode *root;
+        uint32_t node_count;
+    };
+
+    // result of binned sah split finding
+    // split_axis == -1 when no valid split is found
+    struct SAHSplit
+    {
+        int split_axis = -1;
+        int split_bin  = 0;
+        real split_cost = REAL_MAX;
+    };
+
+    class SAHSplitFinder
+    {
+        struct Bin
+        {
+            AABB bound;
+            uint32_t count = 0;
+        };
+
+        int bin_count_;
+        real leaf_cost_;
+        real traversal_cost_;
+
+        std::vector<Bin>  bins_;
+        std::vector<real> right_costs_;
+
+    public:
+
+        SAHSplitFinder(int bin_count, real leaf_cost, real traversal_cost)
+            : bin_count_(bin_count),
+              leaf_cost_(leaf_cost),
+              traversal_cost_(traversal_cost),
+              bins_(bin_count),
+              right_costs_(bin_count)
+        {
+            
+        }
+
+        int bin_index(
+            const AABB &centroid_bound, int axis, const Vec3 &centroid) const noexcept
+        {
+            const real low    = centroid_bound.low[axis];
+            const real extent = centroid_bound.high[axis] - low;
+            const int idx = static_cast<int>(
+                bin_count_ * (centroid[axis] - low) / extent);
+            return math::clamp(idx, 0, bin_count_ - 1);
+        }
+
+        real leaf_cost(uint32_t triangle_count) const noexcept
+        {
+            return leaf_cost_ * triangle_count;
+        }
+
+        SAHSplit find(
+            const BuildingMesh &mesh,
+            const BuildingTriangle *triangles, uint32_t start, uint32_t end,
+            const AABB &all_bound, const AABB &centroid_bound)
+        {
+            SAHSplit ret;
+
+            const real parent_area = surface_area_of(all_bound);
+            if(parent_area <= 0)
+                return ret;
+
+            real best_area_count = REAL_MAX;
+
+            for(int axis = 0; axis < 3; ++axis)
+            {
+                if(centroid_bound.high[axis] <= centroid_bound.low[axis])
+                    continue;
+
+                for(auto &bin : bins_)
+                    bin = Bin();
+
+                for(uint32_t i = start; i < end; ++i)
+                {
+                    const auto &tri = triangles[i];
+                    auto &bin = bins_[bin_index(centroid_bound, axis, tri.centroid)];
+                    bin.bound |= mesh.position(tri.prim, 0);
+                    bin.bound |= mesh.position(tri.prim, 1);
+                    bin.bound |= mesh.position(tri.prim, 2);
+                    ++bin.count;
+                }
+
+                // right_costs_[i]: area * count of bins [i, bin_count)
+
+                AABB acc_bound;
+                uint32_t acc_count = 0;
+                for(int i = bin_count_ - 1; i > 0; --i)
+                {
+                    acc_bound |= bins_[i].bound;
+                    acc_count += bins_[i].count;
+                    right_costs_[i] = acc_count ?
+                        surface_area_of(acc_bound) * acc_count : real(0);
+                }
+
+                acc_bound = AABB();
+                acc_count = 0;
+                for(int i = 0; i < bin_count_ - 1; ++i)
+                {
+                    acc_bound |= bins_[i].bound;
+                    acc_count += bins_[i].count;
+
+                    if(!acc_count || acc_count == end - start)
+                        continue;
+
+                    const real area_count = surface_area_of(acc_bound) * acc_count
+                                          + right_costs_[i + 1];
+                    if(area_count < best_area_count)
+                    {
+                        best_area_count = area_count;
+                        ret.split_axis  = axis;
+                        ret.split_bin   = i + 1;
+                    }
+                }
+            }
+
+            if(ret.split_axis >= 0)
+            {
+                ret.split_cost = traversal_cost_
+                               + leaf_cost_ * best_area_count / parent_area;
+            }
+
+            return ret;
+        }
+    };
+
+    // bounding boxes of a triangle range
+    struct RangeBound
+    {
+        AABB all_bound;
+        AABB centroid_bound;
+
+        RangeBound &operator|=(const RangeBound &rhs) noexcept
+        {
+            all_bound      |= rhs.all_bound;
+            centroid_bound |= rhs.centroid_bound;
+            return *this;
+        }
+    };
+
+    RangeBound compute_range_bound(
+        const BuildingMesh &mesh,
+        const BuildingTriangle *triangles, uint32_t start, uint32_t end) noexcept
+    {
+        RangeBound ret;
+        for(uint32_t i = start; i < end; ++i)
+        {
+            auto &tri = triangles[i];
+            ret.all_bound |= mesh.position(tri.prim, 0);
+            ret.all_bound |= mesh.position(tri.prim, 1);
+            ret.all_bound |= mesh.position(tri.prim, 2);
+            ret.centroid_bound |= tri.centroid;
+        }
+        return ret;
+    }
+
+    // triangle ranges smaller than this are never processed in parallel
+    constexpr uint32_t PARALLEL_GRID_SIZE = 1 << 14;
+
+    // build bvh with a serial top-level phase and parallel subtrees:
+    //
+    // 1. large nodes near the root are split one by one, with their bounds
+    //    computed by all workers
+    // 2. once a task is small enough, it is deferred as an independent
+    //    subtree task
+    // 3. subtree tasks are distributed among workers, each of which owns
+    //    its own arena and sah bins
+    //
+    // the resulted tree doesn't depend on worker count
+    class BVHBuilder : public misc::uncopyable_t
+    {
+        struct BuildingTask
+        {
+            BuildingNode **fillback_ptr;
+            uint32_t start, end;
+            uint32_t depth;
+        };
+
+        const BuildingMesh &mesh_;
+        BuildingTriangle *triangles_;
+        uint32_t depth_threshold_;
+        uint32_t leaf_size_threshold_;
+        const TriangleBVHNoEmbreeParams &params_;
+
+        int worker_count_;
+
+        std::vector<Box<Arena>>     arenas_;
+        std::vector<SAHSplitFinder> sah_finders_;
+
+        RangeBound compute_range_bound_parallel(uint32_t start, uint32_t end)
+        {
+            if(worker_count_ <= 1 || end - start <= 4 * PARALLEL_GRID_SIZE)
+                return compute_range_bound(mesh_, triangles_, start, end);
+
+            std::vector<RangeBound> perthread_bounds(worker_count_);
+            parallel_for_1d_grid(
+                worker_count_, static_cast<int>(end - start),
+                static_cast<int>(PARALLEL_GRID_SIZE),
+                [&](int thread_index, int beg, int lst)
+            {
+                perthread_bounds[thread_index] |= compute_range_bound(
+                    mesh_, triangles_, start + beg, start + lst);
+            });
+
+            RangeBound ret;
+            for(auto &b : perthread_bounds)
+                ret |= b;
+            return ret;
+        }
+
+        // create one node for given task
+        // returns true when an interior node is created and fills children
+        bool build_node(
+            const BuildingTask &task, const RangeBound &bound,
+            SAHSplitFinder &sah_finder, Arena &arena,
+            BuildingTask children[2])
+        {
+            assert(task.start < task.end);
+
+            const AABB &all_bound      = bound.all_bound;
+            const AABB &centroid_bound = bound.centroid_bound;
+
+            auto make_leaf = [&]
+            {
+                auto leaf = arena.create<BuildingNode>();
+                leaf->bounding = all_bound;
+                leaf->left     = nullptr;
+                leaf->right    = nullptr;
+                leaf->start    = task.start;
+                leaf->end      = task.end;
+
+                *task.fillback_ptr = leaf;
+                return false;
+            };
+
+            const uint32_t n = task.end - task.start;
+
+            // try binned sah split. leaf node is created when it's cheaper
+            // than the best split and the triangle count is sufficiently low
+
+            SAHSplit sah_split;
+            if(params_.use_sah && n > 1 && task.depth < depth_threshold_)
+            {
+                sah_split = sah_finder.find(
+                    mesh_, triangles_, task.start, task.end,
+                    all_bound, centroid_bound);
+
+                if(n <= leaf_size_threshold_ &&
+                   sah_finder.leaf_cost(n) <= sah_split.split_cost)
+                    return make_leaf();
+            }
+            else if(n <= leaf_size_threshold_)
+            {
+                // construct leaf node when triangle count is sufficiently low
+                return make_leaf();
+            }
+
+            // select the split axis with max extent
+            const FVec3 centroid_delta = centroid_bound.high - centroid_bound.low;
+            const int split_axis = centroid_delta[0] > centroid_delta[1] ?
+                (centroid_delta[0] > centroid_delta[2] ? 0 : 2) :
+                (centroid_delta[1] > centroid_delta[2] ? 1 : 2);
+
+            // when using sah, partition triangles with the selected bin.
+            // otherwise, divide the axis with centroid position when
+            // recursive depth is small, or divide with triangle count
+            uint32_t split_middle;
+            if(sah_split.split_axis >= 0)
+            {
+                const BuildingTriangle *middle = std::partition(
+                    triangles_ + task.start, triangles_ + task.end,
+                    [&](const BuildingTriangle &tri)
+                {
+                    return sah_finder.bin_index(
+                        centroid_bound, sah_split.split_axis, tri.centroid)
+                        < sah_split.split_bin;
+                });
+                split_middle = static_cast<uint32_t>(middle - triangles_);
+
+                if(split_middle == task.start || split_middle == task.end)
+                    split_middle = task.start + n / 2;
+            }
+            else if(!params_.use_sah && task.depth < depth_threshold_)
+            {
+                const real split_pos = real(0.5) * (
+                    centroid_bound.high[split_axis] + centroid_bound.low[split_axis]);
+                split_middle = task.start;
+                for(uint32_t i = task.start; i < task.end; ++i)
+                {
+                    if(triangles_[i].centroid[split_axis] < split_pos)
+                        std::swap(triangles_[i], triangles_[split_middle++]);
+                }
+
+                if(split_middle == task.start || split_middle == task.end)
+                    split_middle = task.start + n / 2;
+            }
+            else
+            {
+                split_middle = task.start + n / 2;
+                std::nth_element(
+                    triangles_ + task.start, triangles_ + split_middle,
+                    triangles_ + task.end,
+                    [axis = split_axis]
+                    (const BuildingTriangle &L, const BuildingTriangle &R)
+                {
+                    return L.centroid[axis] < R.centroid[axis];
+                });
+            }
+
+            auto interior = arena.create<BuildingNode>();
+            interior->bounding = all_bound;
+            interior->left     = nullptr;
+            interior->right    = nullptr;
+            interior->start    = 0;
+            interior->end      = 0;
+
+            *task.fillback_ptr = interior;
+
+            children[0] = { &interior->left,  task.start,   split_middle, task.depth + 1 };
+            children[1] = { &interior->right, split_middle, task.end,     task.depth + 1 };
+
+            return true;
+        }
+
+        // build the whole subtree of given task with one thread
+        // returns the number of created nodes
+        uint32_t build_subtree(
+            const BuildingTask &root_task,
+            SAHSplitFinder &sah_finder, Arena &arena)
+        {
+            uint32_t node_count = 0;
+
+            std::queue<BuildingTask> tasks;
+            tasks.push(root_task);
+
+            while(!tasks.empty())
+            {
+                const BuildingTask task = tasks.front();
+                tasks.pop();
+
+                const RangeBound bound = compute_range_bound(
+                    mesh_, triangles_, task.start, task.end);
+
+                ++node_count;
+
+                BuildingTask children[2];
+                if(build_node(task, bound, sah_finder, arena, children))
+                {
+                    tasks.push(children[0]);
+                    tasks.push(children[1]);
+                }
+            }
+
+            return node_count;
+        }
+
+    public:
+
+        BVHBuilder(
+            const BuildingMesh &mesh,
+            BuildingTriangle *triangles, uint32_t depth_threshold,
+            const TriangleBVHNoEmbreeParams &params,
+            int worker_count)
+            : mesh_(mesh),
+              triangles_(triangles),
+              depth_threshold_(depth_threshold),
+              leaf_size_threshold_(static_cast<uint32_t>(params.max_leaf_size)),
+              params_(params),
+              worker_count_((std::max)(worker_count, 1))
+        {
+            for(int i = 0; i < worker_count_; ++i)
+            {
+                arenas_.push_back(newBox<Arena>());
+                sah_finders_.emplace_back(
+                    params.sah_bin_count,
+                    params.sah_leaf_cost,
+                    params.sah_traversal_cost);
+            }
+        }
+
+        std::vector<Box<Arena>> release_arenas() noexcept
+        {
+            return std::move(arenas_);
+        }
+
+        BuildingResult build(uint32_t triangle_count)
+        {
+            BuildingResult ret = { nullptr, 0 };
+
+            if(worker_count_ <= 1)
+            {
+                ret.node_count = build_subtree(
+                    { &ret.root, 0, triangle_count, 0 },
+                    sah_finders_[0], *arenas_[0]);
+                return ret;
+            }
+
+            // top-level phase
+
+            const uint32_t subtree_threshold = (std::max)(
+                PARALLEL_GRID_SIZE,
+                triangle_count / (8 * static_cast<uint32_t>(worker_count_)));
+
+            std::vector<BuildingTask> subtree_tasks;
+
+            std::queue<BuildingTask> tasks;
+            tasks.push({ &ret.root, 0, triangle_count, 0 });
+
+            while(!tasks.empty())
+            {
+                const BuildingTask task = tasks.front();
+                tasks.pop();
+
+                if(task.end - task.start <= subtree_threshold)
+                {
+                    subtree_tasks.push_back(task);
+                    continue;
+                }
+
+                const RangeBound bound = compute_range_bound_parallel(
+                    task.start, task.end);
+
+                ++ret.node_count;
+
+                BuildingTask children[2];
+                if(build_node(task, bound, sah_finders_[0], *arenas_[0], children))
+                {
+                    tasks.push(children[0]);
+                    tasks.push(children[1]);
+                }
+            }
+
+            // subtree phase. larger subtrees are scheduled first
+
+            std::sort(subtree_tasks.begin(), subtree_tasks.end(),
+                [](const BuildingTask &L, const BuildingTask &R)
+            {
+                return L.end - L.start > R.end - R.start;
+            });
+
+            std::atomic<size_t> next_subtree = 0;
+            std::atomic<uint32_t> subtree_node_count = 0;
+
+            TaskScheduler::instance().run(worker_count_, [&](int thread_index)
+            {
+                uint32_t local_node_count = 0;
+                for(;;)
+                {
+                    const size_t task_idx = next_subtree++;
+                    if(task_idx >= subtree_tasks.size())
+                        break;
+                    local_node_count += build_subtree(
+                        subtree_tasks[task_idx],
+                        sah_finders_[thread_index], *arenas_[thread_index]);
+                }
+                subtree_node_count += local_node_count;
+            });
+
+            ret.node_count += subtree_node_count;
+            return ret;
+        }
+    };
+
+    void fill_primitive(
+        const BuildingMesh &mesh, const BuildingTriangle &tri,
+        Primitive &prim, PrimitiveInfo &prim_info)
+    {
+        const mesh::vertex_t vtx[3] = {
+            mesh.vertex(tri.prim, 0),
+            mesh.vertex(tri.prim, 1),
+            mesh.vertex(tri.prim, 2)
+        };
+
+        prim.a_   = vtx[0].position;
+        prim.b_a_ = vtx[1].position - vtx[0].position;
+        prim.c_a_ = vtx[2].position - vtx[0].position;
+
+        const FVec3 n_a = vtx[0].normal.normalize();
+        const FVec3 n_b = vtx[1].normal.normalize();
+        const FVec3 n_c = vtx[2].normal.normalize();
+
+        prim_info.n_a_   = n_a;
+        prim_info.n_b_a_ = n_b - n_a;
+        prim_info.n_c_a_ = n_c - n_a;
+
+        prim_info.t_a_   = vtx[0].tex_coord;
+        prim_info.t_b_a_ = vtx[1].tex_coord - vtx[0].tex_coord;
+        prim_info.t_c_a_ = vtx[2].tex_coord - vtx[0].tex_coord;
+
+        prim_info.z_ = cross(prim.b_a_, prim.c_a_).normalize();
+        const FVec3 mean_nor = n_a + n_b + n_c;
+        if(dot(mean_nor, prim_info.z_) < 0)
+            prim_info.z_ = -prim_info.z_;
+
+        prim_info.x_ = dpdu_as_ex(
+            prim.b_a_, prim.c_a_,
+            prim_info.t_b_a_, prim_info.t_c_a_, prim_info.z_);
+    }
+
+
+    Box<BuildingBVH> build_bvh(
+        const BuildingMesh &mesh,
+        uint32_t depth_threshold, const TriangleBVHNoEmbreeParams &params,
+        int worker_count)
+    {
+        const uint32_t triangle_count = mesh.triangle_count();
+        assert(triangle_count);
+
+        auto ret = newBox<BuildingBVH>();
+        ret->mesh = mesh;
+
+        // fill building triangles & compute local bound and area
+
+        ret->triangles.resize(triangle_count);
+        std::vector<real> perthread_area(worker_count, 0);
+        std::vector<AABB> perthread_bound(worker_count);
+
+        parallel_for_1d_grid(
+            worker_count, static_cast<int>(triangle_count),
+            static_cast<int>(PARALLEL_GRID_SIZE),
+            [&](int thread_index, int beg, int end)
+        {
+            real &area  = perthread_area[thread_index];
+            AABB &bound = perthread_bound[thread_index];
+
+            for(int i = beg; i < end; ++i)
+            {
+                const uint32_t prim = static_cast<uint32_t>(i);
+                const FVec3 a = mesh.position(prim, 0);
+                const FVec3 b = mesh.position(prim, 1);
+                const FVec3 c = mesh.position(prim, 2);
+                ret->triangles[i].prim     = prim;
+                ret->triangles[i].centroid = (a + b + c) / real(3);
+                area += triangle_area(b - a, c - a);
+                bound |= a;
+                bound |= b;
+                bound |= c;
+            }
+        });
+
+        for(int i = 0; i < worker_count; ++i)
+        {
+            ret->surface_area += perthread_area[i];
+            ret->bound        |= perthread_bound[i];
+        }
+
+        // build bvh
+
+        BVHBuilder builder(
+            ret->mesh, ret->triangles.data(), depth_threshold,
+            params, worker_count);
+        const auto [root, node_count] = builder.build(triangle_count);
+
+        ret->root       = root;
+        ret->node_count = node_count;
+        ret->arenas     = builder.release_arenas();
+
+        return ret;
+    }
+
+    void TrianglePrimitives::initialize(
+        const BuildingBVH &bvh, int worker_count)
+    {
+        const uint32_t triangle_count =
+            static_cast<uint32_t>(bvh.triangles.size());
+
+        surface_area_ = bvh.surface_area;
+        local_bound_  = bvh.bound;
+
+        prims_.resize(triangle_count);
+        prim_info_.resize(triangle_count);
+
+        std::vector<real> area_arr(triangle_count);
+
+        parallel_for_1d_grid(
+            worker_count, static_cast<int>(triangle_count),
+            static_cast<int>(PARALLEL_GRID_SIZE),
+            [&](int, int beg, int end)
+        {
+            for(int i = beg; i < end; ++i)
+            {
+                fill_primitive(
+                    bvh.mesh, bvh.triangles[i], prims_[i], prim_info_[i]);
+                area_arr[i] = triangle_area(prims_[i].b_a_, prims_[i].c_a_);
+            }
+        });
+
+        prim_sampler_.initialize(
+            area_arr.data(), static_cast<int>(triangle_count));
+
+        prims_data_     = prims_.data();
+        prim_info_data_ = prim_info_.data();
+        prim_count_     = triangle_count;
+    }
+
+    void TrianglePrimitives::initialize_mapped(
+        RC<const MappedFile> mapped_file,
+        const Primitive *prims, const PrimitiveInfo *prim_info,
+        uint32_t prim_count, real surface_area, const AABB &local_bound,
+        int worker_count)
+    {
+        mapped_file_ = std::move(mapped_file);
+
+        prims_.clear();
+        prim_info_.clear();
+
+        prims_data_     = prims;
+        prim_info_data_ = prim_info;
+        prim_count_     = prim_count;
+
+        surface_area_ = surface_area;
+        local_bound_  = local_bound;
+
+        std::vector<real> area_arr(prim_count);
+
+        parallel_for_1d_grid(
+            worker_count, static_cast<int>(prim_count),
+            static_cast<int>(PARALLEL_GRID_SIZE),
+            [&](int, int beg, int end)
+        {
+            for(int i = beg; i < end; ++i)
+                area_arr[i] = triangle_area(prims[i].b_a_, prims[i].c_a_);
+        });
+
+        prim_sampler_.initialize(
+            area_arr.data(), static_cast<int>(prim_count));
+    }
+
+    void TrianglePrimitives::fill_intersection(
+        uint32_t prim_idx, const Ray &r,
+        const TriangleIntersectionRecord &rcd,
+        GeometryIntersection *inct) const noexcept
+    {
+        const PrimitiveInfo &prim_info = prim_info_data_[prim_idx];
+
+        inct->pos            = r.at(rcd.t_ray);
+        inct->geometry_coord = FCoord(prim_info.x_, cross(
+            prim_info.z_, prim_info.x_), prim_info.z_);
+        inct->uv             = prim_info.t_a_ + rcd.uv.x * prim_info.t_b_a_
+                                              + rcd.uv.y * prim_info.t_c_a_;
+        inct->t              = rcd.t_ray;
+
+        const FVec3 user_z = prim_info.n_a_ + rcd.uv.x * FVec3(prim_info.n_b_a_)
+                                           + rcd.uv.y * FVec3(prim_info.n_c_a_);
+        inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
+
+        const Primitive &prim = prims_data_[prim_idx];
+        triangle_dpduv(
+            prim.b_a_, prim.c_a_, prim_info.t_b_a_, prim_info.t_c_a_,
+            &inct->dpdu, &inct->dpdv);
+
+        inct->wr = -r.d;
+    }
+
+    SurfacePoint TrianglePrimitives::sample(
+        real *pdf, const Sample3 &sam) const noexcept
+    {
+        const int prim_idx = prim_sampler_.sample(sam.u);
+        assert(0 <= prim_idx && static_cast<uint32_t>(prim_idx) < prim_count_);
+        const Primitive &prim = prims_data_[prim_idx];
+        const PrimitiveInfo &prim_info = prim_info_data_[prim_idx];
+
+        const Vec2 uv = math::distribution::uniform_on_triangle(sam.v, sam.w);
+
+        SurfacePoint spt;
+        spt.pos            = prim.a_ + uv.x * prim.b_a_ + uv.y * prim.c_a_;
+        spt.geometry_coord = FCoord(
+            prim_info.x_, cross(prim_info.z_, prim_info.x_), prim_info.z_);
+        spt.uv             = prim_info.t_a_ + uv.x * prim_info.t_b_a_
+                                            + uv.y * prim_info.t_c_a_;
+
+        const FVec3 user_z = prim_info.n_a_ + uv.x * FVec3(prim_info.n_b_a_)
+                                           + uv.y * FVec3(prim_info.n_c_a_);
+        spt.user_coord = spt.geometry_coord.rotate_to_new_z(user_z);
+
+        *pdf = 1 / surface_area_;
+
+        return spt;
+    }
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
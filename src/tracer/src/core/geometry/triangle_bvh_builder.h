@@ -0,0 +1,276 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <agz/tracer/core/intersection.h>
+#include <agz/tracer/create/geometry.h>
+#include <agz/tracer/utility/mapped_file.h>
+#include <agz/tracer/utility/triangle_aux.h>
+#include <agz-utils/mesh.h>
+#include <agz-utils/misc.h>
+#include <agz-utils/thread.h>
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    // stack size for traversal the bvh tree
+    constexpr int TRAVERSAL_STACK_SIZE = 128;
+
+    // triangle in bvh
+    struct Primitive
+    {
+        Vec3 a_, b_a_, c_a_;
+    };
+
+    // triangle info in bvh
+    struct PrimitiveInfo
+    {
+        Vec3 n_a_, n_b_a_, n_c_a_;
+        Vec2 t_a_, t_b_a_, t_c_a_;
+        Vec3 x_, z_;
+    };
+
+    inline real surface_area_of(const AABB &bound) noexcept
+    {
+        const FVec3 d = bound.high - bound.low;
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // linking node used in building bvh
+    // leaf node when left == nullptr. otherwise, internal node
+    struct BuildingNode
+    {
+        AABB bounding;
+        BuildingNode *left = nullptr, *right = nullptr;
+        uint32_t start = 0, end = 0;
+    };
+
+    // triangle used in building bvh
+    struct BuildingTriangle
+    {
+        uint32_t prim = 0; // index of the triangle in BuildingMesh
+        Vec3 centroid;
+    };
+
+    // input of build_bvh: either expanded triangles or an indexed mesh,
+    // which must outlive the building process
+    class BuildingMesh
+    {
+        const mesh::triangle_t        *triangles_ = nullptr;
+        const IndexedTriangleMeshView *indexed_   = nullptr;
+        uint32_t triangle_count_ = 0;
+
+    public:
+
+        BuildingMesh() = default;
+
+        BuildingMesh(
+            const mesh::triangle_t *triangles, uint32_t triangle_count) noexcept
+            : triangles_(triangles), triangle_count_(triangle_count)
+        {
+            
+        }
+
+        explicit BuildingMesh(const IndexedTriangleMeshView &indexed) noexcept
+            : indexed_(&indexed), triangle_count_(indexed.triangle_count)
+        {
+            
+        }
+
+        uint32_t triangle_count() const noexcept
+        {
+            return triangle_count_;
+        }
+
+        bool is_indexed() const noexcept
+        {
+            return indexed_ != nullptr;
+        }
+
+        uint32_t vertex_count() const noexcept
+        {
+            return indexed_ ? indexed_->vertex_count : 3 * triangle_count_;
+        }
+
+        // index of vertex k of triangle prim. only valid for indexed meshes
+        uint32_t vertex_index(uint32_t prim, int k) const noexcept
+        {
+            assert(indexed_);
+            return indexed_->indices[3 * size_t(prim) + k];
+        }
+
+        FVec3 position(uint32_t prim, int k) const noexcept
+        {
+            if(!indexed_)
+                return triangles_[prim].vertices[k].position;
+            const float *p =
+                indexed_->positions + 3 * size_t(vertex_index(prim, k));
+            return FVec3(p[0], p[1], p[2]);
+        }
+
+        mesh::vertex_t vertex(uint32_t prim, int k) const
+        {
+            if(!indexed_)
+                return triangles_[prim].vertices[k];
+
+            mesh::vertex_t ret;
+            ret.position = position(prim, k);
+            indexed_->vertex_attrib(
+                vertex_index(prim, k), &ret.normal, &ret.tex_coord);
+            return ret;
+        }
+    };
+
+    // binary bvh produced by build_bvh
+    //
+    // triangles are reordered so that each leaf node refers to a continuous
+    // range of them, and leaf ranges are ordered as in depth-first traversal
+    class BuildingBVH : public misc::uncopyable_t
+    {
+    public:
+
+        BuildingMesh mesh;
+
+        std::vector<BuildingTriangle> triangles;
+
+        const BuildingNode *root = nullptr;
+        uint32_t node_count = 0;
+
+        real surface_area = 0;
+        AABB bound;
+
+        // storage of building nodes
+        std::vector<Box<Arena>> arenas;
+
+        // free building nodes. triangles are kept
+        void release_nodes() noexcept
+        {
+            root = nullptr;
+            arenas.clear();
+        }
+    };
+
+    Box<BuildingBVH> build_bvh(
+        const BuildingMesh &mesh,
+        uint32_t depth_threshold, const TriangleBVHNoEmbreeParams &params,
+        int worker_count);
+
+    // memory used by a bvh layout, excluding sampling tables
+    struct MemoryUsage
+    {
+        size_t node_bytes      = 0;
+        size_t primitive_bytes = 0;
+
+        // memory used by the binary layout of the same tree
+        size_t binary_layout_bytes = 0;
+
+        // estimated peak of memory allocated while building, including the
+        // building tree and temporary buffers but not the input mesh
+        size_t peak_build_bytes = 0;
+
+        // how uvs are stored
+        std::string uv_precision = "float";
+
+        size_t total_bytes() const noexcept
+        {
+            return node_bytes + primitive_bytes;
+        }
+    };
+
+    // size of a node of the binary layout: six bounds and two indices
+    constexpr size_t BINARY_NODE_SIZE = 6 * sizeof(real) + 2 * sizeof(uint32_t);
+
+    inline size_t binary_layout_bytes(const BuildingBVH &bvh) noexcept
+    {
+        return bvh.node_count * BINARY_NODE_SIZE +
+               bvh.triangles.size() * (sizeof(Primitive) + sizeof(PrimitiveInfo));
+    }
+
+    // memory used by building triangles and nodes
+    inline size_t building_bvh_bytes(const BuildingBVH &bvh) noexcept
+    {
+        return bvh.triangles.size() * sizeof(BuildingTriangle) +
+               (bvh.root ? bvh.node_count * sizeof(BuildingNode) : 0);
+    }
+
+    // triangle data shared by different bvh layouts.
+    // primitives are stored in the order of building triangles
+    class TrianglePrimitives : public misc::uncopyable_t
+    {
+        std::vector<Primitive> prims_;
+        std::vector<PrimitiveInfo> prim_info_;
+
+        // point to prims_/prim_info_ or data in mapped_file_
+        const Primitive     *prims_data_     = nullptr;
+        const PrimitiveInfo *prim_info_data_ = nullptr;
+        uint32_t prim_count_ = 0;
+
+        RC<const MappedFile> mapped_file_;
+
+        math::distribution::alias_sampler_t<real> prim_sampler_;
+
+        real surface_area_ = 0;
+        AABB local_bound_;
+
+    public:
+
+        void initialize(
+            const BuildingBVH &bvh,
+            int worker_count);
+
+        // use primitives stored in a mapped bvh cache file
+        void initialize_mapped(
+            RC<const MappedFile> mapped_file,
+            const Primitive *prims, const PrimitiveInfo *prim_info,
+            uint32_t prim_count, real surface_area, const AABB &local_bound,
+            int worker_count);
+
+        const Primitive &prim(uint32_t idx) const noexcept
+        {
+            return prims_data_[idx];
+        }
+
+        const Primitive *prims_data() const noexcept
+        {
+            return prims_data_;
+        }
+
+        const PrimitiveInfo *prim_info_data() const noexcept
+        {
+            return prim_info_data_;
+        }
+
+        uint32_t prim_count() const noexcept
+        {
+            return prim_count_;
+        }
+
+        void fill_intersection(
+            uint32_t prim_idx, const Ray &r,
+            const TriangleIntersectionRecord &rcd,
+            GeometryIntersection *inct) const noexcept;
+
+        real surface_area() const noexcept
+        {
+            return surface_area_;
+        }
+
+        const AABB &local_bound() const noexcept
+        {
+            return local_bound_;
+        }
+
+        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept;
+
+        size_t memory_bytes() const noexcept
+        {
+            return prim_count_ * (sizeof(Primitive) + sizeof(PrimitiveInfo));
+        }
+    };
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include <agz/tracer/utility/stats.h>
+#include <agz/tracer/utility/triangle_aux.h>
+
+#include "./triangle_bvh_compact.h"
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    namespace
+    {
+
+        using CompactBVH = UntransformedCompactTriangleBVH;
+
+        // QUANTIZED_T[q] == q / 255, exact at both endpoints
+        constexpr std::array<real, 256> QUANTIZED_T = []
+        {
+            std::array<real, 256> ret = {};
+            for(int i = 0; i < 256; ++i)
+                ret[i] = real(i) / real(255);
+            return ret;
+        }();
+
+        real dequantize(real low, real high, uint8_t q) noexcept
+        {
+            const real t = QUANTIZED_T[q];
+            return low * (1 - t) + high * t;
+        }
+
+        // conservatively quantize [child_low, child_high] relative to
+        // [parent_low, parent_high]
+        void quantize(
+            real parent_low, real parent_high,
+            real child_low, real child_high,
+            uint8_t *q_low, uint8_t *q_high) noexcept
+        {
+            const real extent = parent_high - parent_low;
+            if(extent <= 0)
+            {
+                *q_low  = 0;
+                *q_high = 255;
+                return;
+            }
+
+            const real scale = 255 / extent;
+            int low  = static_cast<int>(std::floor((child_low  - parent_low) * scale));
+            int high = static_cast<int>(std::ceil ((child_high - parent_low) * scale));
+            low  = math::clamp(low,  0, 255);
+            high = math::clamp(high, 0, 255);
+
+            // fix rounding errors of dequantization
+            while(low > 0 && dequantize(
+                parent_low, parent_high, static_cast<uint8_t>(low)) > child_low)
+                --low;
+            while(high < 255 && dequantize(
+                parent_low, parent_high, static_cast<uint8_t>(high)) < child_high)
+                ++high;
+
+            *q_low  = static_cast<uint8_t>(low);
+            *q_high = static_cast<uint8_t>(high);
+        }
+
+        // octahedral normal encoding
+
+        real sign_not_zero(real x) noexcept
+        {
+            return x >= 0 ? real(1) : real(-1);
+        }
+
+        void encode_normal(const FVec3 &n, int16_t *output) noexcept
+        {
+            const real inv_l1 = 1 / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+            real x = n.x * inv_l1, y = n.y * inv_l1;
+            if(n.z < 0)
+            {
+                const real ox = (1 - std::abs(y)) * sign_not_zero(x);
+                const real oy = (1 - std::abs(x)) * sign_not_zero(y);
+                x = ox;
+                y = oy;
+            }
+
+            output[0] = static_cast<int16_t>(
+                std::round(math::clamp<real>(x, -1, 1) * 32767));
+            output[1] = static_cast<int16_t>(
+                std::round(math::clamp<real>(y, -1, 1) * 32767));
+        }
+
+        FVec3 decode_normal(const int16_t *input) noexcept
+        {
+            real x = real(input[0]) / 32767;
+            real y = real(input[1]) / 32767;
+            const real z = 1 - std::abs(x) - std::abs(y);
+            if(z < 0)
+            {
+                const real ox = (1 - std::abs(y)) * sign_not_zero(x);
+                const real oy = (1 - std::abs(x)) * sign_not_zero(y);
+                x = ox;
+                y = oy;
+            }
+            return FVec3(x, y, z).normalize();
+        }
+
+        // vertices are merged only when all attributes are bitwise equal
+        struct VertexKey
+        {
+            real data[8];
+        };
+
+        VertexKey to_key(const mesh::vertex_t &v) noexcept
+        {
+            return { {
+                v.position.x,  v.position.y, v.position.z,
+                v.normal.x,    v.normal.y,   v.normal.z,
+                v.tex_coord.x, v.tex_coord.y
+            } };
+        }
+
+        int compare_keys(const VertexKey &lhs, const VertexKey &rhs) noexcept
+        {
+            return std::memcmp(lhs.data, rhs.data, sizeof(lhs.data));
+        }
+
+        struct StackEntry
+        {
+            AABB bound;
+            uint32_t ref;
+        };
+
+        void decode_child_bound(
+            const AABB &parent, const CompactBVH::Node &node, int child,
+            AABB *output) noexcept
+        {
+            for(int i = 0; i < 3; ++i)
+            {
+                output->low[i] = dequantize(
+                    parent.low[i], parent.high[i], node.low[child][i]);
+                output->high[i] = dequantize(
+                    parent.low[i], parent.high[i], node.high[child][i]);
+            }
+        }
+
+        bool intersect_bound(
+            const AABB &bound, const FVec3 &ori, const FVec3 &inv_dir,
+            real t_min, real t_max, real *t_near) noexcept
+        {
+            const FVec3 n = inv_dir * (bound.low  - ori);
+            const FVec3 f = inv_dir * (bound.high - ori);
+
+            const real t0 = (std::max)(t_min, elem_min(n, f).max_elem());
+            const real t1 = (std::min)(t_max, elem_max(n, f).min_elem());
+
+            *t_near = t0;
+            return t0 <= t1;
+        }
+
+    } // namespace anonymous
+
+    void UntransformedCompactTriangleBVH::initialize(
+        const BuildingMesh &mesh, const TriangleBVHNoEmbreeParams &params)
+    {
+        const uint32_t triangle_count = mesh.triangle_count();
+
+        if(triangle_count >= MAX_TRIANGLE_COUNT)
+        {
+            throw ObjectConstructionException(
+                "too many triangles for compact bvh layout");
+        }
+
+        if(static_cast<uint32_t>(params.max_leaf_size) > MAX_LEAF_SIZE)
+        {
+            throw ObjectConstructionException(
+                "max_leaf_size of compact bvh layout must be <= " +
+                std::to_string(MAX_LEAF_SIZE));
+        }
+
+        const int worker_count = thread::actual_worker_count(
+            params.build_worker_count);
+
+        const auto bvh = build_bvh(
+            mesh, TRAVERSAL_STACK_SIZE / 2, params, worker_count);
+
+        surface_area_ = bvh->surface_area;
+        local_bound_  = bvh->bound;
+
+        // build quantized nodes
+
+        nodes_.clear();
+        nodes_.reserve(bvh->node_count / 2);
+        root_ = build_node(bvh->root, local_bound_);
+        nodes_.shrink_to_fit();
+
+        memory_usage_.binary_layout_bytes = binary_layout_bytes(*bvh);
+        size_t peak_bytes = building_bvh_bytes(*bvh)
+                          + nodes_.size() * sizeof(Node);
+
+        // building nodes are no longer needed, and are freed before
+        // allocating vertices
+
+        bvh->release_nodes();
+
+        const size_t vertex_temp_bytes = init_vertices(*bvh);
+        peak_bytes = (std::max)(
+            peak_bytes, building_bvh_bytes(*bvh)
+                      + nodes_.size()    * sizeof(Node)
+                      + vertices_.size() * sizeof(Vertex)
+                      + indices_.size()  * sizeof(uint32_t)
+                      + uv_chunks_.size() * sizeof(UVChunk)
+                      + float_uvs_.size() * sizeof(Vec2)
+                      + vertex_temp_bytes);
+
+        // triangle sampler
+
+        std::vector<real> area_arr(triangle_count);
+        for(uint32_t i = 0; i < triangle_count; ++i)
+        {
+            const Vec3 &a = vertices_[indices_[3 * i + 0]].position;
+            const Vec3 &b = vertices_[indices_[3 * i + 1]].position;
+            const Vec3 &c = vertices_[indices_[3 * i + 2]].position;
+            area_arr[i] = triangle_area(b - a, c - a);
+        }
+        prim_sampler_.initialize(
+            area_arr.data(), static_cast<int>(triangle_count));
+
+        memory_usage_.node_bytes       = nodes_.size() * sizeof(Node);
+        memory_usage_.primitive_bytes  = vertices_.size()  * sizeof(Vertex)  +
+                                         indices_.size()   * sizeof(uint32_t) +
+                                         uv_chunks_.size() * sizeof(UVChunk) +
+                                         float_uvs_.size() * sizeof(Vec2);
+        memory_usage_.peak_build_bytes = (std::max)(
+            peak_bytes, building_bvh_bytes(*bvh)
+                      + memory_usage_.total_bytes()
+                      + area_arr.size() * sizeof(real));
+    }
+
+    size_t UntransformedCompactTriangleBVH::init_vertices(const BuildingBVH &bvh)
+    {
+        const BuildingMesh &mesh = bvh.mesh;
+        const size_t triangle_count = bvh.triangles.size();
+
+        // corner k is vertex k % 3 of triangle k / 3
+
+        const uint32_t corner_count = static_cast<uint32_t>(3 * triangle_count);
+
+        auto corner_vertex = [&](uint32_t k)
+        {
+            return mesh.vertex(
+                bvh.triangles[k / 3].prim, static_cast<int>(k % 3));
+        };
+
+        // uvs are kept as floats until all vertices are created, and then
+        // quantized by init_uvs
+
+        std::vector<Vec2> uvs;
+
+        auto add_vertex = [&](const mesh::vertex_t &v)
+        {
+            Vertex vertex;
+            vertex.position = v.position;
+            encode_normal(v.normal.normalize(), vertex.normal);
+            vertex.tex_coord[0] = vertex.tex_coord[1] = 0;
+            vertices_.push_back(vertex);
+            uvs.push_back(v.tex_coord);
+        };
+
+        vertices_.clear();
+        indices_.resize(corner_count);
+
+        // vertices are created in order of first occurrences, so that
+        // vertices of nearby triangles stay close in memory
+
+        if(mesh.is_indexed())
+        {
+            // vertices of an indexed mesh are already shared. unreferenced
+            // ones are dropped
+
+            constexpr uint32_t NO_VERTEX =
+                (std::numeric_limits<uint32_t>::max)();
+            std::vector<uint32_t> remap(mesh.vertex_count(), NO_VERTEX);
+
+            for(uint32_t k = 0; k < corner_count; ++k)
+            {
+                const uint32_t prim = bvh.triangles[k / 3].prim;
+                const uint32_t src  = mesh.vertex_index(
+                    prim, static_cast<int>(k % 3));
+                if(remap[src] == NO_VERTEX)
+                {
+                    remap[src] = static_cast<uint32_t>(vertices_.size());
+                    add_vertex(corner_vertex(k));
+                }
+                indices_[k] = remap[src];
+            }
+
+            const size_t temp_bytes =
+                remap.size() * sizeof(uint32_t) +
+                (vertices_.capacity() - vertices_.size()) * sizeof(Vertex);
+            vertices_.shrink_to_fit();
+
+            return temp_bytes + init_uvs(uvs);
+        }
+
+        // sort-based deduplication, which needs one index per corner instead
+        // of a hash table of vertices
+        //
+        // corners are sorted by key and then by k, so that the first corner
+        // of each run of equal keys is its first occurrence
+
+        std::vector<uint32_t> order(corner_count);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs)
+        {
+            const int cmp = compare_keys(
+                to_key(corner_vertex(lhs)), to_key(corner_vertex(rhs)));
+            return cmp != 0 ? cmp < 0 : lhs < rhs;
+        });
+
+        // indices_[k] = first corner with the same key as corner k
+
+        uint32_t first = 0;
+        for(uint32_t i = 0; i < corner_count; ++i)
+        {
+            if(!i || compare_keys(to_key(corner_vertex(order[i - 1])),
+                                  to_key(corner_vertex(order[i]))) != 0)
+                first = order[i];
+            indices_[order[i]] = first;
+        }
+
+        // order is reused to map first corners to vertex indices
+
+        for(uint32_t k = 0; k < corner_count; ++k)
+        {
+            first = indices_[k];
+            if(first == k)
+            {
+                order[k] = static_cast<uint32_t>(vertices_.size());
+                add_vertex(corner_vertex(k));
+            }
+            indices_[k] = order[first];
+        }
+
+        const size_t temp_bytes =
+            order.size() * sizeof(uint32_t) +
+            (vertices_.capacity() - vertices_.size()) * sizeof(Vertex);
+        vertices_.shrink_to_fit();
+
+        return temp_bytes + init_uvs(uvs);
+    }
+
+    size_t UntransformedCompactTriangleBVH::init_uvs(std::vector<Vec2> &uvs)
+    {
+        assert(uvs.size() == vertices_.size());
+
+        const size_t vertex_count = uvs.size();
+        const size_t chunk_count  =
+            (vertex_count + UV_CHUNK_SIZE - 1) / UV_CHUNK_SIZE;
+        const size_t temp_bytes   = uvs.capacity() * sizeof(Vec2);
+
+        uv_chunks_.clear();
+        float_uvs_.clear();
+
+        // vertices are ordered by first occurrences, so a chunk usually
+        // covers nearby triangles and a single uv tile
+
+        std::vector<UVChunk> chunks(chunk_count);
+        real max_range = 0, max_step = 0;
+
+        for(size_t c = 0; c < chunk_count; ++c)
+        {
+            const size_t beg = c * UV_CHUNK_SIZE;
+            const size_t end = (std::min)(beg + UV_CHUNK_SIZE, vertex_count);
+
+            Vec2 low(REAL_MAX), high(-REAL_MAX);
+            for(size_t i = beg; i < end; ++i)
+            {
+                low.x  = (std::min)(low.x,  uvs[i].x);
+                low.y  = (std::min)(low.y,  uvs[i].y);
+                high.x = (std::max)(high.x, uvs[i].x);
+                high.y = (std::max)(high.y, uvs[i].y);
+            }
+
+            chunks[c].low   = low;
+            chunks[c].scale = (high - low) / real(65535);
+
+            max_range = (std::max)(
+                { max_range, high.x - low.x, high.y - low.y });
+            max_step  = (std::max)(
+                { max_step, chunks[c].scale.x, chunks[c].scale.y });
+        }
+
+        if(max_range > MAX_QUANTIZED_UV_RANGE)
+        {
+            uvs.shrink_to_fit();
+            float_uvs_ = std::move(uvs);
+            memory_usage_.uv_precision = "float";
+            return temp_bytes + chunks.size() * sizeof(UVChunk);
+        }
+
+        auto quantize_uv = [&](real v, real low, real scale)
+        {
+            if(scale <= 0)
+                return uint16_t(0);
+            const real q = std::round((v - low) / scale);
+            return static_cast<uint16_t>(math::clamp<real>(q, 0, 65535));
+        };
+
+        for(size_t i = 0; i < vertex_count; ++i)
+        {
+            const UVChunk &chunk = chunks[i / UV_CHUNK_SIZE];
+            vertices_[i].tex_coord[0] = quantize_uv(
+                uvs[i].x, chunk.low.x, chunk.scale.x);
+            vertices_[i].tex_coord[1] = quantize_uv(
+                uvs[i].y, chunk.low.y, chunk.scale.y);
+        }
+
+        uv_chunks_ = std::move(chunks);
+
+        char precision[64];
+        std::snprintf(
+            precision, sizeof(precision),
+            "16-bit per %u vertices, max step %.3g",
+            UV_CHUNK_SIZE, static_cast<double>(max_step));
+        memory_usage_.uv_precision = precision;
+
+        return temp_bytes;
+    }
+
+    Vec2 UntransformedCompactTriangleBVH::decode_uv(
+        uint32_t vertex_idx) const noexcept
+    {
+        if(!float_uvs_.empty())
+            return float_uvs_[vertex_idx];
+
+        const Vertex &v = vertices_[vertex_idx];
+        const UVChunk &chunk = uv_chunks_[vertex_idx / UV_CHUNK_SIZE];
+        return Vec2(chunk.low.x + v.tex_coord[0] * chunk.scale.x,
+                    chunk.low.y + v.tex_coord[1] * chunk.scale.y);
+    }
+
+    uint32_t UntransformedCompactTriangleBVH::build_node(
+        const BuildingNode *node, const AABB &decoded_bound)
+    {
+        if(!node->left)
+        {
+            const uint32_t count = node->end - node->start;
+            assert(count >= 1 && count <= MAX_LEAF_SIZE);
+            return LEAF_BIT | (node->start << LEAF_COUNT_BITS) | (count - 1);
+        }
+
+        const uint32_t node_idx = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+
+        const BuildingNode *children[2] = { node->left, node->right };
+        for(int c = 0; c < 2; ++c)
+        {
+            const AABB &child_bound = children[c]->bounding;
+
+            uint8_t q_low[3], q_high[3];
+            for(int i = 0; i < 3; ++i)
+            {
+                quantize(
+                    decoded_bound.low[i], decoded_bound.high[i],
+                    child_bound.low[i], child_bound.high[i],
+                    &q_low[i], &q_high[i]);
+
+                nodes_[node_idx].low[c][i]  = q_low[i];
+                nodes_[node_idx].high[c][i] = q_high[i];
+            }
+
+            AABB child_decoded_bound;
+            decode_child_bound(
+                decoded_bound, nodes_[node_idx], c, &child_decoded_bound);
+
+            // nodes_ may be reallocated by building child
+            const uint32_t child_ref = build_node(children[c], child_decoded_bound);
+            nodes_[node_idx].child[c] = child_ref;
+        }
+
+        return node_idx;
+    }
+
+    bool UntransformedCompactTriangleBVH::has_intersection(
+        const Ray &r) const noexcept
+    {
+        const FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+
+        real t_near;
+        if(!intersect_bound(local_bound_, r.o, inv_dir, r.t_min, r.t_max, &t_near))
+            return false;
+
+        StackEntry stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { local_bound_, root_ };
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+
+            if(entry.ref & LEAF_BIT)
+            {
+                const uint32_t start = (entry.ref & ~LEAF_BIT) >> LEAF_COUNT_BITS;
+                const uint32_t end   = start + (entry.ref & (MAX_LEAF_SIZE - 1)) + 1;
+                AGZ_STATS_ADD(TriangleBVHNode, 1);
+                AGZ_STATS_ADD(TriangleBVHTriangle, end - start);
+                for(uint32_t i = start; i < end; ++i)
+                {
+                    const Vec3 &a = vertices_[indices_[3 * i + 0]].position;
+                    const Vec3 &b = vertices_[indices_[3 * i + 1]].position;
+                    const Vec3 &c = vertices_[indices_[3 * i + 2]].position;
+                    if(has_intersection_with_triangle(r, a, b - a, c - a))
+                        return true;
+                }
+                continue;
+            }
+
+            const Node &node = nodes_[entry.ref];
+            AGZ_STATS_ADD(TriangleBVHNode, 1);
+            for(int c = 0; c < 2; ++c)
+            {
+                AABB child_bound(UNINIT);
+                decode_child_bound(entry.bound, node, c, &child_bound);
+                if(intersect_bound(
+                    child_bound, r.o, inv_dir, r.t_min, r.t_max, &t_near))
+                {
+                    assert(top < TRAVERSAL_STACK_SIZE);
+                    stack[top++] = { child_bound, node.child[c] };
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool UntransformedCompactTriangleBVH::closest_intersection(
+        Ray r, GeometryIntersection *inct) const noexcept
+    {
+        const FVec3 inv_dir(1 / r.d.x, 1 / r.d.y, 1 / r.d.z);
+
+        real t_near;
+        if(!intersect_bound(local_bound_, r.o, inv_dir, r.t_min, r.t_max, &t_near))
+            return false;
+
+        StackEntry stack[TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { local_bound_, root_ };
+
+        TriangleIntersectionRecord rcd, tmp_rcd;
+        rcd.t_ray = std::numeric_limits<real>::infinity();
+        uint32_t final_prim_idx = 0;
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+
+            if(entry.ref & LEAF_BIT)
+            {
+                const uint32_t start = (entry.ref & ~LEAF_BIT) >> LEAF_COUNT_BITS;
+                const uint32_t end   = start + (entry.ref & (MAX_LEAF_SIZE - 1)) + 1;
+                AGZ_STATS_ADD(TriangleBVHNode, 1);
+                AGZ_STATS_ADD(TriangleBVHTriangle, end - start);
+                for(uint32_t i = start; i < end; ++i)
+                {
+                    const Vec3 &a = vertices_[indices_[3 * i + 0]].position;
+                    const Vec3 &b = vertices_[indices_[3 * i + 1]].position;
+                    const Vec3 &c = vertices_[indices_[3 * i + 2]].position;
+                    if(closest_intersection_with_triangle(
+                        r, a, b - a, c - a, &tmp_rcd))
+                    {
+                        rcd = tmp_rcd;
+                        r.t_max = tmp_rcd.t_ray;
+                        final_prim_idx = i;
+                    }
+                }
+                continue;
+            }
+
+            const Node &node = nodes_[entry.ref];
+            AGZ_STATS_ADD(TriangleBVHNode, 1);
+
+            AABB child_bounds[2] = { AABB(UNINIT), AABB(UNINIT) };
+            real t[2];
+            bool hit[2];
+            for(int c = 0; c < 2; ++c)
+            {
+                decode_child_bound(entry.bound, node, c, &child_bounds[c]);
+                hit[c] = intersect_bound(
+                    child_bounds[c], r.o, inv_dir, r.t_min, r.t_max, &t[c]);
+            }
+
+            assert(top + 2 <= TRAVERSAL_STACK_SIZE);
+
+            // push the nearer child last so that it's visited first
+            const int first = (hit[0] && hit[1] && t[0] < t[1]) ? 1 : 0;
+            for(int k = 0; k < 2; ++k)
+            {
+                const int c = k == 0 ? first : 1 - first;
+                if(hit[c])
+                    stack[top++] = { child_bounds[c], node.child[c] };
+            }
+        }
+
+        if(std::isinf(rcd.t_ray))
+            return false;
+
+        interpolate(final_prim_idx, rcd.uv, inct, &inct->dpdu, &inct->dpdv);
+
+        inct->pos = r.at(rcd.t_ray);
+        inct->t   = rcd.t_ray;
+        inct->wr  = -r.d;
+
+        return true;
+    }
+
+    SurfacePoint UntransformedCompactTriangleBVH::sample(
+        real *pdf, const Sample3 &sam) const noexcept
+    {
+        const int prim_idx = prim_sampler_.sample(sam.u);
+        assert(0 <= prim_idx && static_cast<size_t>(3 * prim_idx) < indices_.size());
+
+        const Vec2 uv = math::distribution::uniform_on_triangle(sam.v, sam.w);
+
+        SurfacePoint spt;
+        interpolate(static_cast<uint32_t>(prim_idx), uv, &spt);
+
+        const Vec3 &a = vertices_[indices_[3 * prim_idx + 0]].position;
+        const Vec3 &b = vertices_[indices_[3 * prim_idx + 1]].position;
+        const Vec3 &c = vertices_[indices_[3 * prim_idx + 2]].position;
+        spt.pos = a + uv.x * (b - a) + uv.y * (c - a);
+
+        *pdf = 1 / surface_area_;
+
+        return spt;
+    }
+
+    void UntransformedCompactTriangleBVH::interpolate(
+        uint32_t prim_idx, const Vec2 &uv, SurfacePoint *spt,
+        FVec3 *dpdu, FVec3 *dpdv) const noexcept
+    {
+        const uint32_t ia = indices_[3 * prim_idx + 0];
+        const uint32_t ib = indices_[3 * prim_idx + 1];
+        const uint32_t ic = indices_[3 * prim_idx + 2];
+
+        const Vertex &va = vertices_[ia];
+        const Vertex &vb = vertices_[ib];
+        const Vertex &vc = vertices_[ic];
+
+        const FVec3 b_a = vb.position - va.position;
+        const FVec3 c_a = vc.position - va.position;
+
+        const FVec3 n_a = decode_normal(va.normal);
+        const FVec3 n_b = decode_normal(vb.normal);
+        const FVec3 n_c = decode_normal(vc.normal);
+
+        const Vec2 t_a = decode_uv(ia);
+        const Vec2 t_b_a = decode_uv(ib) - t_a;
+        const Vec2 t_c_a = decode_uv(ic) - t_a;
+
+        FVec3 z = cross(b_a, c_a).normalize();
+        if(dot(n_a + n_b + n_c, z) < 0)
+            z = -z;
+        const FVec3 x = dpdu_as_ex(b_a, c_a, t_b_a, t_c_a, z);
+
+        spt->geometry_coord = FCoord(x, cross(z, x), z);
+        spt->uv             = t_a + uv.x * t_b_a + uv.y * t_c_a;
+
+        const FVec3 user_z = n_a + uv.x * (n_b - n_a) + uv.y * (n_c - n_a);
+        spt->user_coord = spt->geometry_coord.rotate_to_new_z(user_z);
+
+        if(dpdu)
+            triangle_dpduv(b_a, c_a, t_b_a, t_c_a, dpdu, dpdv);
+    }
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
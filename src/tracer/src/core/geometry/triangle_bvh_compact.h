@@ -0,0 +1,120 @@
+#pragma once
+
+#include "./triangle_bvh_builder.h"
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    // memory-saving triangle bvh
+    //
+    // each interior node stores bounds of its two children quantized to
+    // 8 bits relative to its own bound, which is decoded during traversal.
+    // triangles are stored as indices into a deduplicated vertex buffer with
+    // octahedral-encoded normals and 16-bit uvs.
+    //
+    // uvs are quantized relative to the uv range of each chunk of
+    // UV_CHUNK_SIZE consecutive vertices, so that tiled/udim uvs keep their
+    // precision. uvs are stored as floats when any chunk spans more than
+    // MAX_QUANTIZED_UV_RANGE units
+    class UntransformedCompactTriangleBVH : public misc::uncopyable_t
+    {
+    public:
+
+        // child reference:
+        //    interior: index of child node
+        //    leaf:     LEAF_BIT | (first triangle << LEAF_COUNT_BITS) | (count - 1)
+        static constexpr uint32_t LEAF_BIT        = 1u << 31;
+        static constexpr uint32_t LEAF_COUNT_BITS = 4;
+        static constexpr uint32_t MAX_LEAF_SIZE   = 1u << LEAF_COUNT_BITS;
+        static constexpr uint32_t MAX_TRIANGLE_COUNT =
+            1u << (31 - LEAF_COUNT_BITS);
+
+        static constexpr uint32_t UV_CHUNK_SIZE          = 1024;
+        static constexpr real     MAX_QUANTIZED_UV_RANGE = 4;
+
+        struct Node
+        {
+            uint8_t low[2][3];
+            uint8_t high[2][3];
+            uint32_t child[2];
+        };
+
+        struct Vertex
+        {
+            Vec3 position;
+            int16_t normal[2];
+            uint16_t tex_coord[2]; // unused when uvs are stored as floats
+        };
+
+        // uv = low + tex_coord * scale for vertices in the chunk
+        struct UVChunk
+        {
+            Vec2 low;
+            Vec2 scale;
+        };
+
+        void initialize(
+            const BuildingMesh &mesh, const TriangleBVHNoEmbreeParams &params);
+
+        bool has_intersection(const Ray &r) const noexcept;
+
+        bool closest_intersection(
+            Ray r, GeometryIntersection *inct) const noexcept;
+
+        real surface_area() const noexcept
+        {
+            return surface_area_;
+        }
+
+        const AABB &local_bound() const noexcept
+        {
+            return local_bound_;
+        }
+
+        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept;
+
+        const MemoryUsage &memory_usage() const noexcept
+        {
+            return memory_usage_;
+        }
+
+    private:
+
+        uint32_t build_node(const BuildingNode *node, const AABB &decoded_bound);
+
+        // returns bytes of temporary buffers
+        size_t init_vertices(const BuildingBVH &bvh);
+
+        // quantize uvs of vertices_ per chunk, or keep them as floats.
+        // returns bytes of temporary buffers
+        size_t init_uvs(std::vector<Vec2> &uvs);
+
+        Vec2 decode_uv(uint32_t vertex_idx) const noexcept;
+
+        // dpdu/dpdv are optional outputs
+        void interpolate(
+            uint32_t prim_idx, const Vec2 &uv, SurfacePoint *spt,
+            FVec3 *dpdu = nullptr, FVec3 *dpdv = nullptr) const noexcept;
+
+        std::vector<Node> nodes_;
+        uint32_t root_;
+
+        std::vector<Vertex> vertices_;
+        std::vector<uint32_t> indices_;
+
+        std::vector<UVChunk> uv_chunks_;
+        std::vector<Vec2>    float_uvs_;
+
+        math::distribution::alias_sampler_t<real> prim_sampler_;
+
+        real surface_area_ = 0;
+        AABB local_bound_;
+
+        MemoryUsage memory_usage_;
+    };
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
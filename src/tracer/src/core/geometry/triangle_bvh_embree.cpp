@@ -228,6 +228,100 @@ namespace tri_bvh_embree_ws
             if(rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
                 return false;
 
+            fill_intersection(r, rayhit, inct);
+            return true;
+        }
+
+        // rays are traced with embree's stream api in chunks.
+        //
+        // streams carry ao, shadow and bounce rays, which are incoherent, so
+        // the default (incoherent) context flags are used
+
+        void has_intersection_n(
+            misc::span<const Ray> rays, bool *results) const noexcept
+        {
+            RTCRay rtc_rays[STREAM_CHUNK_SIZE];
+
+            RTCIntersectContext inct_ctx{};
+            rtcInitIntersectContext(&inct_ctx);
+
+            for(size_t beg = 0; beg < rays.size(); beg += STREAM_CHUNK_SIZE)
+            {
+                const size_t count = (std::min)(
+                    rays.size() - beg, STREAM_CHUNK_SIZE);
+
+                for(size_t i = 0; i < count; ++i)
+                    rtc_rays[i] = to_rtc_ray(rays[beg + i]);
+
+                rtcOccluded1M(
+                    scene_, &inct_ctx, rtc_rays,
+                    static_cast<unsigned>(count), sizeof(RTCRay));
+
+                for(size_t i = 0; i < count; ++i)
+                {
+                    results[beg + i] = rtc_rays[i].tfar < 0 &&
+                                       std::isinf(rtc_rays[i].tfar);
+                }
+            }
+        }
+
+        void closest_intersection_n(
+            misc::span<const Ray> rays,
+            GeometryIntersection *incts, bool *results) const noexcept
+        {
+            alignas(16) RTCRayHit rayhits[STREAM_CHUNK_SIZE];
+
+            RTCIntersectContext inct_ctx{};
+            rtcInitIntersectContext(&inct_ctx);
+
+            for(size_t beg = 0; beg < rays.size(); beg += STREAM_CHUNK_SIZE)
+            {
+                const size_t count = (std::min)(
+                    rays.size() - beg, STREAM_CHUNK_SIZE);
+
+                for(size_t i = 0; i < count; ++i)
+                {
+                    auto &rayhit = rayhits[i];
+                    rayhit.ray = to_rtc_ray(rays[beg + i]);
+                    rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+                    rayhit.hit.geomID    = RTC_INVALID_GEOMETRY_ID;
+                    rayhit.hit.primID    = RTC_INVALID_GEOMETRY_ID;
+                }
+
+                rtcIntersect1M(
+                    scene_, &inct_ctx, rayhits,
+                    static_cast<unsigned>(count), sizeof(RTCRayHit));
+
+                for(size_t i = 0; i < count; ++i)
+                {
+                    results[beg + i] =
+                        rayhits[i].hit.geomID != RTC_INVALID_GEOMETRY_ID;
+                    if(results[beg + i])
+                        fill_intersection(rays[beg + i], rayhits[i], &incts[beg + i]);
+                }
+            }
+        }
+
+    private:
+
+        static constexpr size_t STREAM_CHUNK_SIZE = 64;
+
+        static RTCRay to_rtc_ray(const Ray &r) noexcept
+        {
+            return {
+                r.o.x, r.o.y, r.o.z,
+                r.t_min,
+                r.d.x, r.d.y, r.d.z,
+                0,
+                r.t_max,
+                static_cast<unsigned>(-1), 0, 0
+            };
+        }
+
+        void fill_intersection(
+            const Ray &r, const RTCRayHit &rayhit,
+            GeometryIntersection *inct) const noexcept
+        {
             const real t_val = rayhit.ray.tfar;
             const real u = rayhit.hit.u;
             const real v = rayhit.hit.v;
@@ -243,11 +337,16 @@ namespace tri_bvh_embree_ws
                                  v * FVec3(info.n_c_a);
             inct->user_coord = inct->geometry_coord.rotate_to_new_z(user_z);
 
-            inct->wr = -r.d;
+            const Primitive &prim = prims_[rayhit.hit.primID];
+            triangle_dpduv(
+                prim.b_a, prim.c_a, info.t_b_a, info.t_c_a,
+                &inct->dpdu, &inct->dpdv);
 
-            return true;
+            inct->wr = -r.d;
         }
 
+    public:
+
         SurfacePoint uniformly_sample(const Sample3 &sam) const noexcept
         {
             const int prim_idx = prim_sampler_.sample(sam.u);
@@ -366,6 +465,19 @@ public:
         return untransformed_->closest_intersection(r, inct);
     }
 
+    void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept override
+    {
+        untransformed_->has_intersection_n(rays, results);
+    }
+
+    void closest_intersection_n(
+        misc::span<const Ray> rays,
+        GeometryIntersection *incts, bool *results) const noexcept override
+    {
+        untransformed_->closest_intersection_n(rays, incts, results);
+    }
+
     AABB world_bound() const noexcept override
     {
         return world_bound_;
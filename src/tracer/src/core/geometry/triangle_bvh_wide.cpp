@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <limits>
+
+#include <immintrin.h>
+
+#include <agz/tracer/utility/stats.h>
+#include <agz/tracer/utility/triangle_aux.h>
+
+#include "./triangle_bvh_wide.h"
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    static_assert(std::is_same_v<real, float>,
+                  "wide triangle bvh requires real == float");
+
+    namespace
+    {
+
+        using WideBVH = UntransformedWideTriangleBVH;
+
+        // each node pushes at most WIDTH - 1 more entries than it pops.
+        // wide tree is no deeper than the binary one
+        constexpr int WIDE_TRAVERSAL_STACK_SIZE =
+            (WideBVH::WIDTH - 1) * TRAVERSAL_STACK_SIZE + WideBVH::WIDTH;
+
+        struct StackEntry
+        {
+            uint32_t child;
+            uint32_t packet_count;
+            real     t_near;
+        };
+
+        struct SSERay
+        {
+            __m128 o_x, o_y, o_z;
+            __m128 d_x, d_y, d_z;
+            __m128 inv_d_x, inv_d_y, inv_d_z;
+        };
+
+        SSERay to_sse_ray(const Ray &r) noexcept
+        {
+            SSERay ret;
+            ret.o_x = _mm_set1_ps(r.o.x);
+            ret.o_y = _mm_set1_ps(r.o.y);
+            ret.o_z = _mm_set1_ps(r.o.z);
+            ret.d_x = _mm_set1_ps(r.d.x);
+            ret.d_y = _mm_set1_ps(r.d.y);
+            ret.d_z = _mm_set1_ps(r.d.z);
+            ret.inv_d_x = _mm_set1_ps(1 / r.d.x);
+            ret.inv_d_y = _mm_set1_ps(1 / r.d.y);
+            ret.inv_d_z = _mm_set1_ps(1 / r.d.z);
+            return ret;
+        }
+
+        // slab test with all children of a wide node
+        // returns hit mask and fills near distances
+        int intersect_children(
+            const SSERay &r, real t_min, real t_max,
+            const WideBVH::Node &node, float *t_near) noexcept
+        {
+            const __m128 nx = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.low_x), r.o_x), r.inv_d_x);
+            const __m128 ny = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.low_y), r.o_y), r.inv_d_y);
+            const __m128 nz = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.low_z), r.o_z), r.inv_d_z);
+
+            const __m128 fx = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.high_x), r.o_x), r.inv_d_x);
+            const __m128 fy = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.high_y), r.o_y), r.inv_d_y);
+            const __m128 fz = _mm_mul_ps(
+                _mm_sub_ps(_mm_load_ps(node.high_z), r.o_z), r.inv_d_z);
+
+            const __m128 t0 = _mm_max_ps(
+                _mm_max_ps(_mm_min_ps(nx, fx), _mm_min_ps(ny, fy)),
+                _mm_max_ps(_mm_min_ps(nz, fz), _mm_set1_ps(t_min)));
+            const __m128 t1 = _mm_min_ps(
+                _mm_min_ps(_mm_max_ps(nx, fx), _mm_max_ps(ny, fy)),
+                _mm_min_ps(_mm_max_ps(nz, fz), _mm_set1_ps(t_max)));
+
+            _mm_storeu_ps(t_near, t0);
+
+            const __m128i children = _mm_load_si128(
+                reinterpret_cast<const __m128i*>(node.child));
+            const __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(
+                children, _mm_set1_epi32(static_cast<int>(WideBVH::EMPTY_CHILD))));
+
+            return _mm_movemask_ps(_mm_andnot_ps(empty, _mm_cmple_ps(t0, t1)));
+        }
+
+        // intersect ray with 4 triangles in a packet
+        // returns hit mask and fills t and barycentric coordinates
+        int intersect_packet(
+            const SSERay &r, real t_min, real t_max,
+            const WideBVH::TrianglePacket &packet,
+            float *t, float *alpha, float *beta) noexcept
+        {
+            const __m128 b_a_x = _mm_load_ps(packet.b_a_x);
+            const __m128 b_a_y = _mm_load_ps(packet.b_a_y);
+            const __m128 b_a_z = _mm_load_ps(packet.b_a_z);
+            const __m128 c_a_x = _mm_load_ps(packet.c_a_x);
+            const __m128 c_a_y = _mm_load_ps(packet.c_a_y);
+            const __m128 c_a_z = _mm_load_ps(packet.c_a_z);
+
+            // s1 = cross(d, c_a)
+            const __m128 s1_x = _mm_sub_ps(
+                _mm_mul_ps(r.d_y, c_a_z), _mm_mul_ps(r.d_z, c_a_y));
+            const __m128 s1_y = _mm_sub_ps(
+                _mm_mul_ps(r.d_z, c_a_x), _mm_mul_ps(r.d_x, c_a_z));
+            const __m128 s1_z = _mm_sub_ps(
+                _mm_mul_ps(r.d_x, c_a_y), _mm_mul_ps(r.d_y, c_a_x));
+
+            const __m128 div = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(s1_x, b_a_x), _mm_mul_ps(s1_y, b_a_y)),
+                _mm_mul_ps(s1_z, b_a_z));
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 inv_div = _mm_div_ps(_mm_set1_ps(1), div);
+
+            // o_a = o - a
+            const __m128 o_a_x = _mm_sub_ps(r.o_x, _mm_load_ps(packet.a_x));
+            const __m128 o_a_y = _mm_sub_ps(r.o_y, _mm_load_ps(packet.a_y));
+            const __m128 o_a_z = _mm_sub_ps(r.o_z, _mm_load_ps(packet.a_z));
+
+            const __m128 alpha4 = _mm_mul_ps(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(o_a_x, s1_x), _mm_mul_ps(o_a_y, s1_y)),
+                _mm_mul_ps(o_a_z, s1_z)), inv_div);
+
+            // s2 = cross(o_a, b_a)
+            const __m128 s2_x = _mm_sub_ps(
+                _mm_mul_ps(o_a_y, b_a_z), _mm_mul_ps(o_a_z, b_a_y));
+            const __m128 s2_y = _mm_sub_ps(
+                _mm_mul_ps(o_a_z, b_a_x), _mm_mul_ps(o_a_x, b_a_z));
+            const __m128 s2_z = _mm_sub_ps(
+                _mm_mul_ps(o_a_x, b_a_y), _mm_mul_ps(o_a_y, b_a_x));
+
+            const __m128 beta4 = _mm_mul_ps(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(r.d_x, s2_x), _mm_mul_ps(r.d_y, s2_y)),
+                _mm_mul_ps(r.d_z, s2_z)), inv_div);
+
+            const __m128 t4 = _mm_mul_ps(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(c_a_x, s2_x), _mm_mul_ps(c_a_y, s2_y)),
+                _mm_mul_ps(c_a_z, s2_z)), inv_div);
+
+            __m128 mask = _mm_cmpneq_ps(div, zero);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(alpha4, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(beta4, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(
+                _mm_add_ps(alpha4, beta4), _mm_set1_ps(1)));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(t4, _mm_set1_ps(t_min)));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(t4, _mm_set1_ps(t_max)));
+
+            _mm_storeu_ps(t,     t4);
+            _mm_storeu_ps(alpha, alpha4);
+            _mm_storeu_ps(beta,  beta4);
+
+            return _mm_movemask_ps(mask);
+        }
+
+        void set_lane(
+            WideBVH::TrianglePacket &packet, int lane,
+            const Primitive &prim, uint32_t prim_idx) noexcept
+        {
+            packet.a_x[lane]   = prim.a_.x;
+            packet.a_y[lane]   = prim.a_.y;
+            packet.a_z[lane]   = prim.a_.z;
+            packet.b_a_x[lane] = prim.b_a_.x;
+            packet.b_a_y[lane] = prim.b_a_.y;
+            packet.b_a_z[lane] = prim.b_a_.z;
+            packet.c_a_x[lane] = prim.c_a_.x;
+            packet.c_a_y[lane] = prim.c_a_.y;
+            packet.c_a_z[lane] = prim.c_a_.z;
+            packet.prim_idx[lane] = prim_idx;
+        }
+
+    } // namespace anonymous
+
+    void UntransformedWideTriangleBVH::initialize(
+        const BuildingMesh &mesh, const TriangleBVHNoEmbreeParams &params)
+    {
+        const uint32_t triangle_count = mesh.triangle_count();
+
+        const int worker_count = thread::actual_worker_count(
+            params.build_worker_count);
+
+        const auto bvh = build_bvh(
+            mesh, TRAVERSAL_STACK_SIZE / 2, params, worker_count);
+
+        prims_.initialize(*bvh, worker_count);
+
+        nodes_.clear();
+        packets_.clear();
+        nodes_.reserve(bvh->node_count / 2 + 1);
+        packets_.reserve(triangle_count / 2 + 1);
+
+        build_node(bvh->root);
+
+        memory_usage_.node_bytes          = nodes_.size() * sizeof(Node);
+        memory_usage_.primitive_bytes     = packets_.size() * sizeof(TrianglePacket)
+                                          + prims_.memory_bytes();
+        memory_usage_.binary_layout_bytes = binary_layout_bytes(*bvh);
+        memory_usage_.peak_build_bytes    = building_bvh_bytes(*bvh)
+                                          + memory_usage_.total_bytes();
+    }
+
+    uint32_t UntransformedWideTriangleBVH::build_node(
+        const BuildingNode *binary_node)
+    {
+        // collapse binary subtree: repeatedly open the interior child
+        // with the largest surface area
+
+        const BuildingNode *children[WIDTH] = { binary_node };
+        int child_count = 1;
+
+        while(child_count < WIDTH)
+        {
+            int best_child = -1;
+            real best_area = -1;
+            for(int i = 0; i < child_count; ++i)
+            {
+                if(!children[i]->left)
+                    continue;
+                const real area = surface_area_of(children[i]->bounding);
+                if(area > best_area)
+                {
+                    best_area  = area;
+                    best_child = i;
+                }
+            }
+
+            if(best_child < 0)
+                break;
+
+            const BuildingNode *opened = children[best_child];
+            children[best_child]      = opened->left;
+            children[child_count++]   = opened->right;
+        }
+
+        const uint32_t node_idx = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+
+        for(int i = 0; i < WIDTH; ++i)
+        {
+            Node &node = nodes_[node_idx];
+
+            if(i >= child_count)
+            {
+                node.low_x[i]  = node.low_y[i]  = node.low_z[i]  = 0;
+                node.high_x[i] = node.high_y[i] = node.high_z[i] = 0;
+                node.child[i]        = EMPTY_CHILD;
+                node.packet_count[i] = 0;
+                continue;
+            }
+
+            const BuildingNode *child = children[i];
+            node.low_x[i]  = child->bounding.low.x;
+            node.low_y[i]  = child->bounding.low.y;
+            node.low_z[i]  = child->bounding.low.z;
+            node.high_x[i] = child->bounding.high.x;
+            node.high_y[i] = child->bounding.high.y;
+            node.high_z[i] = child->bounding.high.z;
+
+            if(child->left)
+            {
+                // nodes_ may be reallocated by building child
+                const uint32_t child_idx = build_node(child);
+                nodes_[node_idx].child[i]        = child_idx;
+                nodes_[node_idx].packet_count[i] = 0;
+                continue;
+            }
+
+            const uint32_t packet_start = static_cast<uint32_t>(packets_.size());
+            const uint32_t packet_count = (child->end - child->start + WIDTH - 1) / WIDTH;
+
+            for(uint32_t j = 0; j < packet_count; ++j)
+            {
+                TrianglePacket packet = {};
+                for(int lane = 0; lane < WIDTH; ++lane)
+                {
+                    const uint32_t prim_idx = child->start + j * WIDTH + lane;
+                    if(prim_idx < child->end)
+                        set_lane(packet, lane, prims_.prim(prim_idx), prim_idx);
+                }
+                packets_.push_back(packet);
+            }
+
+            node.child[i]        = LEAF_BIT | packet_start;
+            node.packet_count[i] = packet_count;
+        }
+
+        return node_idx;
+    }
+
+    bool UntransformedWideTriangleBVH::has_intersection(
+        const Ray &r) const noexcept
+    {
+        const SSERay sse_ray = to_sse_ray(r);
+
+        StackEntry stack[WIDE_TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, 0, r.t_min };
+
+        alignas(16) float t_near[WIDTH];
+        alignas(16) float t[WIDTH], alpha[WIDTH], beta[WIDTH];
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+
+            if(entry.child & LEAF_BIT)
+            {
+                const uint32_t packet_start = entry.child & ~LEAF_BIT;
+                AGZ_STATS_ADD(TriangleBVHTriangle, WIDTH * entry.packet_count);
+                for(uint32_t i = 0; i < entry.packet_count; ++i)
+                {
+                    if(intersect_packet(
+                        sse_ray, r.t_min, r.t_max,
+                        packets_[packet_start + i], t, alpha, beta))
+                        return true;
+                }
+                continue;
+            }
+
+            const Node &node = nodes_[entry.child];
+            AGZ_STATS_ADD(TriangleBVHNode, 1);
+            const int mask = intersect_children(
+                sse_ray, r.t_min, r.t_max, node, t_near);
+
+            for(int i = 0; i < WIDTH; ++i)
+            {
+                if(mask & (1 << i))
+                {
+                    assert(top < WIDE_TRAVERSAL_STACK_SIZE);
+                    stack[top++] = {
+                        node.child[i], node.packet_count[i], t_near[i] };
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool UntransformedWideTriangleBVH::closest_intersection(
+        Ray r, GeometryIntersection *inct) const noexcept
+    {
+        const SSERay sse_ray = to_sse_ray(r);
+
+        StackEntry stack[WIDE_TRAVERSAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, 0, r.t_min };
+
+        alignas(16) float t_near[WIDTH];
+        alignas(16) float t[WIDTH], alpha[WIDTH], beta[WIDTH];
+
+        TriangleIntersectionRecord rcd;
+        rcd.t_ray = std::numeric_limits<real>::infinity();
+        uint32_t final_prim_idx = 0;
+
+        while(top)
+        {
+            const StackEntry entry = stack[--top];
+            if(entry.t_near > r.t_max)
+                continue;
+
+            if(entry.child & LEAF_BIT)
+            {
+                const uint32_t packet_start = entry.child & ~LEAF_BIT;
+                AGZ_STATS_ADD(TriangleBVHTriangle, WIDTH * entry.packet_count);
+                for(uint32_t i = 0; i < entry.packet_count; ++i)
+                {
+                    const TrianglePacket &packet = packets_[packet_start + i];
+                    const int mask = intersect_packet(
+                        sse_ray, r.t_min, r.t_max, packet, t, alpha, beta);
+                    for(int lane = 0; lane < WIDTH; ++lane)
+                    {
+                        if((mask & (1 << lane)) && t[lane] <= r.t_max)
+                        {
+                            rcd.t_ray      = t[lane];
+                            rcd.uv         = Vec2(alpha[lane], beta[lane]);
+                            r.t_max        = t[lane];
+                            final_prim_idx = packet.prim_idx[lane];
+                        }
+                    }
+                }
+                continue;
+            }
+
+            const Node &node = nodes_[entry.child];
+            AGZ_STATS_ADD(TriangleBVHNode, 1);
+            const int mask = intersect_children(
+                sse_ray, r.t_min, r.t_max, node, t_near);
+            if(!mask)
+                continue;
+
+            // push hit children from far to near so that the nearest one
+            // is visited first
+
+            int hit_children[WIDTH];
+            int hit_count = 0;
+            for(int i = 0; i < WIDTH; ++i)
+            {
+                if(mask & (1 << i))
+                    hit_children[hit_count++] = i;
+            }
+
+            std::sort(hit_children, hit_children + hit_count,
+                [&](int L, int R) { return t_near[L] > t_near[R]; });
+
+            for(int i = 0; i < hit_count; ++i)
+            {
+                assert(top < WIDE_TRAVERSAL_STACK_SIZE);
+                const int c = hit_children[i];
+                stack[top++] = {
+                    node.child[c], node.packet_count[c], t_near[c] };
+            }
+        }
+
+        if(std::isinf(rcd.t_ray))
+            return false;
+
+        prims_.fill_intersection(final_prim_idx, r, rcd, inct);
+        return true;
+    }
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
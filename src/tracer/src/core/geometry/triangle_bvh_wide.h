@@ -0,0 +1,88 @@
+#pragma once
+
+#include "./triangle_bvh_builder.h"
+
+AGZ_TRACER_BEGIN
+
+namespace tri_bvh_ws
+{
+
+    // 4-wide triangle bvh collapsed from the binary one
+    //
+    // child bounds of each node are stored as soa and tested with one sse
+    // slab test. triangles in leaves are grouped as 4-triangle packets
+    class UntransformedWideTriangleBVH : public misc::uncopyable_t
+    {
+    public:
+
+        static constexpr int WIDTH = 4;
+
+        // child[i] of a wide node:
+        //    interior: index of child node
+        //    leaf:     LEAF_BIT | index of the first packet
+        //    empty:    EMPTY_CHILD
+        static constexpr uint32_t LEAF_BIT    = 1u << 31;
+        static constexpr uint32_t EMPTY_CHILD = 0xffffffff;
+
+        struct alignas(16) Node
+        {
+            float low_x[WIDTH], low_y[WIDTH], low_z[WIDTH];
+            float high_x[WIDTH], high_y[WIDTH], high_z[WIDTH];
+
+            uint32_t child[WIDTH];
+            uint32_t packet_count[WIDTH];
+        };
+
+        // unused lanes have zero edges and are never hit
+        struct alignas(16) TrianglePacket
+        {
+            float a_x[WIDTH],   a_y[WIDTH],   a_z[WIDTH];
+            float b_a_x[WIDTH], b_a_y[WIDTH], b_a_z[WIDTH];
+            float c_a_x[WIDTH], c_a_y[WIDTH], c_a_z[WIDTH];
+
+            uint32_t prim_idx[WIDTH];
+        };
+
+        void initialize(
+            const BuildingMesh &mesh, const TriangleBVHNoEmbreeParams &params);
+
+        bool has_intersection(const Ray &r) const noexcept;
+
+        bool closest_intersection(
+            Ray r, GeometryIntersection *inct) const noexcept;
+
+        real surface_area() const noexcept
+        {
+            return prims_.surface_area();
+        }
+
+        const AABB &local_bound() const noexcept
+        {
+            return prims_.local_bound();
+        }
+
+        SurfacePoint sample(real *pdf, const Sample3 &sam) const noexcept
+        {
+            return prims_.sample(pdf, sam);
+        }
+
+        const MemoryUsage &memory_usage() const noexcept
+        {
+            return memory_usage_;
+        }
+
+    private:
+
+        uint32_t build_node(const BuildingNode *binary_node);
+
+        std::vector<Node> nodes_;
+        std::vector<TrianglePacket> packets_;
+
+        TrianglePrimitives prims_;
+
+        MemoryUsage memory_usage_;
+    };
+
+} // namespace tri_bvh_ws
+
+AGZ_TRACER_END
@@ -2,6 +2,7 @@
 #include <agz/tracer/core/entity.h>
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/utility/reflection.h>
+#include <agz/tracer/utility/stats.h>
 
 #include "./separable.h"
 
@@ -194,6 +195,8 @@ BSSRDFSamplePiResult SeparableBSSRDF::sample_pi(
         if(inct_ray.t_min >= inct_ray.t_max)
             break;
 
+        AGZ_STATS_ADD(BSSRDFProbeRay, 1);
+
         EntityIntersection new_inct;
         if(!po_.entity->closest_intersection(inct_ray, &new_inct))
             break;
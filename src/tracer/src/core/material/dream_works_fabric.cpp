@@ -1,6 +1,7 @@
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/utility/reflection.h>
+#include <agz/tracer/utility/stats.h>
 
 #include "./component/aggregate.h"
 #include "./component/component.h"
@@ -202,11 +203,13 @@ public:
     ShadingPoint shade(
         const EntityIntersection &inct, Arena &arena) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.dream_works_fabric", 1);
+
         const FCoord shading_coord = normal_mapper_->reorient(
             inct.uv, inct.user_coord);
 
-        const FSpectrum color = color_->sample_spectrum(inct.uv);
-        const real roughness = math::saturate(roughness_->sample_real(inct.uv));
+        const FSpectrum color = color_->sample_spectrum(inct);
+        const real roughness = math::saturate(roughness_->sample_real(inct));
 
         const auto bsdf = arena.create_nodestruct<AggregateBSDF<1>>(
             inct.geometry_coord, shading_coord, color);
@@ -4,6 +4,7 @@
 #include <agz/tracer/core/bssrdf.h>
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
 #include "./utility/fresnel_point.h"
@@ -179,6 +180,8 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.glass", 1);
+
         ShadingPoint ret;
 
         const real ior = ior_->sample_real(inct);
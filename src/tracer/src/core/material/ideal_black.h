@@ -2,6 +2,7 @@
 
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/material.h>
+#include <agz/tracer/utility/stats.h>
 
 AGZ_TRACER_BEGIN
 
@@ -53,6 +54,8 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena&) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.ideal_black", 1);
+
         ShadingPoint shd;
         shd.bsdf = IDEAL_BLACK_BSDF_INSTANCE();
         shd.shading_normal = inct.user_coord.z;
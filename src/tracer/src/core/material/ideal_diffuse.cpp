@@ -1,5 +1,6 @@
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
 #include "./component/aggregate.h"
@@ -24,6 +25,8 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.ideal_diffuse", 1);
+
         const FSpectrum albedo = albedo_->sample_spectrum(inct);
         FCoord shading_coord = normal_mapper_->reorient(inct.uv, inct.user_coord);
 
@@ -1,6 +1,7 @@
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/bssrdf.h>
 #include <agz/tracer/core/material.h>
+#include <agz/tracer/utility/stats.h>
 
 AGZ_TRACER_BEGIN
 
@@ -73,6 +74,8 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.invisible_surface", 1);
+
         ShadingPoint shd;
         shd.bsdf = arena.create<InvisibleSurfaceBSDF>(
                                 inct.geometry_coord.z);
@@ -1,6 +1,7 @@
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
 #include "./utility/fresnel_point.h"
@@ -97,9 +98,11 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
-        const FSpectrum rc  = rc_map_->sample_spectrum(inct.uv);
-        const FSpectrum ior = ior_   ->sample_spectrum(inct.uv);
-        const FSpectrum k   = k_     ->sample_spectrum(inct.uv);
+        AGZ_STATS_ADD_NAMED("material_shade.mirror", 1);
+
+        const FSpectrum rc  = rc_map_->sample_spectrum(inct);
+        const FSpectrum ior = ior_   ->sample_spectrum(inct);
+        const FSpectrum k   = k_     ->sample_spectrum(inct);
 
         const ConductorPoint *fresnel = arena.create_nodestruct<ConductorPoint>(
                                             ior, FSpectrum(1), k);
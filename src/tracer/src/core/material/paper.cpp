@@ -1,5 +1,6 @@
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/material.h>
+#include <agz/tracer/utility/stats.h>
 
 #include "./component/aggregate.h"
 #include "./utility/fresnel_point.h"
@@ -707,10 +708,12 @@ public:
     ShadingPoint shade(
         const EntityIntersection &inct, Arena &arena) const override
     {
+        AGZ_STATS_ADD_NAMED("material_shade.paper", 1);
+
         const Coord shading_coord = normal_mapper_->reorient(
             inct.uv, inct.user_coord);
 
-        const FSpectrum color = color_->sample_spectrum(inct.uv);
+        const FSpectrum color = color_->sample_spectrum(inct);
 
         if(inct.geometry_coord.in_positive_z_hemisphere(inct.wr))
         {
@@ -2,6 +2,7 @@
 #include <agz/tracer/core/material.h>
 #include <agz/tracer/core/texture2d.h>
 #include <agz/tracer/utility/reflection.h>
+#include <agz/tracer/utility/stats.h>
 
 #include "./component/aggregate.h"
 #include "./component/diffuse_comp.h"
@@ -32,9 +33,11 @@ public:
 
     ShadingPoint shade(const EntityIntersection &inct, Arena &arena) const override
     {
-        FSpectrum d = d_->sample_spectrum(inct.uv);
-        FSpectrum s = s_->sample_spectrum(inct.uv);
-        const real ns = ns_->sample_real(inct.uv);
+        AGZ_STATS_ADD_NAMED("material_shade.phong", 1);
+
+        FSpectrum d = d_->sample_spectrum(inct);
+        FSpectrum s = s_->sample_spectrum(inct);
+        const real ns = ns_->sample_real(inct);
 
         // ensure energy conservation
 
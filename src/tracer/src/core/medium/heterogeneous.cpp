@@ -1,6 +1,10 @@
+#include <vector>
+
 #include <agz/tracer/core/medium.h>
 #include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/create/medium.h>
 #include <agz/tracer/utility/phase_function.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 #include <agz-utils/texture.h>
 
@@ -8,6 +12,10 @@ AGZ_TRACER_BEGIN
 
 class HeterogeneousMedium : public Medium
 {
+    // majorant of each grid cell covers MAJORANT_BRICK_SIZE^3 density texels
+    static constexpr int MAJORANT_BRICK_SIZE    = 8;
+    static constexpr int MAX_MAJORANT_GRID_SIZE = 64;
+
     FTransform3 local_to_world_;
 
     RC<const Texture3D> density_;
@@ -20,6 +28,261 @@ class HeterogeneousMedium : public Medium
     int max_scattering_count_;
     bool white_for_indiect_;
 
+    TransmittanceEstimatorParams tr_params_;
+
+    // coarse grid of local max densities in unit space
+
+    Vec3i majorant_grid_res_;
+    FVec3 fmajorant_grid_res_;
+    std::vector<real> majorant_grid_;
+
+    void build_majorant_grid()
+    {
+        auto res = [](int texels)
+        {
+            return math::clamp(
+                (texels + MAJORANT_BRICK_SIZE - 1) / MAJORANT_BRICK_SIZE,
+                1, MAX_MAJORANT_GRID_SIZE);
+        };
+
+        majorant_grid_res_ = {
+            res(density_->width()),
+            res(density_->height()),
+            res(density_->depth())
+        };
+        fmajorant_grid_res_ = {
+            static_cast<real>(majorant_grid_res_.x),
+            static_cast<real>(majorant_grid_res_.y),
+            static_cast<real>(majorant_grid_res_.z)
+        };
+
+        majorant_grid_.resize(
+            size_t(majorant_grid_res_.x) *
+            majorant_grid_res_.y * majorant_grid_res_.z);
+
+        for(int z = 0, i = 0; z < majorant_grid_res_.z; ++z)
+        {
+            for(int y = 0; y < majorant_grid_res_.y; ++y)
+            {
+                for(int x = 0; x < majorant_grid_res_.x; ++x, ++i)
+                {
+                    const FVec3 low = {
+                        x / fmajorant_grid_res_.x,
+                        y / fmajorant_grid_res_.y,
+                        z / fmajorant_grid_res_.z
+                    };
+                    const FVec3 high = {
+                        (x + 1) / fmajorant_grid_res_.x,
+                        (y + 1) / fmajorant_grid_res_.y,
+                        (z + 1) / fmajorant_grid_res_.z
+                    };
+                    majorant_grid_[i] = density_->max_real_in(low, high);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief split unit-space segment unit_a + t * unit_dir, t in [0, t_max]
+     *  into pieces with constant majorants using 3d-dda
+     *
+     * func(t_beg, t_end, majorant) returns false to stop the traversal.
+     * pieces outside the unit cube use the global majorant
+     */
+    template<typename Func>
+    void for_each_majorant_segment(
+        const FVec3 &unit_a, const FVec3 &unit_dir, real t_max,
+        Func &&func) const
+    {
+        // clip the segment with the unit cube
+
+        real t_in = 0, t_out = t_max;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            if(unit_dir[axis] == 0)
+            {
+                if(unit_a[axis] < 0 || unit_a[axis] > 1)
+                {
+                    t_in = t_max;
+                    t_out = t_max;
+                }
+                continue;
+            }
+
+            const real inv_dir = 1 / unit_dir[axis];
+            real t0 = -unit_a[axis] * inv_dir;
+            real t1 = (1 - unit_a[axis]) * inv_dir;
+            if(t0 > t1)
+                std::swap(t0, t1);
+            t_in  = (std::max)(t_in, t0);
+            t_out = (std::min)(t_out, t1);
+        }
+
+        if(t_in >= t_out)
+        {
+            func(real(0), t_max, max_density_);
+            return;
+        }
+
+        if(t_in > 0 && !func(real(0), t_in, max_density_))
+            return;
+
+        // traverse grid cells
+
+        FVec3 grid_a, grid_dir;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            grid_a[axis]   = unit_a[axis]   * fmajorant_grid_res_[axis];
+            grid_dir[axis] = unit_dir[axis] * fmajorant_grid_res_[axis];
+        }
+        const FVec3 entry = grid_a + t_in * grid_dir;
+
+        Vec3i cell, step;
+        FVec3 t_next, t_delta;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            cell[axis] = math::clamp(
+                static_cast<int>(entry[axis]), 0,
+                majorant_grid_res_[axis] - 1);
+
+            if(grid_dir[axis] > 0)
+            {
+                step[axis]    = 1;
+                t_next[axis]  = (cell[axis] + 1 - grid_a[axis]) / grid_dir[axis];
+                t_delta[axis] = 1 / grid_dir[axis];
+            }
+            else if(grid_dir[axis] < 0)
+            {
+                step[axis]    = -1;
+                t_next[axis]  = (cell[axis] - grid_a[axis]) / grid_dir[axis];
+                t_delta[axis] = -1 / grid_dir[axis];
+            }
+            else
+            {
+                step[axis]    = 0;
+                t_next[axis]  = REAL_INF;
+                t_delta[axis] = REAL_INF;
+            }
+        }
+
+        real t = t_in;
+        for(;;)
+        {
+            int axis = 0;
+            if(t_next.y < t_next[axis]) axis = 1;
+            if(t_next.z < t_next[axis]) axis = 2;
+
+            const real t_end = (std::min)(t_next[axis], t_out);
+            const int cell_idx = (cell.z * majorant_grid_res_.y + cell.y)
+                               * majorant_grid_res_.x + cell.x;
+            if(t_end > t && !func(t, t_end, majorant_grid_[cell_idx]))
+                return;
+
+            t = t_end;
+            if(t >= t_out)
+                break;
+
+            cell[axis] += step[axis];
+            if(cell[axis] < 0 || cell[axis] >= majorant_grid_res_[axis])
+                break;
+            t_next[axis] += t_delta[axis];
+        }
+
+        if(t_out < t_max)
+            func(t_out, t_max, max_density_);
+    }
+
+    /**
+     * @brief estimate exp(-integral of sigma) from a to b
+     *
+     * sigma(unit_pos) must be bounded by the local density majorant
+     */
+    template<typename Sigma>
+    FSpectrum estimate_tr(
+        const FVec3 &a, const FVec3 &b, Sampler &sampler,
+        Sigma &&sigma) const noexcept
+    {
+        const real t_max = distance(a, b);
+        if(t_max <= 0)
+            return FSpectrum(1);
+
+        const FVec3 unit_a = local_to_world_.apply_inverse_to_point(a);
+        const FVec3 unit_dir =
+            (local_to_world_.apply_inverse_to_point(b) - unit_a) / t_max;
+
+        const bool residual =
+            tr_params_.type == TransmittanceEstimator::ResidualRatio;
+
+        FSpectrum result(1);
+
+        // returns false when result is terminated
+        auto apply_rr = [&]
+        {
+            real max_comp = 0;
+            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+                max_comp = (std::max)(max_comp, result[i]);
+
+            if(max_comp <= 0)
+                return false;
+
+            if(max_comp >= tr_params_.rr_threshold)
+                return true;
+
+            const real survive_prob = max_comp / tr_params_.rr_threshold;
+            if(sampler.sample1().u >= survive_prob)
+            {
+                result = FSpectrum(0);
+                return false;
+            }
+
+            result /= survive_prob;
+            return true;
+        };
+
+        for_each_majorant_segment(unit_a, unit_dir, t_max,
+            [&](real t_beg, real t_end, real majorant)
+        {
+            if(majorant <= 0)
+                return true;
+
+            // ratio tracking is residual ratio tracking with zero control
+
+            const real control = residual ?
+                tr_params_.control_density_ratio * majorant : real(0);
+            const real residual_majorant =
+                (std::max)(control, majorant - control);
+
+            if(control > 0)
+                result *= std::exp(-control * (t_end - t_beg));
+
+            if(residual_majorant > 0)
+            {
+                const real inv_residual_majorant = 1 / residual_majorant;
+                real t = t_beg;
+
+                for(;;)
+                {
+                    t += -std::log(1 - sampler.sample1().u)
+                       * inv_residual_majorant;
+                    if(t >= t_end)
+                        break;
+                    AGZ_STATS_ADD(HeterogeneousMediumStep, 1);
+
+                    const FSpectrum s = sigma(unit_a + t * unit_dir);
+                    result *= FSpectrum(1) - (s - FSpectrum(control))
+                                           * inv_residual_majorant;
+
+                    if(!apply_rr())
+                        return false;
+                }
+            }
+
+            return apply_rr();
+        });
+
+        return result;
+    }
+
 public:
 
     HeterogeneousMedium(
@@ -28,7 +291,8 @@ public:
         RC<const Texture3D> albedo,
         RC<const Texture3D> g,
         int max_scattering_count,
-        bool white_for_indirect)
+        bool white_for_indirect,
+        const TransmittanceEstimatorParams &tr_params)
     {
         local_to_world_ = local_to_world;
 
@@ -42,6 +306,12 @@ public:
 
         max_scattering_count_ = max_scattering_count;
         white_for_indiect_ = white_for_indirect;
+
+        tr_params_ = tr_params;
+        tr_params_.control_density_ratio = math::saturate(
+            tr_params_.control_density_ratio);
+
+        build_majorant_grid();
     }
 
     int get_max_scattering_count() const noexcept override
@@ -52,32 +322,22 @@ public:
     FSpectrum tr(
         const FVec3 &a, const FVec3 &b, Sampler &sampler) const noexcept override
     {
-        real result = 1;
-        real t = 0;
-        const real t_max = distance(a, b);
-
-        for(;;)
+        return estimate_tr(a, b, sampler, [&](const FVec3 &unit_pos)
         {
-            const real delta_t = -std::log(1 - sampler.sample1().u)
-                               * inv_max_density_;
-            t += delta_t;
-            if(t >= t_max)
-                break;
-
-            const FVec3 pos = lerp(a, b, t / t_max);
-            const FVec3 unit_pos = local_to_world_.apply_inverse_to_point(pos);
-            const real density = density_->sample_real(unit_pos);
-            result *= 1 - density / max_density_;
-        }
-
-        return FSpectrum(result);
+            return FSpectrum(density_->sample_real(unit_pos));
+        });
     }
 
     FSpectrum ab(
         const FVec3 &a, const FVec3 &b, Sampler &sampler) const noexcept override
     {
-        // FIXME
-        return tr(a, b, sampler);
+        // sigma_a = density * (1 - albedo) is bounded by density
+        return estimate_tr(a, b, sampler, [&](const FVec3 &unit_pos)
+        {
+            const real density = density_->sample_real(unit_pos);
+            const FSpectrum albedo = albedo_->sample_spectrum(unit_pos);
+            return density * (FSpectrum(1) - albedo);
+        });
     }
 
     SampleOutScatteringResult sample_scattering(
@@ -86,37 +346,61 @@ public:
         bool indirect_scattering) const noexcept override
     {
         const real t_max = distance(a, b);
-        real t = 0;
+        if(t_max <= 0)
+            return SampleOutScatteringResult({}, FSpectrum(1), nullptr);
 
-        for(;;)
+        const FVec3 unit_a = local_to_world_.apply_inverse_to_point(a);
+        const FVec3 unit_dir =
+            (local_to_world_.apply_inverse_to_point(b) - unit_a) / t_max;
+
+        real scattering_t = -1;
+
+        for_each_majorant_segment(unit_a, unit_dir, t_max,
+            [&](real t_beg, real t_end, real majorant)
         {
-            const real delta_t = -std::log(1 - sampler.sample1().u)
-                               * inv_max_density_;
-            t += delta_t;
-            if(t >= t_max)
-                break;
+            if(majorant <= 0)
+                return true;
 
-            const FVec3 pos = lerp(a, b, t / t_max);
-            const FVec3 unit_pos = local_to_world_.apply_inverse_to_point(pos);
-            const real density = density_->sample_real(unit_pos);
-            if(sampler.sample1().u < density / max_density_)
+            const real inv_majorant = 1 / majorant;
+            real t = t_beg;
+
+            for(;;)
             {
-                const FSpectrum albedo =
-                    white_for_indiect_ && indirect_scattering ?
-                    FSpectrum(1) : albedo_->sample_spectrum(unit_pos);
-                const real     g      = g_->sample_real(unit_pos);
+                t += -std::log(1 - sampler.sample1().u) * inv_majorant;
+                if(t >= t_end)
+                    return true;
+                AGZ_STATS_ADD(HeterogeneousMediumStep, 1);
 
-                MediumScattering scattering;
-                scattering.pos    = pos;
-                scattering.medium = this;
-                scattering.wr     = (a - b) / t_max;
+                const FVec3 unit_pos = unit_a + t * unit_dir;
+                const real density = density_->sample_real(unit_pos);
+                if(sampler.sample1().u < density * inv_majorant)
+                {
+                    scattering_t = t;
+                    return false;
+                }
+            }
+        });
 
-                auto phase_function =
-                    arena.create<HenyeyGreensteinPhaseFunction>(g, albedo);
+        if(scattering_t >= 0)
+        {
+            const FVec3 pos = lerp(a, b, scattering_t / t_max);
+            const FVec3 unit_pos = unit_a + scattering_t * unit_dir;
 
-                return SampleOutScatteringResult(
-                    scattering, albedo, phase_function);
-            }
+            const FSpectrum albedo =
+                white_for_indiect_ && indirect_scattering ?
+                FSpectrum(1) : albedo_->sample_spectrum(unit_pos);
+            const real     g      = g_->sample_real(unit_pos);
+
+            MediumScattering scattering;
+            scattering.pos    = pos;
+            scattering.medium = this;
+            scattering.wr     = (a - b) / t_max;
+
+            auto phase_function =
+                arena.create<HenyeyGreensteinPhaseFunction>(g, albedo);
+
+            return SampleOutScatteringResult(
+                scattering, albedo, phase_function);
         }
 
         return SampleOutScatteringResult({}, FSpectrum(1), nullptr);
@@ -129,12 +413,13 @@ RC<Medium> create_heterogeneous_medium(
     RC<const Texture3D> albedo,
     RC<const Texture3D> g,
     int max_scattering_count,
-    bool white_for_indirect)
+    bool white_for_indirect,
+    const TransmittanceEstimatorParams &tr_params)
 {
     return newRC<HeterogeneousMedium>(
         local_to_world, std::move(density),
         std::move(albedo), std::move(g),
-        max_scattering_count, white_for_indirect);
+        max_scattering_count, white_for_indirect, tr_params);
 }
 
 AGZ_TRACER_END
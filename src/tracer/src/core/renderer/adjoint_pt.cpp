@@ -15,6 +15,8 @@
 #include <agz/tracer/render/particle_tracing.h>
 #include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/perthread_samplers.h>
+#include <agz/tracer/utility/progressive_preview.h>
+#include <agz/tracer/utility/task_scheduler.h>
 #include <agz-utils/thread.h>
 
 AGZ_TRACER_BEGIN
@@ -86,7 +88,6 @@ private:
 
     using ForwardGrid  = FilmFilterApplier::FilmGrid<
                             Spectrum, real, Spectrum, Vec3, real>;
-    using BackwardGrid = FilmFilterApplier::FilmGridView<Spectrum>;
 
     Pixel trace_camera_ray(const Scene &scene, const Ray &r, Arena &arena) const
     {
@@ -132,6 +133,28 @@ private:
         ImageBufferTemplate<true, true, true, true, true> image_buffer(
             filter.width(), filter.height());
 
+        Box<ProgressivePreview> preview;
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview = newBox<ProgressivePreview>(
+                filter.width(), filter.height(),
+                [&](const Rect2i &pixels, Image2D<Spectrum> &output)
+            {
+                for(int y = pixels.low.y; y <= pixels.high.y; ++y)
+                {
+                    for(int x = pixels.low.x; x <= pixels.high.x; ++x)
+                    {
+                        const real w = image_buffer.weight(y, x);
+                        output(y, x) = (w > 0 ? 1 / w : real(1))
+                                     * image_buffer.value(y, x)
+                                     + backward(y, x);
+                    }
+                }
+            }, std::chrono::milliseconds(200), params_.forward_task_grid_size);
+        }
+
+        auto get_img = [&] { return preview->get_image(); };
+
         parallel_for_2d_grid(
             thread_count, filter.width(), filter.height(),
             params_.forward_task_grid_size, params_.forward_task_grid_size,
@@ -181,20 +204,16 @@ private:
 
             if constexpr(REPORTER_WITH_PREVIEW)
             {
-                std::lock_guard lk(reporter_mutex);
-                film_grid.merge_into(
-                    image_buffer.value, image_buffer.weight,
-                    image_buffer.albedo, image_buffer.normal,
-                    image_buffer.denoise);
-
-                auto get_img = [&]()
+                preview->write(film_grid.pixel_range(), [&]
                 {
-                    auto ratio = image_buffer.weight.map([](real w)
-                    {
-                        return w > 0 ? 1 / w : real(1);
-                    });
-                    return image_buffer.value * ratio + backward;
-                };
+                    film_grid.merge_into(
+                        image_buffer.value, image_buffer.weight,
+                        image_buffer.albedo, image_buffer.normal,
+                        image_buffer.denoise);
+                });
+                preview->try_refresh();
+
+                std::lock_guard lk(reporter_mutex);
 
                 finished_pixel_count += (rect.high - rect.low).product();
                 const real percent = real(100) * finished_pixel_count
@@ -219,6 +238,12 @@ private:
             return true;
         });
 
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview->refresh();
+            reporter.progress(100, get_img);
+        }
+
         auto ratio = image_buffer.weight.map([](float w)
         {
             return w > 0 ? 1 / w : real(1);
@@ -246,15 +271,30 @@ private:
 
         std::atomic<uint64_t> total_particle_count = 0;
 
-        Box<std::mutex[]> output_img_mutex;
-        std::vector<Image2D<Spectrum>> output_img;
+        SplatFilm film(filter, worker_count);
+
+        // particles are splatted all over the film, so every tile is
+        // resolved in each refresh
 
-        auto backward_func =
-            [&](Sampler *sampler, Image2D<Spectrum> *image, int i)
+        Box<ProgressivePreview> preview;
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview = newBox<ProgressivePreview>(
+                filter.width(), filter.height(),
+                [&](const Rect2i &pixels, Image2D<Spectrum> &output)
+            {
+                const uint64_t pc = total_particle_count;
+                const real ratio = filter.width() * filter.height()
+                                 * (pc ? real(1) / pc : real(0));
+                film.resolve(pixels, ratio, output);
+            });
+        }
+
+        auto get_img = [&] { return preview->get_image(); };
+
+        auto backward_func = [&](Sampler *sampler, int i)
         {
-            auto film_grid = filter.create_subgrid_view(
-                { { 0, 0 }, { filter.width() - 1, filter.height() - 1 } },
-                *image);
+            auto &film_buffer = film.thread_buffer(i);
 
             for(;;)
             {
@@ -271,94 +311,48 @@ private:
                 {
                     ++task_particle_count;
                     trace_vol_particle(
-                        particle_params_, scene, *sampler, film_grid, arena);
+                        particle_params_, scene, *sampler, film_buffer, arena);
                     arena.release();
 
                     if(stop_rendering_)
                         return;
                 }
 
+                total_particle_count += task_particle_count;
+
+                const real percent = real(100) * (task_id + 1)
+                                   / params_.particle_task_count;
+
                 if constexpr(REPORTER_WITH_PREVIEW)
                 {
-                    uint64_t pc;
+                    preview->mark_all_dirty();
+                    preview->try_refresh();
 
-                    {
-                        std::lock_guard lk(output_img_mutex[i]);
-                        output_img[i] = *image;
-                        total_particle_count += task_particle_count;
-                        pc = total_particle_count;
-                    }
-                    
-                    auto get_img = [
-                        worker_count, &output_img, &output_img_mutex,
-                        &filter, pc]()
-                    {
-                        Image2D<Spectrum> ret(filter.height(), filter.width());
-                        for(int j = 0; j < worker_count; ++j)
-                        {
-                            std::lock_guard lk(output_img_mutex[j]);
-                            ret = ret + output_img[j];
-                        }
-
-                        real ratio = filter.width() * filter.height()
-                                   * (pc ? real(1) / pc : real(0));
-                        return ratio * ret;
-                    };
-
-                    const real percent = real(100) * (task_id + 1)
-                                       / params_.particle_task_count;
                     std::lock_guard lk(reporter_mutex);
                     reporter.progress(percent, get_img);
                 }
                 else
                 {
-                    total_particle_count += task_particle_count;
-
-                    const real percent = real(100) * (task_id + 1)
-                                       / params_.particle_task_count;
                     std::lock_guard lk(reporter_mutex);
                     reporter.progress(percent, {});
                 }
             }
         };
 
-        std::vector<std::thread> threads;
-        std::vector<Image2D<Spectrum>> images;
-
-        threads.reserve(worker_count);
-        images.resize(worker_count, Image2D<Spectrum>(
-            filter.height(), filter.width()));
-
-        if constexpr(REPORTER_WITH_PREVIEW)
-        {
-            output_img_mutex = newBox<std::mutex[]>(worker_count);
-            output_img.resize(worker_count, Image2D<Spectrum>(
-                filter.height(), filter.width()));
-        }
-
         auto particle_sampler_prototype = newRC<NativeSampler>(42, false);
 
         PerThreadNativeSamplers perthread_sampler(
             worker_count, *particle_sampler_prototype);;
 
-        for(int i = 0; i < worker_count; ++i)
+        TaskScheduler::instance().run(worker_count, [&](int i)
         {
-            auto sampler = perthread_sampler.get_sampler(i);
-            threads.emplace_back(backward_func, sampler, &images[i], i);
-        }
-
-        for(auto &t : threads)
-            t.join();
+            backward_func(perthread_sampler.get_sampler(i), i);
+        });
 
         const real scale = filter.width() * filter.height()
                          / static_cast<real>(total_particle_count);
 
-        Image2D<Spectrum> ret(filter.height(), filter.width());
-        for(auto &img : images)
-            ret = ret + img;
-        ret = ret * scale;
-
-        return ret;
+        return film.get_image(scale);
     }
 
     AdjointPTRendererParams params_;
@@ -22,7 +22,8 @@ public:
 
     explicit AORenderer(const AORendererParams &params)
         : PerPixelRenderer(
-            params.worker_count, params.task_grid_size, params.spp)
+            params.worker_count, params.task_grid_size, params.spp,
+            params.sampler)
     {
         params_.background_color       = params.background_color;
         params_.low_color              = params.low_color;
@@ -34,11 +35,20 @@ public:
 protected:
 
     Pixel eval_pixel(
-        const Scene &scene, const Ray &ray,
+        const Scene &scene, const Ray &ray, const RayDifferential &,
         Sampler &sampler, Arena &arena) const override
     {
         return trace_ao(params_, scene, ray, sampler);
     }
+
+    void eval_pixels(
+        const Scene &scene, misc::span<const Ray> rays,
+        const RayDifferential *,
+        const PixelSampleIndex *sample_indices, Pixel *pixels,
+        Sampler &sampler, Arena &arena) const override
+    {
+        trace_ao_n(params_, scene, rays, sample_indices, pixels, sampler);
+    }
 };
 
 RC<Renderer> create_ao_renderer(const AORendererParams &params)
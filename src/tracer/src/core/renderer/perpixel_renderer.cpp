@@ -1,29 +1,145 @@
+#include <vector>
+
 #include <agz/tracer/core/camera.h>
 #include <agz/tracer/core/renderer_interactor.h>
 #include <agz/tracer/core/sampler.h>
 #include <agz/tracer/core/scene.h>
 #include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/perthread_samplers.h>
+#include <agz/tracer/utility/progressive_preview.h>
 #include <agz-utils/thread.h>
 
 #include "perpixel_renderer.h"
 
 AGZ_TRACER_BEGIN
 
+namespace
+{
+
+    // avoid huge relative error of nearly black pixels
+    constexpr real ADAPTIVE_LUM_EPS = real(1e-3);
+
+} // namespace anonymous
+
+PerPixelRenderer::PixelStatistics::PixelStatistics(int width, int height)
+    : lum_sum(height, width), lum_sqr_sum(height, width),
+      count(height, width), active(height, width)
+{
+    lum_sum.clear(0);
+    lum_sqr_sum.clear(0);
+    count.clear(0);
+    active.clear(1);
+}
+
+real PerPixelRenderer::PixelStatistics::relative_error(
+    int x, int y) const noexcept
+{
+    const int n = count(y, x);
+    if(n < 2)
+        return REAL_MAX;
+
+    const real mean = lum_sum(y, x) / n;
+    const real var = (std::max)(
+        real(0), (lum_sqr_sum(y, x) - mean * lum_sum(y, x)) / (n - 1));
+    return std::sqrt(var / n) / (mean + ADAPTIVE_LUM_EPS);
+}
+
+bool PerPixelRenderer::PixelStatistics::is_active(int x, int y) const noexcept
+{
+    x = math::clamp(x, 0, active.width() - 1);
+    y = math::clamp(y, 0, active.height() - 1);
+    return active(y, x) != 0;
+}
+
+bool PerPixelRenderer::PixelStatistics::any_active(
+    const Rect2i &pixels) const noexcept
+{
+    for(int y = pixels.low.y; y <= pixels.high.y; ++y)
+    {
+        for(int x = pixels.low.x; x <= pixels.high.x; ++x)
+        {
+            if(is_active(x, y))
+                return true;
+        }
+    }
+    return false;
+}
+
+void PerPixelRenderer::PixelStatistics::add(int x, int y, real lum) noexcept
+{
+    lum_sum(y, x)     += lum;
+    lum_sqr_sum(y, x) += lum * lum;
+    count(y, x)       += 1;
+}
+
 void PerPixelRenderer::render_grid(
     const Scene &scene, Sampler &sampler,
-    Grid &grid, const Vec2i &full_res, int spp) const
+    Grid &grid, const Vec2i &full_res,
+    int sample_index_beg, int spp, PixelStatistics *stats) const
 {
     Arena arena;
     const Camera *camera = scene.get_camera();
     auto sam_bound = grid.sample_pixels();
+    const Rect2i &pixel_range = grid.pixel_range();
+
+    // camera rays of the grid are evaluated in batches
+
+    const int max_batch_size = pixel_batch_size_;
+
+    std::vector<Ray>              batch_rays(max_batch_size);
+    std::vector<RayDifferential>  batch_diffs(max_batch_size);
+    std::vector<PixelSampleIndex> batch_sample_indices(max_batch_size);
+    std::vector<Vec2i>            batch_pixel_coords(max_batch_size);
+    std::vector<Vec2>             batch_film_pos(max_batch_size);
+    std::vector<FSpectrum>        batch_throughput(max_batch_size);
+    std::vector<Pixel>            batch_pixels(max_batch_size);
+    int batch_size = 0;
+
+    auto flush_batch = [&]
+    {
+        eval_pixels(
+            scene, misc::span<const Ray>(batch_rays.data(), batch_size),
+            batch_diffs.data(), batch_sample_indices.data(),
+            batch_pixels.data(), sampler, arena);
+
+        for(int i = 0; i < batch_size; ++i)
+        {
+            const Pixel &pixel = batch_pixels[i];
+            if(!pixel.value.is_finite())
+                continue;
+
+            const FSpectrum value = batch_throughput[i] * pixel.value;
+            grid.apply(
+                batch_film_pos[i].x, batch_film_pos[i].y,
+                value, 1, pixel.albedo, pixel.normal, pixel.denoise);
+
+            const Vec2i &coord = batch_pixel_coords[i];
+            if(stats && pixel_range.low.x <= coord.x && coord.x <= pixel_range.high.x
+                     && pixel_range.low.y <= coord.y && coord.y <= pixel_range.high.y)
+                stats->add(coord.x, coord.y, value.lum());
+        }
+
+        batch_size = 0;
+        arena.release();
+    };
+
+    // footprint of a sample shrinks as more samples are taken in a pixel
+    const real footprint = (std::max)(
+        real(0.125), 1 / std::sqrt(real((std::max)(spp, 1))));
+    const real diff_scale_x = footprint / full_res.x;
+    const real diff_scale_y = footprint / full_res.y;
 
     for(int py = sam_bound.low.y; py <= sam_bound.high.y; ++py)
     {
         for(int px = sam_bound.low.x; px <= sam_bound.high.x; ++px)
         {
+            if(stats && !stats->is_active(px, py))
+                continue;
+
             for(int i = 0; i < spp; ++i)
             {
+                sampler.start_pixel_sample({ { px, py }, sample_index_beg + i });
+
                 const Sample2 film_sam = sampler.sample2();
                 const real pixel_x = px + film_sam.u;
                 const real pixel_y = py + film_sam.v;
@@ -33,24 +149,40 @@ void PerPixelRenderer::render_grid(
                 auto cam_ray = camera->sample_we(
                     { film_x, film_y }, sampler.sample2());
 
-                const Ray ray(cam_ray.pos_on_cam, cam_ray.pos_to_out);
-                const render::Pixel pixel = eval_pixel(
-                    scene, ray, sampler, arena);
+                batch_rays[batch_size]           = Ray(cam_ray.pos_on_cam, cam_ray.pos_to_out);
+                batch_diffs[batch_size]          = cam_ray.differential.scaled(
+                                                       diff_scale_x, diff_scale_y);
+                batch_sample_indices[batch_size] = sampler.pixel_sample_index();
+                batch_pixel_coords[batch_size]   = { px, py };
+                batch_film_pos[batch_size]       = { pixel_x, pixel_y };
+                batch_throughput[batch_size]     = cam_ray.throughput;
 
-                if(pixel.value.is_finite())
+                if(++batch_size == max_batch_size)
                 {
-                    grid.apply(
-                        pixel_x, pixel_y, cam_ray.throughput * pixel.value, 1,
-                        pixel.albedo, pixel.normal, pixel.denoise);
-                }
-
-                arena.release();
+                    flush_batch();
 
-                if(stop_rendering_)
-                    return;
+                    if(stop_rendering_)
+                        return;
+                }
             }
         }
     }
+
+    if(batch_size)
+        flush_batch();
+}
+
+void PerPixelRenderer::eval_pixels(
+    const Scene &scene, misc::span<const Ray> rays,
+    const RayDifferential *diffs,
+    const PixelSampleIndex *sample_indices, Pixel *pixels,
+    Sampler &sampler, Arena &arena) const
+{
+    for(size_t i = 0; i < rays.size(); ++i)
+    {
+        sampler.start_pixel_sample(sample_indices[i]);
+        pixels[i] = eval_pixel(scene, rays[i], diffs[i], sampler, arena);
+    }
 }
 
 template<bool REPORTER_WITH_PREVIEW>
@@ -63,13 +195,31 @@ RenderTarget PerPixelRenderer::render_impl(
 
     ImageBuffer image_buffer(filter.width(), filter.height());
 
-    auto get_img = std::function<Image2D<Spectrum>()>([&]()
+    // preview tiles are aligned with tasks, so that each merged task
+    // only invalidates one tile
+
+    Box<ProgressivePreview> preview;
+    if constexpr(REPORTER_WITH_PREVIEW)
     {
-        auto ratio = image_buffer.weight.map([](real w)
+        preview = newBox<ProgressivePreview>(
+            filter.width(), filter.height(),
+            [&](const Rect2i &pixels, Image2D<Spectrum> &output)
         {
-            return w > 0 ? 1 / w : real(1);
-        });
-        return image_buffer.value * ratio;
+            for(int y = pixels.low.y; y <= pixels.high.y; ++y)
+            {
+                for(int x = pixels.low.x; x <= pixels.high.x; ++x)
+                {
+                    const real w = image_buffer.weight(y, x);
+                    output(y, x) = (w > 0 ? 1 / w : real(1))
+                                 * image_buffer.value(y, x);
+                }
+            }
+        }, std::chrono::milliseconds(200), task_grid_size_);
+    }
+
+    auto get_img = std::function<Image2D<Spectrum>()>([&]()
+    {
+        return preview->get_image();
     });
 
     // create per-thread samplers
@@ -77,7 +227,7 @@ RenderTarget PerPixelRenderer::render_impl(
     auto sampler_prototype = newRC<NativeSampler>(42, false);
 
     PerThreadNativeSamplers perthread_sampler(
-        thread_count, *sampler_prototype);
+        thread_count, *sampler_prototype, sampler_type_);
 
     std::mutex reporter_mutex;
 
@@ -86,18 +236,36 @@ RenderTarget PerPixelRenderer::render_impl(
 
     // rendering iteration
 
-    thread::thread_group_t thread_group(thread_count);
-
-    auto run_iter = [&](double prog_beg, double prog_end, int spp)
+    auto run_iter = [&](
+        double prog_beg, double prog_end, int sample_index_beg, int spp,
+        PixelStatistics *stats)
     {
         int finished_pixel_count = 0;
 
         parallel_for_2d_grid(
             thread_count, filter.width(), filter.height(),
-            task_grid_size_, task_grid_size_, thread_group,
+            task_grid_size_, task_grid_size_,
             [&] (int thread_index, const Rect2i &rect)
         {
-            auto sampler = perthread_sampler.get_sampler(thread_index);
+            const int total_pixel_count = filter.width() * filter.height();
+
+            // skip tasks whose samples are all converged
+
+            if(stats && !stats->any_active(sample_bound_of(
+                filter.radius(), { rect.low, rect.high - Vec2i(1) })))
+            {
+                std::lock_guard lk(reporter_mutex);
+
+                finished_pixel_count += (rect.high - rect.low).product();
+                const double percent = math::lerp(
+                    prog_beg, prog_end,
+                    double(finished_pixel_count) / total_pixel_count);
+                reporter.progress(percent, {});
+
+                return !stop_rendering_;
+            }
+
+            auto sampler = perthread_sampler.get_pixel_sampler(thread_index);
 
             auto grid = filter.create_subgrid<
                 Spectrum, real, Spectrum, Vec3, real>(
@@ -105,17 +273,21 @@ RenderTarget PerPixelRenderer::render_impl(
 
             render_grid(
                 scene, *sampler, grid,
-                { filter.width(), filter.height() }, spp);
-
-            const int total_pixel_count = filter.width() * filter.height();
+                { filter.width(), filter.height() },
+                sample_index_beg, spp, stats);
 
             if constexpr(REPORTER_WITH_PREVIEW)
             {
+                preview->write(grid.pixel_range(), [&]
+                {
+                    grid.merge_into(
+                        image_buffer.value, image_buffer.weight,
+                        image_buffer.albedo, image_buffer.normal,
+                        image_buffer.denoise);
+                });
+                preview->try_refresh();
+
                 std::lock_guard lk(reporter_mutex);
-                grid.merge_into(
-                    image_buffer.value, image_buffer.weight,
-                    image_buffer.albedo, image_buffer.normal,
-                    image_buffer.denoise);
 
                 finished_pixel_count += (rect.high - rect.low).product();
                 const double percent = math::lerp(
@@ -143,14 +315,67 @@ RenderTarget PerPixelRenderer::render_impl(
 
             return !stop_rendering_;
         });
+
+        if constexpr(REPORTER_WITH_PREVIEW)
+        {
+            preview->refresh();
+            reporter.progress(prog_end, get_img);
+        }
     };
 
     // start rendering
 
-    if(reporter.need_image_preview())
+    if(max_spp_ > 0)
+    {
+        // every pixel receives spp_ samples first. after that, pixels whose
+        // relative error is above target_error_ are sampled in rounds until
+        // max_spp_ is reached, and converged pixels are skipped
+
+        PixelStatistics stats(filter.width(), filter.height());
+
+        const int max_spp   = (std::max)(max_spp_, spp_);
+        const int round_spp = (std::max)(1, spp_ / 2);
+
+        run_iter(0, 100.0 * spp_ / max_spp, 0, spp_, &stats);
+
+        int finished_spp = spp_;
+        while(finished_spp < max_spp && !stop_rendering_)
+        {
+            // a pixel never becomes active again, so all active pixels
+            // have finished_spp samples
+
+            bool any_active = false;
+            for(int y = 0; y < filter.height(); ++y)
+            {
+                for(int x = 0; x < filter.width(); ++x)
+                {
+                    auto &active = stats.active(y, x);
+                    if(active && stats.relative_error(x, y) <= target_error_)
+                        active = 0;
+                    any_active |= active != 0;
+                }
+            }
+
+            if(!any_active)
+                break;
+
+            const int new_finished_spp = (std::min)(
+                max_spp, finished_spp + round_spp);
+
+            const double prog_beg = 100.0 * finished_spp / max_spp;
+            const double prog_end = 100.0 * new_finished_spp / max_spp;
+
+            run_iter(
+                prog_beg, prog_end, finished_spp,
+                new_finished_spp - finished_spp, &stats);
+
+            finished_spp = new_finished_spp;
+        }
+    }
+    else if(reporter.need_image_preview())
     {
         const double first_iter_prog_end = 100.0 / spp_;
-        run_iter(0, first_iter_prog_end, 1);
+        run_iter(0, first_iter_prog_end, 0, 1, nullptr);
 
         const int per_iter_spp = (std::max)(6, spp_ / 20);
         int finished_spp = 1;
@@ -166,13 +391,13 @@ RenderTarget PerPixelRenderer::render_impl(
             const double prog_beg = 100.0 * finished_spp / spp_;
             const double prog_end = 100.0 * new_finished_spp / spp_;
 
-            run_iter(prog_beg, prog_end, delta_spp);
+            run_iter(prog_beg, prog_end, finished_spp, delta_spp, nullptr);
 
             finished_spp = new_finished_spp;
         }
     }
     else
-        run_iter(0, 100, spp_);
+        run_iter(0, 100, 0, spp_, nullptr);
 
     reporter.end_stage();
     reporter.end();
@@ -192,12 +417,26 @@ RenderTarget PerPixelRenderer::render_impl(
 }
 
 PerPixelRenderer::PerPixelRenderer(
-    int worker_count, int task_grid_size, int spp)
-    : worker_count_(worker_count), task_grid_size_(task_grid_size), spp_(spp)
+    int worker_count, int task_grid_size, int spp,
+    PixelSamplerType sampler_type)
+    : worker_count_(worker_count), task_grid_size_(task_grid_size), spp_(spp),
+      sampler_type_(sampler_type), target_error_(0), max_spp_(0),
+      pixel_batch_size_(PIXEL_BATCH_SIZE)
 {
     
 }
 
+void PerPixelRenderer::set_pixel_batch_size(int batch_size) noexcept
+{
+    pixel_batch_size_ = (std::max)(1, batch_size);
+}
+
+void PerPixelRenderer::set_adaptive_sampling(real target_error, int max_spp)
+{
+    target_error_ = target_error;
+    max_spp_      = max_spp;
+}
+
 RenderTarget PerPixelRenderer::render(
     FilmFilterApplier filter, Scene &scene, RendererInteractor &reporter)
 {
@@ -2,6 +2,7 @@
 
 #include <agz/tracer/core/renderer.h>
 #include <agz/tracer/core/render_target.h>
+#include <agz/tracer/core/sampler.h>
 #include <agz/tracer/render/path_tracing.h>
 
 AGZ_TRACER_BEGIN
@@ -14,9 +15,35 @@ class PerPixelRenderer : public Renderer
     using Grid = FilmFilterApplier::FilmGrid<
         Spectrum, real, Spectrum, Vec3, real>;
 
+    // luminance statistics of each pixel for adaptive sampling.
+    // statistics of a pixel are only written by the task owning the pixel
+    struct PixelStatistics
+    {
+        Image2D<real>          lum_sum;
+        Image2D<real>          lum_sqr_sum;
+        Image2D<int>           count;
+        Image2D<unsigned char> active;
+
+        PixelStatistics(int width, int height);
+
+        // standard error of mean luminance relative to the mean
+        real relative_error(int x, int y) const noexcept;
+
+        // samples of pixels out of the image follow the nearest pixel
+        bool is_active(int x, int y) const noexcept;
+
+        bool any_active(const Rect2i &pixels) const noexcept;
+
+        void add(int x, int y, real lum) noexcept;
+    };
+
+    // sample indices of each pixel are [sample_index_beg, sample_index_beg + spp).
+    // when stats is not nullptr, only active pixels are sampled and
+    // statistics of grid.pixel_range() are updated
     void render_grid(
         const Scene &scene, Sampler &sampler,
-        Grid &grid, const Vec2i &full_res, int spp) const;
+        Grid &grid, const Vec2i &full_res,
+        int sample_index_beg, int spp, PixelStatistics *stats) const;
 
     template<bool REPORTER_WITH_PREVIEW>
     RenderTarget render_impl(
@@ -27,17 +54,50 @@ class PerPixelRenderer : public Renderer
 
     int spp_;
 
+    PixelSamplerType sampler_type_;
+
+    // adaptive sampling is disabled when max_spp_ <= 0
+    real target_error_;
+    int max_spp_;
+
+    int pixel_batch_size_;
+
 protected:
 
     using Pixel = render::Pixel;
 
+    // default max number of camera rays passed to eval_pixels at once
+    static constexpr int PIXEL_BATCH_SIZE = 64;
+
+    void set_pixel_batch_size(int batch_size) noexcept;
+
+    // diff is the ray differential for the footprint of one sample
     virtual Pixel eval_pixel(
-        const Scene &scene, const Ray &ray,
+        const Scene &scene, const Ray &ray, const RayDifferential &diff,
         Sampler &sampler, Arena &arena) const = 0;
 
+    // evaluate a batch of coherent camera rays from the same grid.
+    // sample_indices[i] is the sampler state right after generating rays[i].
+    // calls eval_pixel on each ray by default
+    virtual void eval_pixels(
+        const Scene &scene, misc::span<const Ray> rays,
+        const RayDifferential *diffs,
+        const PixelSampleIndex *sample_indices, Pixel *pixels,
+        Sampler &sampler, Arena &arena) const;
+
 public:
 
-    PerPixelRenderer(int worker_count, int task_grid_size, int spp);
+    PerPixelRenderer(
+        int worker_count, int task_grid_size, int spp,
+        PixelSamplerType sampler_type = PixelSamplerType::Native);
+
+    /**
+     * @brief enable adaptive sampling
+     *
+     * after spp samples, pixels whose relative error is still above
+     * target_error receive more samples until max_spp is reached
+     */
+    void set_adaptive_sampling(real target_error, int max_spp);
 
     RenderTarget render(
         FilmFilterApplier filter, Scene &scene,
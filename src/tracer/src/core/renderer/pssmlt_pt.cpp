@@ -10,43 +10,13 @@
 
 AGZ_TRACER_BEGIN
 
-namespace
-{
-    struct AtomicSpectrum
-    {
-        std::atomic<real> channels[SPECTRUM_COMPONENT_COUNT] = { 0 };
-
-        AtomicSpectrum() = default;
-
-        AtomicSpectrum(const AtomicSpectrum &s) noexcept
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                channels[i] = s.channels[i].load();
-        }
-
-        void add(const FSpectrum &rhs) noexcept
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                math::atomic_add(channels[i], rhs[i]);
-        }
-
-        Spectrum to_spectrum() const noexcept
-        {
-            Spectrum ret;
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                ret[i] = channels[i].load();
-            return ret;
-        }
-    };
-}
-
 class PSSMLTPTRenderer : public Renderer
 {
     PSSMLTPTRendererParams params_;
 
     render::Pixel (*trace_func_)(
         const render::TraceParams&, const Scene&,
-        const Ray&, Sampler&, Arena&);
+        const Ray&, Sampler&, Arena&, const RayDifferential&);
 
     render::TraceParams trace_params_;
 
@@ -77,7 +47,7 @@ FSpectrum PSSMLTPTRenderer::eval_path(
     const Ray ray(cam_sam.pos_on_cam, cam_sam.pos_to_out);
 
     const FSpectrum radiance = trace_func_(
-        trace_params_, scene, ray, sampler, arena).value;
+        trace_params_, scene, ray, sampler, arena, {}).value;
 
     return cam_sam.throughput * radiance;
 }
@@ -173,14 +143,7 @@ RenderTarget PSSMLTPTRenderer::render(
 
     // film
 
-    Image2D<AtomicSpectrum> film(filter.height(), filter.width());
-
-    const Rect2i pixel_range = {
-        { 0, 0 },
-        { filter.width() - 1, filter.height() - 1 }
-    };
-
-    const real filter_radius = filter.radius();
+    SplatFilm film(filter, thread_count);
 
     // perthread native samplers
 
@@ -193,6 +156,7 @@ RenderTarget PSSMLTPTRenderer::render(
     auto run_markov_chain = [&](int thread_index, uint64_t mut_count)
     {
         Arena &local_arena = perthread_arenas[thread_index];
+        auto &film_buffer = film.thread_buffer(thread_index);
 
         // sample startup seed
 
@@ -258,13 +222,9 @@ RenderTarget PSSMLTPTRenderer::render(
 
                 if(proposed_add.is_finite())
                 {
-                    apply_image_filter(
-                        pixel_range, filter_radius, proposed_pixel_coord,
-                        [&](int px, int py, real x_rel, real y_rel)
-                    {
-                        const real w = filter.eval_filter(x_rel, y_rel);
-                        film(py, px).add(w * proposed_add);
-                    });
+                    film_buffer.splat(
+                        proposed_pixel_coord.x, proposed_pixel_coord.y,
+                        proposed_add);
                 }
             }
 
@@ -273,13 +233,8 @@ RenderTarget PSSMLTPTRenderer::render(
 
             if(current_add.is_finite())
             {
-                apply_image_filter(
-                    pixel_range, filter_radius, current_pixel_coord,
-                    [&](int px, int py, real x_rel, real y_rel)
-                {
-                    const real w = filter.eval_filter(x_rel, y_rel);
-                    film(py, px).add(w * current_add);
-                });
+                film_buffer.splat(
+                    current_pixel_coord.x, current_pixel_coord.y, current_add);
             }
 
             // accept/reject
@@ -316,8 +271,6 @@ RenderTarget PSSMLTPTRenderer::render(
         const int chain_report_interval = math::clamp(
             params_.chain_count / 32, thread_count, 1000);
 
-        thread::thread_group_t thread_group;
-
         uint64_t finished_mut_cnt = 0;
 
         for(int chain_idx = 0; chain_idx < params_.chain_count;
@@ -330,7 +283,7 @@ RenderTarget PSSMLTPTRenderer::render(
                                              params_.chain_count);
             const int chain_cnt = chain_end - chain_idx;
 
-            parallel_for_1d_grid(thread_count, chain_cnt, 1, thread_group,
+            parallel_for_1d_grid(thread_count, chain_cnt, 1,
                 [&](int thread_index, int beg, int end)
             {
                 assert(beg + 1 == end);
@@ -365,10 +318,7 @@ RenderTarget PSSMLTPTRenderer::render(
                 const real scale = b / params_.mut_per_pixel
                                  * total_mut_cnt / finished_mut_cnt;
 
-                return film.map([scale](const AtomicSpectrum &s)
-                {
-                    return scale * s.to_spectrum();
-                });
+                return film.get_image(scale);
             };
             
             const real percent = real(100) * finished_mut_cnt
@@ -418,10 +368,7 @@ RenderTarget PSSMLTPTRenderer::render(
     const real scale = b / params_.mut_per_pixel;
 
     RenderTarget ret;
-    ret.image = film.map([scale](const AtomicSpectrum &s)
-    {
-        return scale * s.to_spectrum();
-    });
+    ret.image = film.get_image(scale);
 
     return ret;
 }
@@ -11,14 +11,14 @@ class PathTracingRenderer : public PerPixelRenderer
 
     render::Pixel(*eval_func_)(
         const render::TraceParams &, const Scene &,
-        const Ray &, Sampler &, Arena &);
+        const Ray &, Sampler &, Arena &, const RayDifferential &);
 
 public:
 
     explicit PathTracingRenderer(const PTRendererParams &params)
         : PerPixelRenderer(
             params.worker_count,
-            params.task_grid_size, params.spp)
+            params.task_grid_size, params.spp, params.sampler)
     {
         params_.min_depth = params.min_depth;
         params_.max_depth = params.max_depth;
@@ -29,15 +29,22 @@ public:
             eval_func_ = &render::trace_std;
         else
             eval_func_ = &render::trace_nomis;
+
+        if(params.adaptive)
+        {
+            const int max_spp = params.max_spp > 0 ?
+                                params.max_spp : 4 * params.spp;
+            set_adaptive_sampling(params.target_error, max_spp);
+        }
     }
 
 protected:
 
     Pixel eval_pixel(
-        const Scene &scene, const Ray &ray,
+        const Scene &scene, const Ray &ray, const RayDifferential &diff,
         Sampler &sampler, Arena &arena) const override
     {
-        return eval_func_(params_, scene, ray, sampler, arena);
+        return eval_func_(params_, scene, ray, sampler, arena, diff);
     }
 };
 
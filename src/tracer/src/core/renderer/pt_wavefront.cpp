@@ -0,0 +1,654 @@
+#include <algorithm>
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+#include <agz/tracer/core/bsdf.h>
+#include <agz/tracer/core/bssrdf.h>
+#include <agz/tracer/core/entity.h>
+#include <agz/tracer/core/light.h>
+#include <agz/tracer/core/material.h>
+#include <agz/tracer/core/medium.h>
+#include <agz/tracer/core/scene.h>
+#include <agz/tracer/create/renderer.h>
+#include <agz/tracer/render/direct_illum.h>
+
+#include "./perpixel_renderer.h"
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    // soa states of paths being traced. path i belongs to camera ray i
+    struct PathStates
+    {
+        std::vector<Ray>              ray;
+        std::vector<RayDifferential>  diff; // of camera rays
+        std::vector<FSpectrum>        coef;
+        std::vector<PixelSampleIndex> sample_index;
+
+        std::vector<int> depth;
+        std::vector<int> s_depth;
+        std::vector<int> scattering_count;
+
+        // previous vertex, used for mis weights of emission found by
+        // bsdf sampling. prev_nor is zero for medium vertex
+        std::vector<FVec3>         prev_pos;
+        std::vector<FVec3>         prev_nor;
+        std::vector<real>          prev_bsdf_pdf;
+        std::vector<unsigned char> prev_is_delta;
+
+        // false when emission found by next ray has been accounted
+        std::vector<unsigned char> count_emission;
+
+        void resize(size_t size)
+        {
+            ray             .resize(size);
+            diff            .resize(size);
+            coef            .resize(size);
+            sample_index    .resize(size);
+            depth           .resize(size);
+            s_depth         .resize(size);
+            scattering_count.resize(size);
+            prev_pos        .resize(size);
+            prev_nor        .resize(size);
+            prev_bsdf_pdf   .resize(size);
+            prev_is_delta   .resize(size);
+            count_emission  .resize(size);
+        }
+    };
+
+    enum class VertexType : unsigned char
+    {
+        None,   // path is terminated
+        Surface,
+        Medium
+    };
+
+    // soa buffers of one wave. entry j belongs to path active[j]
+    struct WaveBuffers
+    {
+        std::vector<int> active;
+
+        std::vector<Ray>                rays;
+        std::vector<EntityIntersection> incts;
+        std::unique_ptr<bool[]>         has_inct;
+
+        std::vector<int>         shade_order;
+        std::vector<ShadingPoint> shds;
+
+        std::vector<VertexType>       vertex_type;
+        std::vector<MediumScattering> scatterings;
+        std::vector<const BSDF*>      phase_functions;
+
+        std::vector<Ray>       shadow_rays;
+        std::vector<FSpectrum> shadow_contribs;
+        std::vector<int>       shadow_paths;
+        std::unique_ptr<bool[]> shadow_occluded;
+
+        size_t flag_capacity = 0;
+
+        // prepare for a batch of size paths. buffers never shrink, so they
+        // are allocated only when a larger batch is seen
+        void reset(size_t size)
+        {
+            if(size > flag_capacity)
+            {
+                has_inct       .reset(new bool[size]);
+                shadow_occluded.reset(new bool[size]);
+                flag_capacity = size;
+            }
+
+            active.clear();
+            active.reserve(size);
+            rays.resize(size);
+            incts.resize(size);
+            shade_order.reserve(size);
+            shds.resize(size);
+            vertex_type.resize(size);
+            scatterings.resize(size);
+            phase_functions.resize(size);
+            shadow_rays.reserve(size);
+            shadow_contribs.reserve(size);
+            shadow_paths.reserve(size);
+        }
+    };
+
+    // buffers of a rendering thread, reused by all batches it evaluates
+    struct ThreadBuffers
+    {
+        PathStates  paths;
+        WaveBuffers wave;
+        Arena       wave_arena; // released after each wave
+    };
+
+    real mis_weight(real bsdf_pdf, real light_pdf) noexcept
+    {
+        return bsdf_pdf / (bsdf_pdf + light_pdf);
+    }
+
+} // namespace anonymous
+
+/**
+ * @brief path tracer processing camera rays of a batch as waves
+ *
+ * each wave runs the following stages on all active paths:
+ *  1. find closest intersections as a ray stream
+ *  2. shade intersections sorted by material type
+ *  3. sample medium scattering, accumulate emission and apply RR strategy
+ *  4. sample one light per vertex and generate shadow rays
+ *  5. trace shadow rays as a stream
+ *  6. sample bsdf to generate rays of next wave
+ *
+ * emission found by bsdf sampling is weighted with the balance heuristic
+ * used by render::trace_std, so that the results are statistically equal
+ */
+class PathTracingWavefrontRenderer : public PerPixelRenderer
+{
+    render::TraceParams params_;
+
+    // add emission of paths whose rays hit a light source or escape
+    void accumulate_emission(
+        const Scene &scene, PathStates &paths, WaveBuffers &wave,
+        int j, Pixel &pixel) const
+    {
+        const int i = wave.active[j];
+        if(!paths.count_emission[i])
+            return;
+
+        const Ray &r = wave.rays[j];
+
+        if(!wave.has_inct[j])
+        {
+            const EnvirLight *light = scene.envir_light();
+            if(!light)
+                return;
+
+            const FSpectrum radiance = light->radiance(r.o, r.d);
+            if(!radiance)
+                return;
+
+            real weight = 1;
+            if(!paths.prev_is_delta[i])
+            {
+                const real light_pdf = light->pdf(r.o, r.d) * scene.light_pdf(
+                    paths.prev_pos[i], paths.prev_nor[i], light);
+                weight = mis_weight(paths.prev_bsdf_pdf[i], light_pdf);
+            }
+
+            pixel.value += weight * paths.coef[i] * radiance;
+            return;
+        }
+
+        const EntityIntersection &inct = wave.incts[j];
+        const AreaLight *light = inct.entity->as_light();
+        if(!light)
+            return;
+
+        const FSpectrum radiance = light->radiance(
+            inct.pos, inct.geometry_coord.z, inct.uv, inct.wr);
+        if(!radiance)
+            return;
+
+        real weight = 1;
+        if(!paths.prev_is_delta[i])
+        {
+            const real light_pdf = light->pdf(
+                r.o, inct.pos, inct.geometry_coord.z) * scene.light_pdf(
+                    paths.prev_pos[i], paths.prev_nor[i], light);
+            weight = mis_weight(paths.prev_bsdf_pdf[i], light_pdf);
+        }
+
+        pixel.value += weight * paths.coef[i] * radiance;
+    }
+
+    // stage 3. returns false when the path is terminated
+    bool sample_medium_and_emission(
+        const Scene &scene, PathStates &paths, WaveBuffers &wave, int j,
+        Pixel &pixel, Sampler &sampler, Arena &arena) const
+    {
+        const int i = wave.active[j];
+        const Ray &r = wave.rays[j];
+
+        if(!wave.has_inct[j])
+        {
+            accumulate_emission(scene, paths, wave, j, pixel);
+            return false;
+        }
+
+        const EntityIntersection &inct = wave.incts[j];
+        const Medium *medium = inct.wr_medium();
+
+        // rays beyond max depth only collect emission for the previous vertex
+
+        if(paths.depth[i] > params_.max_depth)
+        {
+            paths.coef[i] *= medium->tr(r.o, inct.pos, sampler);
+            accumulate_emission(scene, paths, wave, j, pixel);
+            return false;
+        }
+
+        int &scattering_count = paths.scattering_count[i];
+        if(scattering_count < medium->get_max_scattering_count())
+        {
+            const auto medium_sample = medium->sample_scattering(
+                r.o, inct.pos, sampler, arena, scattering_count > 0);
+            paths.coef[i] *= medium_sample.throughput;
+
+            if(medium_sample.is_scattering_happened())
+            {
+                ++scattering_count;
+                wave.vertex_type[j]     = VertexType::Medium;
+                wave.scatterings[j]     = medium_sample.scattering_point;
+                wave.phase_functions[j] = medium_sample.phase_function;
+            }
+        }
+        else
+            paths.coef[i] *= medium->ab(r.o, inct.pos, sampler);
+
+        if(wave.vertex_type[j] == VertexType::Surface)
+        {
+            scattering_count = 0;
+            accumulate_emission(scene, paths, wave, j, pixel);
+        }
+
+        // apply RR strategy
+
+        if(paths.depth[i] > params_.min_depth)
+        {
+            if(sampler.sample1().u > params_.cont_prob)
+                return false;
+            paths.coef[i] /= params_.cont_prob;
+        }
+
+        return true;
+    }
+
+    // stage 4
+    void sample_light(
+        const Scene &scene, PathStates &paths, WaveBuffers &wave, int j,
+        Sampler &sampler) const
+    {
+        const int i = wave.active[j];
+
+        const bool is_surface = wave.vertex_type[j] == VertexType::Surface;
+        const FVec3 pos = is_surface ? wave.incts[j].pos : wave.scatterings[j].pos;
+        const FVec3 nor = is_surface ? wave.incts[j].geometry_coord.z : FVec3(0);
+
+        const auto [light, select_light_pdf] = scene.sample_light(
+            pos, nor, sampler.sample1());
+        if(!light)
+            return;
+
+        // there is no medium when envir light is visible
+        if(!is_surface && !light->is_area())
+            return;
+
+        const auto light_sample = light->sample(pos, sampler.sample5());
+        if(!light_sample.radiance || !light_sample.pdf)
+            return;
+
+        const FVec3 to_light = light_sample.pos - pos;
+        const real dist = to_light.length();
+        const real shadow_ray_len = dist - EPS();
+        if(shadow_ray_len <= EPS())
+            return;
+        const FVec3 dir = to_light / dist;
+
+        FSpectrum f;
+        real bsdf_pdf;
+
+        if(is_surface)
+        {
+            const EntityIntersection &inct = wave.incts[j];
+            const BSDF *bsdf = wave.shds[j].bsdf;
+
+            const FSpectrum bsdf_f = bsdf->eval(dir, inct.wr, TransMode::Radiance);
+            if(!bsdf_f)
+                return;
+
+            f = bsdf_f * std::abs(cos(dir, inct.geometry_coord.z));
+            if(light->is_area())
+                f *= inct.medium(dir)->tr(light_sample.pos, pos, sampler);
+            bsdf_pdf = bsdf->pdf(dir, inct.wr);
+        }
+        else
+        {
+            const MediumScattering &scattering = wave.scatterings[j];
+            const BSDF *phase_function = wave.phase_functions[j];
+
+            f = phase_function->eval(dir, scattering.wr, TransMode::Radiance);
+            if(!f)
+                return;
+
+            f *= scattering.medium->tr(pos, light_sample.pos, sampler);
+            bsdf_pdf = phase_function->pdf(dir, scattering.wr);
+        }
+
+        const FSpectrum contrib = paths.coef[i] * f * light_sample.radiance
+                                / (select_light_pdf * light_sample.pdf + bsdf_pdf);
+        if(!contrib)
+            return;
+
+        wave.shadow_rays.emplace_back(pos, dir, EPS(), shadow_ray_len);
+        wave.shadow_contribs.push_back(contrib);
+        wave.shadow_paths.push_back(i);
+    }
+
+    // stage 6. returns false when the path is terminated
+    bool sample_bsdf(
+        const Scene &scene, PathStates &paths, WaveBuffers &wave, int j,
+        Pixel &pixel, Sampler &sampler, Arena &arena) const
+    {
+        const int i = wave.active[j];
+
+        if(wave.vertex_type[j] == VertexType::Medium)
+        {
+            const MediumScattering &scattering = wave.scatterings[j];
+
+            const auto bsdf_sample = wave.phase_functions[j]->sample(
+                scattering.wr, TransMode::Radiance, sampler.sample3());
+            if(!bsdf_sample.f || bsdf_sample.pdf < EPS())
+                return false;
+
+            paths.coef[i] *= bsdf_sample.f / bsdf_sample.pdf;
+            paths.ray[i] = Ray(scattering.pos, bsdf_sample.dir.normalize());
+
+            paths.prev_pos[i]       = scattering.pos;
+            paths.prev_nor[i]       = FVec3(0);
+            paths.prev_bsdf_pdf[i]  = bsdf_sample.pdf;
+            paths.prev_is_delta[i]  = bsdf_sample.is_delta;
+            paths.count_emission[i] = 1;
+
+            ++paths.depth[i];
+            return true;
+        }
+
+        const EntityIntersection &inct = wave.incts[j];
+        const ShadingPoint &shd = wave.shds[j];
+
+        const auto bsdf_sample = shd.bsdf->sample(
+            inct.wr, TransMode::Radiance, sampler.sample3());
+        if(!bsdf_sample.f || bsdf_sample.pdf < EPS())
+            return false;
+
+        const FVec3 dir = bsdf_sample.dir.normalize();
+        const real abscos = std::abs(cos(inct.geometry_coord.z, dir));
+        paths.coef[i] *= bsdf_sample.f * abscos / bsdf_sample.pdf;
+        paths.ray[i] = Ray(inct.eps_offset(dir), dir);
+
+        paths.prev_pos[i]       = inct.pos;
+        paths.prev_nor[i]       = inct.geometry_coord.z;
+        paths.prev_bsdf_pdf[i]  = bsdf_sample.pdf;
+        paths.prev_is_delta[i]  = bsdf_sample.is_delta;
+        paths.count_emission[i] = 1;
+
+        bool is_new_sample_delta = bsdf_sample.is_delta;
+
+        // bssrdf. the exit point is processed in place with the routines
+        // of render::trace_std, which account emission found by its
+        // own bsdf sample
+
+        const bool pos_in  = inct.geometry_coord.in_positive_z_hemisphere(dir);
+        const bool pos_out = inct.geometry_coord.in_positive_z_hemisphere(inct.wr);
+
+        if(shd.bssrdf && !pos_in && pos_out)
+        {
+            const auto bssrdf_sample = shd.bssrdf->sample_pi(
+                sampler.sample3(), arena);
+            if(!bssrdf_sample.coef)
+                return false;
+
+            paths.coef[i] *= bssrdf_sample.coef / bssrdf_sample.pdf;
+
+            const auto &new_inct = bssrdf_sample.inct;
+            const auto new_shd = new_inct.material->shade(new_inct, arena);
+
+            pixel.value += paths.coef[i] * mis_sample_one_light(
+                scene, new_inct, new_shd, sampler);
+
+            const auto new_bsdf_sample = new_shd.bsdf->sample(
+                new_inct.wr, TransMode::Radiance, sampler.sample3());
+            if(!new_bsdf_sample.f)
+                return false;
+
+            const FVec3 new_dir = new_bsdf_sample.dir.normalize();
+            const real new_abscos = std::abs(cos(
+                new_inct.geometry_coord.z, new_dir));
+            paths.coef[i] *= new_bsdf_sample.f * new_abscos / new_bsdf_sample.pdf;
+            paths.ray[i] = Ray(new_inct.eps_offset(new_dir), new_dir);
+
+            paths.count_emission[i] = 0;
+            is_new_sample_delta = new_bsdf_sample.is_delta;
+        }
+
+        int &depth = paths.depth[i], &s_depth = paths.s_depth[i];
+        if(is_new_sample_delta && depth >= 2 && s_depth <= params_.specular_depth)
+        {
+            --depth;
+            ++s_depth;
+        }
+        ++depth;
+
+        return true;
+    }
+
+    void trace_waves(
+        const Scene &scene, PathStates &paths, WaveBuffers &wave,
+        Pixel *pixels, Sampler &sampler, Arena &arena) const
+    {
+        // sampler states of different paths are switched between stages
+
+        auto begin_path = [&](int i)
+        {
+            sampler.start_pixel_sample(paths.sample_index[i]);
+        };
+
+        auto end_path = [&](int i)
+        {
+            paths.sample_index[i] = sampler.pixel_sample_index();
+        };
+
+        while(!wave.active.empty())
+        {
+            const int count = static_cast<int>(wave.active.size());
+
+            // 1. intersect
+
+            for(int j = 0; j < count; ++j)
+                wave.rays[j] = paths.ray[wave.active[j]];
+
+            scene.closest_intersection_n(
+                misc::span<const Ray>(wave.rays.data(), count),
+                wave.incts.data(), wave.has_inct.get());
+
+            for(int j = 0; j < count; ++j)
+            {
+                const int i = wave.active[j];
+                if(wave.has_inct[j] && paths.depth[i] == 1)
+                {
+                    wave.incts[j].compute_uv_differentials(
+                        paths.ray[i], paths.diff[i]);
+                }
+            }
+
+            // 2. shade, sorted by material type
+
+            wave.shade_order.clear();
+            for(int j = 0; j < count; ++j)
+            {
+                wave.vertex_type[j] = VertexType::None;
+                if(wave.has_inct[j])
+                    wave.shade_order.push_back(j);
+            }
+
+            std::sort(wave.shade_order.begin(), wave.shade_order.end(),
+                [&](int lhs, int rhs)
+            {
+                const Material *lm = wave.incts[lhs].material;
+                const Material *rm = wave.incts[rhs].material;
+                const std::type_index lt = typeid(*lm), rt = typeid(*rm);
+                if(lt != rt)
+                    return lt < rt;
+                return lm < rm;
+            });
+
+            for(int j : wave.shade_order)
+            {
+                const EntityIntersection &inct = wave.incts[j];
+                wave.shds[j] = inct.material->shade(inct, arena);
+                wave.vertex_type[j] = VertexType::Surface;
+
+                const int i = wave.active[j];
+                if(paths.depth[i] == 1)
+                {
+                    Pixel &pixel = pixels[i];
+                    pixel.normal = wave.shds[j].shading_normal;
+                    pixel.albedo = wave.shds[j].bsdf->albedo();
+                    if(inct.entity->get_no_denoise_flag())
+                        pixel.denoise = 0;
+                }
+            }
+
+            // 3. medium scattering, emission and RR
+
+            for(int j = 0; j < count; ++j)
+            {
+                const int i = wave.active[j];
+                begin_path(i);
+                if(!sample_medium_and_emission(
+                    scene, paths, wave, j, pixels[i], sampler, arena))
+                    wave.vertex_type[j] = VertexType::None;
+                end_path(i);
+            }
+
+            // 4. light sampling
+
+            wave.shadow_rays.clear();
+            wave.shadow_contribs.clear();
+            wave.shadow_paths.clear();
+
+            for(int j = 0; j < count; ++j)
+            {
+                if(wave.vertex_type[j] == VertexType::None)
+                    continue;
+                const int i = wave.active[j];
+                begin_path(i);
+                sample_light(scene, paths, wave, j, sampler);
+                end_path(i);
+            }
+
+            // 5. shadow rays
+
+            if(!wave.shadow_rays.empty())
+            {
+                scene.has_intersection_n(
+                    misc::span<const Ray>(
+                        wave.shadow_rays.data(), wave.shadow_rays.size()),
+                    wave.shadow_occluded.get());
+
+                for(size_t k = 0; k < wave.shadow_rays.size(); ++k)
+                {
+                    if(!wave.shadow_occluded[k])
+                        pixels[wave.shadow_paths[k]].value += wave.shadow_contribs[k];
+                }
+            }
+
+            // 6. bsdf sampling and compaction of active paths
+
+            int new_count = 0;
+            for(int j = 0; j < count; ++j)
+            {
+                if(wave.vertex_type[j] == VertexType::None)
+                    continue;
+
+                const int i = wave.active[j];
+                begin_path(i);
+                const bool alive = sample_bsdf(
+                    scene, paths, wave, j, pixels[i], sampler, arena);
+                end_path(i);
+
+                if(alive)
+                    wave.active[new_count++] = i;
+            }
+            wave.active.resize(new_count);
+
+            arena.release();
+        }
+    }
+
+public:
+
+    explicit PathTracingWavefrontRenderer(const PTWavefrontRendererParams &params)
+        : PerPixelRenderer(
+            params.worker_count,
+            params.task_grid_size, params.spp, params.sampler)
+    {
+        params_.min_depth      = params.min_depth;
+        params_.max_depth      = params.max_depth;
+        params_.cont_prob      = params.cont_prob;
+        params_.specular_depth = params.specular_depth;
+
+        set_pixel_batch_size(params.queue_size);
+    }
+
+protected:
+
+    Pixel eval_pixel(
+        const Scene &scene, const Ray &ray, const RayDifferential &diff,
+        Sampler &sampler, Arena &arena) const override
+    {
+        const PixelSampleIndex sample_index = sampler.pixel_sample_index();
+        Pixel pixel;
+        eval_pixels(
+            scene, misc::span<const Ray>(&ray, 1),
+            &diff, &sample_index, &pixel, sampler, arena);
+        return pixel;
+    }
+
+    void eval_pixels(
+        const Scene &scene, misc::span<const Ray> rays,
+        const RayDifferential *diffs,
+        const PixelSampleIndex *sample_indices, Pixel *pixels,
+        Sampler &sampler, Arena &arena) const override
+    {
+        const size_t count = rays.size();
+
+        // eval_pixels is called once per batch by each rendering thread.
+        // keeping the soa buffers alive across calls avoids allocating
+        // dozens of arrays for every batch
+        thread_local ThreadBuffers buffers;
+
+        PathStates  &paths = buffers.paths;
+        WaveBuffers &wave  = buffers.wave;
+        paths.resize(count);
+        wave.reset(count);
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            paths.ray[i]              = rays[i];
+            paths.diff[i]             = diffs[i];
+            paths.coef[i]             = FSpectrum(1);
+            paths.sample_index[i]     = sample_indices[i];
+            paths.depth[i]            = 1;
+            paths.s_depth[i]          = 1;
+            paths.scattering_count[i] = 0;
+            paths.prev_is_delta[i]    = 1; // emission seen by camera is not weighted
+            paths.count_emission[i]   = 1;
+
+            pixels[i] = Pixel();
+            wave.active.push_back(static_cast<int>(i));
+        }
+
+        trace_waves(scene, paths, wave, pixels, sampler, buffers.wave_arena);
+    }
+};
+
+RC<Renderer> create_pt_wavefront_renderer(
+    const PTWavefrontRendererParams &params)
+{
+    return newRC<PathTracingWavefrontRenderer>(params);
+}
+
+AGZ_TRACER_END
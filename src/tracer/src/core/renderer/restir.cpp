@@ -9,6 +9,7 @@
 #include <agz/tracer/core/render_target.h>
 #include <agz/tracer/core/sampler.h>
 #include <agz/tracer/core/scene.h>
+#include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/reservoir.h>
 #include <agz-utils/thread.h>
 
@@ -48,8 +49,6 @@ class ReSTIRRenderer : public Renderer
     using ImageBuffer     = Image2D<Pixel>;
     using ImageReservoirs = Image2D<Reservoir<ReservoirData>>;
 
-    using ThreadPool = thread::thread_group_t;
-
     void create_pixel_reservoir(
         const Vec2i     &pixel_coord,
         ImageBuffer     &image_buffer,
@@ -208,7 +207,6 @@ class ReSTIRRenderer : public Renderer
     }
 
     void create_frame_reservoirs(
-        ThreadPool         &threads,
         ImageBuffer        &image_buffer,
         ImageReservoirs    &image_reservoirs,
         const Scene        &scene,
@@ -231,9 +229,10 @@ class ReSTIRRenderer : public Renderer
             }
         };
 
-        parallel_forrange(
-            0, image_reservoirs.height(),
-            thread_func, threads, params_.worker_count);
+        parallel_for_1d_grid(
+            params_.worker_count,
+            image_reservoirs.height(), 1,
+            [&](int thread_idx, int y, int) { thread_func(thread_idx, y); });
     }
 
     void combine_neghbor_reservoirs(
@@ -342,7 +341,6 @@ class ReSTIRRenderer : public Renderer
 
     void reuse_spatial(
         const Scene       &scene,
-        ThreadPool        &threads,
         const ImageBuffer &image_buffer,
         ImageReservoirs   &input_reservoirs,
         ImageReservoirs   &output_reservoirs,
@@ -359,9 +357,10 @@ class ReSTIRRenderer : public Renderer
             }
         };
 
-        parallel_forrange(
-            0, input_reservoirs.height(),
-            thread_func, threads, params_.worker_count);
+        parallel_for_1d_grid(
+            params_.worker_count,
+            input_reservoirs.height(), 1,
+            [&](int thread_idx, int y, int) { thread_func(thread_idx, y); });
     }
 
     FSpectrum resolve_pixel(
@@ -433,8 +432,6 @@ public:
         reporter.begin();
         reporter.new_stage();
 
-        ThreadPool threads;
-
         auto get_img = [&]
         {
             return image_buffer.map([](const Pixel &p)
@@ -451,7 +448,7 @@ public:
                 a.release();
 
             create_frame_reservoirs(
-                threads, image_buffer, image_reservoirs_a, scene,
+                image_buffer, image_reservoirs_a, scene,
                 thread_samplers.data(), thread_bsdf_arenas.data());
 
             if(stop_rendering_)
@@ -463,7 +460,7 @@ public:
             for(int j = 0; j < params_.I; ++j)
             {
                 reuse_spatial(
-                    scene, threads, image_buffer,
+                    scene, image_buffer,
                     *src, *dst,
                     thread_samplers.data());
 
@@ -485,9 +482,12 @@ public:
                         break;
                 }
             };
-            parallel_forrange(
-                0, filter.height(),
-                resolve_thread_func, threads, params_.worker_count);
+            parallel_for_1d_grid(
+                params_.worker_count,
+                filter.height(), 1, [&](int thread_idx, int y, int)
+            {
+                resolve_thread_func(thread_idx, y);
+            });
 
             reporter.progress(100.0 * (i + 1) / params_.spp, get_img);
 
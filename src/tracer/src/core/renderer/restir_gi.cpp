@@ -11,6 +11,7 @@
 #include <agz/tracer/core/scene.h>
 #include <agz/tracer/render/direct_illum.h>
 #include <agz/tracer/render/path_tracing.h>
+#include <agz/tracer/utility/parallel_grid.h>
 #include <agz/tracer/utility/reservoir.h>
 #include <agz-utils/thread.h>
 
@@ -18,8 +19,6 @@ AGZ_TRACER_BEGIN
 
 class ReSTIRGIRenderer : public Renderer
 {
-    using ThreadPool = thread::thread_group_t;
-
     struct ReservoirData
     {
         Vec3        sample_point;
@@ -323,7 +322,6 @@ class ReSTIRGIRenderer : public Renderer
     void create_initial_samples(
         const Scene    &scene,
         Image2D<Pixel> &pixels,
-        ThreadPool     &threads,
         NativeSampler  *perthread_samplers,
         Arena          *perthread_arenas) const
     {
@@ -354,8 +352,10 @@ class ReSTIRGIRenderer : public Renderer
             }
         };
 
-        parallel_forrange(
-            0, pixels.height(), thread_func, threads, params_.worker_count);
+        parallel_for_1d_grid(
+            params_.worker_count,
+            pixels.height(), 1,
+            [&](int thread_idx, int y, int) { thread_func(thread_idx, y); });
     }
 
     template<bool ResolveReservoirA>
@@ -376,7 +376,7 @@ class ReSTIRGIRenderer : public Renderer
 
     template<bool ResolveReservoirA>
     void resolve_gi(
-        const Scene &scene, ThreadPool &threads, Image2D<Pixel> &pixels) const
+        const Scene &scene, Image2D<Pixel> &pixels) const
     {
         auto thread_func = [&](int thread_idx, int y)
         {
@@ -391,8 +391,10 @@ class ReSTIRGIRenderer : public Renderer
             }
         };
 
-        thread::parallel_forrange(
-            0, pixels.height(), thread_func, threads, params_.worker_count);
+        parallel_for_1d_grid(
+            params_.worker_count,
+            pixels.height(), 1,
+            [&](int thread_idx, int y, int) { thread_func(thread_idx, y); });
     }
 
     template<bool A2B>
@@ -501,7 +503,6 @@ class ReSTIRGIRenderer : public Renderer
     template<bool A2B>
     void reuse_spatial(
         const Scene    &scene,
-        ThreadPool     &threads,
         Image2D<Pixel> &pixels,
         NativeSampler  *thread_samplers) const
     {
@@ -518,8 +519,10 @@ class ReSTIRGIRenderer : public Renderer
             }
         };
 
-        parallel_forrange(
-            0, pixels.height(), thread_func, threads, params_.worker_count);
+        parallel_for_1d_grid(
+            params_.worker_count,
+            pixels.height(), 1,
+            [&](int thread_idx, int y, int) { thread_func(thread_idx, y); });
     }
 
     ReSTIRGIParams params_;
@@ -556,8 +559,6 @@ public:
         for(int i = 0; i < params_.worker_count; ++i)
             thread_samplers.push_back(NativeSampler(i, false));
 
-        ThreadPool threads;
-
         reporter.begin();
         reporter.new_stage();
 
@@ -577,7 +578,7 @@ public:
                 a.release();
 
             create_initial_samples(
-                scene, pixels, threads,
+                scene, pixels,
                 thread_samplers.data(), thread_arenas.data());
 
             for(int j = 0; j < params_.I; ++j)
@@ -585,12 +586,12 @@ public:
                 if((j & 1) == 0)
                 {
                     reuse_spatial<true>(
-                        scene, threads, pixels, thread_samplers.data());
+                        scene, pixels, thread_samplers.data());
                 }
                 else
                 {
                     reuse_spatial<false>(
-                        scene, threads, pixels, thread_samplers.data());
+                        scene, pixels, thread_samplers.data());
                 }
             }
 
@@ -598,9 +599,9 @@ public:
                 break;
 
             if((params_.I & 1) == 0)
-                resolve_gi<true>(scene, threads, pixels);
+                resolve_gi<true>(scene, pixels);
             else
-                resolve_gi<false>(scene, threads, pixels);
+                resolve_gi<false>(scene, pixels);
 
             reporter.progress(100.0 * (i + 1) / params_.spp, get_img);
 
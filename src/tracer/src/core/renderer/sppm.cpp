@@ -43,15 +43,12 @@ RenderTarget SPPMRenderer::render(
 
     // determine initial search radius
 
-    AABB world_bound = scene.world_bound();
+    const AABB world_bound = scene.world_bound();
 
     real init_radius = params_.init_radius;
     if(init_radius < 0)
         init_radius = (world_bound.high - world_bound.low).length() / 1000;
 
-    world_bound.low  -= FVec3(init_radius);
-    world_bound.high += FVec3(init_radius);
-
     // initialize pixels
 
     Image2D<Spectrum> albedo_buffer (filter.height(), filter.width());
@@ -75,6 +72,11 @@ RenderTarget SPPMRenderer::render(
 
     std::vector<Arena> perthread_vp_arena(thread_count);
 
+    // photon deposit buffers
+
+    std::vector<render::sppm::PhotonDepositBuffer>
+        perthread_deposits(thread_count);
+
     // how to compute the final image
 
     auto compute_image = [&](int iter_cnt, uint64_t photon_cnt)
@@ -95,9 +97,7 @@ RenderTarget SPPMRenderer::render(
 
     // run sppm iterations
 
-    real max_radius = init_radius;
-
-    thread::thread_group_t thread_group;
+    render::sppm::VisiblePointSearcher vp_searcher;
 
     for(int iter = 0; iter < params_.iteration_count; ++iter)
     {
@@ -115,10 +115,6 @@ RenderTarget SPPMRenderer::render(
 
         // clear visible points
 
-        const real grid_sidelen = real(1.05) * max_radius;
-        render::sppm::VisiblePointSearcher vp_searcher(
-            world_bound, grid_sidelen, 40960);
-
         for(auto &a : perthread_vp_arena)
             a.release();
 
@@ -129,7 +125,6 @@ RenderTarget SPPMRenderer::render(
         parallel_for_2d_grid(
             thread_count, filter.width(), filter.height(),
             params_.forward_task_grid_size, params_.forward_task_grid_size,
-            thread_group,
             [&](int thread_index, const Rect2i &grid)
         {
             auto camera    = scene.get_camera();
@@ -159,9 +154,6 @@ RenderTarget SPPMRenderer::render(
                         scene, ray, cam_sam.throughput,
                         vp_arena, *sampler, &gpixel, pixel.direct_illum);
 
-                    if(pixel.vp.is_valid())
-                        vp_searcher.add_vp(pixel, vp_arena);
-
                     albedo_buffer(y, x) += gpixel.albedo;
                     normal_buffer(y, x) += gpixel.normal;
                     denoise_buffer(y, x) += gpixel.denoise;
@@ -182,6 +174,12 @@ RenderTarget SPPMRenderer::render(
             return true;
         });
 
+        // build visible point grid
+
+        vp_searcher.build(
+            &sppm_pixels(0, 0), size_t(filter.width()) * filter.height(),
+            thread_count);
+
         reporter.progress(progress_mid, {});
 
         // trace photons
@@ -191,10 +189,10 @@ RenderTarget SPPMRenderer::render(
             thread_count,
             params_.photons_per_iteration,
             4096,
-            thread_group,
             [&](int thread_index, int beg, int end)
         {
-            auto sampler = perthread_sampler.get_sampler(thread_index);
+            auto sampler   = perthread_sampler.get_sampler(thread_index);
+            auto &deposits = perthread_deposits[thread_index];
             Arena local_arena;
             for(int i = beg; i < end; ++i)
             {
@@ -202,7 +200,7 @@ RenderTarget SPPMRenderer::render(
                     params_.photon_min_depth,
                     params_.photon_max_depth,
                     params_.photon_cont_prob,
-                    vp_searcher, scene, local_arena, *sampler);
+                    vp_searcher, deposits, scene, local_arena, *sampler);
 
                 if(local_arena.used_bytes() > 4 * 1024 * 1024)
                     local_arena.release();
@@ -222,28 +220,31 @@ RenderTarget SPPMRenderer::render(
             return true;
         });
 
-        // update pixel params
+        // reduce photon deposits of each thread
 
-        max_radius = 0;
-        for(int y = 0; y < filter.height(); ++y)
+        parallel_for_1d_grid(
+            thread_count, thread_count, 1,
+            [&](int thread_index, int beg, int end)
         {
-            for(int x = 0; x < filter.width(); ++x)
-            {
-                if(sppm_pixels(y, x).vp.is_valid())
-                {
-                    max_radius = (std::max)(max_radius,
-                                            sppm_pixels(y, x).radius);
-                }
-            }
-        }
+            for(int i = beg; i < end; ++i)
+                perthread_deposits[i].sort_and_reduce();
+        });
 
-        if(max_radius == 0)
-            max_radius = init_radius;
+        // update pixel params
 
         parallel_for_1d_grid(
-            thread_count, filter.height(), 128, thread_group,
+            thread_count, filter.height(), 128,
             [&](int thread_index, int beg, int end)
         {
+            // rows [beg, end) are owned by this task
+
+            const render::sppm::Pixel *pixel_beg = &sppm_pixels(beg, 0);
+            const render::sppm::Pixel *pixel_end =
+                &sppm_pixels(end - 1, filter.width() - 1) + 1;
+
+            for(auto &deposits : perthread_deposits)
+                deposits.apply(pixel_beg, pixel_end);
+
             for(int y = beg; y < end; ++y)
             {
                 for(int x = 0; x < filter.width(); ++x)
@@ -257,6 +258,9 @@ RenderTarget SPPMRenderer::render(
             }
         });
 
+        for(auto &deposits : perthread_deposits)
+            deposits.clear();
+
         // report progress
 
         if(reporter.need_image_preview())
@@ -11,40 +11,6 @@
 
 AGZ_TRACER_BEGIN
 
-namespace
-{
-    struct AtomicSpectrum
-    {
-        std::atomic<real> channels[SPECTRUM_COMPONENT_COUNT];
-
-        AtomicSpectrum() noexcept
-        {
-            for(auto &c : channels)
-                c = real(0);
-        }
-
-        AtomicSpectrum(const AtomicSpectrum &s) noexcept
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                channels[i] = s.channels[i].load();
-        }
-
-        void add(const FSpectrum &s) noexcept
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                math::atomic_add(channels[i], s[i]);
-        }
-
-        Spectrum to_spectrum() const noexcept
-        {
-            Spectrum ret;
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                ret[i] = channels[i];
-            return ret;
-        }
-    };
-}
-
 class VolBDPTRenderer : public Renderer
 {
 public:
@@ -59,8 +25,6 @@ private:
 
     using ImageBuffer = ImageBufferTemplate<true, true, true, true, true>;
 
-    using ParticleImage = Image2D<AtomicSpectrum>;
-
     using FilmGridView = FilmFilterApplier::FilmGridView<
         Spectrum, real, Spectrum, Vec3, real>;
 
@@ -68,13 +32,11 @@ private:
     {
         const Scene &scene;
         FilmGridView &film_grid_view;
-        ParticleImage &particle_image;
-        FilmFilterApplier filter;
+        SplatFilm::ThreadBuffer &particle_film;
 
         Vec2 full_res;
 
         Rect2 particle_sample_pixel_bound;
-        Rect2i particle_pixel_range;
 
         render::bdpt::Vertex *camera_subpath_space = nullptr;
         render::bdpt::Vertex *light_subpath_space  = nullptr;
@@ -89,7 +51,7 @@ private:
     template<bool USE_MIS>
     int render_grid(
         const Scene &scene, NativeSampler &sampler,
-        FilmGridView &film_grid_view, ParticleImage &particle_image,
+        FilmGridView &film_grid_view, SplatFilm::ThreadBuffer &particle_film,
         FilmFilterApplier filter, int spp);
 
     template<bool REPORT_WITH_PREVIEW, bool USE_MIS>
@@ -153,15 +115,7 @@ int VolBDPTRenderer::render_bdpt_path(
         select_light, [&](const Vec2 &particle_coord, const FSpectrum &rad)
     {
         if(rad.is_finite())
-        {
-            apply_image_filter(
-                params.particle_pixel_range, params.filter.radius(),
-                particle_coord, [&](int pix, int piy, real rel_x, real rel_y)
-            {
-                const real weight = params.filter.eval_filter(rel_x, rel_y);
-                params.particle_image(piy, pix).add(weight * rad);
-            });
-        }
+            params.particle_film.splat(particle_coord.x, particle_coord.y, rad);
     });
 
     if(radiance.is_finite())
@@ -180,7 +134,7 @@ int VolBDPTRenderer::render_bdpt_path(
 template<bool USE_MIS>
 int VolBDPTRenderer::render_grid(
     const Scene &scene, NativeSampler &sampler,
-    FilmGridView &film_grid_view, ParticleImage &particle_image,
+    FilmGridView &film_grid_view, SplatFilm::ThreadBuffer &particle_film,
     FilmFilterApplier filter, int spp)
 {
     if(scene.lights().empty())
@@ -194,19 +148,12 @@ int VolBDPTRenderer::render_grid(
         { real(filter.width() - 1), real(filter.height() - 1) }
     };
 
-    const Rect2i particle_pixel_range = {
-        { 0, 0 },
-        { filter.width() - 1, filter.height() - 1 }
-    };
-
     EvalPathParams eval_params = {
         scene,
         film_grid_view,
-        particle_image,
-        filter,
+        particle_film,
         { real(filter.width()), real(filter.height()) },
         particle_sample_pixel_bound,
-        particle_pixel_range,
         cam_subpath.data(),
         lht_subpath.data()
     };
@@ -245,14 +192,15 @@ RenderTarget VolBDPTRenderer::render_impl(
     // initialize image buffers
 
     ImageBuffer image_buffer(filter.width(), filter.height());
-    ParticleImage particle_image(filter.height(), filter.width());
-
     std::atomic<uint64_t> particle_count = 0;
 
-    // thread pool
+    // worker count
 
     const int thread_count = thread::actual_worker_count(params_.worker_count);
-    thread::thread_group_t threads(thread_count);
+
+    // particles are splatted into per-thread buffers of particle_film
+
+    SplatFilm particle_film(filter, thread_count);
 
     // per-thread samplers
 
@@ -288,12 +236,8 @@ RenderTarget VolBDPTRenderer::render_impl(
 
             const real bwd_ratio = filter.width() * filter.height() *
                 (particle_count > 0 ? real(1) / particle_count : real(0));
-            const auto bwd_img = particle_image.map([&](const AtomicSpectrum &as)
-            {
-                return bwd_ratio * as.to_spectrum();
-            });
 
-            return fwd_img + bwd_img;
+            return fwd_img + particle_film.get_image(bwd_ratio);
         };
 
         // render 1 spp for fast previewing
@@ -302,7 +246,7 @@ RenderTarget VolBDPTRenderer::render_impl(
             thread_count,
             filter.width(), filter.height(),
             params_.task_grid_size, params_.task_grid_size,
-            threads, [&](int thread_index, const Rect2i &grid)
+            [&](int thread_index, const Rect2i &grid)
         {
             auto view = filter.create_subgrid_view({
                 grid.low, grid.high - Vec2i(1)},
@@ -313,7 +257,8 @@ RenderTarget VolBDPTRenderer::render_impl(
 
             const int delta_pc = render_grid<USE_MIS>(
                 scene, *perthread_samplers[thread_index],
-                view, particle_image, filter, 1);
+                view, particle_film.thread_buffer(thread_index),
+                filter, 1);
 
             particle_count += delta_pc;
 
@@ -343,7 +288,7 @@ RenderTarget VolBDPTRenderer::render_impl(
                 thread_count,
                 filter.width(), filter.height(),
                 params_.task_grid_size, params_.task_grid_size,
-                threads, [&](int thread_index, const Rect2i &grid)
+                [&](int thread_index, const Rect2i &grid)
             {
                 auto view = filter.create_subgrid_view({
                     grid.low, grid.high - Vec2i(1) },
@@ -354,7 +299,8 @@ RenderTarget VolBDPTRenderer::render_impl(
 
                 const int delta_pc = render_grid<USE_MIS>(
                     scene, *perthread_samplers[thread_index],
-                    view, particle_image, filter, delta_spp);
+                    view, particle_film.thread_buffer(thread_index),
+                    filter, delta_spp);
 
                 particle_count += delta_pc;
 
@@ -383,7 +329,7 @@ RenderTarget VolBDPTRenderer::render_impl(
             thread_count,
             filter.width(), filter.height(),
             params_.task_grid_size, params_.task_grid_size,
-            threads, [&](int thread_index, const Rect2i &grid)
+            [&](int thread_index, const Rect2i &grid)
         {
             if(stop_rendering_)
                 return false;
@@ -397,7 +343,8 @@ RenderTarget VolBDPTRenderer::render_impl(
 
             const int delta_pc = render_grid<USE_MIS>(
                 scene, *perthread_samplers[thread_index],
-                view, particle_image, filter, params_.spp);
+                view, particle_film.thread_buffer(thread_index),
+                filter, params_.spp);
 
             particle_count += delta_pc;
 
@@ -437,11 +384,7 @@ RenderTarget VolBDPTRenderer::render_impl(
 
     const real bwd_ratio = filter.width() * filter.height() *
         (particle_count > 0 ? real(1) / particle_count : real(0));
-    render_target.image += particle_image.map(
-        [&](const AtomicSpectrum &as)
-    {
-        return bwd_ratio * as.to_spectrum();
-    });
+    render_target.image += particle_film.get_image(bwd_ratio);
 
     return render_target;
 }
@@ -0,0 +1,278 @@
+#include <algorithm>
+
+#include "./light_bvh.h"
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    real angle_between(const FVec3 &a, const FVec3 &b) noexcept
+    {
+        if(dot(a, b) < 0)
+            return PI_r - 2 * std::asin(math::saturate((a + b).length() / 2));
+        return 2 * std::asin(math::saturate((b - a).length() / 2));
+    }
+
+    // rotate v around unit axis k, where dot(k, v) == 0
+    FVec3 rotate_orthogonal(const FVec3 &v, const FVec3 &k, real theta) noexcept
+    {
+        return v * std::cos(theta) + cross(k, v) * std::sin(theta);
+    }
+
+} // namespace anonymous
+
+real LightBounds::importance(const FVec3 &pos, const FVec3 &nor) const noexcept
+{
+    if(phi <= 0)
+        return 0;
+
+    // bounding sphere of spatial bound
+
+    const FVec3 centre = real(0.5) * (bound.low + bound.high);
+    const real radius2 = (bound.high - centre).length_square();
+
+    const FVec3 centre_to_pos = pos - centre;
+    const real dist2 = centre_to_pos.length_square();
+
+    // clamp distance to avoid huge importance of nodes close to pos
+    const real clamped_dist2 = (std::max)(dist2, std::sqrt(radius2));
+
+    // angle subtended by the bounding sphere
+
+    if(dist2 <= radius2)
+        return phi / clamped_dist2;
+
+    const real theta_b = std::asin(std::sqrt(radius2 / dist2));
+    const FVec3 wi = centre_to_pos / std::sqrt(dist2);
+
+    // min angle between emitting directions and wi
+
+    const real theta_w = angle_between(axis, wi);
+    const real theta_p = (std::max)(real(0), theta_w - theta_o - theta_b);
+    if(theta_p >= theta_e)
+        return 0;
+
+    real ret = phi * std::cos(theta_p) / clamped_dist2;
+
+    // min angle between nor and directions to the bound
+
+    if(nor.length_square() > 0)
+    {
+        const real theta_i = angle_between(nor.normalize(), -wi);
+        const real theta_ip = (std::max)(real(0), (std::min)(
+            theta_i, PI_r - theta_i) - theta_b);
+        ret *= std::cos(theta_ip);
+    }
+
+    return (std::max)(ret, real(0));
+}
+
+LightBounds operator|(const LightBounds &lhs, const LightBounds &rhs) noexcept
+{
+    if(lhs.phi <= 0)
+        return rhs;
+    if(rhs.phi <= 0)
+        return lhs;
+
+    LightBounds ret;
+    ret.bound   = lhs.bound | rhs.bound;
+    ret.phi     = lhs.phi + rhs.phi;
+    ret.theta_e = (std::max)(lhs.theta_e, rhs.theta_e);
+
+    // union of two normal cones
+
+    const real theta_d = angle_between(lhs.axis, rhs.axis);
+
+    if((std::min)(theta_d + rhs.theta_o, PI_r) <= lhs.theta_o)
+    {
+        ret.axis    = lhs.axis;
+        ret.theta_o = lhs.theta_o;
+        return ret;
+    }
+
+    if((std::min)(theta_d + lhs.theta_o, PI_r) <= rhs.theta_o)
+    {
+        ret.axis    = rhs.axis;
+        ret.theta_o = rhs.theta_o;
+        return ret;
+    }
+
+    const real theta_o = (lhs.theta_o + theta_d + rhs.theta_o) / 2;
+    const FVec3 rot_axis = cross(lhs.axis, rhs.axis);
+    if(theta_o >= PI_r || rot_axis.length_square() <= 0)
+    {
+        ret.axis    = lhs.axis;
+        ret.theta_o = PI_r;
+        return ret;
+    }
+
+    ret.axis = rotate_orthogonal(
+        lhs.axis, rot_axis.normalize(), theta_o - lhs.theta_o).normalize();
+    ret.theta_o = theta_o;
+    return ret;
+}
+
+void LightBVH::build(std::vector<BuildingLight> lights)
+{
+    nodes_.clear();
+    light_to_path_.clear();
+
+    // lights with zero power are never sampled
+
+    lights.erase(std::remove_if(lights.begin(), lights.end(),
+        [](const BuildingLight &l) { return l.bounds.phi <= 0; }),
+        lights.end());
+
+    if(lights.empty())
+        return;
+
+    nodes_.reserve(2 * lights.size());
+    build_aux(lights.data(), static_cast<uint32_t>(lights.size()), 0, 0);
+}
+
+bool LightBVH::empty() const noexcept
+{
+    return nodes_.empty();
+}
+
+const Light *LightBVH::sample(
+    const FVec3 &pos, const FVec3 &nor, real u, real *pdf) const noexcept
+{
+    if(nodes_.empty())
+        return nullptr;
+
+    uint32_t node_idx = 0;
+    real ret_pdf = 1;
+
+    for(;;)
+    {
+        const Node &node = nodes_[node_idx];
+
+        if(node.light)
+        {
+            if(node_idx == 0 && node.bounds.importance(pos, nor) <= 0)
+                return nullptr;
+            *pdf = ret_pdf;
+            return node.light;
+        }
+
+        const uint32_t left = node_idx + 1;
+        const real left_imp  = nodes_[left].bounds.importance(pos, nor);
+        const real right_imp = nodes_[node.right].bounds.importance(pos, nor);
+        if(left_imp <= 0 && right_imp <= 0)
+            return nullptr;
+
+        const real left_prob = left_imp / (left_imp + right_imp);
+        if(u < left_prob)
+        {
+            u = (std::min)(u / left_prob, real(1) - EPS());
+            ret_pdf *= left_prob;
+            node_idx = left;
+        }
+        else
+        {
+            u = (std::min)((u - left_prob) / (1 - left_prob), real(1) - EPS());
+            ret_pdf *= 1 - left_prob;
+            node_idx = node.right;
+        }
+    }
+}
+
+real LightBVH::pdf(
+    const FVec3 &pos, const FVec3 &nor, const Light *light) const noexcept
+{
+    const auto it = light_to_path_.find(light);
+    if(it == light_to_path_.end())
+        return 0;
+
+    const uint32_t leaf = it->second.node;
+    uint64_t bits = it->second.bits;
+
+    if(leaf == 0)
+        return nodes_[0].bounds.importance(pos, nor) > 0 ? real(1) : real(0);
+
+    uint32_t node_idx = 0;
+    real ret = 1;
+
+    while(node_idx != leaf)
+    {
+        const Node &node = nodes_[node_idx];
+
+        const uint32_t left = node_idx + 1;
+        const real left_imp  = nodes_[left].bounds.importance(pos, nor);
+        const real right_imp = nodes_[node.right].bounds.importance(pos, nor);
+        if(left_imp <= 0 && right_imp <= 0)
+            return 0;
+
+        const real left_prob = left_imp / (left_imp + right_imp);
+        if(bits & 1)
+        {
+            ret *= 1 - left_prob;
+            node_idx = node.right;
+        }
+        else
+        {
+            ret *= left_prob;
+            node_idx = left;
+        }
+        bits >>= 1;
+    }
+
+    return ret;
+}
+
+uint32_t LightBVH::build_aux(
+    BuildingLight *lights, uint32_t count, uint64_t bits, int depth)
+{
+    assert(count);
+
+    const auto node_idx = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    if(count == 1)
+    {
+        nodes_[node_idx].bounds = lights[0].bounds;
+        nodes_[node_idx].light  = lights[0].light;
+        light_to_path_[lights[0].light] = { node_idx, bits };
+        return node_idx;
+    }
+
+    // split at the median of the widest centroid axis
+
+    AABB centroid_bound;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const AABB &b = lights[i].bounds.bound;
+        centroid_bound |= real(0.5) * (b.low + b.high);
+    }
+
+    int split_axis = 0;
+    const FVec3 extent = centroid_bound.high - centroid_bound.low;
+    if(extent.y > extent[split_axis]) split_axis = 1;
+    if(extent.z > extent[split_axis]) split_axis = 2;
+
+    const uint32_t split_idx = count / 2;
+    std::nth_element(
+        lights, lights + split_idx, lights + count,
+        [split_axis](const BuildingLight &lhs, const BuildingLight &rhs)
+    {
+        return lhs.bounds.bound.low[split_axis] + lhs.bounds.bound.high[split_axis] <
+               rhs.bounds.bound.low[split_axis] + rhs.bounds.bound.high[split_axis];
+    });
+
+    // median split keeps depth below 64, so the leaf path fits in bits
+
+    build_aux(lights, split_idx, bits, depth + 1);
+    const uint32_t right = build_aux(
+        lights + split_idx, count - split_idx,
+        bits | (uint64_t(1) << depth), depth + 1);
+
+    Node &node = nodes_[node_idx];
+    node.right  = right;
+    node.bounds = nodes_[node_idx + 1].bounds | nodes_[right].bounds;
+
+    return node_idx;
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <agz/tracer/core/light.h>
+
+AGZ_TRACER_BEGIN
+
+/**
+ * @brief bounds of light emission used for estimating light importance
+ *
+ * spatial bound, bounding cone (axis, theta_o) of normals, emitting angle
+ * theta_e around each normal and total power
+ */
+struct LightBounds
+{
+    AABB bound;
+    real phi = 0;
+
+    FVec3 axis = FVec3(0, 0, 1);
+    real theta_o = 0;
+    real theta_e = 0;
+
+    /**
+     * @brief estimated contribution to a point
+     *
+     * @param nor surface normal at pos. zero when pos is in medium
+     */
+    real importance(const FVec3 &pos, const FVec3 &nor) const noexcept;
+};
+
+LightBounds operator|(const LightBounds &lhs, const LightBounds &rhs) noexcept;
+
+/**
+ * @brief bvh of area lights for sampling a light according to its
+ *  estimated contribution to a shading point
+ *
+ * each leaf contains one light. at each interior node, a child is chosen
+ * with probability proportional to its importance
+ */
+class LightBVH
+{
+public:
+
+    struct BuildingLight
+    {
+        const Light *light = nullptr;
+        LightBounds bounds;
+    };
+
+    void build(std::vector<BuildingLight> lights);
+
+    bool empty() const noexcept;
+
+    /**
+     * @brief sample a light
+     *
+     * @return nullptr when no light can contribute to pos
+     */
+    const Light *sample(
+        const FVec3 &pos, const FVec3 &nor, real u, real *pdf) const noexcept;
+
+    /**
+     * @brief pdf of sample. zero when light is not in the bvh
+     */
+    real pdf(const FVec3 &pos, const FVec3 &nor, const Light *light) const noexcept;
+
+private:
+
+    // left child of an interior node is right after it
+    struct Node
+    {
+        LightBounds bounds;
+        const Light *light = nullptr; // nullptr for interior node
+        uint32_t right = 0;
+    };
+
+    // bits of leaf path: bit i is set when the right child is chosen at depth i
+    struct LeafPath
+    {
+        uint32_t node;
+        uint64_t bits;
+    };
+
+    uint32_t build_aux(
+        BuildingLight *lights, uint32_t count, uint64_t bits, int depth);
+
+    std::vector<Node> nodes_;
+
+    std::unordered_map<const Light*, LeafPath> light_to_path_;
+};
+
+AGZ_TRACER_END
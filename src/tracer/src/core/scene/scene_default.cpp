@@ -10,8 +10,11 @@
 #include <agz/tracer/core/scene.h>
 #include <agz/tracer/create/medium.h>
 #include <agz/tracer/create/scene.h>
+#include <agz/tracer/utility/stats.h>
 #include <agz-utils/misc.h>
 
+#include "./light_bvh.h"
+
 AGZ_TRACER_BEGIN
 
 class DefaultScene : public Scene
@@ -31,10 +34,18 @@ class DefaultScene : public Scene
     std::vector<real> light_pdf_table_;
     std::unordered_map<const Light*, real> light_ptr_to_pdf_;
 
+    // area lights for sampling with respect to shading points
+    LightBVH light_bvh_;
+
+    // probability of choosing envir light in sample_light(pos, nor, sam)
+    real envir_light_select_prob_ = 0;
+
     void construct_light_sampler()
     {
         light_selector_.destroy();
         light_pdf_table_.clear();
+        light_bvh_.build({});
+        envir_light_select_prob_ = 0;
 
         if(lights_.empty())
             return;
@@ -52,6 +63,32 @@ class DefaultScene : public Scene
         light_selector_.initialize(
             light_pdf_table_.data(), light_pdf_table_.size());
 
+        std::vector<LightBVH::BuildingLight> bvh_lights;
+        for(auto &ent : entities_)
+        {
+            const AreaLight *light = ent->as_light();
+            if(!light)
+                continue;
+
+            LightBVH::BuildingLight bvh_light;
+            bvh_light.light        = light;
+            bvh_light.bounds.bound = ent->world_bound();
+            bvh_light.bounds.phi   = light->power().lum();
+
+            real cos_theta_o, cos_theta_e;
+            light->emission_bound(
+                &bvh_light.bounds.axis, &cos_theta_o, &cos_theta_e);
+            bvh_light.bounds.theta_o = std::acos(math::clamp(cos_theta_o, real(-1), real(1)));
+            bvh_light.bounds.theta_e = std::acos(math::clamp(cos_theta_e, real(-1), real(1)));
+
+            bvh_lights.push_back(bvh_light);
+        }
+        light_bvh_.build(std::move(bvh_lights));
+
+        // envir light and the light bvh are chosen with equal probability
+        if(envir_light_)
+            envir_light_select_prob_ = light_bvh_.empty() ? real(1) : real(0.5);
+
         light_ptr_to_pdf_.clear();
         for(size_t i = 0; i < light_pdf_table_.size(); ++i)
         {
@@ -128,8 +165,34 @@ public:
         return it != light_ptr_to_pdf_.end() ? it->second : real(0);
     }
 
+    SceneSampleLightResult sample_light(
+        const FVec3 &pos, const FVec3 &nor,
+        const Sample1 &sam) const noexcept override
+    {
+        real u = sam.u;
+        if(u < envir_light_select_prob_)
+            return { envir_light_.get(), envir_light_select_prob_ };
+        u = (u - envir_light_select_prob_) / (1 - envir_light_select_prob_);
+
+        real pdf;
+        const Light *light = light_bvh_.sample(pos, nor, u, &pdf);
+        if(!light)
+            return { nullptr, 0 };
+        return { light, (1 - envir_light_select_prob_) * pdf };
+    }
+
+    real light_pdf(
+        const FVec3 &pos, const FVec3 &nor,
+        const Light *light) const noexcept override
+    {
+        if(!light->is_area())
+            return light == envir_light_.get() ? envir_light_select_prob_ : real(0);
+        return (1 - envir_light_select_prob_) * light_bvh_.pdf(pos, nor, light);
+    }
+
     bool has_intersection(const Ray &r) const noexcept override
     {
+        AGZ_STATS_ADD(ShadowRay, 1);
         return aggregate_->has_intersection(r);
     }
 
@@ -143,9 +206,25 @@ public:
     bool closest_intersection(
         const Ray &r, EntityIntersection *inct) const noexcept override
     {
+        AGZ_STATS_ADD(ClosestRay, 1);
         return aggregate_->closest_intersection(r, inct);
     }
 
+    void has_intersection_n(
+        misc::span<const Ray> rays, bool *results) const noexcept override
+    {
+        AGZ_STATS_ADD(ShadowRay, rays.size());
+        aggregate_->has_intersection_n(rays, results);
+    }
+
+    void closest_intersection_n(
+        misc::span<const Ray> rays,
+        EntityIntersection *incts, bool *results) const noexcept override
+    {
+        AGZ_STATS_ADD(ClosestRay, rays.size());
+        aggregate_->closest_intersection_n(rays, incts, results);
+    }
+
     AABB world_bound() const noexcept override
     {
         AABB world_bound;
@@ -6,6 +6,18 @@ class Constant2D : public Texture2D
 {
     FSpectrum texel_;
 
+protected:
+
+    FSpectrum sample_spectrum_impl(const Vec2 &uv) const noexcept override
+    {
+        return texel_;
+    }
+
+    real sample_real_impl(const Vec2 &uv) const noexcept override
+    {
+        return texel_.r;
+    }
+
 public:
 
     Constant2D(
@@ -13,12 +25,6 @@ public:
     {
         init_common_params(common_params);
         texel_ = texel;
-
-        if(inv_gamma_ != 1)
-        {
-            for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
-                texel_[i] = std::pow(texel_[i], inv_gamma_);
-        }
     }
 
     int width() const noexcept override
@@ -30,16 +36,6 @@ public:
     {
         return 1;
     }
-
-    FSpectrum sample_spectrum(const Vec2 &uv) const noexcept override
-    {
-        return texel_;
-    }
-
-    real sample_real(const Vec2 &uv) const noexcept override
-    {
-        return texel_.r;
-    }
 };
 
 RC<Texture2D> create_constant2d_texture(
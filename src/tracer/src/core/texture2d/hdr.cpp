@@ -6,12 +6,38 @@
 #include <agz-utils/misc.h>
 #include <agz-utils/texture.h>
 
+#include "./mipmap.h"
+
 AGZ_TRACER_BEGIN
 
+namespace
+{
+
+    struct Color3fTraits
+    {
+        static FSpectrum to_spectrum(const math::color3f &texel) noexcept
+        {
+            return texel;
+        }
+
+        static math::color3f from_spectrum(const FSpectrum &spectrum) noexcept
+        {
+            return math::color3f(spectrum.r, spectrum.g, spectrum.b);
+        }
+    };
+
+} // namespace anonymous
+
 class HDRTexture : public Texture2D
 {
+    using Mipmap = MipmapPyramid<math::color3f, Color3fTraits>;
+
     RC<const Image2D<math::color3f>> data_;
 
+    // used by trilinear and ewa filtering
+    Box<const Mipmap> mipmap_;
+    bool ewa_ = false;
+
     static FSpectrum nearest_sample_impl(
         const texture::texture2d_t<math::color3f> *data, const Vec2 &uv) noexcept
     {
@@ -37,6 +63,16 @@ protected:
         return sample_impl_(data_.get(), uv.saturate());
     }
 
+    FSpectrum filtered_sample_spectrum_impl(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept override
+    {
+        if(!mipmap_)
+            return sample_spectrum_impl(uv);
+        if(ewa_)
+            return mipmap_->ewa(uv.saturate(), duvdx, duvdy, EWA_MAX_ANISOTROPY);
+        return mipmap_->trilinear(uv.saturate(), duvdx, duvdy);
+    }
+
 public:
 
     HDRTexture(
@@ -54,6 +90,12 @@ public:
             sample_impl_ = nearest_sample_impl;
         else if(sampler == "linear")
             sample_impl_ = linear_sample_impl;
+        else if(sampler == "trilinear" || sampler == "ewa")
+        {
+            sample_impl_ = linear_sample_impl;
+            mipmap_ = newBox<Mipmap>(data_);
+            ewa_ = sampler == "ewa";
+        }
         else
             throw ObjectConstructionException("invalid sample method");
 
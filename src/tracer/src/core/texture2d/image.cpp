@@ -7,12 +7,39 @@
 #include <agz-utils/misc.h>
 #include <agz-utils/texture.h>
 
+#include "./mipmap.h"
+
 AGZ_TRACER_BEGIN
 
+namespace
+{
+
+    struct Color3bTraits
+    {
+        static FSpectrum to_spectrum(const math::color3b &texel) noexcept
+        {
+            return math::from_color3b<real>(texel);
+        }
+
+        static math::color3b from_spectrum(const FSpectrum &spectrum) noexcept
+        {
+            return math::to_color3b<real>(
+                Spectrum(spectrum.r, spectrum.g, spectrum.b));
+        }
+    };
+
+} // namespace anonymous
+
 class ImageTexture : public Texture2D
 {
+    using Mipmap = MipmapPyramid<math::color3b, Color3bTraits>;
+
     RC<const Image2D<math::color3b>> data_;
 
+    // used by trilinear and ewa filtering
+    Box<const Mipmap> mipmap_;
+    bool ewa_ = false;
+
     static FSpectrum nearest_sample_impl(
         const texture::texture2d_t<math::color3b> *data, const Vec2 &uv) noexcept
     {
@@ -40,6 +67,28 @@ protected:
         return sample_impl_(data_.get(), uv.saturate());
     }
 
+    FSpectrum filtered_sample_spectrum_impl(
+        const EntityIntersection &inct) const noexcept override
+    {
+        if(!mipmap_)
+            return sample_spectrum(inct.uv);
+
+        Vec2 uv, duvdx, duvdy;
+        map_footprint(inct, &uv, &duvdx, &duvdy);
+        if(ewa_)
+        {
+            return apply_inv_gamma(mipmap_->ewa(
+                uv.saturate(), duvdx, duvdy, EWA_MAX_ANISOTROPY));
+        }
+        return apply_inv_gamma(mipmap_->trilinear(uv.saturate(), duvdx, duvdy));
+    }
+
+    real filtered_sample_real_impl(
+        const EntityIntersection &inct) const noexcept override
+    {
+        return filtered_sample_spectrum_impl(inct).r;
+    }
+
 public:
 
     ImageTexture(
@@ -52,11 +101,16 @@ public:
         assert(data && data->is_available());
         data_ = std::move(data);
 
-
         if(sampler == "nearest")
             sample_impl_ = nearest_sample_impl;
         else if(sampler == "linear")
             sample_impl_ = linear_sample_impl;
+        else if(sampler == "trilinear" || sampler == "ewa")
+        {
+            sample_impl_ = linear_sample_impl;
+            mipmap_ = newBox<Mipmap>(data_);
+            ewa_ = sampler == "ewa";
+        }
         else
             throw ObjectConstructionException("invalid sample method");
     }
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <vector>
+
+#include <agz/tracer/common.h>
+#include <agz-utils/texture.h>
+
+AGZ_TRACER_BEGIN
+
+// default max ratio between major and minor axes of ewa footprint
+constexpr real EWA_MAX_ANISOTROPY = 8;
+
+/**
+ * @brief trilinear and EWA filtering over mip levels
+ *
+ * Levels provides:
+ *  int level_count() const;
+ *  int level_width(int level) const;
+ *  int level_height(int level) const;
+ *  FSpectrum texel(int level, int x, int y) const;
+ *
+ * level 0 is the finest level and each following level halves the size of
+ * the previous one. texel (x, y) of a level covers uv range
+ * [x, x + 1] / width * [y, y + 1] / height.
+ */
+template<typename Levels>
+class MipmapFilter
+{
+public:
+
+    /**
+     * @brief bilinear lookup at the level whose texels best match the
+     *  isotropic footprint, blended with the next level
+     */
+    FSpectrum trilinear(
+        const Vec2 &uv, const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        const int level_count = levels().level_count();
+
+        const real width = 2 * (std::max)(
+            (std::max)(std::abs(duvdx.x), std::abs(duvdx.y)),
+            (std::max)(std::abs(duvdy.x), std::abs(duvdy.y)));
+
+        const real level = texel_level(width);
+        if(level <= 0)
+            return bilinear(0, uv);
+        if(level >= level_count - 1)
+            return bilinear(level_count - 1, uv);
+
+        const int ilevel = static_cast<int>(level);
+        const real t = level - ilevel;
+        return (1 - t) * bilinear(ilevel, uv) + t * bilinear(ilevel + 1, uv);
+    }
+
+    /**
+     * @brief elliptically weighted average over the anisotropic footprint
+     *
+     * eccentricity of the ellipse is clamped to max_anisotropy by enlarging
+     * the minor axis, which bounds the number of texels to be filtered
+     */
+    FSpectrum ewa(
+        const Vec2 &uv, Vec2 duvdx, Vec2 duvdy,
+        real max_anisotropy) const noexcept
+    {
+        if(duvdx.length_square() < duvdy.length_square())
+            std::swap(duvdx, duvdy);
+
+        const real major_length = duvdx.length();
+        real minor_length = duvdy.length();
+
+        if(minor_length * max_anisotropy < major_length && minor_length > 0)
+        {
+            const real scale = major_length / (minor_length * max_anisotropy);
+            duvdy *= scale;
+            minor_length *= scale;
+        }
+
+        if(minor_length == 0)
+            return bilinear(0, uv);
+
+        const real level = (std::max)(real(0), texel_level(minor_length));
+        const int ilevel = static_cast<int>(level);
+        const real t = level - ilevel;
+
+        const FSpectrum v0 = ewa_at_level(ilevel, uv, duvdx, duvdy);
+        if(t <= 0)
+            return v0;
+        return (1 - t) * v0 + t * ewa_at_level(ilevel + 1, uv, duvdx, duvdy);
+    }
+
+    FSpectrum bilinear(int level, const Vec2 &uv) const noexcept
+    {
+        const Levels &lv = levels();
+        const auto tex = [&lv, level](int x, int y)
+            { return lv.texel(level, x, y); };
+        return texture::linear_sample2d(
+            uv, tex, lv.level_width(level), lv.level_height(level));
+    }
+
+    FSpectrum nearest(int level, const Vec2 &uv) const noexcept
+    {
+        const Levels &lv = levels();
+        const auto tex = [&lv, level](int x, int y)
+            { return lv.texel(level, x, y); };
+        return texture::nearest_sample2d(
+            uv, tex, lv.level_width(level), lv.level_height(level));
+    }
+
+private:
+
+    const Levels &levels() const noexcept
+    {
+        return static_cast<const Levels &>(*this);
+    }
+
+    // continuous level where a texel has the given size in uv space
+    real texel_level(real uv_size) const noexcept
+    {
+        const int res = (std::max)(
+            levels().level_width(0), levels().level_height(0));
+        return std::log2((std::max)(uv_size * res, real(1e-8)));
+    }
+
+    FSpectrum ewa_at_level(
+        int level, const Vec2 &uv,
+        const Vec2 &duvdx, const Vec2 &duvdy) const noexcept
+    {
+        const Levels &lv = levels();
+        if(level >= lv.level_count())
+            return bilinear(lv.level_count() - 1, uv);
+
+        const int w = lv.level_width(level), h = lv.level_height(level);
+
+        // ellipse in texel space: A * s^2 + B * s * t + C * t^2 < 1
+
+        const real s = uv.x * w - real(0.5);
+        const real t = uv.y * h - real(0.5);
+        const real dsdx = duvdx.x * w, dtdx = duvdx.y * h;
+        const real dsdy = duvdy.x * w, dtdy = duvdy.y * h;
+
+        real A = dtdx * dtdx + dtdy * dtdy + 1;
+        real B = -2 * (dsdx * dtdx + dsdy * dtdy);
+        real C = dsdx * dsdx + dsdy * dsdy + 1;
+        const real inv_f = 1 / (A * C - B * B * real(0.25));
+        A *= inv_f;
+        B *= inv_f;
+        C *= inv_f;
+
+        const real det = -B * B + 4 * A * C;
+        const real inv_det = 1 / det;
+        const real u_sqrt = std::sqrt(det * C);
+        const real v_sqrt = std::sqrt(A * det);
+
+        const int s0 = static_cast<int>(std::ceil (s - 2 * inv_det * u_sqrt));
+        const int s1 = static_cast<int>(std::floor(s + 2 * inv_det * u_sqrt));
+        const int t0 = static_cast<int>(std::ceil (t - 2 * inv_det * v_sqrt));
+        const int t1 = static_cast<int>(std::floor(t + 2 * inv_det * v_sqrt));
+
+        // gaussian weights, shifted to be zero on the ellipse boundary
+        constexpr real ALPHA = 2;
+        const real exp_alpha = std::exp(-ALPHA);
+
+        FSpectrum sum;
+        real weight_sum = 0;
+
+        for(int it = t0; it <= t1; ++it)
+        {
+            const real tt = it - t;
+            const int y = math::clamp(it, 0, h - 1);
+
+            for(int is = s0; is <= s1; ++is)
+            {
+                const real ss = is - s;
+                const real r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+                if(r2 >= 1)
+                    continue;
+
+                const int x = math::clamp(is, 0, w - 1);
+                const real weight = std::exp(-ALPHA * r2) - exp_alpha;
+                sum += weight * lv.texel(level, x, y);
+                weight_sum += weight;
+            }
+        }
+
+        if(weight_sum <= 0)
+            return bilinear(level, uv);
+        return sum / weight_sum;
+    }
+};
+
+/**
+ * @brief in-memory mip pyramid of an image
+ *
+ * each level is downsampled from the previous one with a box filter,
+ * until 1x1.
+ *
+ * Traits provides:
+ *  static FSpectrum to_spectrum(const Texel &texel);
+ *  static Texel from_spectrum(const FSpectrum &spectrum);
+ */
+template<typename Texel, typename Traits>
+class MipmapPyramid : public MipmapFilter<MipmapPyramid<Texel, Traits>>
+{
+public:
+
+    using Image = texture::texture2d_t<Texel>;
+
+    explicit MipmapPyramid(RC<const Image> base)
+    {
+        assert(base && base->is_available());
+        base_ = std::move(base);
+
+        const Image *last = base_.get();
+        while(last->width() > 1 || last->height() > 1)
+        {
+            levels_.push_back(downsample(*last));
+            last = &levels_.back();
+        }
+    }
+
+    int level_count() const noexcept
+    {
+        return 1 + static_cast<int>(levels_.size());
+    }
+
+    int level_width(int level) const noexcept
+    {
+        return image(level).width();
+    }
+
+    int level_height(int level) const noexcept
+    {
+        return image(level).height();
+    }
+
+    FSpectrum texel(int level, int x, int y) const noexcept
+    {
+        return Traits::to_spectrum(image(level)(y, x));
+    }
+
+private:
+
+    const Image &image(int level) const noexcept
+    {
+        assert(0 <= level && level < level_count());
+        return level ? levels_[level - 1] : *base_;
+    }
+
+    static Image downsample(const Image &src)
+    {
+        const int src_w = src.width(), src_h = src.height();
+        const int dst_w = (std::max)(1, (src_w + 1) / 2);
+        const int dst_h = (std::max)(1, (src_h + 1) / 2);
+
+        Image ret(dst_h, dst_w);
+        for(int y = 0; y < dst_h; ++y)
+        {
+            const int y0 = (std::min)(2 * y,     src_h - 1);
+            const int y1 = (std::min)(2 * y + 1, src_h - 1);
+
+            for(int x = 0; x < dst_w; ++x)
+            {
+                const int x0 = (std::min)(2 * x,     src_w - 1);
+                const int x1 = (std::min)(2 * x + 1, src_w - 1);
+
+                const FSpectrum sum = Traits::to_spectrum(src(y0, x0))
+                                    + Traits::to_spectrum(src(y0, x1))
+                                    + Traits::to_spectrum(src(y1, x0))
+                                    + Traits::to_spectrum(src(y1, x1));
+                ret(y, x) = Traits::from_spectrum(real(0.25) * sum);
+            }
+        }
+
+        return ret;
+    }
+
+    RC<const Image> base_;
+    std::vector<Image> levels_;
+};
+
+AGZ_TRACER_END
@@ -0,0 +1,144 @@
+#include <cstring>
+
+#include <agz/tracer/core/texture2d.h>
+#include <agz/tracer/utility/texture_tile_cache.h>
+#include <agz-utils/misc.h>
+#include <agz-utils/texture.h>
+
+#include "./mipmap.h"
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    // mip levels of a tiled texture file. texels are fetched via tile cache
+    class TiledMipmap : public MipmapFilter<TiledMipmap>
+    {
+        RC<const TiledTextureFile> file_;
+        TextureTileCache &cache_;
+
+    public:
+
+        explicit TiledMipmap(RC<const TiledTextureFile> file)
+            : file_(std::move(file)), cache_(TextureTileCache::instance())
+        {
+
+        }
+
+        int level_count() const noexcept
+        {
+            return file_->level_count();
+        }
+
+        int level_width(int level) const noexcept
+        {
+            return file_->level_width(level);
+        }
+
+        int level_height(int level) const noexcept
+        {
+            return file_->level_height(level);
+        }
+
+        FSpectrum texel(int level, int x, int y) const noexcept
+        {
+            const unsigned char *tile = cache_.get_tile(
+                *file_, file_->tile_index(level, x, y));
+            const unsigned char *data = tile + file_->texel_offset(x, y);
+
+            if(file_->format() == TiledTextureFormat::RGB8)
+            {
+                return math::from_color3b<real>(
+                    math::color3b(data[0], data[1], data[2]));
+            }
+
+            float rgb[3];
+            std::memcpy(rgb, data, sizeof(rgb));
+            return FSpectrum(rgb[0], rgb[1], rgb[2]);
+        }
+    };
+
+} // namespace anonymous
+
+class TiledImageTexture : public Texture2D
+{
+    TiledMipmap mipmap_;
+
+    bool nearest_ = false;
+
+    // used by trilinear and ewa filtering
+    bool filtered_ = false;
+    bool ewa_      = false;
+
+protected:
+
+    FSpectrum sample_spectrum_impl(const Vec2 &uv) const noexcept override
+    {
+        if(nearest_)
+            return mipmap_.nearest(0, uv.saturate());
+        return mipmap_.bilinear(0, uv.saturate());
+    }
+
+    FSpectrum filtered_sample_spectrum_impl(
+        const EntityIntersection &inct) const noexcept override
+    {
+        if(!filtered_)
+            return sample_spectrum(inct.uv);
+
+        Vec2 uv, duvdx, duvdy;
+        map_footprint(inct, &uv, &duvdx, &duvdy);
+        if(ewa_)
+        {
+            return apply_inv_gamma(mipmap_.ewa(
+                uv.saturate(), duvdx, duvdy, EWA_MAX_ANISOTROPY));
+        }
+        return apply_inv_gamma(mipmap_.trilinear(uv.saturate(), duvdx, duvdy));
+    }
+
+    real filtered_sample_real_impl(
+        const EntityIntersection &inct) const noexcept override
+    {
+        return filtered_sample_spectrum_impl(inct).r;
+    }
+
+public:
+
+    TiledImageTexture(
+        const Texture2DCommonParams &common_params,
+        RC<const TiledTextureFile> file,
+        const std::string &sampler)
+        : mipmap_(std::move(file))
+    {
+        init_common_params(common_params);
+
+        if(sampler == "nearest")
+            nearest_ = true;
+        else if(sampler == "trilinear" || sampler == "ewa")
+        {
+            filtered_ = true;
+            ewa_ = sampler == "ewa";
+        }
+        else if(sampler != "linear")
+            throw ObjectConstructionException("invalid sample method");
+    }
+
+    int width() const noexcept override
+    {
+        return mipmap_.level_width(0);
+    }
+
+    int height() const noexcept override
+    {
+        return mipmap_.level_height(0);
+    }
+};
+
+RC<Texture2D> create_tiled_image_texture(
+    const Texture2DCommonParams &common_params,
+    RC<const TiledTextureFile> file, const std::string &sampler)
+{
+    return newRC<TiledImageTexture>(common_params, std::move(file), sampler);
+}
+
+AGZ_TRACER_END
@@ -32,23 +32,28 @@ class ImageTexture3D : public Texture3D
 
 protected:
 
+    real texel_real(int x, int y, int z) const noexcept
+    {
+        SWITCH_ET(
+        {
+            return data_->at(z, y, x);
+        },
+        {
+            return data_->at(z, y, x) / real(255);
+        },
+        {
+            return data_->at(z, y, x).r;
+        },
+        {
+            return math::from_color3b<real>(data_->at(z, y, x)).r;
+        });
+    }
+
     real sample_real_impl(const FVec3 &uvw) const noexcept override
     {
         auto access_texel = [&](int x, int y, int z)
         {
-            SWITCH_ET(
-            {
-                return data_->at(z, y, x);
-            },
-            {
-                return data_->at(z, y, x) / real(255);
-            },
-            {
-                return data_->at(z, y, x).r;
-            },
-            {
-                return math::from_color3b<real>(data_->at(z, y, x)).r;
-            });
+            return texel_real(x, y, z);
         };
 
         if constexpr(USE_LINEAR_INTERP)
@@ -170,6 +175,30 @@ public:
     {
         return max_real_;
     }
+
+    real max_real_in(
+        const FVec3 &uvw_low, const FVec3 &uvw_high) const noexcept override
+    {
+        Vec3i beg, end;
+        if(!uvw_to_texel_range(
+            uvw_low, uvw_high,
+            { data_->width(), data_->height(), data_->depth() }, beg, end))
+            return max_real_;
+
+        real ret = 0;
+        for(int z = beg.z; z <= end.z; ++z)
+        {
+            for(int y = beg.y; y <= end.y; ++y)
+            {
+                for(int x = beg.x; x <= end.x; ++x)
+                    ret = (std::max)(ret, texel_real(x, y, z));
+            }
+        }
+
+        if(inv_gamma_ != 1)
+            ret = std::pow(ret, inv_gamma_);
+        return ret;
+    }
 };
 
 RC<Texture3D> create_image3d(
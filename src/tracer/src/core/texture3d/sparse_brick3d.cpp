@@ -0,0 +1,126 @@
+#include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/utility/sparse_volume.h>
+#include <agz-utils/texture.h>
+
+AGZ_TRACER_BEGIN
+
+template<bool USE_LINEAR_INTERP>
+class SparseBrickTexture3D : public Texture3D
+{
+    RC<const SparseBrickVolume> volume_;
+
+    FSpectrum max_spec_;
+
+protected:
+
+    real sample_real_impl(const FVec3 &uvw) const noexcept override
+    {
+        auto access_texel = [&](int x, int y, int z)
+        {
+            return volume_->texel(x, y, z, 0);
+        };
+
+        if constexpr(USE_LINEAR_INTERP)
+        {
+            return texture::linear_sample3d<real>(
+                uvw, access_texel,
+                volume_->width(), volume_->height(), volume_->depth());
+        }
+        else
+        {
+            return texture::nearest_sample3d<real>(
+                uvw, access_texel,
+                volume_->width(), volume_->height(), volume_->depth());
+        }
+    }
+
+    FSpectrum sample_spectrum_impl(const FVec3 &uvw) const noexcept override
+    {
+        auto access_texel = [&](int x, int y, int z)
+        {
+            return volume_->texel_spectrum(x, y, z);
+        };
+
+        if constexpr(USE_LINEAR_INTERP)
+        {
+            return texture::linear_sample3d<real>(
+                uvw, access_texel,
+                volume_->width(), volume_->height(), volume_->depth());
+        }
+        else
+        {
+            return texture::nearest_sample3d<real>(
+                uvw, access_texel,
+                volume_->width(), volume_->height(), volume_->depth());
+        }
+    }
+
+public:
+
+    SparseBrickTexture3D(
+        const Texture3DCommonParams &common_params,
+        RC<const SparseBrickVolume> volume)
+    {
+        init_common_params(common_params);
+        volume_ = std::move(volume);
+        max_spec_ = volume_->max_spectrum();
+    }
+
+    int width() const noexcept override
+    {
+        return volume_->width();
+    }
+
+    int height() const noexcept override
+    {
+        return volume_->height();
+    }
+
+    int depth() const noexcept override
+    {
+        return volume_->depth();
+    }
+
+    FSpectrum max_spectrum() const noexcept override
+    {
+        return max_spec_;
+    }
+
+    real max_real() const noexcept override
+    {
+        return max_spec_.r;
+    }
+
+    real max_real_in(
+        const FVec3 &uvw_low, const FVec3 &uvw_high) const noexcept override
+    {
+        Vec3i beg, end;
+        if(!uvw_to_texel_range(
+            uvw_low, uvw_high,
+            { volume_->width(), volume_->height(), volume_->depth() },
+            beg, end))
+            return max_real();
+
+        real ret = volume_->max_real_in(beg, end);
+        if(inv_gamma_ != 1)
+            ret = std::pow(ret, inv_gamma_);
+        return ret;
+    }
+};
+
+RC<Texture3D> create_sparse_brick3d(
+    const Texture3DCommonParams &common_params,
+    RC<const SparseBrickVolume> volume,
+    bool use_linear_sampler)
+{
+    if(use_linear_sampler)
+    {
+        return newRC<SparseBrickTexture3D<true>>(
+            common_params, std::move(volume));
+    }
+
+    return newRC<SparseBrickTexture3D<false>>(
+        common_params, std::move(volume));
+}
+
+AGZ_TRACER_END
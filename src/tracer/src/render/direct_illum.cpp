@@ -11,7 +11,7 @@ AGZ_TRACER_BEGIN
 FSpectrum mis_sample_area_light(
     const Scene &scene, const AreaLight *light,
     const EntityIntersection &inct, const ShadingPoint &shd,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     const Sample5 sam = sampler.sample5();
 
@@ -38,13 +38,13 @@ FSpectrum mis_sample_area_light(
                      * std::abs(cos(inct_to_light, inct.geometry_coord.z));
     const real bsdf_pdf = shd.bsdf->pdf(inct_to_light, inct.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_light_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_area_light(
     const Scene &scene, const AreaLight *light,
     const MediumScattering &scattering, const BSDF *phase_function,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     const Sample5 sam = sampler.sample5();
 
@@ -66,13 +66,13 @@ FSpectrum mis_sample_area_light(
                      * light_sample.radiance * bsdf_f;
     const real bsdf_pdf = phase_function->pdf(inct_to_light, scattering.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_light_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_envir_light(
     const Scene &scene, const EnvirLight *light,
     const EntityIntersection &inct, const ShadingPoint &shd,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     const Sample5 sam = sampler.sample5();
 
@@ -95,13 +95,13 @@ FSpectrum mis_sample_envir_light(
                      * bsdf_f * std::abs(cos(ref_to_light, inct.geometry_coord.z));
     const real bsdf_pdf = shd.bsdf->pdf(ref_to_light, inct.wr);
 
-    return f / (light_sample.pdf + bsdf_pdf);
+    return f / (select_light_pdf * light_sample.pdf + bsdf_pdf);
 }
 
 FSpectrum mis_sample_envir_light(
     const Scene &scene, const EnvirLight *light,
     const MediumScattering &scattering, const BSDF *phase_function,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     // there is no medium when envir light is visible
     return {};
@@ -110,26 +110,27 @@ FSpectrum mis_sample_envir_light(
 FSpectrum mis_sample_light(
     const Scene &scene, const Light *lht,
     const EntityIntersection &inct, const ShadingPoint &shd,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     if(lht->is_area())
-        return mis_sample_area_light(scene, lht->as_area(), inct, shd, sampler);
-    return mis_sample_envir_light(scene, lht->as_envir(), inct, shd, sampler);
+        return mis_sample_area_light(scene, lht->as_area(), inct, shd, sampler, select_light_pdf);
+    return mis_sample_envir_light(scene, lht->as_envir(), inct, shd, sampler, select_light_pdf);
 }
 
 FSpectrum mis_sample_light(
     const Scene &scene, const Light *lht,
     const MediumScattering &scattering, const BSDF *phase_function,
-    Sampler &sampler)
+    Sampler &sampler, real select_light_pdf)
 {
     if(lht->is_area())
-        return mis_sample_area_light(scene, lht->as_area(), scattering, phase_function, sampler);
-    return mis_sample_envir_light(scene, lht->as_envir(), scattering, phase_function, sampler);
+        return mis_sample_area_light(scene, lht->as_area(), scattering, phase_function, sampler, select_light_pdf);
+    return mis_sample_envir_light(scene, lht->as_envir(), scattering, phase_function, sampler, select_light_pdf);
 }
 
 FSpectrum mis_sample_bsdf(
     const Scene &scene, const EntityIntersection &inct, const ShadingPoint &shd, Sampler &sampler,
-    BSDFSampleResult &bsdf_sample, bool &has_ent_inct, EntityIntersection &ent_inct)
+    BSDFSampleResult &bsdf_sample, bool &has_ent_inct, EntityIntersection &ent_inct,
+    bool one_light)
 {
     const Sample3 sam = sampler.sample3();
     has_ent_inct = false;
@@ -163,6 +164,8 @@ FSpectrum mis_sample_bsdf(
             else
             {
                 real light_pdf = light->pdf(new_ray.o, new_ray.d);
+                if(one_light)
+                    light_pdf *= scene.light_pdf(inct.pos, inct.geometry_coord.z, light);
                 envir_illum += f / (bsdf_sample.pdf + light_pdf);
             }
         }
@@ -186,14 +189,17 @@ FSpectrum mis_sample_bsdf(
     if(bsdf_sample.is_delta)
         return f / bsdf_sample.pdf;
 
-    const real light_pdf = light->pdf(
+    real light_pdf = light->pdf(
         new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
+    if(one_light)
+        light_pdf *= scene.light_pdf(inct.pos, inct.geometry_coord.z, light);
     return f / (bsdf_sample.pdf + light_pdf);
 }
 
 FSpectrum mis_sample_bsdf(
     const Scene &scene, const MediumScattering &scattering, const BSDF *phase_function, Sampler &sampler,
-    BSDFSampleResult &bsdf_sample, bool &has_ent_inct, EntityIntersection &ent_inct)
+    BSDFSampleResult &bsdf_sample, bool &has_ent_inct, EntityIntersection &ent_inct,
+    bool one_light)
 {
     const Sample3 sam = sampler.sample3();
     has_ent_inct = false;
@@ -224,7 +230,9 @@ FSpectrum mis_sample_bsdf(
                 envir_illum += f / bsdf_sample.pdf;
             else
             {
-                const real light_pdf = light->pdf(new_ray.o, new_ray.d);
+                real light_pdf = light->pdf(new_ray.o, new_ray.d);
+                if(one_light)
+                    light_pdf *= scene.light_pdf(scattering.pos, FVec3(0), light);
                 envir_illum += f / (bsdf_sample.pdf + light_pdf);
             }
         }
@@ -247,35 +255,77 @@ FSpectrum mis_sample_bsdf(
     if(bsdf_sample.is_delta)
         return f / bsdf_sample.pdf;
 
-    const real light_pdf = light->pdf(
+    real light_pdf = light->pdf(
         new_ray.o, ent_inct.pos, ent_inct.geometry_coord.z);
+    if(one_light)
+        light_pdf *= scene.light_pdf(scattering.pos, FVec3(0), light);
     return f / (bsdf_sample.pdf + light_pdf);
 }
 
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
     const EntityIntersection &inct, const ShadingPoint &shd,
-    Sampler &sampler)
+    Sampler &sampler, bool one_light)
 {
     BSDFSampleResult bsdf_sample(UNINIT);
     bool has_ent_inct;
     EntityIntersection ent_inct;
     return mis_sample_bsdf(
         scene, inct, shd, sampler,
-        bsdf_sample, has_ent_inct, ent_inct);
+        bsdf_sample, has_ent_inct, ent_inct, one_light);
 }
 
 FSpectrum mis_sample_bsdf(
     const Scene &scene,
     const MediumScattering &scattering, const BSDF *phase_function,
-    Sampler &sampler)
+    Sampler &sampler, bool one_light)
 {
     BSDFSampleResult bsdf_sample(UNINIT);
     bool has_ent_inct;
     EntityIntersection ent_inct;
     return mis_sample_bsdf(
         scene, scattering, phase_function, sampler,
-        bsdf_sample, has_ent_inct, ent_inct);
+        bsdf_sample, has_ent_inct, ent_inct, one_light);
+}
+
+FSpectrum mis_sample_one_light(
+    const Scene &scene,
+    const EntityIntersection &inct, const ShadingPoint &shd,
+    Sampler &sampler)
+{
+    FSpectrum ret;
+
+    const auto [light, select_light_pdf] = scene.sample_light(
+        inct.pos, inct.geometry_coord.z, sampler.sample1());
+    if(light)
+    {
+        ret += mis_sample_light(
+            scene, light, inct, shd, sampler, select_light_pdf);
+    }
+
+    ret += mis_sample_bsdf(scene, inct, shd, sampler, true);
+
+    return ret;
+}
+
+FSpectrum mis_sample_one_light(
+    const Scene &scene,
+    const MediumScattering &scattering, const BSDF *phase_function,
+    Sampler &sampler)
+{
+    FSpectrum ret;
+
+    const auto [light, select_light_pdf] = scene.sample_light(
+        scattering.pos, FVec3(0), sampler.sample1());
+    if(light)
+    {
+        ret += mis_sample_light(
+            scene, light, scattering, phase_function, sampler, select_light_pdf);
+    }
+
+    ret += mis_sample_bsdf(scene, scattering, phase_function, sampler, true);
+
+    return ret;
 }
 
 AGZ_TRACER_END
@@ -11,7 +11,7 @@ AGZ_TRACER_RENDER_BEGIN
 
 void trace_particle(
     const ParticleTraceParams &params, const Scene &scene, Sampler &sampler,
-    FilmFilterApplier::FilmGridView<Spectrum> &film, Arena &arena)
+    SplatFilm::ThreadBuffer &film, Arena &arena)
 {
     const auto [light, select_light_pdf] = scene.sample_light(sampler.sample1());
     if(!light)
@@ -66,7 +66,7 @@ void trace_particle(
                         inct.geometry_coord.z, camera_sample.ref_to_pos));
                     const FSpectrum f = coef * bsdf_f * abscos
                         * camera_sample.we / camera_sample.pdf;
-                    film.apply(pixel_x, pixel_y, f);
+                    film.splat(pixel_x, pixel_y, f);
                 }
             }
         }
@@ -87,7 +87,7 @@ void trace_particle(
 void trace_vol_particle(
     const ParticleTraceParams &params,
     const Scene &scene, Sampler &sampler,
-    FilmFilterApplier::FilmGridView<Spectrum> &film,
+    SplatFilm::ThreadBuffer &film,
     Arena &arena)
 {
     const auto [light, select_light_pdf] = scene.sample_light(sampler.sample1());
@@ -151,7 +151,7 @@ void trace_vol_particle(
 
                         const FSpectrum f = coef * bsdf_f * tr
                                          * cam_sam.we / cam_sam.pdf;
-                        film.apply(pixel_x, pixel_y, f);
+                        film.splat(pixel_x, pixel_y, f);
                     }
                 }
             }
@@ -196,7 +196,7 @@ void trace_vol_particle(
 
                     const FSpectrum f = coef * bsdf_f * abscos * tr
                                      * camera_sample.we / camera_sample.pdf;
-                    film.apply(pixel_x, pixel_y, f);
+                    film.splat(pixel_x, pixel_y, f);
                 }
             }
         }
@@ -1,3 +1,6 @@
+#include <memory>
+#include <vector>
+
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/bssrdf.h>
 #include <agz/tracer/core/camera.h>
@@ -12,9 +15,43 @@
 
 AGZ_TRACER_RENDER_BEGIN
 
+namespace
+{
+
+    // bool array used as stream query results, which only grows
+    class FlagBuffer
+    {
+        std::unique_ptr<bool[]> data_;
+        size_t capacity_ = 0;
+
+    public:
+
+        bool *get(size_t size)
+        {
+            if(size > capacity_)
+            {
+                data_.reset(new bool[size]);
+                capacity_ = size;
+            }
+            return data_.get();
+        }
+    };
+
+    // buffers of trace_ao_n, reused by all batches of a rendering thread
+    struct AOBuffers
+    {
+        std::vector<EntityIntersection> incts;
+        FlagBuffer                      has_inct;
+
+        std::vector<Ray> shadow_rays;
+        FlagBuffer       occluded;
+    };
+
+} // namespace anonymous
+
 Pixel trace_std(
     const TraceParams &params, const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena)
+    Sampler &sampler, Arena &arena, const RayDifferential &diff)
 {
     FSpectrum coef(1);
     Ray r = ray;
@@ -48,6 +85,9 @@ Pixel trace_std(
             return pixel;
         }
 
+        if(depth == 1)
+            ent_inct.compute_uv_differentials(r, diff);
+
         // fill gbuffer
 
         const ShadingPoint ent_shd = ent_inct.material->shade(ent_inct, arena);
@@ -85,12 +125,7 @@ Pixel trace_std(
                 FSpectrum direct_illum;
                 for(int i = 0; i < params.direct_illum_sample_count; ++i)
                 {
-                    for(auto light : scene.lights())
-                    {
-                        direct_illum += coef * mis_sample_light(
-                            scene, light, scattering_point, phase_function, sampler);
-                    }
-                    direct_illum += coef * mis_sample_bsdf(
+                    direct_illum += coef * mis_sample_one_light(
                         scene, scattering_point, phase_function, sampler);
                 }
 
@@ -134,12 +169,7 @@ Pixel trace_std(
         FSpectrum direct_illum;
         for(int i = 0; i < params.direct_illum_sample_count; ++i)
         {
-            for(auto light : scene.lights())
-            {
-                direct_illum += coef * mis_sample_light(
-                    scene, light, ent_inct, ent_shd, sampler);
-            }
-            direct_illum += coef * mis_sample_bsdf(
+            direct_illum += coef * mis_sample_one_light(
                 scene, ent_inct, ent_shd, sampler);
         }
 
@@ -193,12 +223,7 @@ Pixel trace_std(
             FSpectrum new_direct_illum;
             for(int i = 0; i < params.direct_illum_sample_count; ++i)
             {
-                for(auto light : scene.lights())
-                {
-                    new_direct_illum += coef * mis_sample_light(
-                        scene, light, new_inct, new_shd, sampler);
-                }
-                new_direct_illum += coef * mis_sample_bsdf(
+                new_direct_illum += coef * mis_sample_one_light(
                     scene, new_inct, new_shd, sampler);
             }
 
@@ -226,7 +251,7 @@ Pixel trace_std(
 
 Pixel trace_nomis(
     const TraceParams &params, const Scene &scene, const Ray &ray,
-    Sampler &sampler, Arena &arena)
+    Sampler &sampler, Arena &arena, const RayDifferential &diff)
 {
     FSpectrum coef(1);
     Ray r = ray;
@@ -257,6 +282,9 @@ Pixel trace_nomis(
             return pixel;
         }
 
+        if(depth == 1)
+            ent_inct.compute_uv_differentials(r, diff);
+
         // fill gbuffer
 
         const auto ent_shd = ent_inct.material->shade(ent_inct, arena);
@@ -414,6 +442,89 @@ Pixel trace_ao(
     };
 }
 
+void trace_ao_n(
+    const AOParams &params, const Scene &scene,
+    misc::span<const Ray> rays, const PixelSampleIndex *sample_indices,
+    Pixel *pixels, Sampler &sampler)
+{
+    const size_t ray_count = rays.size();
+
+    thread_local AOBuffers buffers;
+
+    // trace all camera rays at once
+
+    std::vector<EntityIntersection> &incts = buffers.incts;
+    incts.resize(ray_count);
+    bool *has_inct = buffers.has_inct.get(ray_count);
+    scene.closest_intersection_n(rays, incts.data(), has_inct);
+
+    // generate shadow rays of all intersections and trace them at once
+
+    const size_t ao_count = static_cast<size_t>(params.ao_sample_count);
+
+    std::vector<Ray> &shadow_rays = buffers.shadow_rays;
+    shadow_rays.clear();
+    shadow_rays.reserve(ray_count * ao_count);
+
+    for(size_t i = 0; i < ray_count; ++i)
+    {
+        if(!has_inct[i])
+            continue;
+
+        const EntityIntersection &inct = incts[i];
+        const FVec3 start_pos = inct.eps_offset(inct.geometry_coord.z);
+
+        sampler.start_pixel_sample(sample_indices[i]);
+
+        for(size_t j = 0; j < ao_count; ++j)
+        {
+            const Sample2 sam = sampler.sample2();
+            const FVec3 local_dir = math::distribution
+                                        ::zweighted_on_hemisphere(sam.u, sam.v).first;
+            const FVec3 global_dir = inct.geometry_coord.local_to_global(local_dir)
+                                                       .normalize();
+
+            // same as scene.visible(start_pos, start_pos + global_dir * dis)
+            shadow_rays.emplace_back(
+                start_pos, global_dir,
+                EPS(), params.max_occlusion_distance - EPS());
+        }
+    }
+
+    bool *occluded = buffers.occluded.get(shadow_rays.size());
+    scene.has_intersection_n(
+        misc::span<const Ray>(shadow_rays.data(), shadow_rays.size()),
+        occluded);
+
+    size_t shadow_ray_idx = 0;
+    for(size_t i = 0; i < ray_count; ++i)
+    {
+        if(!has_inct[i])
+        {
+            pixels[i] = { { {}, {}, 1 }, params.background_color };
+            continue;
+        }
+
+        const EntityIntersection &inct = incts[i];
+
+        real ao_factor = 0;
+        for(size_t j = 0; j < ao_count; ++j)
+        {
+            if(!occluded[shadow_ray_idx++])
+                ao_factor += 1;
+        }
+        ao_factor /= params.ao_sample_count;
+
+        pixels[i] = {
+            {
+                params.high_color, inct.geometry_coord.z,
+                inct.entity->get_no_denoise_flag() ? real(0) : real(1)
+            },
+            lerp(params.low_color, params.high_color, math::saturate(ao_factor))
+        };
+    }
+}
+
 Pixel trace_albedo_ao(
     const AlbedoAOParams &params, const Scene &scene, const Ray &ray,
     Sampler &sampler, Arena &arena)
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <agz/tracer/core/bsdf.h>
 #include <agz/tracer/core/entity.h>
 #include <agz/tracer/core/intersection.h>
@@ -6,77 +8,356 @@
 #include <agz/tracer/core/scene.h>
 #include <agz/tracer/render/direct_illum.h>
 #include <agz/tracer/render/photon_mapping.h>
+#include <agz/tracer/utility/parallel_grid.h>
 
 AGZ_TRACER_RENDER_BEGIN
 
 namespace sppm
 {
 
-VisiblePointSearcher::VisiblePointSearcher(
-    const AABB &world_bound,
-    real grid_sidelen,
-    size_t entry_count)
-    : hashed_grid_aux_(world_bound, grid_sidelen, entry_count)
+void PhotonDepositBuffer::add(Pixel *pixel, const FSpectrum &phi)
+{
+    deposits_.push_back({ pixel, phi, 1 });
+
+    // keep memory usage bounded by the number of distinct pixels
+    if(deposits_.size() >= reduce_threshold_)
+    {
+        sort_and_reduce();
+        reduce_threshold_ = (std::max)(reduce_threshold_, 2 * deposits_.size());
+    }
+}
+
+void PhotonDepositBuffer::sort_and_reduce()
+{
+    if(deposits_.empty())
+        return;
+
+    std::sort(deposits_.begin(), deposits_.end(),
+        [](const Deposit &lhs, const Deposit &rhs)
+    {
+        return std::less<const Pixel*>()(lhs.pixel, rhs.pixel);
+    });
+
+    size_t out = 0;
+    for(size_t i = 1; i < deposits_.size(); ++i)
+    {
+        Deposit &last = deposits_[out];
+        if(deposits_[i].pixel == last.pixel)
+        {
+            last.phi   += deposits_[i].phi;
+            last.count += deposits_[i].count;
+        }
+        else
+            deposits_[++out] = deposits_[i];
+    }
+
+    deposits_.resize(out + 1);
+}
+
+void PhotonDepositBuffer::apply(const Pixel *beg, const Pixel *end) const
 {
-    node_entry_count_ = entry_count;
-    node_entries_ = newBox<std::atomic<VPNode*>[]>(node_entry_count_);
-    
-    clear();
+    const std::less<const Pixel*> less;
+
+    auto it = std::lower_bound(
+        deposits_.begin(), deposits_.end(), beg,
+        [&](const Deposit &d, const Pixel *p) { return less(d.pixel, p); });
+
+    for(; it != deposits_.end() && less(it->pixel, end); ++it)
+    {
+        Pixel &pixel = *it->pixel;
+
+        // no other thread is writing these pixels, so load/store is enough
+        for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
+        {
+            pixel.phi[i].store(
+                pixel.phi[i].load(std::memory_order_relaxed) + it->phi[i],
+                std::memory_order_relaxed);
+        }
+        pixel.M.store(
+            pixel.M.load(std::memory_order_relaxed) + it->count,
+            std::memory_order_relaxed);
+    }
 }
 
-void VisiblePointSearcher::clear()
+void PhotonDepositBuffer::clear()
 {
-    for(size_t i = 0; i < node_entry_count_; ++i)
-        node_entries_[i] = nullptr;
+    deposits_.clear();
 }
 
-void VisiblePointSearcher::add_vp(Pixel &pixel, Arena &vp_node_arena)
+void VisiblePointSearcher::build(
+    Pixel *pixels, size_t pixel_count,
+    int thread_count)
 {
-    const Vec3i &min_grid = hashed_grid_aux_.pos_to_grid(
-        pixel.vp.pos - FVec3(pixel.radius));
-    const Vec3i &max_grid = hashed_grid_aux_.pos_to_grid(
-        pixel.vp.pos + FVec3(pixel.radius));
+    constexpr int PIXEL_GRID_SIZE = 4096;
+
+    const int total_pixels = static_cast<int>(pixel_count);
+
+    // statistics of visible points
+
+    struct VPStatistics
+    {
+        size_t count      = 0;
+        real   radius_sum = 0;
+        real   max_radius = 0;
+        AABB   bound;
+    };
+
+    std::vector<VPStatistics> perthread_stats(thread_count);
+
+    parallel_for_1d_grid(
+        thread_count, total_pixels, PIXEL_GRID_SIZE,
+        [&](int thread_index, int beg, int end)
+    {
+        auto &stats = perthread_stats[thread_index];
+        for(int i = beg; i < end; ++i)
+        {
+            const Pixel &pixel = pixels[i];
+            if(!pixel.vp.is_valid())
+                continue;
+
+            ++stats.count;
+            stats.radius_sum += pixel.radius;
+            stats.max_radius = (std::max)(stats.max_radius, pixel.radius);
+            stats.bound |= AABB(
+                pixel.vp.pos - FVec3(pixel.radius),
+                pixel.vp.pos + FVec3(pixel.radius));
+        }
+    });
+
+    VPStatistics stats;
+    for(auto &s : perthread_stats)
+    {
+        stats.count      += s.count;
+        stats.radius_sum += s.radius_sum;
+        stats.max_radius  = (std::max)(stats.max_radius, s.max_radius);
+        stats.bound      |= s.bound;
+    }
+
+    records_.clear();
+    if(!stats.count)
+    {
+        entry_mask_ = 0;
+        entry_beg_.assign(2, 0);
+        return;
+    }
+
+    // cells twice as large as the average search radius keep each visible
+    // point in a few cells. large radii are bounded to 9^3 cells at most
+
+    const real avg_radius = stats.radius_sum / stats.count;
+    cell_sidelen_ = (std::max)(2 * avg_radius, stats.max_radius / 4);
+    inv_cell_sidelen_ = 1 / cell_sidelen_;
+    world_low_ = stats.bound.low;
+
+    size_t entry_count = 1;
+    while(entry_count < 2 * stats.count)
+        entry_count <<= 1;
+    entry_mask_ = entry_count - 1;
+
+    if(entry_cursor_count_ < entry_count)
+    {
+        entry_cursors_ = newBox<std::atomic<uint32_t>[]>(entry_count);
+        entry_cursor_count_ = entry_count;
+    }
+
+    auto for_each_cell = [&](const Pixel &pixel, auto &&func)
+    {
+        const Vec3i low = pos_to_cell(pixel.vp.pos - FVec3(pixel.radius));
+        const Vec3i high = pos_to_cell(pixel.vp.pos + FVec3(pixel.radius));
+
+        for(int z = low.z; z <= high.z; ++z)
+        {
+            for(int y = low.y; y <= high.y; ++y)
+            {
+                for(int x = low.x; x <= high.x; ++x)
+                    func(Vec3i(x, y, z));
+            }
+        }
+    };
+
+    // count records of each entry
 
-    for(int z = min_grid.z; z <= max_grid.z; ++z)
+    parallel_for_1d_grid(
+        thread_count, static_cast<int>(entry_count), 1 << 16,
+        [&](int, int beg, int end)
     {
-        for(int y = min_grid.y; y <= max_grid.y; ++y)
+        for(int i = beg; i < end; ++i)
+            entry_cursors_[i].store(0, std::memory_order_relaxed);
+    });
+
+    parallel_for_1d_grid(
+        thread_count, total_pixels, PIXEL_GRID_SIZE,
+        [&](int, int beg, int end)
+    {
+        for(int i = beg; i < end; ++i)
         {
-            for(int x = min_grid.x; x <= max_grid.x; ++x)
+            if(!pixels[i].vp.is_valid())
+                continue;
+
+            for_each_cell(pixels[i], [&](const Vec3i &cell)
             {
-                const size_t entry_idx = hashed_grid_aux_.grid_to_entry({ x, y, z });
-                auto &entry = node_entries_[entry_idx];
+                entry_cursors_[cell_to_entry(cell)].fetch_add(
+                    1, std::memory_order_relaxed);
+            });
+        }
+    });
+
+    // exclusive prefix sum of counts. each block is summed in parallel,
+    // then block offsets are propagated
 
-                VPNode *new_node = vp_node_arena.create<VPNode>();
-                new_node->pixel = &pixel;
-                new_node->next  = entry;
+    constexpr int SCAN_BLOCK_SIZE = 1 << 16;
+    const int scan_block_count = static_cast<int>(
+        (entry_count + SCAN_BLOCK_SIZE - 1) / SCAN_BLOCK_SIZE);
 
-                while(!entry.compare_exchange_weak(new_node->next, new_node))
-                    ;
+    entry_beg_.resize(entry_count + 1);
+    std::vector<uint32_t> block_sums(scan_block_count + 1, 0);
+
+    parallel_for_1d_grid(
+        thread_count, scan_block_count, 1,
+        [&](int, int beg, int end)
+    {
+        for(int block = beg; block < end; ++block)
+        {
+            const size_t entry_beg = size_t(block) * SCAN_BLOCK_SIZE;
+            const size_t entry_end = (std::min)(
+                entry_beg + SCAN_BLOCK_SIZE, entry_count);
+
+            uint32_t sum = 0;
+            for(size_t i = entry_beg; i < entry_end; ++i)
+            {
+                entry_beg_[i] = sum;
+                sum += entry_cursors_[i].load(std::memory_order_relaxed);
             }
+            block_sums[block + 1] = sum;
         }
-    }
+    });
+
+    for(int block = 0; block < scan_block_count; ++block)
+        block_sums[block + 1] += block_sums[block];
+
+    parallel_for_1d_grid(
+        thread_count, scan_block_count, 1,
+        [&](int, int beg, int end)
+    {
+        for(int block = beg; block < end; ++block)
+        {
+            const size_t entry_beg = size_t(block) * SCAN_BLOCK_SIZE;
+            const size_t entry_end = (std::min)(
+                entry_beg + SCAN_BLOCK_SIZE, entry_count);
+
+            for(size_t i = entry_beg; i < entry_end; ++i)
+            {
+                entry_beg_[i] += block_sums[block];
+                entry_cursors_[i].store(
+                    entry_beg_[i], std::memory_order_relaxed);
+            }
+        }
+    });
+
+    entry_beg_[entry_count] = block_sums[scan_block_count];
+
+    // scatter records to their entries
+
+    records_.resize(entry_beg_[entry_count]);
+
+    parallel_for_1d_grid(
+        thread_count, total_pixels, PIXEL_GRID_SIZE,
+        [&](int, int beg, int end)
+    {
+        for(int i = beg; i < end; ++i)
+        {
+            Pixel &pixel = pixels[i];
+            if(!pixel.vp.is_valid())
+                continue;
+
+            for_each_cell(pixel, [&](const Vec3i &cell)
+            {
+                const uint32_t record_idx =
+                    entry_cursors_[cell_to_entry(cell)].fetch_add(
+                        1, std::memory_order_relaxed);
+
+                records_[record_idx] = {
+                    pixel.vp.pos, pixel.radius * pixel.radius,
+                    &pixel, cell_to_key(cell)
+                };
+            });
+        }
+    });
 }
 
-void VisiblePointSearcher::add_photon(
-    const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr)
+template<typename Func>
+void VisiblePointSearcher::for_each_contribution(
+    const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr,
+    Func &&func) const
 {
-    const size_t entry_index = hashed_grid_aux_.pos_to_entry(photon_pos);
-    for(VPNode *node = node_entries_[entry_index]; node; node = node->next)
+    if(records_.empty())
+        return;
+
+    const Vec3i cell = pos_to_cell(photon_pos);
+    const uint64_t cell_key = cell_to_key(cell);
+    const size_t entry = cell_to_entry(cell);
+
+    const uint32_t end = entry_beg_[entry + 1];
+    for(uint32_t i = entry_beg_[entry]; i < end; ++i)
     {
-        auto &pixel = *node->pixel;
-        if(distance2(pixel.vp.pos, photon_pos) > pixel.radius * pixel.radius)
+        const VPRecord &record = records_[i];
+        if(record.cell_key != cell_key ||
+           distance2(record.pos, photon_pos) > record.radius2)
             continue;
 
+        auto &pixel = *record.pixel;
         const FSpectrum delta_phi = phi * pixel.vp.bsdf->eval(
             wr, pixel.vp.wr, TransMode::Radiance);
 
         if(!delta_phi.is_finite())
             continue;
 
+        func(pixel, delta_phi);
+    }
+}
+
+Vec3i VisiblePointSearcher::pos_to_cell(const FVec3 &pos) const noexcept
+{
+    constexpr real MAX_CELL = real((1 << 21) - 1);
+    const FVec3 cell = (pos - world_low_) * inv_cell_sidelen_;
+    return {
+        static_cast<int>(math::clamp<real>(cell.x, 0, MAX_CELL)),
+        static_cast<int>(math::clamp<real>(cell.y, 0, MAX_CELL)),
+        static_cast<int>(math::clamp<real>(cell.z, 0, MAX_CELL))
+    };
+}
+
+size_t VisiblePointSearcher::cell_to_entry(const Vec3i &cell) const noexcept
+{
+    return misc::hash(cell.x, cell.y, cell.z) & entry_mask_;
+}
+
+uint64_t VisiblePointSearcher::cell_to_key(const Vec3i &cell) noexcept
+{
+    return (uint64_t(cell.x) << 42) | (uint64_t(cell.y) << 21) | uint64_t(cell.z);
+}
+
+void VisiblePointSearcher::add_photon(
+    const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr) const
+{
+    for_each_contribution(photon_pos, phi, wr,
+        [](Pixel &pixel, const FSpectrum &delta_phi)
+    {
         for(int i = 0; i < SPECTRUM_COMPONENT_COUNT; ++i)
             math::atomic_add(pixel.phi[i], delta_phi[i]);
         ++pixel.M;
-    }
+    });
+}
+
+void VisiblePointSearcher::add_photon(
+    const FVec3 &photon_pos, const FSpectrum &phi, const FVec3 &wr,
+    PhotonDepositBuffer &deposits) const
+{
+    for_each_contribution(photon_pos, phi, wr,
+        [&](Pixel &pixel, const FSpectrum &delta_phi)
+    {
+        deposits.add(&pixel, delta_phi);
+    });
 }
 
 Pixel::VisiblePoint tracer_vp(
@@ -169,63 +450,95 @@ Pixel::VisiblePoint tracer_vp(
     return { {}, {}, {}, nullptr };
 }
 
-void trace_photon(
-    int min_depth, int max_depth, real cont_prob,
-    VisiblePointSearcher &vp_searcher,
-    const Scene &scene, Arena &arena, Sampler &sampler)
+namespace
 {
-    // emit a photon
 
-    auto [light, select_light_pdf] = scene.sample_light(sampler.sample1());
-    if(!light)
-        return;
+    template<typename AddPhoton>
+    void trace_photon_impl(
+        int min_depth, int max_depth, real cont_prob,
+        const Scene &scene, Arena &arena, Sampler &sampler,
+        AddPhoton &&add_photon)
+    {
+        // emit a photon
 
-    const auto emit = light->sample_emit(sampler.sample5());
-    if(!emit.radiance)
-        return;
+        auto [light, select_light_pdf] = scene.sample_light(sampler.sample1());
+        if(!light)
+            return;
 
-    FSpectrum coef = emit.radiance * std::abs(cos(emit.nor, emit.dir))
-                  / (select_light_pdf * emit.pdf_pos * emit.pdf_dir);
+        const auto emit = light->sample_emit(sampler.sample5());
+        if(!emit.radiance)
+            return;
 
-    Ray ray(emit.pos, emit.dir, EPS());
+        FSpectrum coef = emit.radiance * std::abs(cos(emit.nor, emit.dir))
+                      / (select_light_pdf * emit.pdf_pos * emit.pdf_dir);
 
-    // trace the photon
+        Ray ray(emit.pos, emit.dir, EPS());
 
-    for(int depth = 1; depth <= max_depth; ++depth)
-    {
-        // apply RR strategy
+        // trace the photon
 
-        if(depth > min_depth)
+        for(int depth = 1; depth <= max_depth; ++depth)
         {
-            if(sampler.sample1().u > cont_prob)
-                return;
-            coef /= cont_prob;
-        }
+            // apply RR strategy
 
-        // find closest intersection
+            if(depth > min_depth)
+            {
+                if(sampler.sample1().u > cont_prob)
+                    return;
+                coef /= cont_prob;
+            }
 
-        EntityIntersection inct;
-        if(!scene.closest_intersection(ray, &inct))
-            return;
+            // find closest intersection
 
-        // accumulate flux at visible points
-        // ignore direct illumination
-        if(depth > 1)
-            vp_searcher.add_photon(inct.pos, coef, inct.wr);
+            EntityIntersection inct;
+            if(!scene.closest_intersection(ray, &inct))
+                return;
 
-        // sample bsdf to create next ray
+            // accumulate flux at visible points
+            // ignore direct illumination
+            if(depth > 1)
+                add_photon(inct.pos, coef, inct.wr);
 
-        const ShadingPoint shd = inct.material->shade(inct, arena);
-        const auto bsdf_sample = shd.bsdf->sample(
-            inct.wr, TransMode::Importance, sampler.sample3());
-        if(!bsdf_sample.f)
-            return;
+            // sample bsdf to create next ray
 
-        coef *= bsdf_sample.f / bsdf_sample.pdf
-              * std::abs(cos(inct.geometry_coord.z, bsdf_sample.dir));
+            const ShadingPoint shd = inct.material->shade(inct, arena);
+            const auto bsdf_sample = shd.bsdf->sample(
+                inct.wr, TransMode::Importance, sampler.sample3());
+            if(!bsdf_sample.f)
+                return;
 
-        ray = Ray(inct.eps_offset(bsdf_sample.dir), bsdf_sample.dir);
+            coef *= bsdf_sample.f / bsdf_sample.pdf
+                  * std::abs(cos(inct.geometry_coord.z, bsdf_sample.dir));
+
+            ray = Ray(inct.eps_offset(bsdf_sample.dir), bsdf_sample.dir);
+        }
     }
+
+} // namespace anonymous
+
+void trace_photon(
+    int min_depth, int max_depth, real cont_prob,
+    const VisiblePointSearcher &vp_searcher,
+    const Scene &scene, Arena &arena, Sampler &sampler)
+{
+    trace_photon_impl(
+        min_depth, max_depth, cont_prob, scene, arena, sampler,
+        [&](const FVec3 &pos, const FSpectrum &phi, const FVec3 &wr)
+    {
+        vp_searcher.add_photon(pos, phi, wr);
+    });
+}
+
+void trace_photon(
+    int min_depth, int max_depth, real cont_prob,
+    const VisiblePointSearcher &vp_searcher, PhotonDepositBuffer &deposits,
+    const Scene &scene, Arena &arena, Sampler &sampler)
+{
+    trace_photon_impl(
+        min_depth, max_depth, cont_prob, scene, arena, sampler,
+        [&](const FVec3 &pos, const FSpectrum &phi, const FVec3 &wr)
+    {
+        vp_searcher.add_photon(pos, phi, wr, deposits);
+    });
 }
 
 void update_pixel_params(real alpha, Pixel &pixel)
@@ -0,0 +1,492 @@
+#include <cmath>
+#include <vector>
+
+#include <agz/tracer/utility/ld_sampler.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    // max number of values generated by one sampleN() call
+    constexpr int SOBOL_DIM_COUNT = 5;
+
+    constexpr int BLUE_NOISE_SIZE = 64;
+
+    uint32_t hash_u32(uint32_t x) noexcept
+    {
+        // lowbias32 by Chris Wellons
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t hash_combine(uint32_t seed, uint32_t v) noexcept
+    {
+        return hash_u32(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+    }
+
+    uint32_t reverse_bits(uint32_t x) noexcept
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) noexcept
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept
+    {
+        x = reverse_bits(x);
+        x = laine_karras_permutation(x, seed);
+        return reverse_bits(x);
+    }
+
+    real to_unit(uint32_t x) noexcept
+    {
+        constexpr real ONE_MINUS_EPS = real(0x1.fffffep-1);
+        return (std::min)(real(x) * real(0x1p-32), ONE_MINUS_EPS);
+    }
+
+    real fract(real x) noexcept
+    {
+        constexpr real ONE_MINUS_EPS = real(0x1.fffffep-1);
+        return (std::min)(x - std::floor(x), ONE_MINUS_EPS);
+    }
+
+    // sobol direction numbers of the first dims, from primitive polynomials
+    // and initial values of Joe & Kuo
+    struct SobolDirections
+    {
+        uint32_t v[SOBOL_DIM_COUNT][32];
+
+        SobolDirections() noexcept
+        {
+            for(int i = 0; i < 32; ++i)
+                v[0][i] = 1u << (31 - i);
+
+            struct Poly { int s; uint32_t a; uint32_t m[3]; };
+            const Poly polys[SOBOL_DIM_COUNT - 1] = {
+                { 1, 0, { 1 } },
+                { 2, 1, { 1, 3 } },
+                { 3, 1, { 1, 3, 1 } },
+                { 3, 2, { 1, 1, 1 } }
+            };
+
+            for(int d = 1; d < SOBOL_DIM_COUNT; ++d)
+            {
+                const Poly &p = polys[d - 1];
+                uint32_t *dv = v[d];
+
+                for(int i = 0; i < p.s; ++i)
+                    dv[i] = p.m[i] << (31 - i);
+
+                for(int i = p.s; i < 32; ++i)
+                {
+                    dv[i] = dv[i - p.s] ^ (dv[i - p.s] >> p.s);
+                    for(int k = 1; k < p.s; ++k)
+                        dv[i] ^= ((p.a >> (p.s - 1 - k)) & 1) * dv[i - k];
+                }
+            }
+        }
+    };
+
+    uint32_t sobol(uint32_t index, int dim) noexcept
+    {
+        static const SobolDirections directions;
+
+        uint32_t ret = 0;
+        for(int bit = 0; index; ++bit, index >>= 1)
+        {
+            if(index & 1)
+                ret ^= directions.v[dim][bit];
+        }
+        return ret;
+    }
+
+    /*
+     * blue noise mask generated by void-and-cluster
+     * (Ulichney 1993, "The void-and-cluster method for dither array generation")
+     */
+    class BlueNoiseMask
+    {
+        static constexpr int N = BLUE_NOISE_SIZE;
+        static constexpr int PIXEL_COUNT = N * N;
+        static constexpr int KERNEL_RADIUS = 6;
+
+        real kernel_[2 * KERNEL_RADIUS + 1][2 * KERNEL_RADIUS + 1];
+
+        real values_[PIXEL_COUNT];
+
+        struct Pattern
+        {
+            std::vector<bool> ones;
+            std::vector<real> energy;
+        };
+
+        void toggle(Pattern &pattern, int idx, bool one) const noexcept
+        {
+            pattern.ones[idx] = one;
+
+            const real sign = one ? real(1) : real(-1);
+            const int x = idx % N, y = idx / N;
+            for(int dy = -KERNEL_RADIUS; dy <= KERNEL_RADIUS; ++dy)
+            {
+                const int ny = (y + dy + N) % N;
+                for(int dx = -KERNEL_RADIUS; dx <= KERNEL_RADIUS; ++dx)
+                {
+                    const int nx = (x + dx + N) % N;
+                    pattern.energy[ny * N + nx] +=
+                        sign * kernel_[dy + KERNEL_RADIUS][dx + KERNEL_RADIUS];
+                }
+            }
+        }
+
+        // one with max energy
+        static int tightest_cluster(const Pattern &pattern) noexcept
+        {
+            int ret = -1;
+            for(int i = 0; i < PIXEL_COUNT; ++i)
+            {
+                if(pattern.ones[i] &&
+                   (ret < 0 || pattern.energy[i] > pattern.energy[ret]))
+                    ret = i;
+            }
+            return ret;
+        }
+
+        // zero with min energy
+        static int largest_void(const Pattern &pattern) noexcept
+        {
+            int ret = -1;
+            for(int i = 0; i < PIXEL_COUNT; ++i)
+            {
+                if(!pattern.ones[i] &&
+                   (ret < 0 || pattern.energy[i] < pattern.energy[ret]))
+                    ret = i;
+            }
+            return ret;
+        }
+
+    public:
+
+        BlueNoiseMask()
+        {
+            constexpr real SIGMA = real(1.5);
+            for(int dy = -KERNEL_RADIUS; dy <= KERNEL_RADIUS; ++dy)
+            {
+                for(int dx = -KERNEL_RADIUS; dx <= KERNEL_RADIUS; ++dx)
+                {
+                    kernel_[dy + KERNEL_RADIUS][dx + KERNEL_RADIUS] = std::exp(
+                        -real(dx * dx + dy * dy) / (2 * SIGMA * SIGMA));
+                }
+            }
+
+            // initial binary pattern
+
+            Pattern initial;
+            initial.ones.resize(PIXEL_COUNT, false);
+            initial.energy.resize(PIXEL_COUNT, real(0));
+
+            const int init_count = PIXEL_COUNT / 10;
+            for(int i = 0, placed = 0; placed < init_count; ++i)
+            {
+                const int idx = static_cast<int>(
+                    hash_u32(static_cast<uint32_t>(i)) % PIXEL_COUNT);
+                if(!initial.ones[idx])
+                {
+                    toggle(initial, idx, true);
+                    ++placed;
+                }
+            }
+
+            // move ones from tightest clusters to largest voids
+
+            for(int iter = 0; iter < PIXEL_COUNT; ++iter)
+            {
+                const int cluster = tightest_cluster(initial);
+                toggle(initial, cluster, false);
+
+                const int void_idx = largest_void(initial);
+                toggle(initial, void_idx, true);
+
+                if(void_idx == cluster)
+                    break;
+            }
+
+            // ranks of initial ones
+
+            std::vector<int> ranks(PIXEL_COUNT);
+            {
+                Pattern pattern = initial;
+                for(int rank = init_count - 1; rank >= 0; --rank)
+                {
+                    const int cluster = tightest_cluster(pattern);
+                    toggle(pattern, cluster, false);
+                    ranks[cluster] = rank;
+                }
+            }
+
+            // ranks of remaining pixels
+
+            {
+                Pattern pattern = std::move(initial);
+                for(int rank = init_count; rank < PIXEL_COUNT; ++rank)
+                {
+                    const int void_idx = largest_void(pattern);
+                    toggle(pattern, void_idx, true);
+                    ranks[void_idx] = rank;
+                }
+            }
+
+            for(int i = 0; i < PIXEL_COUNT; ++i)
+                values_[i] = (ranks[i] + real(0.5)) / PIXEL_COUNT;
+        }
+
+        real operator()(int x, int y) const noexcept
+        {
+            return values_[(y & (N - 1)) * N + (x & (N - 1))];
+        }
+    };
+
+    const BlueNoiseMask &blue_noise_mask()
+    {
+        static const BlueNoiseMask mask;
+        return mask;
+    }
+
+    constexpr int HALTON_PRIMES[] = {
+          2,   3,   5,   7,  11,  13,  17,  19,  23,  29,
+         31,  37,  41,  43,  47,  53,  59,  61,  67,  71,
+         73,  79,  83,  89,  97, 101, 103, 107, 109, 113,
+        127, 131, 137, 139, 149, 151, 157, 163, 167, 173,
+        179, 181, 191, 193, 197, 199, 211, 223, 227, 229,
+        233, 239, 241, 251, 257, 263, 269, 271, 277, 281,
+        283, 293, 307, 311
+    };
+
+    constexpr int HALTON_DIM_COUNT =
+        static_cast<int>(sizeof(HALTON_PRIMES) / sizeof(HALTON_PRIMES[0]));
+
+    real radical_inverse(int base, uint32_t index) noexcept
+    {
+        const double inv_base = 1.0 / base;
+        double inv_base_n = 1;
+        uint64_t reversed = 0;
+        while(index)
+        {
+            const uint32_t next = index / base;
+            const uint32_t digit = index - next * base;
+            reversed = reversed * base + digit;
+            inv_base_n *= inv_base;
+            index = next;
+        }
+        return static_cast<real>(reversed * inv_base_n);
+    }
+
+    uint32_t pixel_hash(const Vec2i &pixel, uint32_t seed) noexcept
+    {
+        return hash_combine(
+            hash_combine(seed, static_cast<uint32_t>(pixel.x)),
+            static_cast<uint32_t>(pixel.y));
+    }
+
+} // namespace anonymous
+
+SobolSampler::SobolSampler(uint32_t seed) noexcept
+    : seed_(seed), pixel_seed_(seed)
+{
+
+}
+
+template<int N>
+void SobolSampler::sample_dims(real *output) noexcept
+{
+    static_assert(N <= SOBOL_DIM_COUNT);
+
+    const int dim = index_.dimension++;
+    const uint32_t seed = hash_combine(
+        pixel_seed_, static_cast<uint32_t>(dim));
+
+    const uint32_t index = nested_uniform_scramble(
+        static_cast<uint32_t>(index_.index), seed);
+
+    for(int i = 0; i < N; ++i)
+    {
+        const uint32_t v = nested_uniform_scramble(
+            sobol(index, i), hash_combine(seed, static_cast<uint32_t>(i)));
+        output[i] = dither(to_unit(v), dim * SOBOL_DIM_COUNT + i);
+    }
+}
+
+Sample1 SobolSampler::sample1()
+{
+    real u[1];
+    sample_dims<1>(u);
+    return { u[0] };
+}
+
+Sample2 SobolSampler::sample2()
+{
+    real u[2];
+    sample_dims<2>(u);
+    return { u[0], u[1] };
+}
+
+Sample3 SobolSampler::sample3()
+{
+    real u[3];
+    sample_dims<3>(u);
+    return { u[0], u[1], u[2] };
+}
+
+Sample4 SobolSampler::sample4()
+{
+    real u[4];
+    sample_dims<4>(u);
+    return { u[0], u[1], u[2], u[3] };
+}
+
+Sample5 SobolSampler::sample5()
+{
+    real u[5];
+    sample_dims<5>(u);
+    return { u[0], u[1], u[2], u[3], u[4] };
+}
+
+void SobolSampler::start_pixel_sample(const PixelSampleIndex &index)
+{
+    index_ = index;
+    pixel_seed_ = pixel_seed(index.pixel);
+}
+
+PixelSampleIndex SobolSampler::pixel_sample_index() const
+{
+    return index_;
+}
+
+uint32_t SobolSampler::pixel_seed(const Vec2i &pixel) const noexcept
+{
+    return pixel_hash(pixel, seed_);
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint32_t seed) noexcept
+    : SobolSampler(seed)
+{
+    // build the mask before rendering
+    blue_noise_mask();
+}
+
+uint32_t BlueNoiseSampler::pixel_seed(const Vec2i &pixel) const noexcept
+{
+    return seed_;
+}
+
+real BlueNoiseSampler::dither(real u, int dim) const noexcept
+{
+    // different dims use different toroidal offsets of the mask
+    const uint32_t h = hash_combine(seed_, static_cast<uint32_t>(dim));
+    const int ox = static_cast<int>(h & (BLUE_NOISE_SIZE - 1));
+    const int oy = static_cast<int>((h >> 16) & (BLUE_NOISE_SIZE - 1));
+    return fract(u + blue_noise_mask()(index_.pixel.x + ox, index_.pixel.y + oy));
+}
+
+HaltonSampler::HaltonSampler(uint32_t seed) noexcept
+    : seed_(seed), pixel_seed_(seed)
+{
+
+}
+
+real HaltonSampler::next() noexcept
+{
+    const int dim = index_.dimension++;
+    const uint32_t dim_seed = hash_combine(
+        pixel_seed_, static_cast<uint32_t>(dim));
+    const auto index = static_cast<uint32_t>(index_.index);
+
+    if(dim >= HALTON_DIM_COUNT)
+        return to_unit(hash_combine(dim_seed, index));
+
+    // toroidal shift keeps the stratification of each pixel
+    return fract(radical_inverse(HALTON_PRIMES[dim], index) + to_unit(dim_seed));
+}
+
+Sample1 HaltonSampler::sample1()
+{
+    return { next() };
+}
+
+Sample2 HaltonSampler::sample2()
+{
+    const real u = next();
+    const real v = next();
+    return { u, v };
+}
+
+Sample3 HaltonSampler::sample3()
+{
+    const real u = next();
+    const real v = next();
+    const real w = next();
+    return { u, v, w };
+}
+
+Sample4 HaltonSampler::sample4()
+{
+    const real u = next();
+    const real v = next();
+    const real w = next();
+    const real r = next();
+    return { u, v, w, r };
+}
+
+Sample5 HaltonSampler::sample5()
+{
+    const real u = next();
+    const real v = next();
+    const real w = next();
+    const real r = next();
+    const real s = next();
+    return { u, v, w, r, s };
+}
+
+void HaltonSampler::start_pixel_sample(const PixelSampleIndex &index)
+{
+    index_ = index;
+    pixel_seed_ = pixel_hash(index.pixel, seed_);
+}
+
+PixelSampleIndex HaltonSampler::pixel_sample_index() const
+{
+    return index_;
+}
+
+Box<Sampler> create_pixel_sampler(PixelSamplerType type, uint32_t seed)
+{
+    switch(type)
+    {
+    case PixelSamplerType::Sobol:
+        return newBox<SobolSampler>(seed);
+    case PixelSamplerType::Halton:
+        return newBox<HaltonSampler>(seed);
+    case PixelSamplerType::BlueNoise:
+        return newBox<BlueNoiseSampler>(seed);
+    default:
+        return nullptr;
+    }
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,134 @@
+#include <agz/tracer/utility/progressive_preview.h>
+
+AGZ_TRACER_BEGIN
+
+ProgressivePreview::ProgressivePreview(
+    int width, int height, ResolveFunc resolve,
+    Clock::duration min_refresh_interval, int tile_size)
+    : width_(width), height_(height), tile_size_((std::max)(tile_size, 1)),
+      resolve_(std::move(resolve)),
+      min_refresh_interval_(min_refresh_interval),
+      last_refresh_time_(Clock::now())
+{
+    tile_count_x_ = (width_  + tile_size_ - 1) / tile_size_;
+    tile_count_y_ = (height_ + tile_size_ - 1) / tile_size_;
+
+    const int tile_count = tile_count_x_ * tile_count_y_;
+    tile_mutexes_  = newBox<std::mutex[]>(tile_count);
+    tile_versions_ = newBox<std::atomic<uint32_t>[]>(tile_count);
+    for(int i = 0; i < tile_count; ++i)
+        tile_versions_[i].store(0, std::memory_order_relaxed);
+
+    // both images are black and up to date with version 0
+
+    for(int i = 0; i < 2; ++i)
+    {
+        image_versions_[i].resize(tile_count, 0);
+        images_[i].initialize(height_, width_);
+    }
+}
+
+void ProgressivePreview::mark_dirty(const Rect2i &pixels) noexcept
+{
+    const Rect2i tiles = tile_range(pixels);
+    for(int y = tiles.low.y; y <= tiles.high.y; ++y)
+    {
+        for(int x = tiles.low.x; x <= tiles.high.x; ++x)
+        {
+            tile_versions_[y * tile_count_x_ + x].fetch_add(
+                1, std::memory_order_release);
+        }
+    }
+}
+
+void ProgressivePreview::mark_all_dirty() noexcept
+{
+    mark_dirty({ { 0, 0 }, { width_ - 1, height_ - 1 } });
+}
+
+bool ProgressivePreview::try_refresh()
+{
+    std::unique_lock lk(refresh_mutex_, std::try_to_lock);
+    if(!lk.owns_lock())
+        return false;
+
+    if(Clock::now() - last_refresh_time_ < min_refresh_interval_)
+        return false;
+
+    refresh_impl();
+    return true;
+}
+
+void ProgressivePreview::refresh()
+{
+    std::lock_guard lk(refresh_mutex_);
+    refresh_impl();
+}
+
+Image2D<Spectrum> ProgressivePreview::get_image() const
+{
+    std::lock_guard lk(front_mutex_);
+    return images_[front_];
+}
+
+Rect2i ProgressivePreview::tile_range(const Rect2i &pixels) const noexcept
+{
+    return {
+        {
+            math::clamp(pixels.low.x / tile_size_, 0, tile_count_x_ - 1),
+            math::clamp(pixels.low.y / tile_size_, 0, tile_count_y_ - 1)
+        },
+        {
+            math::clamp(pixels.high.x / tile_size_, 0, tile_count_x_ - 1),
+            math::clamp(pixels.high.y / tile_size_, 0, tile_count_y_ - 1)
+        }
+    };
+}
+
+void ProgressivePreview::refresh_impl()
+{
+    // the back image is only accessed by the refreshing thread, so tiles
+    // can be resolved without blocking get_image
+
+    const int back = 1 - front_;
+    Image2D<Spectrum> &image = images_[back];
+    std::vector<uint32_t> &versions = image_versions_[back];
+
+    for(int ty = 0; ty < tile_count_y_; ++ty)
+    {
+        for(int tx = 0; tx < tile_count_x_; ++tx)
+        {
+            const int tile_index = ty * tile_count_x_ + tx;
+
+            // a tile written after this load is resolved again next time
+            const uint32_t version = tile_versions_[tile_index].load(
+                std::memory_order_acquire);
+            if(version == versions[tile_index])
+                continue;
+
+            const Rect2i pixels = {
+                { tx * tile_size_, ty * tile_size_ },
+                {
+                    (std::min)((tx + 1) * tile_size_, width_)  - 1,
+                    (std::min)((ty + 1) * tile_size_, height_) - 1
+                }
+            };
+
+            {
+                std::lock_guard lk(tile_mutexes_[tile_index]);
+                resolve_(pixels, image);
+            }
+
+            versions[tile_index] = version;
+        }
+    }
+
+    {
+        std::lock_guard lk(front_mutex_);
+        front_ = back;
+    }
+
+    last_refresh_time_ = Clock::now();
+}
+
+AGZ_TRACER_END
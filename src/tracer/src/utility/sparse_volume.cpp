@@ -0,0 +1,356 @@
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <agz/tracer/utility/sparse_volume.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    uint64_t align_section(uint64_t offset) noexcept
+    {
+        return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT
+                                                * SECTION_ALIGNMENT;
+    }
+
+    size_t encoding_elem_size(SparseVolumeEncoding encoding)
+    {
+        switch(encoding)
+        {
+        case SparseVolumeEncoding::Float32: return sizeof(float);
+        case SparseVolumeEncoding::UNorm8:  return sizeof(uint8_t);
+        case SparseVolumeEncoding::UNorm16: return sizeof(uint16_t);
+        }
+        throw std::runtime_error("unknown sparse volume encoding");
+    }
+
+    // write dense volume with texel accessor func(x, y, z, channel)
+    template<typename Func>
+    void save_sparse_brick_volume_impl(
+        const std::string &filename,
+        int width, int height, int depth, int channel_count,
+        const Func &func, SparseVolumeEncoding encoding,
+        int brick_size, real empty_threshold)
+    {
+        if(width <= 0 || height <= 0 || depth <= 0)
+            throw std::runtime_error("empty volume");
+
+        if(brick_size <= 0 || (brick_size & (brick_size - 1)))
+        {
+            throw std::runtime_error(
+                "invalid brick size: " + std::to_string(brick_size));
+        }
+
+        const size_t elem_size = encoding_elem_size(encoding);
+        const size_t brick_texel_count =
+            size_t(brick_size) * brick_size * brick_size;
+        const size_t brick_bytes =
+            brick_texel_count * channel_count * elem_size;
+
+        SparseVolumeHeader header = {};
+        std::memcpy(header.magic, SparseBrickVolume::MAGIC, sizeof(header.magic));
+        header.version       = SparseBrickVolume::VERSION;
+        header.encoding      = encoding;
+        header.width         = uint32_t(width);
+        header.height        = uint32_t(height);
+        header.depth         = uint32_t(depth);
+        header.channel_count = uint32_t(channel_count);
+        header.brick_size    = uint32_t(brick_size);
+        header.brick_count_x = uint32_t((width  + brick_size - 1) / brick_size);
+        header.brick_count_y = uint32_t((height + brick_size - 1) / brick_size);
+        header.brick_count_z = uint32_t((depth  + brick_size - 1) / brick_size);
+
+        const size_t brick_count = size_t(header.brick_count_x)
+                                 * header.brick_count_y
+                                 * header.brick_count_z;
+
+        std::vector<uint32_t>              brick_table(brick_count);
+        std::vector<SparseVolumeBrickInfo> brick_infos;
+        std::vector<unsigned char>         brick_data;
+
+        std::vector<float> texels(brick_texel_count * channel_count);
+
+        for(uint32_t bz = 0; bz < header.brick_count_z; ++bz)
+        {
+            for(uint32_t by = 0; by < header.brick_count_y; ++by)
+            {
+                for(uint32_t bx = 0; bx < header.brick_count_x; ++bx)
+                {
+                    // gather texels of the brick. texels outside the volume
+                    // repeat the border ones
+
+                    bool empty = true;
+                    for(int lz = 0, i = 0; lz < brick_size; ++lz)
+                    {
+                        const int z = (std::min)(int(bz) * brick_size + lz, depth - 1);
+                        for(int ly = 0; ly < brick_size; ++ly)
+                        {
+                            const int y = (std::min)(int(by) * brick_size + ly, height - 1);
+                            for(int lx = 0; lx < brick_size; ++lx)
+                            {
+                                const int x = (std::min)(int(bx) * brick_size + lx, width - 1);
+                                for(int c = 0; c < channel_count; ++c, ++i)
+                                {
+                                    texels[i] = float(func(x, y, z, c));
+                                    empty &= texels[i] <= empty_threshold;
+                                }
+                            }
+                        }
+                    }
+
+                    const size_t table_idx =
+                        (size_t(bz) * header.brick_count_y + by)
+                            * header.brick_count_x + bx;
+
+                    if(empty)
+                    {
+                        brick_table[table_idx] = SparseBrickVolume::EMPTY_BRICK;
+                        continue;
+                    }
+
+                    brick_table[table_idx] = uint32_t(brick_infos.size());
+
+                    // quantize
+
+                    SparseVolumeBrickInfo info = {};
+                    for(int c = 0; c < channel_count; ++c)
+                    {
+                        float low = texels[c], high = texels[c];
+                        for(size_t i = c; i < texels.size(); i += channel_count)
+                        {
+                            low  = (std::min)(low,  texels[i]);
+                            high = (std::max)(high, texels[i]);
+                        }
+
+                        if(encoding == SparseVolumeEncoding::Float32)
+                        {
+                            info.base[c]  = 0;
+                            info.scale[c] = 1;
+                        }
+                        else
+                        {
+                            const float max_q =
+                                encoding == SparseVolumeEncoding::UNorm8 ?
+                                255.0f : 65535.0f;
+                            info.base[c]  = low;
+                            info.scale[c] = (high - low) / max_q;
+                        }
+                    }
+
+                    const size_t data_offset = brick_data.size();
+                    brick_data.resize(data_offset + brick_bytes);
+                    unsigned char *data = brick_data.data() + data_offset;
+
+                    info.max_value = 0;
+                    for(size_t i = 0; i < texels.size(); ++i)
+                    {
+                        const int c = int(i % channel_count);
+
+                        float value = texels[i];
+                        if(encoding == SparseVolumeEncoding::Float32)
+                            std::memcpy(data + i * elem_size, &value, elem_size);
+                        else
+                        {
+                            const float max_q =
+                                encoding == SparseVolumeEncoding::UNorm8 ?
+                                255.0f : 65535.0f;
+
+                            float q = 0;
+                            if(info.scale[c] > 0)
+                            {
+                                q = std::round(math::clamp(
+                                    (value - info.base[c]) / info.scale[c],
+                                    0.0f, max_q));
+                            }
+
+                            if(encoding == SparseVolumeEncoding::UNorm8)
+                                data[i] = uint8_t(q);
+                            else
+                            {
+                                const uint16_t q16 = uint16_t(q);
+                                std::memcpy(data + i * elem_size, &q16, elem_size);
+                            }
+
+                            // max values are computed from decoded texels
+                            value = info.base[c] + info.scale[c] * q;
+                        }
+
+                        header.max_value[c] = (std::max)(
+                            header.max_value[c], value);
+                        if(!c)
+                            info.max_value = (std::max)(info.max_value, value);
+                    }
+
+                    brick_infos.push_back(info);
+                }
+            }
+        }
+
+        header.occupied_brick_count = uint32_t(brick_infos.size());
+        header.brick_table_offset = align_section(sizeof(header));
+        header.brick_info_offset  = align_section(
+            header.brick_table_offset + brick_table.size() * sizeof(uint32_t));
+        header.brick_data_offset  = align_section(
+            header.brick_info_offset +
+            brick_infos.size() * sizeof(SparseVolumeBrickInfo));
+
+        std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+        if(!fout)
+            throw std::runtime_error("failed to open file: " + filename);
+
+        auto write_section = [&](uint64_t offset, const void *data, size_t bytes)
+        {
+            const auto pos = static_cast<uint64_t>(fout.tellp());
+            static const char zeros[SECTION_ALIGNMENT] = {};
+            fout.write(zeros, static_cast<std::streamsize>(offset - pos));
+            fout.write(static_cast<const char*>(data),
+                       static_cast<std::streamsize>(bytes));
+        };
+
+        write_section(0, &header, sizeof(header));
+        write_section(
+            header.brick_table_offset, brick_table.data(),
+            brick_table.size() * sizeof(uint32_t));
+        write_section(
+            header.brick_info_offset, brick_infos.data(),
+            brick_infos.size() * sizeof(SparseVolumeBrickInfo));
+        write_section(
+            header.brick_data_offset, brick_data.data(), brick_data.size());
+
+        if(!fout)
+            throw std::runtime_error("failed to write file: " + filename);
+    }
+
+} // namespace anonymous
+
+SparseBrickVolume::SparseBrickVolume(const std::string &filename)
+    : file_(filename)
+{
+    auto fail = [&](const std::string &msg)
+    {
+        throw std::runtime_error(
+            "invalid sparse brick volume " + filename + ": " + msg);
+    };
+
+    const unsigned char *data = file_.data();
+    const size_t size = file_.size();
+
+    if(size < sizeof(SparseVolumeHeader))
+        fail("file is too small");
+
+    header_ = reinterpret_cast<const SparseVolumeHeader*>(data);
+    if(std::memcmp(header_->magic, MAGIC, sizeof(MAGIC)) != 0)
+        fail("magic number mismatch");
+    if(header_->version != VERSION)
+        fail("unsupported version " + std::to_string(header_->version));
+
+    const size_t elem_size = encoding_elem_size(header_->encoding);
+
+    if(!header_->width || !header_->height || !header_->depth)
+        fail("empty volume");
+    if(header_->channel_count != 1 && header_->channel_count != 3)
+        fail("invalid channel count");
+
+    const uint32_t brick_size = header_->brick_size;
+    if(!brick_size || (brick_size & (brick_size - 1)))
+        fail("invalid brick size");
+
+    while((1u << brick_shift_) < brick_size)
+        ++brick_shift_;
+    brick_mask_ = int(brick_size - 1);
+
+    if(header_->brick_count_x != (header_->width  + brick_size - 1) / brick_size ||
+       header_->brick_count_y != (header_->height + brick_size - 1) / brick_size ||
+       header_->brick_count_z != (header_->depth  + brick_size - 1) / brick_size)
+        fail("invalid brick count");
+
+    const uint64_t brick_count = uint64_t(header_->brick_count_x)
+                               * header_->brick_count_y
+                               * header_->brick_count_z;
+    brick_bytes_ = size_t(brick_size) * brick_size * brick_size
+                 * header_->channel_count * elem_size;
+
+    auto check_section = [&](uint64_t offset, uint64_t bytes)
+    {
+        if(offset % SECTION_ALIGNMENT || offset > size || bytes > size - offset)
+            fail("section out of range");
+    };
+
+    check_section(header_->brick_table_offset, brick_count * sizeof(uint32_t));
+    check_section(
+        header_->brick_info_offset,
+        uint64_t(header_->occupied_brick_count) * sizeof(SparseVolumeBrickInfo));
+    check_section(
+        header_->brick_data_offset,
+        uint64_t(header_->occupied_brick_count) * brick_bytes_);
+
+    brick_table_ = reinterpret_cast<const uint32_t*>(
+        data + header_->brick_table_offset);
+    brick_infos_ = reinterpret_cast<const SparseVolumeBrickInfo*>(
+        data + header_->brick_info_offset);
+    brick_data_  = data + header_->brick_data_offset;
+
+    for(uint64_t i = 0; i < brick_count; ++i)
+    {
+        if(brick_table_[i] != EMPTY_BRICK &&
+           brick_table_[i] >= header_->occupied_brick_count)
+            fail("invalid brick index");
+    }
+}
+
+FSpectrum SparseBrickVolume::max_spectrum() const noexcept
+{
+    if(header_->channel_count == 1)
+        return FSpectrum(header_->max_value[0]);
+    return FSpectrum(
+        header_->max_value[0], header_->max_value[1], header_->max_value[2]);
+}
+
+real SparseBrickVolume::max_real_in(
+    const Vec3i &beg, const Vec3i &end) const noexcept
+{
+    real ret = 0;
+    for(int bz = beg.z >> brick_shift_; bz <= end.z >> brick_shift_; ++bz)
+    {
+        for(int by = beg.y >> brick_shift_; by <= end.y >> brick_shift_; ++by)
+        {
+            for(int bx = beg.x >> brick_shift_; bx <= end.x >> brick_shift_; ++bx)
+            {
+                const uint32_t brick = brick_index(bx, by, bz);
+                if(brick != EMPTY_BRICK)
+                    ret = (std::max)(ret, real(brick_infos_[brick].max_value));
+            }
+        }
+    }
+    return ret;
+}
+
+void save_sparse_brick_volume(
+    const std::string &filename, const Image3D<real> &data,
+    SparseVolumeEncoding encoding, int brick_size, real empty_threshold)
+{
+    save_sparse_brick_volume_impl(
+        filename, data.width(), data.height(), data.depth(), 1,
+        [&](int x, int y, int z, int)
+    {
+        return data.at(z, y, x);
+    }, encoding, brick_size, empty_threshold);
+}
+
+void save_sparse_brick_volume(
+    const std::string &filename, const Image3D<Spectrum> &data,
+    SparseVolumeEncoding encoding, int brick_size, real empty_threshold)
+{
+    save_sparse_brick_volume_impl(
+        filename, data.width(), data.height(), data.depth(), 3,
+        [&](int x, int y, int z, int c)
+    {
+        return data.at(z, y, x)[c];
+    }, encoding, brick_size, empty_threshold);
+}
+
+AGZ_TRACER_END
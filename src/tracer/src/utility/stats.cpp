@@ -0,0 +1,178 @@
+#include <agz/tracer/utility/stats.h>
+
+#ifdef AGZ_TRACER_STATS
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+AGZ_TRACER_BEGIN
+
+namespace stats
+{
+
+    namespace
+    {
+
+        constexpr int DROPPED_COUNTER = MAX_COUNTER_COUNT - 1;
+
+        struct Registry
+        {
+            std::mutex mutex;
+
+            std::vector<std::string> names;
+
+            // counters of alive threads are summed up on query
+            std::vector<const detail::ThreadCounters*> threads;
+            uint64_t retired[MAX_COUNTER_COUNT] = {};
+            uint64_t base[MAX_COUNTER_COUNT]    = {};
+
+            Registry()
+            {
+                names = {
+                    "rays.primary",
+                    "rays.closest",
+                    "rays.shadow",
+                    "rays.bssrdf_probe",
+                    "triangle_bvh.nodes",
+                    "triangle_bvh.triangles",
+                    "entity_bvh.nodes",
+                    "entity_bvh.entities",
+                    "heterogeneous_medium.steps"
+                };
+                assert(names.size() == size_t(Counter::BuiltinCount));
+            }
+
+            // requires mutex to be locked
+            void sum(uint64_t *output) const
+            {
+                std::copy(retired, retired + MAX_COUNTER_COUNT, output);
+                for(auto t : threads)
+                {
+                    for(int i = 0; i < MAX_COUNTER_COUNT; ++i)
+                        output[i] += t->values[i].load(std::memory_order_relaxed);
+                }
+            }
+        };
+
+        Registry &registry()
+        {
+            static Registry ret;
+            return ret;
+        }
+
+    } // namespace anonymous
+
+    namespace detail
+    {
+
+        ThreadCounters::ThreadCounters()
+        {
+            for(auto &v : values)
+                v.store(0, std::memory_order_relaxed);
+
+            auto &reg = registry();
+            std::lock_guard lk(reg.mutex);
+            reg.threads.push_back(this);
+        }
+
+        ThreadCounters::~ThreadCounters()
+        {
+            auto &reg = registry();
+            std::lock_guard lk(reg.mutex);
+            for(int i = 0; i < MAX_COUNTER_COUNT; ++i)
+                reg.retired[i] += values[i].load(std::memory_order_relaxed);
+            reg.threads.erase(
+                std::find(reg.threads.begin(), reg.threads.end(), this));
+        }
+
+    } // namespace detail
+
+    int register_counter(const std::string &name)
+    {
+        auto &reg = registry();
+        std::lock_guard lk(reg.mutex);
+
+        const auto it = std::find(reg.names.begin(), reg.names.end(), name);
+        if(it != reg.names.end())
+            return static_cast<int>(it - reg.names.begin());
+
+        if(static_cast<int>(reg.names.size()) >= DROPPED_COUNTER)
+            return DROPPED_COUNTER;
+
+        reg.names.push_back(name);
+        return static_cast<int>(reg.names.size() - 1);
+    }
+
+    void reset()
+    {
+        // counters can only be written by their owners, so the current
+        // sums are recorded as the new base instead
+        auto &reg = registry();
+        std::lock_guard lk(reg.mutex);
+        reg.sum(reg.base);
+    }
+
+    std::string report_json()
+    {
+        auto &reg = registry();
+
+        std::vector<std::string> names;
+        uint64_t values[MAX_COUNTER_COUNT];
+        {
+            std::lock_guard lk(reg.mutex);
+            names = reg.names;
+            reg.sum(values);
+            for(int i = 0; i < MAX_COUNTER_COUNT; ++i)
+                values[i] -= reg.base[i];
+        }
+
+        if(values[DROPPED_COUNTER])
+        {
+            names.resize(DROPPED_COUNTER);
+            names.push_back("stats.dropped");
+        }
+
+        // group counters by the part of names before the first dot,
+        // keeping the registration order
+
+        std::vector<std::string> groups;
+        for(auto &name : names)
+        {
+            const std::string group = name.substr(0, name.find('.'));
+            if(std::find(groups.begin(), groups.end(), group) == groups.end())
+                groups.push_back(group);
+        }
+
+        std::string ret = "{\n";
+        for(size_t g = 0; g < groups.size(); ++g)
+        {
+            ret += "  \"" + groups[g] + "\": {";
+
+            bool first = true;
+            for(size_t i = 0; i < names.size(); ++i)
+            {
+                const size_t dot = names[i].find('.');
+                if(names[i].substr(0, dot) != groups[g])
+                    continue;
+
+                const std::string item = dot == std::string::npos ?
+                                         names[i] : names[i].substr(dot + 1);
+                ret += first ? "\n" : ",\n";
+                ret += "    \"" + item + "\": " + std::to_string(values[i]);
+                first = false;
+            }
+
+            ret += g + 1 < groups.size() ? "\n  },\n" : "\n  }\n";
+        }
+        ret += "}";
+
+        return ret;
+    }
+
+} // namespace stats
+
+AGZ_TRACER_END
+
+#endif // #ifdef AGZ_TRACER_STATS
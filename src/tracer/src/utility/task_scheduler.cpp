@@ -0,0 +1,428 @@
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <agz/tracer/utility/task_scheduler.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    // set when the current thread is running a job of the pool
+    thread_local bool is_in_pool_job = false;
+
+    // parse cpu list like "0-3,8,10-11"
+    std::vector<int> parse_cpu_list(const std::string &str)
+    {
+        std::vector<int> ret;
+        std::stringstream sst(str);
+        std::string item;
+        while(std::getline(sst, item, ','))
+        {
+            if(item.empty() || item == "\n")
+                continue;
+
+            const size_t dash = item.find('-');
+            const int beg = std::stoi(item.substr(0, dash));
+            const int end = dash == std::string::npos ?
+                            beg : std::stoi(item.substr(dash + 1));
+            for(int i = beg; i <= end; ++i)
+                ret.push_back(i);
+        }
+        return ret;
+    }
+
+    // returns cpus usable by this process of each numa node.
+    // empty when unavailable
+    std::vector<std::vector<int>> query_numa_nodes()
+    {
+        std::vector<std::vector<int>> ret;
+
+#ifdef __linux__
+        cpu_set_t process_cpus;
+        CPU_ZERO(&process_cpus);
+        if(sched_getaffinity(0, sizeof(cpu_set_t), &process_cpus) != 0)
+            return {};
+
+        for(int node = 0;; ++node)
+        {
+            std::ifstream fin(
+                "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if(!fin)
+                break;
+
+            std::string line;
+            std::getline(fin, line);
+
+            try
+            {
+                auto cpus = parse_cpu_list(line);
+                cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu)
+                {
+                    return cpu < 0 || cpu >= CPU_SETSIZE ||
+                           !CPU_ISSET(cpu, &process_cpus);
+                }), cpus.end());
+
+                if(!cpus.empty())
+                    ret.push_back(std::move(cpus));
+            }
+            catch(...)
+            {
+                return {};
+            }
+        }
+#endif
+
+        return ret;
+    }
+
+    // floor(v / 2)
+    int floor_half(int v) noexcept
+    {
+        return (v - (v < 0 ? 1 : 0)) / 2;
+    }
+
+    int sign(int v) noexcept
+    {
+        return (v > 0) - (v < 0);
+    }
+
+    // generalized hilbert curve on the rectangle spanned by (x, y), a and b,
+    // where a is the major axis and b is the minor one. every tile is
+    // visited exactly once, so the cost is linear in the tile count
+    void gilbert(
+        int x, int y, int ax, int ay, int bx, int by,
+        std::vector<Vec2i> &out)
+    {
+        const int w = std::abs(ax + ay);
+        const int h = std::abs(bx + by);
+
+        const int dax = sign(ax), day = sign(ay);
+        const int dbx = sign(bx), dby = sign(by);
+
+        if(h == 1)
+        {
+            for(int i = 0; i < w; ++i, x += dax, y += day)
+                out.push_back({ x, y });
+            return;
+        }
+
+        if(w == 1)
+        {
+            for(int i = 0; i < h; ++i, x += dbx, y += dby)
+                out.push_back({ x, y });
+            return;
+        }
+
+        int ax2 = floor_half(ax), ay2 = floor_half(ay);
+        int bx2 = floor_half(bx), by2 = floor_half(by);
+
+        const int w2 = std::abs(ax2 + ay2);
+        const int h2 = std::abs(bx2 + by2);
+
+        if(2 * int64_t(w) > 3 * int64_t(h))
+        {
+            // long rectangle: split along the major axis, keeping the
+            // halves even so that the curve stays connected
+
+            if((w2 & 1) && w > 2)
+            {
+                ax2 += dax;
+                ay2 += day;
+            }
+
+            gilbert(x, y, ax2, ay2, bx, by, out);
+            gilbert(x + ax2, y + ay2, ax - ax2, ay - ay2, bx, by, out);
+            return;
+        }
+
+        // standard case: one step up, one long horizontal step, one step down
+
+        if((h2 & 1) && h > 2)
+        {
+            bx2 += dbx;
+            by2 += dby;
+        }
+
+        gilbert(x, y, bx2, by2, ax2, ay2, out);
+        gilbert(x + bx2, y + by2, ax, ay, bx - bx2, by - by2, out);
+        gilbert(
+            x + (ax - dax) + (bx2 - dbx), y + (ay - day) + (by2 - dby),
+            -bx2, -by2, -(ax - ax2), -(ay - ay2), out);
+    }
+
+} // namespace anonymous
+
+TaskScheduler &TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler()
+{
+    const auto nodes = query_numa_nodes();
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        for(int cpu : nodes[i])
+        {
+            cpus_.push_back(cpu);
+            cpu_nodes_.push_back(static_cast<int>(i));
+        }
+    }
+
+    if(cpus_.empty())
+    {
+        const int count = (std::max)(1u, std::thread::hardware_concurrency());
+        for(int i = 0; i < count; ++i)
+        {
+            cpus_.push_back(i);
+            cpu_nodes_.push_back(0);
+        }
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard lk(mutex_);
+        exit_ = true;
+    }
+    job_cond_.notify_all();
+
+    for(auto &w : workers_)
+        w.join();
+}
+
+void TaskScheduler::set_affinity(Affinity affinity)
+{
+    std::lock_guard lk(job_mutex_);
+    affinity_ = affinity;
+
+    // worker i runs thread index i + 1
+    for(size_t i = 0; i < workers_.size(); ++i)
+        apply_affinity(workers_[i], static_cast<int>(i + 1));
+}
+
+TaskScheduler::Affinity TaskScheduler::affinity() const
+{
+    return affinity_;
+}
+
+void TaskScheduler::run(
+    int thread_count, const std::function<void(int)> &func)
+{
+    if(thread_count <= 1)
+    {
+        func(0);
+        return;
+    }
+
+    if(is_in_pool_job)
+    {
+        run_with_temporary_threads(thread_count, func);
+        return;
+    }
+
+    std::unique_lock job_lk(job_mutex_, std::try_to_lock);
+    if(!job_lk.owns_lock())
+    {
+        run_with_temporary_threads(thread_count, func);
+        return;
+    }
+
+    spawn_workers(thread_count - 1);
+
+    {
+        std::lock_guard lk(mutex_);
+        ++job_id_;
+        job_func_         = &func;
+        job_thread_count_ = thread_count;
+        job_remaining_    = thread_count - 1;
+        job_exception_    = nullptr;
+    }
+    job_cond_.notify_all();
+
+    std::exception_ptr caller_exception;
+    is_in_pool_job = true;
+    try
+    {
+        func(0);
+    }
+    catch(...)
+    {
+        caller_exception = std::current_exception();
+    }
+    is_in_pool_job = false;
+
+    std::unique_lock lk(mutex_);
+    done_cond_.wait(lk, [&] { return job_remaining_ == 0; });
+    job_func_ = nullptr;
+
+    if(caller_exception)
+        std::rethrow_exception(caller_exception);
+    if(job_exception_)
+        std::rethrow_exception(job_exception_);
+}
+
+void TaskScheduler::spawn_workers(int worker_count)
+{
+    while(static_cast<int>(workers_.size()) < worker_count)
+    {
+        // job_id_ is only changed with job_mutex_ locked, which is held by
+        // the caller
+
+        const int worker_index = static_cast<int>(workers_.size());
+        const uint64_t job_id = job_id_;
+        workers_.emplace_back([this, worker_index, job_id]
+        {
+            worker_func(worker_index, job_id);
+        });
+        if(affinity_ != Affinity::None)
+            apply_affinity(workers_.back(), worker_index + 1);
+    }
+}
+
+void TaskScheduler::worker_func(int worker_index, uint64_t last_job_id)
+{
+    const int thread_index = worker_index + 1;
+
+    for(;;)
+    {
+        const std::function<void(int)> *func;
+
+        {
+            std::unique_lock lk(mutex_);
+            job_cond_.wait(lk, [&] { return exit_ || job_id_ != last_job_id; });
+            if(exit_)
+                return;
+
+            last_job_id = job_id_;
+            if(thread_index >= job_thread_count_)
+                continue;
+            func = job_func_;
+        }
+
+        std::exception_ptr exception;
+        is_in_pool_job = true;
+        try
+        {
+            (*func)(thread_index);
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+        }
+        is_in_pool_job = false;
+
+        bool done;
+        {
+            std::lock_guard lk(mutex_);
+            if(exception && !job_exception_)
+                job_exception_ = exception;
+            done = --job_remaining_ == 0;
+        }
+        if(done)
+            done_cond_.notify_one();
+    }
+}
+
+void TaskScheduler::apply_affinity(std::thread &thread, int thread_index) const
+{
+#ifdef __linux__
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+
+    const int cpu_count = static_cast<int>(cpus_.size());
+    const int cpu_idx = thread_index % cpu_count;
+
+    switch(affinity_)
+    {
+    case Affinity::None:
+        for(int cpu : cpus_)
+            CPU_SET(cpu, &cpu_set);
+        break;
+    case Affinity::NumaNode:
+        for(int i = 0; i < cpu_count; ++i)
+        {
+            if(cpu_nodes_[i] == cpu_nodes_[cpu_idx])
+                CPU_SET(cpus_[i], &cpu_set);
+        }
+        break;
+    case Affinity::Core:
+        CPU_SET(cpus_[cpu_idx], &cpu_set);
+        break;
+    }
+
+    pthread_setaffinity_np(
+        thread.native_handle(), sizeof(cpu_set_t), &cpu_set);
+
+#else
+
+    AGZ_UNACCESSED(thread);
+    AGZ_UNACCESSED(thread_index);
+
+#endif
+}
+
+void TaskScheduler::run_with_temporary_threads(
+    int thread_count, const std::function<void(int)> &func)
+{
+    std::vector<std::exception_ptr> exceptions(thread_count);
+    auto thread_func = [&](int thread_index)
+    {
+        try
+        {
+            func(thread_index);
+        }
+        catch(...)
+        {
+            exceptions[thread_index] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for(int i = 1; i < thread_count; ++i)
+        threads.emplace_back(thread_func, i);
+
+    thread_func(0);
+
+    for(auto &t : threads)
+        t.join();
+
+    for(auto &e : exceptions)
+    {
+        if(e)
+            std::rethrow_exception(e);
+    }
+}
+
+std::vector<Vec2i> hilbert_tile_order(int x_count, int y_count)
+{
+    std::vector<Vec2i> ret;
+    if(x_count <= 0 || y_count <= 0)
+        return ret;
+    ret.reserve(size_t(x_count) * y_count);
+
+    // the curve covers the grid directly instead of walking an enclosing
+    // power-of-2 square, which is quadratic in the longer side
+
+    if(x_count >= y_count)
+        gilbert(0, 0, x_count, 0, 0, y_count, ret);
+    else
+        gilbert(0, 0, 0, y_count, x_count, 0, ret);
+
+    return ret;
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cstring>
+
+#include <agz/tracer/utility/logger.h>
+#include <agz/tracer/utility/texture_tile_cache.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    constexpr uint64_t INVALID_KEY = ~uint64_t(0);
+
+    uint64_t make_key(uint32_t file_id, uint32_t tile) noexcept
+    {
+        return (uint64_t(file_id) << 32) | tile;
+    }
+
+    int front_slot(uint64_t key) noexcept
+    {
+        static_assert(TextureTileCache::FRONT_CACHE_SIZE == 64);
+        return static_cast<int>((key * 0x9e3779b97f4a7c15ull) >> 58);
+    }
+
+} // namespace anonymous
+
+struct TextureTileCache::FrontCache
+{
+    struct Entry
+    {
+        uint64_t key = INVALID_KEY;
+        RC<const TileData> data;
+    };
+
+    Entry entries[FRONT_CACHE_SIZE];
+
+    uint64_t generation = 0;
+
+    // only written by the owner thread
+    std::atomic<uint64_t> hit_count = 0;
+
+    FrontCache()
+    {
+        auto &cache = instance();
+        std::lock_guard lk(cache.fronts_mutex_);
+        cache.fronts_.push_back(this);
+    }
+
+    ~FrontCache()
+    {
+        auto &cache = instance();
+        std::lock_guard lk(cache.fronts_mutex_);
+        cache.retired_front_hit_count_ += hit_count.load(std::memory_order_relaxed);
+        cache.fronts_.erase(
+            std::find(cache.fronts_.begin(), cache.fronts_.end(), this));
+    }
+
+    void flush() noexcept
+    {
+        for(auto &e : entries)
+        {
+            e.key = INVALID_KEY;
+            e.data.reset();
+        }
+    }
+};
+
+TextureTileCache &TextureTileCache::instance()
+{
+    static TextureTileCache cache;
+    return cache;
+}
+
+void TextureTileCache::set_memory_budget(size_t bytes)
+{
+    std::lock_guard lk(mutex_);
+    budget_ = bytes;
+    evict();
+}
+
+size_t TextureTileCache::memory_budget() const
+{
+    std::lock_guard lk(mutex_);
+    return budget_;
+}
+
+const unsigned char *TextureTileCache::get_tile(
+    const TiledTextureFile &file, uint32_t tile) noexcept
+{
+    thread_local FrontCache front;
+
+    const uint64_t generation = generation_.load(std::memory_order_acquire);
+    if(front.generation != generation)
+    {
+        front.flush();
+        front.generation = generation;
+    }
+
+    const uint64_t key = make_key(file.id(), tile);
+    auto &entry = front.entries[front_slot(key)];
+
+    if(entry.key == key)
+    {
+        // single writer, so no atomic read-modify-write is needed
+        front.hit_count.store(
+            front.hit_count.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+        return entry.data->data();
+    }
+
+    entry.data = get_shared_tile(file, tile, key);
+    entry.key  = key;
+    return entry.data->data();
+}
+
+RC<const TextureTileCache::TileData> TextureTileCache::get_shared_tile(
+    const TiledTextureFile &file, uint32_t tile, uint64_t key) noexcept
+{
+    {
+        std::lock_guard lk(mutex_);
+        if(auto it = key2entry_.find(key); it != key2entry_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ++hit_count_;
+            return it->second->data;
+        }
+    }
+
+    // read the tile without holding the lock, so that other threads are not
+    // blocked by file io
+
+    auto data = newRC<TileData>(file.tile_bytes());
+    try
+    {
+        file.read_tile(tile, data->data());
+    }
+    catch(const std::exception &err)
+    {
+        std::memset(data->data(), 0, data->size());
+        if(!read_error_reported_.exchange(true))
+            AGZ_INFO("texture tile cache: {}", err.what());
+    }
+
+    std::lock_guard lk(mutex_);
+
+    // the tile may have been loaded by another thread meanwhile
+    if(auto it = key2entry_.find(key); it != key2entry_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++miss_count_;
+        return it->second->data;
+    }
+
+    lru_.push_front({ key, data });
+    key2entry_[key] = lru_.begin();
+
+    ++miss_count_;
+    resident_bytes_ += data->size();
+    peak_bytes_ = (std::max)(peak_bytes_, resident_bytes_);
+
+    evict();
+
+    return data;
+}
+
+void TextureTileCache::evict()
+{
+    // the most recently used tile is always kept
+    while(resident_bytes_ > budget_ && lru_.size() > 1)
+    {
+        const LRUEntry &entry = lru_.back();
+        resident_bytes_ -= entry.data->size();
+        key2entry_.erase(entry.key);
+        lru_.pop_back();
+        ++evict_count_;
+    }
+}
+
+void TextureTileCache::clear()
+{
+    std::lock_guard lk(mutex_);
+    lru_.clear();
+    key2entry_.clear();
+    resident_bytes_ = 0;
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+TextureTileCache::Statistics TextureTileCache::statistics() const
+{
+    Statistics ret;
+
+    {
+        std::lock_guard lk(fronts_mutex_);
+        uint64_t front_hit_count = retired_front_hit_count_;
+        for(auto front : fronts_)
+            front_hit_count += front->hit_count.load(std::memory_order_relaxed);
+        ret.front_hit_count = front_hit_count - front_hit_count_base_;
+    }
+
+    std::lock_guard lk(mutex_);
+    ret.hit_count           = hit_count_;
+    ret.miss_count          = miss_count_;
+    ret.evict_count         = evict_count_;
+    ret.resident_bytes      = resident_bytes_;
+    ret.peak_resident_bytes = peak_bytes_;
+
+    return ret;
+}
+
+void TextureTileCache::reset_statistics()
+{
+    {
+        // front hit counters can only be written by their owners, so the
+        // current sum is recorded as the new base
+        std::lock_guard lk(fronts_mutex_);
+        uint64_t front_hit_count = retired_front_hit_count_;
+        for(auto front : fronts_)
+            front_hit_count += front->hit_count.load(std::memory_order_relaxed);
+        front_hit_count_base_ = front_hit_count;
+    }
+
+    std::lock_guard lk(mutex_);
+    hit_count_   = 0;
+    miss_count_  = 0;
+    evict_count_ = 0;
+    peak_bytes_  = resident_bytes_;
+}
+
+AGZ_TRACER_END
@@ -0,0 +1,317 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+#include <agz/tracer/utility/tiled_texture.h>
+
+AGZ_TRACER_BEGIN
+
+namespace
+{
+
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    uint64_t align_section(uint64_t offset) noexcept
+    {
+        return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT
+                                                * SECTION_ALIGNMENT;
+    }
+
+    size_t format_texel_size(TiledTextureFormat format)
+    {
+        switch(format)
+        {
+        case TiledTextureFormat::RGB8:   return 3 * sizeof(uint8_t);
+        case TiledTextureFormat::RGB32F: return 3 * sizeof(float);
+        }
+        throw std::runtime_error("unknown tiled texture format");
+    }
+
+    std::atomic<uint32_t> next_file_id = 0;
+
+    FSpectrum to_spectrum(const math::color3b &texel) noexcept
+    {
+        return math::from_color3b<real>(texel);
+    }
+
+    FSpectrum to_spectrum(const math::color3f &texel) noexcept
+    {
+        return texel;
+    }
+
+    void from_spectrum(const FSpectrum &spectrum, math::color3b *texel) noexcept
+    {
+        *texel = math::to_color3b<real>(
+            Spectrum(spectrum.r, spectrum.g, spectrum.b));
+    }
+
+    void from_spectrum(const FSpectrum &spectrum, math::color3f *texel) noexcept
+    {
+        *texel = math::color3f(spectrum.r, spectrum.g, spectrum.b);
+    }
+
+    void write_texel(const math::color3b &texel, unsigned char *output) noexcept
+    {
+        output[0] = texel.r;
+        output[1] = texel.g;
+        output[2] = texel.b;
+    }
+
+    void write_texel(const math::color3f &texel, unsigned char *output) noexcept
+    {
+        const float rgb[3] = { texel.r, texel.g, texel.b };
+        std::memcpy(output, rgb, sizeof(rgb));
+    }
+
+    // same box filter as in-memory mipmaps
+    template<typename Texel>
+    Image2D<Texel> downsample(const Image2D<Texel> &src)
+    {
+        const int src_w = src.width(), src_h = src.height();
+        const int dst_w = (std::max)(1, (src_w + 1) / 2);
+        const int dst_h = (std::max)(1, (src_h + 1) / 2);
+
+        Image2D<Texel> ret(dst_h, dst_w);
+        for(int y = 0; y < dst_h; ++y)
+        {
+            const int y0 = (std::min)(2 * y,     src_h - 1);
+            const int y1 = (std::min)(2 * y + 1, src_h - 1);
+
+            for(int x = 0; x < dst_w; ++x)
+            {
+                const int x0 = (std::min)(2 * x,     src_w - 1);
+                const int x1 = (std::min)(2 * x + 1, src_w - 1);
+
+                const FSpectrum sum = to_spectrum(src(y0, x0))
+                                    + to_spectrum(src(y0, x1))
+                                    + to_spectrum(src(y1, x0))
+                                    + to_spectrum(src(y1, x1));
+                from_spectrum(real(0.25) * sum, &ret(y, x));
+            }
+        }
+
+        return ret;
+    }
+
+    template<typename Texel>
+    void save_tiled_texture_impl(
+        const std::string &filename, const Image2D<Texel> &data,
+        TiledTextureFormat format, int tile_size)
+    {
+        if(!data.is_available())
+            throw std::runtime_error("empty texture");
+
+        if(tile_size < 8 || (tile_size & (tile_size - 1)))
+        {
+            throw std::runtime_error(
+                "invalid tile size: " + std::to_string(tile_size));
+        }
+
+        const size_t texel_bytes = format_texel_size(format);
+        const size_t tile_bytes  = size_t(tile_size) * tile_size * texel_bytes;
+
+        // level 0 is the input image. the others are kept in memory, which
+        // takes 1/3 of the input size
+
+        std::vector<Image2D<Texel>> extra_levels;
+        {
+            const Image2D<Texel> *last = &data;
+            while(last->width() > 1 || last->height() > 1)
+            {
+                extra_levels.push_back(downsample(*last));
+                last = &extra_levels.back();
+            }
+        }
+
+        auto level_image = [&](size_t level) -> const Image2D<Texel> &
+        {
+            return level ? extra_levels[level - 1] : data;
+        };
+
+        TiledTextureHeader header = {};
+        std::memcpy(header.magic, TiledTextureFile::MAGIC, sizeof(header.magic));
+        header.version     = TiledTextureFile::VERSION;
+        header.format      = format;
+        header.width       = uint32_t(data.width());
+        header.height      = uint32_t(data.height());
+        header.tile_size   = uint32_t(tile_size);
+        header.level_count = uint32_t(extra_levels.size() + 1);
+
+        std::vector<TiledTextureLevel> levels(header.level_count);
+        for(size_t i = 0; i < levels.size(); ++i)
+        {
+            const Image2D<Texel> &img = level_image(i);
+            TiledTextureLevel &lv = levels[i];
+            lv.width        = uint32_t(img.width());
+            lv.height       = uint32_t(img.height());
+            lv.tile_count_x = uint32_t((img.width()  + tile_size - 1) / tile_size);
+            lv.tile_count_y = uint32_t((img.height() + tile_size - 1) / tile_size);
+            lv.first_tile   = header.tile_count;
+            header.tile_count += uint64_t(lv.tile_count_x) * lv.tile_count_y;
+        }
+
+        if(header.tile_count > 0xffffffffull)
+            throw std::runtime_error("too many tiles in " + filename);
+
+        header.level_offset     = align_section(sizeof(header));
+        header.tile_data_offset = align_section(
+            header.level_offset + levels.size() * sizeof(TiledTextureLevel));
+
+        std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+        if(!fout)
+            throw std::runtime_error("failed to open file: " + filename);
+
+        auto write_section = [&](uint64_t offset, const void *bytes, size_t size)
+        {
+            const auto pos = static_cast<uint64_t>(fout.tellp());
+            static const char zeros[SECTION_ALIGNMENT] = {};
+            fout.write(zeros, static_cast<std::streamsize>(offset - pos));
+            fout.write(static_cast<const char*>(bytes),
+                       static_cast<std::streamsize>(size));
+        };
+
+        write_section(0, &header, sizeof(header));
+        write_section(
+            header.level_offset, levels.data(),
+            levels.size() * sizeof(TiledTextureLevel));
+        write_section(header.tile_data_offset, nullptr, 0);
+
+        std::vector<unsigned char> tile(tile_bytes);
+        for(size_t i = 0; i < levels.size(); ++i)
+        {
+            const Image2D<Texel> &img = level_image(i);
+            const int w = img.width(), h = img.height();
+
+            for(uint32_t ty = 0; ty < levels[i].tile_count_y; ++ty)
+            {
+                for(uint32_t tx = 0; tx < levels[i].tile_count_x; ++tx)
+                {
+                    unsigned char *output = tile.data();
+                    for(int ly = 0; ly < tile_size; ++ly)
+                    {
+                        const int y = (std::min)(int(ty) * tile_size + ly, h - 1);
+                        for(int lx = 0; lx < tile_size; ++lx)
+                        {
+                            const int x = (std::min)(int(tx) * tile_size + lx, w - 1);
+                            write_texel(img(y, x), output);
+                            output += texel_bytes;
+                        }
+                    }
+
+                    fout.write(reinterpret_cast<const char*>(tile.data()),
+                               static_cast<std::streamsize>(tile_bytes));
+                }
+            }
+        }
+
+        if(!fout)
+            throw std::runtime_error("failed to write file: " + filename);
+    }
+
+} // namespace anonymous
+
+TiledTextureFile::TiledTextureFile(const std::string &filename)
+    : filename_(filename), id_(next_file_id++), header_{}
+{
+    auto fail = [&](const std::string &msg)
+    {
+        throw std::runtime_error(
+            "invalid tiled texture " + filename + ": " + msg);
+    };
+
+    MappedFile(filename).swap(file_);
+    const uint64_t size = file_.size();
+
+    if(size < sizeof(TiledTextureHeader))
+        fail("file is too small");
+
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+
+    if(std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0)
+        fail("magic number mismatch");
+    if(header_.version != VERSION)
+        fail("unsupported version " + std::to_string(header_.version));
+
+    texel_bytes_ = format_texel_size(header_.format);
+
+    if(!header_.width || !header_.height)
+        fail("empty texture");
+
+    const uint32_t tile_size = header_.tile_size;
+    if(tile_size < 8 || (tile_size & (tile_size - 1)))
+        fail("invalid tile size");
+
+    while((1u << tile_shift_) < tile_size)
+        ++tile_shift_;
+    tile_mask_  = int(tile_size - 1);
+    tile_bytes_ = size_t(tile_size) * tile_size * texel_bytes_;
+
+    if(!header_.level_count || header_.level_count > 32)
+        fail("invalid level count");
+    if(header_.tile_count > 0xffffffffull)
+        fail("too many tiles");
+
+    auto check_section = [&](uint64_t offset, uint64_t bytes)
+    {
+        if(offset % SECTION_ALIGNMENT || offset > size || bytes > size - offset)
+            fail("section out of range");
+    };
+
+    check_section(
+        header_.level_offset,
+        uint64_t(header_.level_count) * sizeof(TiledTextureLevel));
+    check_section(
+        header_.tile_data_offset, header_.tile_count * tile_bytes_);
+
+    levels_.resize(header_.level_count);
+    std::memcpy(
+        levels_.data(), file_.data() + header_.level_offset,
+        levels_.size() * sizeof(TiledTextureLevel));
+
+    // check the level chain so that tile indices never go out of range
+
+    uint32_t expected_w = header_.width, expected_h = header_.height;
+    uint64_t expected_first_tile = 0;
+    for(auto &lv : levels_)
+    {
+        if(lv.width != expected_w || lv.height != expected_h)
+            fail("invalid level size");
+        if(lv.tile_count_x != (lv.width  + tile_size - 1) / tile_size ||
+           lv.tile_count_y != (lv.height + tile_size - 1) / tile_size)
+            fail("invalid level tile count");
+        if(lv.first_tile != expected_first_tile)
+            fail("invalid level tile offset");
+
+        expected_first_tile += uint64_t(lv.tile_count_x) * lv.tile_count_y;
+        expected_w = (std::max)(1u, (expected_w + 1) / 2);
+        expected_h = (std::max)(1u, (expected_h + 1) / 2);
+    }
+
+    if(expected_first_tile != header_.tile_count)
+        fail("tile count mismatch");
+}
+
+void TiledTextureFile::read_tile(uint32_t tile, unsigned char *output) const
+{
+    assert(tile < header_.tile_count);
+    const uint64_t offset = header_.tile_data_offset + uint64_t(tile) * tile_bytes_;
+    std::memcpy(output, file_.data() + offset, tile_bytes_);
+}
+
+void save_tiled_texture(
+    const std::string &filename, const Image2D<math::color3b> &data,
+    int tile_size)
+{
+    save_tiled_texture_impl(
+        filename, data, TiledTextureFormat::RGB8, tile_size);
+}
+
+void save_tiled_texture(
+    const std::string &filename, const Image2D<math::color3f> &data,
+    int tile_size)
+{
+    save_tiled_texture_impl(
+        filename, data, TiledTextureFormat::RGB32F, tile_size);
+}
+
+AGZ_TRACER_END
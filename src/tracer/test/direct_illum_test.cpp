@@ -0,0 +1,127 @@
+#include <cmath>
+#include <cstdio>
+
+#include <agz/tracer/core/entity.h>
+#include <agz/tracer/core/material.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/create/aggregate.h>
+#include <agz/tracer/create/entity.h>
+#include <agz/tracer/create/geometry.h>
+#include <agz/tracer/create/material.h>
+#include <agz/tracer/create/medium.h>
+#include <agz/tracer/create/scene.h>
+#include <agz/tracer/create/texture2d.h>
+#include <agz/tracer/render/direct_illum.h>
+
+using namespace agz::tracer;
+
+namespace
+{
+
+    // quad on z = height facing -z
+    RC<Entity> create_quad_light(
+        real x0, real y0, real x1, real y1, real height,
+        const FSpectrum &radiance, const MediumInterface &med)
+    {
+        auto geometry = create_quad(
+            { x0, y0, height }, { x0, y1, height },
+            { x1, y1, height }, { x1, y0, height },
+            { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 }, FTransform3());
+        return create_geometric(
+            geometry, create_ideal_black(), med, radiance, false, -1);
+    }
+
+} // namespace anonymous
+
+/*
+ * mis_sample_one_light picks one light by the light bvh and weights it with
+ * the selection probability. its expectation must match the sum of
+ * mis_sample_light over all lights plus the bsdf sampling part, which
+ * doesn't involve light selection at all
+ */
+int main()
+{
+    MediumInterface med;
+    med.in  = create_void();
+    med.out = create_void();
+
+    // diffuse ground lit by lights of different sizes, heights and powers,
+    // so that the light bvh selects them with different probabilities
+
+    DefaultSceneParams scene_params;
+
+    auto ground = create_double_sided(create_quad(
+        { -10, -10, 0 }, { 10, -10, 0 }, { 10, 10, 0 }, { -10, 10, 0 },
+        { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, FTransform3()));
+    auto albedo = create_constant2d_texture({}, FSpectrum(real(0.8)));
+    scene_params.entities.push_back(create_geometric(
+        ground, create_ideal_diffuse(albedo, newBox<NormalMapper>()),
+        med, {}, false, -1));
+
+    scene_params.entities.push_back(create_quad_light(
+        -1, -1, 1, 1, 4, FSpectrum(2, 2, 2), med));
+    scene_params.entities.push_back(create_quad_light(
+        2, 2, real(2.3), real(2.3), 1, FSpectrum(40, 30, 20), med));
+    scene_params.entities.push_back(create_quad_light(
+        -6, 3, -4, 5, 2, FSpectrum(1, 3, 5), med));
+    scene_params.entities.push_back(create_quad_light(
+        5, -8, 9, -4, 6, FSpectrum(real(0.5)), med));
+
+    std::vector<RC<const Entity>> const_entities(
+        scene_params.entities.begin(), scene_params.entities.end());
+    scene_params.aggregate = create_native_aggregate();
+    scene_params.aggregate->build(const_entities);
+
+    auto scene = create_default_scene(scene_params);
+    scene->start_rendering();
+
+    EntityIntersection inct;
+    if(!scene->closest_intersection(
+        Ray({ real(0.3), real(-0.2), 3 }, { 0, 0, -1 }), &inct))
+    {
+        std::printf("failed to find the shading point\n");
+        return 1;
+    }
+
+    Arena arena;
+    const ShadingPoint shd = inct.material->shade(inct, arena);
+
+    NativeSampler sampler(42, false);
+
+    constexpr int SAMPLE_COUNT = 1 << 20;
+
+    FSpectrum all_lights, one_light;
+    for(int i = 0; i < SAMPLE_COUNT; ++i)
+    {
+        for(auto light : scene->lights())
+            all_lights += mis_sample_light(*scene, light, inct, shd, sampler);
+        all_lights += mis_sample_bsdf(*scene, inct, shd, sampler);
+
+        one_light += mis_sample_one_light(*scene, inct, shd, sampler);
+    }
+    all_lights = all_lights / real(SAMPLE_COUNT);
+    one_light  = one_light  / real(SAMPLE_COUNT);
+
+    std::printf("all lights: (%f, %f, %f)\n",
+                all_lights.r, all_lights.g, all_lights.b);
+    std::printf("one light:  (%f, %f, %f)\n",
+                one_light.r, one_light.g, one_light.b);
+
+    for(int c = 0; c < SPECTRUM_COMPONENT_COUNT; ++c)
+    {
+        if(!(all_lights[c] > 0))
+        {
+            std::printf("no direct illumination in channel %d\n", c);
+            return 1;
+        }
+
+        const real rel_err = std::abs(one_light[c] - all_lights[c]) / all_lights[c];
+        if(rel_err > real(0.02))
+        {
+            std::printf("relative error in channel %d: %f\n", c, rel_err);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <cmath>
+#include <cstdio>
+
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/utility/ld_sampler.h>
+
+using namespace agz::tracer;
+
+namespace
+{
+
+    constexpr int PIXEL_RES = 64;
+    constexpr int SPP       = 64;
+
+    // smooth 4d integrand: a pixel-footprint-like gaussian times a
+    // light-sample-like polynomial
+    real integrand(const Sample2 &film, const Sample2 &light) noexcept
+    {
+        const real gaussian = std::exp(-(film.u * film.u + film.v * film.v));
+        return gaussian * (light.u + light.v * light.v);
+    }
+
+    real reference_integral() noexcept
+    {
+        // \int_0^1 exp(-x^2) dx = sqrt(pi) / 2 * erf(1)
+        const double g = 0.5 * std::sqrt(agz::math::PI<double>) * std::erf(1.0);
+        return static_cast<real>(g * g * (1.0 / 2 + 1.0 / 3));
+    }
+
+    // every pixel gives an independent spp-sample estimate. returns the rmse
+    // of these estimates
+    template<typename NextSample>
+    real estimate_rmse(const NextSample &next_sample)
+    {
+        const double ref = reference_integral();
+
+        double sum_sqr_err = 0;
+        for(int y = 0; y < PIXEL_RES; ++y)
+        {
+            for(int x = 0; x < PIXEL_RES; ++x)
+            {
+                double sum = 0;
+                for(int i = 0; i < SPP; ++i)
+                {
+                    Sample2 film, light;
+                    next_sample(Vec2i(x, y), i, &film, &light);
+                    sum += integrand(film, light);
+                }
+
+                const double err = sum / SPP - ref;
+                sum_sqr_err += err * err;
+            }
+        }
+
+        return static_cast<real>(
+            std::sqrt(sum_sqr_err / (PIXEL_RES * PIXEL_RES)));
+    }
+
+    real native_rmse()
+    {
+        NativeSampler sampler(42, false);
+        return estimate_rmse(
+            [&](const Vec2i &, int, Sample2 *film, Sample2 *light)
+        {
+            *film  = sampler.sample2();
+            *light = sampler.sample2();
+        });
+    }
+
+    real pixel_sampler_rmse(PixelSamplerType type)
+    {
+        auto sampler = create_pixel_sampler(type, 42);
+        return estimate_rmse(
+            [&](const Vec2i &pixel, int index, Sample2 *film, Sample2 *light)
+        {
+            sampler->start_pixel_sample({ pixel, index, 0 });
+            *film  = sampler->sample2();
+            *light = sampler->sample2();
+        });
+    }
+
+} // namespace anonymous
+
+/*
+ * integrate a smooth 4d function with SPP samples per pixel, and compare the
+ * rmse of per-pixel estimates of each low-discrepancy sampler with that of
+ * the native sampler
+ */
+int main()
+{
+    const real native = native_rmse();
+    std::printf("native: rmse = %e\n", native);
+
+    struct Case
+    {
+        const char *name;
+        PixelSamplerType type;
+    };
+
+    const Case cases[] = {
+        { "sobol",      PixelSamplerType::Sobol     },
+        { "halton",     PixelSamplerType::Halton    },
+        { "blue noise", PixelSamplerType::BlueNoise }
+    };
+
+    bool ok = native > 0;
+    for(auto &c : cases)
+    {
+        const real rmse = pixel_sampler_rmse(c.type);
+        const bool pass = rmse < native;
+        std::printf(
+            "%s: rmse = %e (%.3fx native)%s\n",
+            c.name, rmse, rmse / native, pass ? "" : " FAILED");
+        ok &= pass;
+    }
+
+    if(!ok)
+    {
+        std::printf("low-discrepancy samplers must beat the native sampler\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <agz/tracer/core/medium.h>
+#include <agz/tracer/core/sampler.h>
+#include <agz/tracer/core/texture3d.h>
+#include <agz/tracer/create/medium.h>
+#include <agz/tracer/create/texture3d.h>
+
+using namespace agz::tracer;
+
+namespace
+{
+
+    constexpr int ESTIMATE_COUNT = 50000;
+
+    // sum of gaussian blobs over a constant floor. density lookups are counted
+    class BlobDensity : public Texture3D
+    {
+        struct Blob
+        {
+            FVec3 center;
+            real sharpness;
+            real peak;
+        };
+
+        static constexpr real FLOOR = real(0.2);
+
+        Blob blobs_[2] = {
+            { { real(0.4), real(0.5),  real(0.5)  }, 20, 4 },
+            { { real(0.7), real(0.45), real(0.55) }, 60, 6 }
+        };
+
+        mutable uint64_t lookup_count_ = 0;
+
+    protected:
+
+        real sample_real_impl(const FVec3 &uvw) const noexcept override
+        {
+            ++lookup_count_;
+            real ret = FLOOR;
+            for(auto &b : blobs_)
+            {
+                ret += b.peak * std::exp(
+                    -b.sharpness * (uvw - b.center).length_square());
+            }
+            return ret;
+        }
+
+    public:
+
+        BlobDensity()
+        {
+            init_common_params({});
+        }
+
+        uint64_t lookup_count() const noexcept
+        {
+            return lookup_count_;
+        }
+
+        void reset_lookup_count() noexcept
+        {
+            lookup_count_ = 0;
+        }
+
+        int width()  const noexcept override { return 64; }
+        int height() const noexcept override { return 64; }
+        int depth()  const noexcept override { return 64; }
+
+        FSpectrum max_spectrum() const noexcept override
+        {
+            return FSpectrum(max_real());
+        }
+
+        real max_real() const noexcept override
+        {
+            real ret = FLOOR;
+            for(auto &b : blobs_)
+                ret += b.peak;
+            return ret;
+        }
+
+        // each blob is bounded by its value at the closest point of the box
+        real max_real_in(
+            const FVec3 &uvw_low, const FVec3 &uvw_high) const noexcept override
+        {
+            real ret = FLOOR;
+            for(auto &b : blobs_)
+            {
+                FVec3 closest;
+                for(int i = 0; i < 3; ++i)
+                {
+                    closest[i] = std::clamp(
+                        b.center[i], uvw_low[i], uvw_high[i]);
+                }
+                ret += b.peak * std::exp(
+                    -b.sharpness * (closest - b.center).length_square());
+            }
+            return ret;
+        }
+    };
+
+    struct Estimation
+    {
+        double mean     = 0;
+        double variance = 0;
+        double lookups  = 0; // per estimate
+    };
+
+    template<typename Estimate>
+    Estimation estimate(BlobDensity &density, const Estimate &func)
+    {
+        density.reset_lookup_count();
+
+        double sum = 0, sum_sqr = 0;
+        for(int i = 0; i < ESTIMATE_COUNT; ++i)
+        {
+            const double e = func();
+            sum     += e;
+            sum_sqr += e * e;
+        }
+
+        Estimation ret;
+        ret.mean     = sum / ESTIMATE_COUNT;
+        ret.variance = (std::max)(
+            0.0, (sum_sqr - sum * sum / ESTIMATE_COUNT) / (ESTIMATE_COUNT - 1));
+        ret.lookups  = double(density.lookup_count()) / ESTIMATE_COUNT;
+        return ret;
+    }
+
+} // namespace anonymous
+
+/*
+ * estimate the transmittance of a segment crossing a procedural density with
+ * track-length (delta tracking), ratio and residual ratio tracking. all the
+ * means must agree with exp(-optical depth) computed by quadrature
+ */
+int main()
+{
+    auto density = newRC<BlobDensity>();
+    auto albedo  = create_constant3d_texture({}, FSpectrum(1));
+    auto g       = create_constant3d_texture({}, FSpectrum(0));
+
+    // the segment leaves the unit cube, which covers the global majorant
+    const FVec3 a(real(-0.2), real(0.5), real(0.45));
+    const FVec3 b(real(1.2),  real(0.4), real(0.6));
+
+    double optical_depth = 0;
+    {
+        constexpr int STEPS = 200000;
+        const double dt = distance(a, b) / STEPS;
+        for(int i = 0; i < STEPS; ++i)
+        {
+            const real t = (i + real(0.5)) / STEPS;
+            optical_depth += density->sample_real(lerp(a, b, t)) * dt;
+        }
+    }
+    const double reference = std::exp(-optical_depth);
+
+    auto create_medium = [&](TransmittanceEstimator type, real rr_threshold)
+    {
+        TransmittanceEstimatorParams params;
+        params.type         = type;
+        params.rr_threshold = rr_threshold;
+        return create_heterogeneous_medium(
+            FTransform3(), density, albedo, g, 1, false, params);
+    };
+
+    NativeSampler sampler(42, false);
+    Arena arena;
+
+    struct Case
+    {
+        const char *name;
+        Estimation result;
+    };
+
+    Case cases[5];
+
+    {
+        auto medium = create_medium(TransmittanceEstimator::Ratio, 0);
+        cases[0] = { "track-length", estimate(*density, [&]
+        {
+            const auto result = medium->sample_scattering(
+                a, b, sampler, arena, false);
+            arena.release();
+            return result.is_scattering_happened() ? 0.0 : 1.0;
+        }) };
+    }
+
+    const struct
+    {
+        const char *name;
+        TransmittanceEstimator type;
+        real rr_threshold;
+    } tracking_cases[4] = {
+        { "ratio",             TransmittanceEstimator::Ratio,         0         },
+        { "ratio+rr",          TransmittanceEstimator::Ratio,         real(0.1) },
+        { "residual ratio",    TransmittanceEstimator::ResidualRatio, 0         },
+        { "residual ratio+rr", TransmittanceEstimator::ResidualRatio, real(0.1) }
+    };
+
+    for(int i = 0; i < 4; ++i)
+    {
+        auto &c = tracking_cases[i];
+        auto medium = create_medium(c.type, c.rr_threshold);
+        cases[i + 1] = { c.name, estimate(*density, [&]
+        {
+            return static_cast<double>(medium->tr(a, b, sampler).r);
+        }) };
+    }
+
+    std::printf(
+        "reference: %f (optical depth = %f)\n", reference, optical_depth);
+
+    bool ok = true;
+    for(auto &c : cases)
+    {
+        // 5 standard errors, plus a small margin for the quadrature
+        const double std_err = std::sqrt(c.result.variance / ESTIMATE_COUNT);
+        const bool pass =
+            std::abs(c.result.mean - reference) <= 5 * std_err + 1e-3;
+
+        std::printf(
+            "%s: mean = %f, variance = %f, lookups = %f, "
+            "variance * lookups = %f%s\n",
+            c.name, c.result.mean, c.result.variance, c.result.lookups,
+            c.result.variance * c.result.lookups, pass ? "" : " FAILED");
+
+        ok &= pass;
+    }
+
+    if(!ok)
+    {
+        std::printf("transmittance estimators disagree\n");
+        return 1;
+    }
+
+    return 0;
+}